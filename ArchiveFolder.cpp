@@ -12,8 +12,10 @@
 //   -c [ --config ] arg   Config File Name
 //   -s [ --Source ] arg   Source Folder To ZIP
 //   -z [ --zip ] arg      ZIP File Name
+//   -t [ --threads ] arg (=1) Number of threads used to compress files
+//   -o [ --stdout ]       Stream archive to standard output (progress to stderr)
 // 
-// Dependencies: C11++, Classes (CFileZIP), Linux, Boost C++ Libraries.
+// Dependencies: C11++, Classes (CFileZIP), Linux, Boost C++ Libraries, zlib.
 //
 
 // =============
@@ -29,12 +31,18 @@
 #include <thread>
 #include <iomanip>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 //
 // Antik Classes
 //
 
 #include "CZIP.hpp"
+#include "ZIPArchiveWriter.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
 
@@ -61,8 +69,23 @@ struct ParamArgData {
     std::string configFileName;      // Configuration file name
     std::string zipFileName;         // ZIP Archive File Name
     std::string sourceFolderName;    // Source folder
+    int threads { 1 };               // Number of compression threads
+    bool bStdout { false };          // == true stream archive to stdout
 };
 
+//
+// Files larger than this are not compressed into memory whole by a worker thread but
+// deflated by the workers in independent chunks.
+//
+
+constexpr std::uint64_t kMaxBufferedEntrySize { 64 * 1024 * 1024 };
+
+//
+// Number of compressed entries (or chunks) per thread that may be waiting to be written.
+//
+
+constexpr std::size_t kEntriesPerThread { 2 };
+
 // ===============
 // LOCAL FUNCTIONS
 // ===============
@@ -86,7 +109,8 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
 
     commonOptions.add_options()
             ("source,s", po::value<std::string>(&argData.sourceFolderName)->required(), "Source Folder To ZIP")
-            ("zip,z", po::value<std::string>(&argData.zipFileName)->required(), "ZIP File Name");
+            ("zip,z", po::value<std::string>(&argData.zipFileName), "ZIP File Name")
+            ("threads,t", po::value<int>(&argData.threads)->default_value(1), "Number of threads used to compress files");
 
 }
 
@@ -101,7 +125,8 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
     po::options_description commandLine("Command Line Options");
     commandLine.add_options()
             ("help", "Display help message")
-            ("config,c", po::value<std::string>(&argData.configFileName), "Config File Name");
+            ("config,c", po::value<std::string>(&argData.configFileName), "Config File Name")
+            ("stdout,o", "Stream archive to standard output (progress to stderr)");
 
     addCommonOptions(commandLine, argData);
 
@@ -135,8 +160,22 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Stream archive to stdout
+
+        if (vm.count("stdout")) {
+            argData.bStdout = true;
+        }
+
         po::notify(vm);
 
+        if (argData.zipFileName.empty() && !argData.bStdout) {
+            throw po::error("ZIP file name or --stdout required.");
+        }
+
+        if (argData.threads < 1) {
+            throw po::error("Number of threads must be at least one.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "ArchiveFolder Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -145,6 +184,168 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
 }
 
+//
+// Unit of compression work for createArchiveParallel(); a whole file or one chunk of
+// a large one.
+//
+
+struct ArchiveWorkUnit {
+    std::size_t file { 0 };          // Index into archive file list
+    std::uint64_t chunk { 0 };       // Chunk number (large files)
+    std::uint64_t chunks { 0 };      // Number of chunks (0 == compressed whole)
+};
+
+//
+// Compressed result of a unit of work.
+//
+
+struct ArchiveWorkResult {
+    ZIPCompressedEntry entry;        // Whole file
+    ZIPDeflatedChunk chunk;          // Chunk of a large file
+};
+
+//
+// Create archive compressing files in parallel. Worker threads deflate files into
+// memory (storing any that do not shrink) while the calling thread writes finished
+// entries to the archive in file list order; so the archive is the same whatever the
+// number of threads. Files too large to buffer are split into chunks that are deflated
+// independently by the workers (pigz style) and written one after the other as a
+// single entry. Workers only run a bounded number of units ahead of the writer.
+//
+
+static void createArchiveParallel(ZIPArchiveWriter &zipWriter, const Antik::FileList &fileNameList, int threads, std::ostream &progress) {
+
+    Antik::FileList archiveFileList;
+    for (auto& fileName : fileNameList) {
+        progress << "Add " << fileName << '\n';
+        if (CFile::isFile(fileName)) archiveFileList.push_back(fileName);
+    }
+
+    std::vector<ArchiveWorkUnit> workUnits;
+    for (std::size_t file = 0; file < archiveFileList.size(); file++) {
+        std::uint64_t fileSize { std::filesystem::file_size(archiveFileList[file]) };
+        if (fileSize > kMaxBufferedEntrySize) {
+            std::uint64_t chunks { ZIPArchiveWriter::chunkCount(fileSize) };
+            for (std::uint64_t chunk = 0; chunk < chunks; chunk++) {
+                workUnits.push_back({ file, chunk, chunks });
+            }
+        } else {
+            workUnits.push_back({ file, 0, 0 });
+        }
+    }
+
+    std::atomic<std::size_t> nextToCompress { 0 };
+    std::size_t nextToWrite { 0 };
+    std::map<std::size_t, ArchiveWorkResult> compressedUnits;
+    std::exception_ptr workerException;
+    bool bStop { false };
+    std::mutex entryMutex;
+    std::condition_variable entryReady, entryWritten;
+    std::size_t window = threads * kEntriesPerThread;
+
+    auto compressWorker = [&]() {
+        try {
+            for (std::size_t index = nextToCompress++; index < workUnits.size(); index = nextToCompress++) {
+                {
+                    std::unique_lock<std::mutex> lock(entryMutex);
+                    entryWritten.wait(lock, [&] { return (bStop || (index < nextToWrite + window)); });
+                    if (bStop) return;
+                }
+                auto &workUnit = workUnits[index];
+                auto &fileName = archiveFileList[workUnit.file];
+                ArchiveWorkResult result;
+                if (workUnit.chunks) {
+                    result.chunk = ZIPArchiveWriter::deflateChunk(fileName, workUnit.chunk, workUnit.chunk == workUnit.chunks - 1);
+                } else {
+                    result.entry = ZIPArchiveWriter::compressFile(fileName, fileName.substr(1));
+                }
+                std::unique_lock<std::mutex> lock(entryMutex);
+                compressedUnits[index] = std::move(result);
+                entryReady.notify_all();
+            }
+        } catch (...) {
+            std::unique_lock<std::mutex> lock(entryMutex);
+            if (!workerException) {
+                workerException = std::current_exception();
+            }
+            bStop = true;
+            entryReady.notify_all();
+            entryWritten.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int thread = 0; thread < threads; thread++) {
+        workers.emplace_back(compressWorker);
+    }
+
+    auto stopWorkers = [&]() {
+        {
+            std::unique_lock<std::mutex> lock(entryMutex);
+            bStop = true;
+            entryWritten.notify_all();
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    };
+
+    try {
+
+        // Write entries (and chunks) in order as they become available
+
+        for (; nextToWrite < workUnits.size();) {
+            ArchiveWorkResult result;
+            {
+                std::unique_lock<std::mutex> lock(entryMutex);
+                entryReady.wait(lock, [&] { return (workerException || compressedUnits.count(nextToWrite)); });
+                if (workerException) {
+                    std::rethrow_exception(workerException);
+                }
+                result = std::move(compressedUnits[nextToWrite]);
+                compressedUnits.erase(nextToWrite);
+            }
+            auto &workUnit = workUnits[nextToWrite];
+            if (workUnit.chunks) {
+                auto &fileName = archiveFileList[workUnit.file];
+                if (workUnit.chunk == 0) {
+                    zipWriter.beginChunked(fileName, fileName.substr(1));
+                }
+                zipWriter.addChunk(result.chunk);
+                if (workUnit.chunk == workUnit.chunks - 1) {
+                    zipWriter.endChunked();
+                }
+            } else {
+                zipWriter.add(result.entry);
+            }
+            std::unique_lock<std::mutex> lock(entryMutex);
+            nextToWrite++;
+            entryWritten.notify_all();
+        }
+
+    } catch (...) {
+        stopWorkers();
+        throw;
+    }
+
+    stopWorkers();
+
+}
+
+//
+// Create archive writing each file as it is compressed; only one block of a file is
+// held in memory at a time, whatever its size.
+//
+
+static void createArchiveStreamed(ZIPArchiveWriter &zipWriter, const Antik::FileList &fileNameList, std::ostream &progress) {
+
+    for (auto& fileName : fileNameList) {
+        progress << "Add " << fileName << '\n';
+        if (CFile::isFile(fileName)) zipWriter.addStreamed(fileName, fileName.substr(1));
+    }
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -159,7 +360,54 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
-        if (!argData.zipFileName.empty()) {
+        if (argData.bStdout) {
+
+            // Stream archive to stdout (which no longer carries progress output)
+
+            ZIPArchiveWriter zipWriter { ZIPArchiveWriter::fileDescriptorSink(STDOUT_FILENO) };
+
+            Antik::FileList fileNameList = CFile::directoryContentsList(argData.sourceFolderName);
+
+            std::cerr << "There are " << fileNameList.size() << " files: " << std::endl;
+            if (argData.threads > 1) {
+                createArchiveParallel(zipWriter, fileNameList, argData.threads, std::cerr);
+            } else {
+                createArchiveStreamed(zipWriter, fileNameList, std::cerr);
+            }
+
+            std::cerr << "Streamed Archive (" << zipWriter.bytesWritten() << " bytes)." << std::endl;
+            zipWriter.close();
+
+        } else if (!argData.zipFileName.empty() && (argData.threads > 1)) {
+
+            std::ofstream zipFileStream(argData.zipFileName, std::ios::binary | std::ios::trunc);
+            if (!zipFileStream.is_open()) {
+                throw std::runtime_error("Could not create ZIP archive [" + argData.zipFileName + "]");
+            }
+
+            ZIPArchiveWriter zipWriter { [&zipFileStream](const char *data, std::size_t size) {
+                if (!zipFileStream.write(data, size)) {
+                    throw std::runtime_error("Error writing to ZIP archive.");
+                }
+            } };
+
+            // Iterate recursively through folder hierarchy creating file list then compress in parallel
+
+            Antik::FileList fileNameList = CFile::directoryContentsList(argData.sourceFolderName);
+
+            std::cout << "There are " << fileNameList.size() << " files: " << std::endl;
+            createArchiveParallel(zipWriter, fileNameList, argData.threads, std::cout);
+
+            // Save archive
+
+            std::cout << "Creating Archive " << argData.zipFileName << "." << std::endl;
+            zipWriter.close();
+            zipFileStream.close();
+            if (!zipFileStream) {
+                throw std::runtime_error("Error closing ZIP archive [" + argData.zipFileName + "]");
+            }
+
+        } else if (!argData.zipFileName.empty()) {
 
             CZIP zipFile(argData.zipFileName);
 
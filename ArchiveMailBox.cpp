@@ -18,12 +18,24 @@
 //   -d [ --destination ] arg Destination for attachments
 //   -u [ --updates ]         Search since last file archived.
 //   -a [ --all ]             Download files for all mailboxes.
+//   -b [ --batch ] arg (=1)  Number of e-mails fetched per UID FETCH command
+//   --maxbytes arg (=0)      Cap on message bytes fetched per batch (0 = no cap)
+//   --stream                 Stream message bodies straight to .eml files
+//   --compress               Use COMPRESS=DEFLATE for streamed fetches if the server supports it
+//   -n [ --connections ] arg (=1) Number of IMAP connections archiving mailboxes in parallel
+//   --pack                   Append e-mails to one mbox pack file per mailbox
+//   --sync                   Make e-mails durable (batched fdatasync) before indexing them
 //
 // Note: MIME encoded words in the email subject line are decoded to the best ASCII fit
-// available.
+// available. Each mailbox folder holds an index (.ArchiveMailBox.index) of the UIDs
+// archived; it is used by --updates and rebuilt from the folder if missing. If the
+// mailbox UIDVALIDITY changes the e-mails archived under the old one are moved aside
+// to a "<mailbox>.uidvalidity-<old>" folder and the mailbox archived afresh. With --pack each mailbox folder holds a single append only
+// mboxrd file (ArchiveMailBox.mbox) in place of its .eml files. With --compress the
+// streamed (--stream) connection negotiates RFC 4978 COMPRESS=DEFLATE after login.
 // 
 // Dependencies: C11++, Classes (CFileMIME, CFile, CPath, CMailIMAP, CMailIMAPParse,
-//               CMailIMAPBodyStruct), Linux, Boost C++ Libraries.
+//               CMailIMAPBodyStruct), Linux, Boost C++ Libraries, libcurl, zlib.
 //
 
 // =============
@@ -37,6 +49,13 @@
 #include <iostream> 
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <filesystem>
 
 //
 // Antik Classes
@@ -44,9 +63,11 @@
 
 #include "CIMAP.hpp"
 #include "CIMAPParse.hpp"
+#include "IMAPStreamConnection.hpp"
 #include "CMIME.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "MailArchiveWriter.hpp"
 
 using namespace Antik::IMAP;
 using namespace Antik::File;
@@ -76,7 +97,13 @@ struct ParamArgData {
     std::string configFileName;    // Configuration file name
     bool bOnlyUpdates {false };    // = true search date since last .eml archived
     bool bAllMailBoxes {false };   // = true archive all mailboxes
-
+    int batchSize { 1 };           // Number of e-mails fetched per UID FETCH
+    std::uint64_t maxBatchBytes { 0 }; // Cap on message bytes per batch (0 = no cap)
+    bool bStream { false };        // = true stream message bodies to .eml files
+    bool bCompress { false };      // = true COMPRESS=DEFLATE streamed connection
+    int connections { 1 };         // Number of IMAP connections used
+    bool bPack { false };          // = true append e-mails to mailbox pack file
+    bool bSync { false };          // = true fdatasync e-mails before indexing
 };
 
 //
@@ -91,6 +118,27 @@ constexpr int kMaxSubjectLine = 80;
 
 constexpr const  char *kEMLFileExt { ".eml" };
 
+//
+// Per mailbox archive index. It records the mailbox UIDVALIDITY and the UID and .eml
+// file name of each e-mail archived so that an update run need not rescan the folder.
+// Index format (appended to as each e-mail is archived):
+//
+//   # Antik mailbox index 1
+//   UIDVALIDITY <uidvalidity>
+//   <uid>\t<.eml file name | ArchiveMailBox.mbox#<pack file offset>>
+//
+
+constexpr const char *kMailBoxIndexFileName { ".ArchiveMailBox.index" };
+constexpr const char *kMailBoxIndexHeader { "# Antik mailbox index 1" };
+
+struct MailBoxIndex {
+    std::string indexFileName;                               // Index file
+    std::uint64_t uidValidity { 0 };                         // Mailbox UIDVALIDITY
+    std::uint64_t highestUID { 0 };                          // Highest UID archived
+    std::unordered_map<std::uint64_t, std::string> archived; // UID to .eml file name
+    std::ofstream indexStream;                               // Index append stream
+};
+
 // ===============
 // LOCAL FUNCTIONS
 // ===============
@@ -121,7 +169,14 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("mailbox,m", po::value<std::string>(&argData.mailBoxName)->required(), "Mailbox name")
             ("destination,d", po::value<std::string>(&argData.destinationFolder)->required(), "Destination for e-mail archive")
             ("updates,u", "Search since last file archived.")
-            ("all,a", "Download files for all mailboxes.");
+            ("all,a", "Download files for all mailboxes.")
+            ("batch,b", po::value<int>(&argData.batchSize)->default_value(1), "Number of e-mails fetched per UID FETCH command")
+            ("maxbytes", po::value<std::uint64_t>(&argData.maxBatchBytes)->default_value(0), "Cap on message bytes fetched per batch (0 = no cap)")
+            ("stream", "Stream message bodies straight to .eml files")
+            ("compress", "Use COMPRESS=DEFLATE for streamed fetches if the server supports it")
+            ("connections,n", po::value<int>(&argData.connections)->default_value(1), "Number of IMAP connections archiving mailboxes in parallel")
+            ("pack", "Append e-mails to one mbox pack file per mailbox")
+            ("sync", "Make e-mails durable (batched fdatasync) before indexing them");
 
 }
 
@@ -182,8 +237,43 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             argData.bAllMailBoxes = true;
         }
 
+        // Stream message bodies to disk
+
+        if (vm.count("stream")) {
+            argData.bStream = true;
+        }
+
+        // Compress streamed connection
+
+        if (vm.count("compress")) {
+            if (!argData.bStream) {
+                throw po::error("--compress applies to the streamed connection (--stream).");
+            }
+            argData.bCompress = true;
+        }
+
+        // Archive to mailbox pack files
+
+        if (vm.count("pack")) {
+            argData.bPack = true;
+        }
+
+        // Sync e-mails to disk before they are indexed
+
+        if (vm.count("sync")) {
+            argData.bSync = true;
+        }
+
         po::notify(vm);
 
+        if (argData.batchSize < 1) {
+            throw po::error("Batch size must be at least one.");
+        }
+
+        if (argData.connections < 1) {
+            throw po::error("Number of connections must be at least one.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "ArchiveMailBox Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -238,14 +328,243 @@ static std::string sendCommand(CIMAP& imap, [[maybe_unused]] const std::string&
 
 }
 
+//
+// Rebuild a mailbox index by scanning its folder. Each saved .eml file has a "(UID)"
+// prefix; get the UID from this. E-mails in a pack file are found from its separator
+// lines.
+//
+
+static void rescanMailBoxFolder(const CPath &destinationFolder, MailBoxIndex &mailBoxIndex) {
+
+    mailBoxIndex.archived.clear();
+    mailBoxIndex.highestUID = 0;
+
+    if (CFile::exists(destinationFolder) && CFile::isDirectory(destinationFolder)) {
+
+        Antik::FileList mailMessages { CFile::directoryContentsList(destinationFolder) };
+
+        for (auto& mailFile : mailMessages) {
+            if (CFile::isFile(mailFile) && (CPath(mailFile).extension().compare(kEMLFileExt) == 0)) {
+                std::string emlFileName { CPath(mailFile).fileName() };
+                std::uint64_t currentUID { std::strtoull(CIMAPParse::stringBetween(emlFileName, '(', ')').c_str(), nullptr, 10) };
+                if (currentUID) {
+                    mailBoxIndex.archived[currentUID] = emlFileName;
+                    if (currentUID > mailBoxIndex.highestUID) {
+                        mailBoxIndex.highestUID = currentUID;
+                    }
+                }
+            }
+        }
+
+        MailArchiveWriter::scanPackFile(destinationFolder.toString(), [&](std::uint64_t uid, const std::string &archivedName) {
+            mailBoxIndex.archived[uid] = archivedName;
+            if (uid > mailBoxIndex.highestUID) {
+                mailBoxIndex.highestUID = uid;
+            }
+        });
+
+    }
+
+}
+
+//
+// Write mailbox index to a temporary file then rename it over the old index.
+//
+
+static void saveMailBoxIndex(MailBoxIndex &mailBoxIndex) {
+
+    std::string temporaryFileName { mailBoxIndex.indexFileName + ".tmp" };
+
+    mailBoxIndex.indexStream.close();
+
+    {
+        std::ofstream indexStream(temporaryFileName, std::ios::trunc);
+        if (!indexStream.is_open()) {
+            throw std::runtime_error("Could not create mailbox index [" + temporaryFileName + "]");
+        }
+        indexStream << kMailBoxIndexHeader << "\n" << "UIDVALIDITY " << mailBoxIndex.uidValidity << "\n";
+        for (auto &entry : mailBoxIndex.archived) {
+            indexStream << entry.first << '\t' << entry.second << '\n';
+        }
+        indexStream.flush();
+        if (!indexStream) {
+            throw std::runtime_error("Could not write mailbox index [" + temporaryFileName + "]");
+        }
+    }
+
+    CFile::rename(temporaryFileName, mailBoxIndex.indexFileName);
+
+}
+
+//
+// Move the e-mails (and pack file) archived under an old UIDVALIDITY out of a mailbox
+// folder into a sibling "<mailbox>.uidvalidity-<old>" folder; their UIDs mean nothing
+// under the new numbering.
+//
+
+static void moveAsideMailBoxFolder(const CPath &destinationFolder, const std::string &oldUIDValidity) {
+
+    std::filesystem::path mailBoxFolder { destinationFolder.toString() };
+    std::filesystem::path asideFolder { mailBoxFolder.string() + ".uidvalidity-" + oldUIDValidity };
+
+    std::cout << "Mailbox UIDVALIDITY changed; moving old e-mails to [" << asideFolder.string() << "]" << std::endl;
+
+    std::filesystem::create_directories(asideFolder);
+
+    for (auto &entry : std::filesystem::directory_iterator(mailBoxFolder)) {
+        if (entry.is_regular_file() && ((entry.path().extension() == kEMLFileExt) ||
+                (entry.path().filename() == MailArchiveWriter::kPackFileName))) {
+            std::filesystem::rename(entry.path(), asideFolder / entry.path().filename());
+        }
+    }
+
+}
+
+//
+// Load the index for a mailbox folder. If it is missing (or unreadable) the folder is
+// rescanned and a new index written. If it was written for a different UIDVALIDITY
+// the old e-mails are moved aside and the index started empty.
+//
+
+static void loadMailBoxIndex(const CPath &destinationFolder, std::uint64_t uidValidity, MailBoxIndex &mailBoxIndex) {
+
+    CPath indexFilePath { destinationFolder };
+    indexFilePath.join(kMailBoxIndexFileName);
+
+    mailBoxIndex.indexFileName = indexFilePath.toString();
+    mailBoxIndex.archived.clear();
+    mailBoxIndex.highestUID = 0;
+
+    if (CFile::exists(indexFilePath)) {
+
+        std::ifstream indexStream(mailBoxIndex.indexFileName);
+        std::string line;
+
+        bool bHeader = std::getline(indexStream, line) && (line == kMailBoxIndexHeader) && std::getline(indexStream, line);
+
+        if (bHeader && (line == "UIDVALIDITY " + std::to_string(uidValidity))) {
+            mailBoxIndex.uidValidity = uidValidity;
+            while (std::getline(indexStream, line)) {
+                std::size_t tab = line.find('\t');
+                if (tab != std::string::npos) {
+                    std::uint64_t uid { std::strtoull(line.c_str(), nullptr, 10) };
+                    mailBoxIndex.archived[uid] = line.substr(tab + 1);
+                    if (uid > mailBoxIndex.highestUID) {
+                        mailBoxIndex.highestUID = uid;
+                    }
+                }
+            }
+            return;
+        }
+
+        if (bHeader && (line.find("UIDVALIDITY ") == 0)) {
+            indexStream.close();
+            moveAsideMailBoxFolder(destinationFolder, line.substr(line.find(' ') + 1));
+            mailBoxIndex.uidValidity = uidValidity;
+            saveMailBoxIndex(mailBoxIndex);
+            return;
+        }
+
+        std::cout << "Mailbox index unreadable; rescanning [" << destinationFolder.toString() << "]" << std::endl;
+
+    }
+
+    mailBoxIndex.uidValidity = uidValidity;
+    rescanMailBoxFolder(destinationFolder, mailBoxIndex);
+    saveMailBoxIndex(mailBoxIndex);
+
+}
+
+//
+// Record an archived e-mail in the mailbox index (appended and flushed straight away
+// so the index is up to date should the run be interrupted).
+//
+
+static void recordArchivedEmail(MailBoxIndex &mailBoxIndex, std::uint64_t uid, const std::string &emlFileName) {
+
+    if (!mailBoxIndex.indexStream.is_open()) {
+        mailBoxIndex.indexStream.open(mailBoxIndex.indexFileName, std::ios::app);
+        if (!mailBoxIndex.indexStream.is_open()) {
+            throw std::runtime_error("Could not open mailbox index [" + mailBoxIndex.indexFileName + "]");
+        }
+    }
+
+    mailBoxIndex.indexStream << uid << '\t' << emlFileName << std::endl;
+
+    mailBoxIndex.archived[uid] = emlFileName;
+    if (uid > mailBoxIndex.highestUID) {
+        mailBoxIndex.highestUID = uid;
+    }
+
+}
+
+//
+// Return subject line of a fetched e-mail in a form usable in a file name.
+//
+
+static std::string fetchEntrySubject(const CIMAPParse::FetchRespData &fetchEntry) {
+
+    std::string subject;
+
+    for (auto &resp : fetchEntry.responseMap) {
+        if (resp.first.find("BODY[HEADER.FIELDS (SUBJECT)]") == 0) {
+            if (resp.second.find("Subject:") != std::string::npos) { // Contains "Subject:"
+                subject = resp.second.substr(8);
+                subject = Antik::File::CMIME::convertMIMEStringToASCII(subject);
+                if (subject.length() > kMaxSubjectLine) { // Truncate for file name
+                    subject = subject.substr(0, kMaxSubjectLine);
+                }
+                for (auto &ch : subject) { // Remove all but alpha numeric from subject
+                    if (!std::isalnum(ch)) ch = ' ';
+                }
+            }
+        }
+    }
+
+    return (subject);
+
+}
+
+//
+// Archive a fetched e-mail from its body and subject line. The body is written
+// straight from the parsed response.
+//
+
+static void archiveFetchEntry(const CIMAPParse::FetchRespData &fetchEntry, MailArchiveWriter &archiveWriter,
+                              std::uint64_t index, MailBoxIndex &mailBoxIndex) {
+
+    std::string subject { fetchEntrySubject(fetchEntry) };
+    const std::string *emailBody { nullptr };
+
+    std::cout << "EMAIL MESSAGE NO. [" << fetchEntry.index << "]" << std::endl;
+    for (auto &resp : fetchEntry.responseMap) {
+        if (resp.first.find("BODY[]") == 0) {
+            emailBody = &resp.second;
+        }
+    }
+
+    // Have email body so create .eml file for it.
+
+    if (emailBody && !emailBody->empty() && !mailBoxIndex.archived.count(index)) {
+        std::string emlFileName { "(" + std::to_string(index) + ") " + subject + kEMLFileExt };
+        try {
+            std::cout << "Creating [" << archiveWriter.destination(emlFileName) << "]" << std::endl;
+            archiveWriter.write(index, emlFileName, emailBody->data(), emailBody->length());
+        } catch (MailArchiveWriter::Exception &e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+}
+
 //
 // Fetch a given e-mails body and subject line and create an .eml file for it.
 //
 
 static void fetchEmailAndArchive(CIMAP& imap, const std::string& mailBoxName, 
-                     const CPath &destinationFolder, std::uint64_t index) {
+                     MailArchiveWriter &archiveWriter, std::uint64_t index, MailBoxIndex &mailBoxIndex) {
 
-    std::string command, commandResponse, subject, emailBody;
+    std::string command, commandResponse;
     CIMAPParse::COMMANDRESPONSE parsedResponse;
 
     command = "UID FETCH " + std::to_string(index) + " (BODY[] BODY[HEADER.FIELDS (SUBJECT)])";
@@ -253,78 +572,224 @@ static void fetchEmailAndArchive(CIMAP& imap, const std::string& mailBoxName,
     parsedResponse = parseCommandResponse(command, commandResponse);
 
     if (parsedResponse) {
+        for (auto &fetchEntry : parsedResponse->fetchList) {
+            archiveFetchEntry(fetchEntry, archiveWriter, index, mailBoxIndex);
+        }
+    }
 
-        for (auto fetchEntry : parsedResponse->fetchList) {
-            std::cout << "EMAIL MESSAGE NO. [" << fetchEntry.index << "]" << std::endl;
-            for (auto resp : fetchEntry.responseMap) {
-                if (resp.first.find("BODY[]") == 0) {
-                    emailBody = resp.second;
-                } else if (resp.first.find("BODY[HEADER.FIELDS (SUBJECT)]") == 0) {
-                    if (resp.second.find("Subject:") != std::string::npos) { // Contains "Subject:"
-                        subject = resp.second.substr(8);
-                        subject = Antik::File::CMIME::convertMIMEStringToASCII(subject);
-                        if (subject.length() > kMaxSubjectLine) { // Truncate for file name
-                            subject = subject.substr(0, kMaxSubjectLine);
-                        }
-                        for (auto &ch : subject) { // Remove all but alpha numeric from subject
-                            if (!std::isalnum(ch)) ch = ' ';
-                        }
-                    }
-                }
+}
+
+//
+// Return an IMAP UID sequence set ("1:5,7,9:12") for a sorted list of UIDs.
+//
+
+static std::string uidSequenceSet(std::vector<std::uint64_t>::const_iterator first, 
+                                  std::vector<std::uint64_t>::const_iterator last) {
+
+    std::string sequenceSet;
+
+    while (first != last) {
+        auto rangeEnd = first;
+        while ((std::next(rangeEnd) != last) && (*std::next(rangeEnd) == *rangeEnd + 1)) {
+            rangeEnd++;
+        }
+        if (!sequenceSet.empty()) {
+            sequenceSet += ",";
+        }
+        sequenceSet += std::to_string(*first);
+        if (rangeEnd != first) {
+            sequenceSet += ":" + std::to_string(*rangeEnd);
+        }
+        first = std::next(rangeEnd);
+    }
+
+    return (sequenceSet);
+
+}
+
+//
+// Return UID of a fetch response entry (zero if not present).
+//
+
+static std::uint64_t fetchEntryUID(const CIMAPParse::FetchRespData &fetchEntry) {
+
+    auto uid = fetchEntry.responseMap.find("UID");
+    if (uid != fetchEntry.responseMap.end()) {
+        return (std::strtoull(uid->second.c_str(), nullptr, 10));
+    }
+    return (0);
+
+}
+
+//
+// Fetch e-mails in batches of UIDs with one UID FETCH per batch and create an .eml
+// file for each as its fetch entry is processed. If a byte cap is given the message
+// sizes are fetched first (one command for all UIDs) and a batch is closed before it
+// would go over the cap; a message larger than the cap, or whose size the server did
+// not return, is fetched on its own.
+//
+
+static void fetchEmailsAndArchive(CIMAP& imap, const std::string& mailBoxName, MailArchiveWriter &archiveWriter,
+                                  std::vector<std::uint64_t> uids, const ParamArgData &argData,
+                                  MailBoxIndex &mailBoxIndex) {
+
+    std::string command, commandResponse;
+    CIMAPParse::COMMANDRESPONSE parsedResponse;
+    std::unordered_map<std::uint64_t, std::uint64_t> messageSizes;
+
+    std::sort(uids.begin(), uids.end());
+
+    if (argData.maxBatchBytes && !uids.empty()) {
+        command = "UID FETCH " + uidSequenceSet(uids.begin(), uids.end()) + " (RFC822.SIZE)";
+        commandResponse = sendCommand(imap, mailBoxName, command);
+        parsedResponse = parseCommandResponse(command, commandResponse);
+        for (auto &fetchEntry : parsedResponse->fetchList) {
+            auto size = fetchEntry.responseMap.find("RFC822.SIZE");
+            if (size != fetchEntry.responseMap.end()) {
+                messageSizes[fetchEntryUID(fetchEntry)] = std::strtoull(size->second.c_str(), nullptr, 10);
+            }
+        }
+        for (auto uid : uids) {
+            if (!messageSizes.count(uid)) {
+                std::cerr << "No RFC822.SIZE returned for UID [" << uid << "]; fetching it on its own." << std::endl;
             }
         }
+    }
 
-        // Have email body so create .eml file for it.
+    auto messageSize = [&messageSizes, &argData](std::uint64_t uid) { // Unknown is over the cap
+        auto size = messageSizes.find(uid);
+        return ((size != messageSizes.end()) ? size->second : argData.maxBatchBytes + 1);
+    };
 
-        if (!emailBody.empty()) {
-            CPath fullFilePath { destinationFolder };
-            fullFilePath.join("(" + std::to_string(index) + ") " + subject + kEMLFileExt);
-            if (!CFile::exists(fullFilePath)) {
-                std::istringstream emailBodyStream(emailBody);
-                std::ofstream emlFileStream(fullFilePath.toString(), std::ios::binary);
-                if (emlFileStream.is_open()) {
-                    std::cout << "Creating [" << fullFilePath.toString() << "]" << std::endl;
-                    for (std::string line; std::getline(emailBodyStream, line, '\n');) {
-                        line.push_back('\n');
-                        emlFileStream.write(&line[0], line.length());
-                    }
-                } else {
-                    std::cerr << "Failed to create file [" << fullFilePath.toString() << "]" << std::endl;
+    for (auto batchStart = uids.cbegin(); batchStart != uids.cend();) {
+
+        auto batchEnd = batchStart;
+        std::uint64_t batchBytes { 0 };
+
+        do {
+            batchBytes += messageSize(*batchEnd);
+            batchEnd++;
+        } while ((batchEnd != uids.cend()) && (batchEnd - batchStart < argData.batchSize) &&
+                 (!argData.maxBatchBytes || (batchBytes + messageSize(*batchEnd) <= argData.maxBatchBytes)));
+
+        command = "UID FETCH " + uidSequenceSet(batchStart, batchEnd) + " (BODY[] BODY[HEADER.FIELDS (SUBJECT)])";
+        commandResponse = sendCommand(imap, mailBoxName, command);
+        parsedResponse = parseCommandResponse(command, commandResponse);
+        commandResponse.clear();
+
+        if (parsedResponse) {
+            for (auto &fetchEntry : parsedResponse->fetchList) {
+                std::uint64_t uid { fetchEntryUID(fetchEntry) };
+                if (uid) {
+                    archiveFetchEntry(fetchEntry, archiveWriter, uid, mailBoxIndex);
                 }
+                fetchEntry.responseMap.clear();
             }
         }
 
+        batchStart = batchEnd;
+
     }
 
 }
 
 //
-// Find the UID on the last message saved and search from that. Each saved .eml file has a "(UID)"
-// prefix; get the UID from this.
+// Fetch e-mails in batches as fetchEmailsAndArchive() does but stream each BODY[]
+// literal straight into a part file as it is received so no message is ever held in
+// memory. Once the command completes its (literal free) response gives the UID and
+// subject for each message and the part file is renamed to its .eml file name (or
+// appended to the pack file).
 //
 
-static std::uint64_t getLowerSearchLimit(const CPath &destinationFolder) {
+static void fetchEmailsStreamed(IMAPStreamConnection& imapStream, const CPath &destinationFolder,
+                                MailArchiveWriter &archiveWriter, std::vector<std::uint64_t> uids,
+                                const ParamArgData &argData, MailBoxIndex &mailBoxIndex) {
 
-    if (CFile::exists(destinationFolder) && CFile::isDirectory(destinationFolder)) {
+    struct PartFile {
+        std::string fileName;       // Part file name
+        bool bNewLineAtEnd { true }; // == true body ended in a newline
+    };
 
-        std::uint64_t highestUID=1, currentUID=0;
-        
-        Antik::FileList mailMessages { CFile::directoryContentsList(destinationFolder) };
+    std::unordered_map<std::uint64_t, PartFile> partFiles;
+    std::ofstream partFileStream;
+    PartFile *currentPart { nullptr };
 
-        for (auto& mailFile : mailMessages) {
-            if (CFile::isFile(mailFile) && (CPath(mailFile).extension().compare(kEMLFileExt) == 0)) {
-                currentUID=std::strtoull(CIMAPParse::stringBetween(mailFile,'(', ')').c_str(), nullptr, 10);
-                if (currentUID > highestUID) {
-                    highestUID = currentUID;
-                } 
+    IMAPLiteralSink bodySink;
+
+    bodySink.begin = [&](const std::string &responsePrefix, std::uint64_t) {
+        std::size_t literalStart { responsePrefix.rfind('{') };
+        if ((literalStart < 7) || (responsePrefix.compare(literalStart - 7, 7, "BODY[] ") != 0)) {
+            return (false); // Keep subject (or anything else) inline
+        }
+        std::uint64_t sequenceNumber { std::strtoull(responsePrefix.c_str() + 2, nullptr, 10) };
+        CPath partFilePath { destinationFolder };
+        partFilePath.join(".fetch-" + std::to_string(sequenceNumber) + ".part");
+        currentPart = &partFiles[sequenceNumber];
+        currentPart->fileName = partFilePath.toString();
+        partFileStream.open(currentPart->fileName, std::ios::binary | std::ios::trunc);
+        if (!partFileStream.is_open()) {
+            throw std::runtime_error("Failed to create file [" + currentPart->fileName + "]");
+        }
+        return (true);
+    };
+
+    bodySink.data = [&](const char *data, std::size_t length) {
+        partFileStream.write(data, length);
+        currentPart->bNewLineAtEnd = (data[length - 1] == '\n');
+    };
+
+    bodySink.end = [&]() {
+        if (!currentPart->bNewLineAtEnd) {
+            partFileStream.put('\n');
+        }
+        partFileStream.close();
+    };
+
+    std::sort(uids.begin(), uids.end());
+
+    for (auto batchStart = uids.cbegin(); batchStart != uids.cend();) {
+
+        auto batchEnd = batchStart + std::min<std::ptrdiff_t>(argData.batchSize, uids.cend() - batchStart);
+        std::string command { "UID FETCH " + uidSequenceSet(batchStart, batchEnd) + " (BODY[] BODY[HEADER.FIELDS (SUBJECT)])" };
+        std::string commandResponse;
+
+        partFiles.clear();
+
+        try {
+            commandResponse = imapStream.sendCommand(command, &bodySink);
+        } catch (...) {
+            for (auto &partFile : partFiles) {
+                CFile::remove(partFile.second.fileName);
             }
+            throw;
         }
-        
-        return (highestUID);
-        
+
+        CIMAPParse::COMMANDRESPONSE parsedResponse { parseCommandResponse(command, commandResponse) };
+
+        for (auto &fetchEntry : parsedResponse->fetchList) {
+            auto partFile = partFiles.find(fetchEntry.index);
+            std::uint64_t uid { fetchEntryUID(fetchEntry) };
+            if (partFile == partFiles.end()) {
+                continue;
+            }
+            std::cout << "EMAIL MESSAGE NO. [" << fetchEntry.index << "]" << std::endl;
+            std::string emlFileName { "(" + std::to_string(uid) + ") " + fetchEntrySubject(fetchEntry) + kEMLFileExt };
+            if (uid && !mailBoxIndex.archived.count(uid)) {
+                std::cout << "Creating [" << archiveWriter.destination(emlFileName) << "]" << std::endl;
+                archiveWriter.writeFile(uid, emlFileName, partFile->second.fileName);
+            } else {
+                CFile::remove(partFile->second.fileName);
+            }
+            partFiles.erase(partFile);
+        }
+
+        for (auto &partFile : partFiles) {
+            CFile::remove(partFile.second.fileName);
+        }
+
+        batchStart = batchEnd;
+
     }
-    
-    return(0);
 
 }
 
@@ -363,6 +828,154 @@ static void createMailBoxList(CIMAP& imap, const ParamArgData& argData,
     }
 }
 
+//
+// Archive a mailbox: SELECT it, load its archive index, SEARCH for e-mails and fetch
+// and archive those found.
+//
+
+static void archiveMailBox(CIMAP &imap, IMAPStreamConnection &imapStream, std::string mailBox,
+                           const ParamArgData &argData) {
+
+    CIMAPParse::COMMANDRESPONSE parsedResponse;
+    CPath mailBoxPath { argData.destinationFolder };
+    std::string command, commandResponse;
+    std::uint64_t searchUID=0, uidValidity=0;
+    MailBoxIndex mailBoxIndex;
+    
+    std::cout << "MAIL BOX [" << mailBox << "]" << std::endl;
+
+    // SELECT mailbox
+
+    command = "SELECT " + mailBox;
+    commandResponse = sendCommand(imap, mailBox, command);
+    parsedResponse = parseCommandResponse(command, commandResponse);
+
+    if (parsedResponse->responseMap.count(kUIDVALIDITY)) {
+        uidValidity = std::strtoull(parsedResponse->responseMap[kUIDVALIDITY].c_str(), nullptr, 10);
+    }
+
+    if (argData.bStream) {
+        parseCommandResponse(command, imapStream.sendCommand(command));
+    }
+
+    // Clear any quotes from mailbox name for folder name
+
+    if (mailBox.front() == '\"') mailBox = mailBox.substr(1);
+    if (mailBox.back() == '\"') mailBox.pop_back();
+
+    // Create destination folder
+
+    mailBoxPath.join(mailBox);
+    if (!argData.destinationFolder.empty() && !CFile::exists(mailBoxPath)) {
+        std::cout << "Creating destination folder = [" << mailBoxPath.toString() << "]" << std::endl;
+        CFile::createDirectory(mailBoxPath);
+    }
+
+    // Load archive index; get UID of newest archived message and search from that for updates
+
+    loadMailBoxIndex(mailBoxPath, uidValidity, mailBoxIndex);
+
+    MailArchiveWriter archiveWriter(mailBoxPath.toString(), argData.bPack, argData.bSync,
+            [&](std::uint64_t uid, const std::string &archivedName) {
+                recordArchivedEmail(mailBoxIndex, uid, archivedName);
+            });
+
+    if (argData.bOnlyUpdates) {
+        searchUID = mailBoxIndex.highestUID;
+    }
+
+    // SEARCH for email.
+
+    if (searchUID!=0) { // Updates
+        std::cout << "Searching from [" << std::to_string(searchUID) << "]" << std::endl;
+        command = "UID SEARCH UID "+std::to_string(searchUID)+":*";
+    } else {            // All
+        command = "UID SEARCH UID 1:*";
+    }
+
+    commandResponse = sendCommand(imap, mailBox, command);
+    
+    // Archive any email returned from search
+    
+    parsedResponse = parseCommandResponse(command, commandResponse);
+    if (parsedResponse) {
+        std::vector<std::uint64_t> uids;
+        for (auto index : parsedResponse->indexes) {
+            if (!mailBoxIndex.archived.count(index)) { // Skip e-mails already archived
+                uids.push_back(index);
+            }
+        }
+        if (argData.bStream) {
+            fetchEmailsStreamed(imapStream, mailBoxPath, archiveWriter, uids, argData, mailBoxIndex);
+        } else if (argData.batchSize > 1) {
+            fetchEmailsAndArchive(imap, mailBox, archiveWriter, uids, argData, mailBoxIndex);
+        } else {
+            for (auto index : uids) {
+                fetchEmailAndArchive(imap, mailBox, archiveWriter, index, mailBoxIndex);
+            }
+        }
+    }
+
+    // Index any e-mails still waiting on a sync
+
+    archiveWriter.commit();
+
+}
+
+//
+// Archive mailboxes in parallel. Each worker opens its own authenticated CIMAP (and if
+// streaming IMAPStreamConnection) session and takes mailboxes from a shared queue
+// until it is empty. The first error stops the workers taking any more mailboxes and
+// is rethrown.
+//
+
+static void archiveMailBoxesParallel(const ParamArgData &argData, const std::vector<std::string> &mailBoxList) {
+
+    std::atomic<std::size_t> nextMailBox { 0 };
+    std::exception_ptr workerException;
+    std::mutex exceptionMutex;
+
+    auto archiveWorker = [&]() {
+        try {
+            CIMAP imap;
+            IMAPStreamConnection imapStream;
+            imap.setServer(argData.serverURL);
+            imap.setUserAndPassword(argData.userName, argData.userPassword);
+            imap.connect();
+            if (argData.bStream) {
+                imapStream.setServer(argData.serverURL);
+                imapStream.setUserAndPassword(argData.userName, argData.userPassword);
+                imapStream.setCompression(argData.bCompress);
+                imapStream.connect();
+            }
+            for (std::size_t mailBox = nextMailBox++; mailBox < mailBoxList.size(); mailBox = nextMailBox++) {
+                archiveMailBox(imap, imapStream, mailBoxList[mailBox], argData);
+            }
+            imap.disconnect();
+            imapStream.disconnect();
+        } catch (...) {
+            std::unique_lock<std::mutex> lock(exceptionMutex);
+            if (!workerException) {
+                workerException = std::current_exception();
+            }
+            nextMailBox = mailBoxList.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int connection = 0; connection < std::min<int>(argData.connections, mailBoxList.size()); connection++) {
+        workers.emplace_back(archiveWorker);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    if (workerException) {
+        std::rethrow_exception(workerException);
+    }
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -373,6 +986,7 @@ int main(int argc, char** argv) {
 
         ParamArgData argData;
         CIMAP imap;
+        IMAPStreamConnection imapStream;
         std::vector<std::string> mailBoxList;
 
         // Read in command line parameters and process
@@ -390,72 +1004,36 @@ int main(int argc, char** argv) {
 
         imap.connect();
 
-        // Create mailbox list
-
-        createMailBoxList(imap, argData, mailBoxList);
-
-        for (std::string mailBox : mailBoxList) {
-
-            CIMAPParse::COMMANDRESPONSE parsedResponse;
-            CPath mailBoxPath { argData.destinationFolder };
-            std::string command, commandResponse;
-            std::uint64_t searchUID=0;
-            
-            std::cout << "MAIL BOX [" << mailBox << "]" << std::endl;
-
-            // SELECT mailbox
-
-            command = "SELECT " + mailBox;
-            commandResponse = sendCommand(imap, mailBox, command);
-            parsedResponse = parseCommandResponse(command, commandResponse);
-
-            // Clear any quotes from mailbox name for folder name
-
-            if (mailBox.front() == '\"') mailBox = mailBox.substr(1);
-            if (mailBox.back() == '\"') mailBox.pop_back();
-
-            // Create destination folder
-
-            mailBoxPath.join(mailBox);
-            if (!argData.destinationFolder.empty() && !CFile::exists(mailBoxPath)) {
-                std::cout << "Creating destination folder = [" << mailBoxPath.toString() << "]" << std::endl;
-                CFile::createDirectory(mailBoxPath);
-            }
-
-            // Get UID of newest archived message and search from that for updates
+        // Second connection for streamed fetches (workers open their own)
 
-            if (argData.bOnlyUpdates) {
-                searchUID = getLowerSearchLimit(mailBoxPath);
+        if (argData.bStream && (argData.connections == 1)) {
+            imapStream.setServer(argData.serverURL);
+            imapStream.setUserAndPassword(argData.userName, argData.userPassword);
+            imapStream.setCompression(argData.bCompress);
+            imapStream.connect();
+            if (argData.bCompress && !imapStream.getCompressedStatus()) {
+                std::cout << "Server does not support COMPRESS=DEFLATE; fetching uncompressed." << std::endl;
             }
+        }
 
-            // SEARCH for email.
+        // Create mailbox list
 
-            if (searchUID!=0) { // Updates
-                std::cout << "Searching from [" << std::to_string(searchUID) << "]" << std::endl;
-                command = "UID SEARCH UID "+std::to_string(searchUID)+":*";
-            } else {            // All
-                command = "UID SEARCH UID 1:*";
-            }
+        createMailBoxList(imap, argData, mailBoxList);
 
-            commandResponse = sendCommand(imap, mailBox, command);
-            
-            // Archive any email returned from search
-            
-            parsedResponse = parseCommandResponse(command, commandResponse);
-            if (parsedResponse) {
-                for (auto index : parsedResponse->indexes) {
-                    if (index != searchUID) {
-                        fetchEmailAndArchive(imap, mailBox, mailBoxPath, index);
-                    }
-                }
+        if (argData.connections > 1) {
+            archiveMailBoxesParallel(argData, mailBoxList);
+        } else {
+            for (auto &mailBox : mailBoxList) {
+                archiveMailBox(imap, imapStream, mailBox, argData);
             }
-
         }
 
         std::cout << "Disconnecting from server [" << argData.serverURL << "]" << std::endl;
 
         imap.disconnect();
 
+        imapStream.disconnect();
+
     //
     // Catch any errors
     //    
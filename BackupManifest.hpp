@@ -0,0 +1,283 @@
+#ifndef BACKUPMANIFEST_HPP
+#define BACKUPMANIFEST_HPP
+
+//
+// Header: BackupManifest
+//
+// Description: Persistent local manifest used by the backup programs (FTP, SFTP and
+// SCP) for incremental backups. For each file under the backup directory it records
+// its size, last write time and an optional content hash (SHA-256); a later run then only needs
+// to send those files that are new or have changed. The manifest is a plain text file
+// that is written (and fsync'ed) to a temporary file and renamed over the old one so
+// that it is never left half written.
+//
+// Manifest format (one line per file, path relative to the backup directory):
+//
+//   # Antik backup manifest 1
+//   <size>\t<last write time>\t<hash or ->\t<relative path>
+//
+// Dependencies: C11++, Classes (CFile), SHA256, Linux.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <stdexcept>
+
+//
+// Linux
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//
+// Antik Classes
+//
+
+#include "CFile.hpp"
+#include "SHA256.hpp"
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// Manifest entry for a file
+//
+
+struct BackupManifestEntry {
+    std::uintmax_t size { 0 };   // File size (0 for a directory)
+    std::int64_t lastWrite { 0 }; // Last write time (file clock ticks)
+    std::string hash;            // Content hash (empty if not calculated)
+};
+
+//
+// Manifest keyed on file path relative to the backup directory
+//
+
+typedef std::unordered_map<std::string, BackupManifestEntry> BackupManifest;
+
+//
+// Manifest header line
+//
+
+constexpr const char *kBackupManifestHeader { "# Antik backup manifest 1" };
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// Return the default manifest file name for a backup directory; it is placed next
+// to (not in) the directory so that it is never backed up itself.
+//
+
+inline std::string defaultManifestFileName(std::string localDirectory) {
+
+    while ((localDirectory.size() > 1) && (localDirectory.back() == '/')) {
+        localDirectory.pop_back();
+    }
+
+    return (localDirectory + ".manifest");
+
+}
+
+//
+// Return path of a file relative to the backup directory (manifest key).
+//
+
+inline std::string manifestKey(const std::string &localDirectory, const std::string &filePath) {
+    return (std::filesystem::path(filePath).lexically_relative(localDirectory).generic_string());
+}
+
+//
+// Load manifest. A missing manifest is treated as empty (ie. full backup).
+//
+
+inline BackupManifest loadBackupManifest(const std::string &manifestFileName) {
+
+    BackupManifest manifest;
+
+    if (!Antik::File::CFile::exists(manifestFileName)) {
+        return (manifest);
+    }
+
+    std::ifstream manifestStream(manifestFileName);
+    std::string line;
+
+    if (!std::getline(manifestStream, line) || (line != kBackupManifestHeader)) {
+        throw std::runtime_error("[" + manifestFileName + "] is not a backup manifest.");
+    }
+
+    while (std::getline(manifestStream, line)) {
+        std::istringstream lineStream(line);
+        BackupManifestEntry entry;
+        std::string size, lastWrite, hash, filePath;
+        if (std::getline(lineStream, size, '\t') && std::getline(lineStream, lastWrite, '\t') &&
+                std::getline(lineStream, hash, '\t') && std::getline(lineStream, filePath)) {
+            entry.size = std::strtoull(size.c_str(), nullptr, 10);
+            entry.lastWrite = std::strtoll(lastWrite.c_str(), nullptr, 10);
+            if (hash != "-") {
+                entry.hash = hash;
+            }
+            manifest[filePath] = entry;
+        }
+    }
+
+    return (manifest);
+
+}
+
+//
+// Write manifest to a temporary file then rename it over the old manifest.
+//
+
+inline void saveBackupManifest(const std::string &manifestFileName, const BackupManifest &manifest) {
+
+    std::string temporaryFileName { manifestFileName + ".tmp" };
+
+    {
+        std::ofstream manifestStream(temporaryFileName, std::ios::trunc);
+        if (!manifestStream.is_open()) {
+            throw std::runtime_error("Could not create manifest [" + temporaryFileName + "]");
+        }
+        manifestStream << kBackupManifestHeader << "\n";
+        for (auto &entry : manifest) {
+            manifestStream << entry.second.size << '\t' << entry.second.lastWrite << '\t'
+                    << (entry.second.hash.empty() ? "-" : entry.second.hash) << '\t'
+                    << entry.first << '\n';
+        }
+        manifestStream.close();
+        if (!manifestStream) {
+            throw std::runtime_error("Could not write manifest [" + temporaryFileName + "]");
+        }
+    }
+
+    // Make sure the new manifest is on disk before it replaces the old one
+
+    int manifestFd = open(temporaryFileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if ((manifestFd == -1) || (fsync(manifestFd) == -1)) {
+        if (manifestFd != -1) close(manifestFd);
+        throw std::runtime_error("Could not sync manifest [" + temporaryFileName + "]");
+    }
+    close(manifestFd);
+
+    std::filesystem::rename(temporaryFileName, manifestFileName);
+
+}
+
+//
+// Build the manifest for the current file list and return those files that are new
+// or have changed since the previous manifest. A file whose size and last write time
+// are unchanged is taken to be the same; if hashing is enabled a file with the same
+// size but a new last write time is only sent if its contents hash differs. Existing
+// directories are never resent.
+//
+
+inline Antik::FileList filesChangedSinceManifest(const std::string &localDirectory, const Antik::FileList &localFileList,
+                                                 const BackupManifest &previousManifest, BackupManifest &currentManifest,
+                                                 bool bHash) {
+
+    Antik::FileList changedFiles;
+
+    for (auto &localFile : localFileList) {
+
+        std::string key { manifestKey(localDirectory, localFile) };
+        BackupManifestEntry entry;
+        bool bDirectory = Antik::File::CFile::isDirectory(localFile);
+
+        entry.lastWrite = std::filesystem::last_write_time(localFile).time_since_epoch().count();
+        if (!bDirectory) {
+            entry.size = std::filesystem::file_size(localFile);
+        }
+
+        auto previous = previousManifest.find(key);
+        bool bChanged = (previous == previousManifest.end());
+
+        if (!bChanged && !bDirectory) {
+            if (previous->second.size != entry.size) {
+                bChanged = true;
+            } else if (previous->second.lastWrite != entry.lastWrite) {
+                if (bHash) {
+                    entry.hash = sha256FileContents(localFile);
+                    bChanged = (entry.hash != previous->second.hash);
+                } else {
+                    bChanged = true;
+                }
+            } else {
+                entry.hash = previous->second.hash;
+            }
+        }
+
+        if (bChanged && bHash && !bDirectory && entry.hash.empty()) {
+            entry.hash = sha256FileContents(localFile);
+        }
+
+        if (bChanged) {
+            changedFiles.push_back(localFile);
+        }
+
+        currentManifest[key] = entry;
+
+    }
+
+    return (changedFiles);
+
+}
+
+//
+// Save the current manifest after a backup run. Changed files that were not reported
+// back as transferred keep their previous entry (or are dropped if new) so that they
+// are sent again next time. Transferred paths are those under transferredDirectory
+// (the remote backup directory) and are matched exactly on their manifest key.
+//
+
+inline void commitBackupManifest(const std::string &manifestFileName, const std::string &localDirectory,
+                                 const std::string &transferredDirectory,
+                                 const BackupManifest &previousManifest, BackupManifest &currentManifest,
+                                 const Antik::FileList &changedFiles, const Antik::FileList &filesTransferred) {
+
+    std::string transferredBase { std::filesystem::path(transferredDirectory).lexically_normal().generic_string() };
+    std::unordered_set<std::string> transferredKeys;
+
+    while ((transferredBase.size() > 1) && (transferredBase.back() == '/')) {
+        transferredBase.pop_back();
+    }
+
+    for (auto &file : filesTransferred) {
+        std::string key { manifestKey(transferredBase, std::filesystem::path(file).lexically_normal().generic_string()) };
+        if (!key.empty() && (key != ".") && (key != "..") && (key.compare(0, 3, "../") != 0)) {
+            transferredKeys.insert(key);
+        }
+    }
+
+    for (auto &file : changedFiles) {
+        std::string key { manifestKey(localDirectory, file) };
+        if (!transferredKeys.count(key)) {
+            auto previous = previousManifest.find(key);
+            if (previous != previousManifest.end()) {
+                currentManifest[key] = previous->second;
+            } else {
+                currentManifest.erase(key);
+            }
+        }
+    }
+
+    saveBackupManifest(manifestFileName, currentManifest);
+
+}
+
+#endif /* BACKUPMANIFEST_HPP */
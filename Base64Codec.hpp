@@ -0,0 +1,341 @@
+#ifndef BASE64CODEC_HPP
+#define BASE64CODEC_HPP
+
+//
+// Header: Base64Codec
+//
+// Description: Streaming base64 decoder/encoder for the mail example programs. The
+// decoder may be fed encoded text in blocks of any size (CR/LF line breaks and any
+// other characters outside the base64 alphabet are skipped as RFC 2045 requires) and
+// appends the decoded bytes straight to a caller supplied output buffer. Runs of 16
+// encoded characters are decoded with SSSE3 where the CPU supports it, otherwise by
+// a table-driven loop. The encoder takes data in blocks and writes 76 character
+// CRLF terminated lines.
+//
+// Dependencies: C11++.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <array>
+#include <cstring>
+#include <cstdint>
+
+//
+// SSSE3 intrinsics where available
+//
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64CODEC_SSSE3 1
+#endif
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// Streaming base64 decoder.
+//
+
+class Base64Decoder {
+public:
+
+    //
+    // Decode a block of encoded text appending the bytes to decoded. Any partial
+    // group of four characters at the end is kept for the next call.
+    //
+
+    void decode(const char *encoded, std::size_t length, std::string &decoded) {
+
+        std::size_t decodedSize { decoded.size() };
+
+        // Room for worst case output plus SIMD store overrun
+
+        decoded.resize(decodedSize + (length / 4 + 1) * 3 + 16);
+
+        char *output { &decoded[decodedSize] };
+        const char *encodedEnd { encoded + length };
+
+        // Decode each line in turn skipping its CR/LF
+
+        while (encoded < encodedEnd) {
+            const char *lineEnd = static_cast<const char *> (std::memchr(encoded, '\n', encodedEnd - encoded));
+            if (!lineEnd) {
+                lineEnd = encodedEnd;
+            }
+            const char *dataEnd { lineEnd };
+            if ((dataEnd > encoded) && (*(dataEnd - 1) == '\r')) {
+                dataEnd--;
+            }
+            output = decodeRun(encoded, dataEnd, output);
+            encoded = (lineEnd == encodedEnd) ? lineEnd : lineEnd + 1;
+        }
+
+        decoded.resize(output - decoded.data());
+
+    }
+
+    //
+    // Flush any final unpadded group of characters.
+    //
+
+    void finish(std::string &decoded) {
+        if (m_quartetCount >= 2) {
+            decoded.push_back(static_cast<char> ((m_quartet[0] << 2) | (m_quartet[1] >> 4)));
+            if (m_quartetCount == 3) {
+                decoded.push_back(static_cast<char> ((m_quartet[1] << 4) | (m_quartet[2] >> 2)));
+            }
+        }
+        m_quartetCount = 0;
+    }
+
+private:
+
+    static constexpr std::uint8_t kInvalid { 0xFF };
+    static constexpr std::uint8_t kPad { 0xFE };
+
+    static const std::array<std::uint8_t, 256>& decodeTable() {
+        static const std::array<std::uint8_t, 256> table = [] {
+            std::array<std::uint8_t, 256> decodeTable;
+            const char *alphabet { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" };
+            decodeTable.fill(kInvalid);
+            for (std::uint8_t value = 0; value < 64; value++) {
+                decodeTable[static_cast<std::uint8_t> (alphabet[value])] = value;
+            }
+            decodeTable['='] = kPad;
+            return decodeTable;
+        }();
+        return (table);
+    }
+
+#ifdef BASE64CODEC_SSSE3
+
+    static bool bSSSE3() {
+        static const bool bSupported { __builtin_cpu_supports("ssse3") != 0 };
+        return (bSupported);
+    }
+
+    //
+    // Decode 16 characters to 12 bytes (16 are stored). Returns false without storing
+    // anything if any character is outside the alphabet (including padding).
+    //
+
+    __attribute__((target("ssse3")))
+    static bool decodeBlockSSSE3(const char *encoded, char *output) {
+
+        const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask2F = _mm_set1_epi8(0x2F);
+
+        __m128i characters = _mm_loadu_si128(reinterpret_cast<const __m128i *> (encoded));
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(characters, 4), mask2F);
+        __m128i loNibbles = _mm_and_si128(characters, mask2F);
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) {
+            return (false);
+        }
+
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(characters, mask2F), hiNibbles));
+        __m128i values = _mm_add_epi8(characters, roll);
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *> (output), packed);
+
+        return (true);
+
+    }
+
+#endif
+
+    //
+    // Decode a run of characters (no line breaks) returning new output position.
+    //
+
+    char *decodeRun(const char *encoded, const char *encodedEnd, char *output) {
+
+        const std::array<std::uint8_t, 256> &table { decodeTable() };
+
+        while (encoded < encodedEnd) {
+
+            // Whole groups of characters when on a group boundary
+
+            if (m_quartetCount == 0) {
+#ifdef BASE64CODEC_SSSE3
+                if (bSSSE3()) {
+                    while ((encodedEnd - encoded >= 16) && decodeBlockSSSE3(encoded, output)) {
+                        encoded += 16;
+                        output += 12;
+                    }
+                }
+#endif
+                while (encodedEnd - encoded >= 4) {
+                    std::uint8_t first { table[static_cast<std::uint8_t> (encoded[0])] };
+                    std::uint8_t second { table[static_cast<std::uint8_t> (encoded[1])] };
+                    std::uint8_t third { table[static_cast<std::uint8_t> (encoded[2])] };
+                    std::uint8_t fourth { table[static_cast<std::uint8_t> (encoded[3])] };
+                    if ((first | second | third | fourth) & 0xC0) {
+                        break;
+                    }
+                    *output++ = static_cast<char> ((first << 2) | (second >> 4));
+                    *output++ = static_cast<char> ((second << 4) | (third >> 2));
+                    *output++ = static_cast<char> ((third << 6) | fourth);
+                    encoded += 4;
+                }
+                if (encoded == encodedEnd) {
+                    break;
+                }
+            }
+
+            // Single character (partial group, padding or character to skip)
+
+            std::uint8_t value { table[static_cast<std::uint8_t> (*encoded++)] };
+
+            if (value == kInvalid) {
+                continue;
+            } else if (value == kPad) {
+                if (m_quartetCount >= 2) {
+                    *output++ = static_cast<char> ((m_quartet[0] << 2) | (m_quartet[1] >> 4));
+                    if (m_quartetCount == 3) {
+                        *output++ = static_cast<char> ((m_quartet[1] << 4) | (m_quartet[2] >> 2));
+                    }
+                }
+                m_quartetCount = 0;
+                continue;
+            }
+
+            m_quartet[m_quartetCount++] = value;
+            if (m_quartetCount == 4) {
+                *output++ = static_cast<char> ((m_quartet[0] << 2) | (m_quartet[1] >> 4));
+                *output++ = static_cast<char> ((m_quartet[1] << 4) | (m_quartet[2] >> 2));
+                *output++ = static_cast<char> ((m_quartet[2] << 6) | m_quartet[3]);
+                m_quartetCount = 0;
+            }
+
+        }
+
+        return (output);
+
+    }
+
+    std::uint8_t m_quartet[4] {};   // Partial group of decoded characters
+    int m_quartetCount { 0 };      // Characters in partial group
+
+};
+
+//
+// Streaming base64 encoder producing CRLF terminated lines.
+//
+
+class Base64Encoder {
+public:
+
+    static constexpr std::size_t kLineLength { 76 };
+
+    //
+    // Encode a block of data appending the text to encoded. Up to two bytes that do
+    // not make a whole group are kept for the next call.
+    //
+
+    void encode(const char *data, std::size_t length, std::string &encoded) {
+
+        const std::uint8_t *input { reinterpret_cast<const std::uint8_t *> (data) };
+        const std::uint8_t *inputEnd { input + length };
+
+        // Complete any partial group from last call
+
+        while ((m_tripletCount != 0) && (input < inputEnd)) {
+            m_triplet[m_tripletCount++] = *input++;
+            if (m_tripletCount == 3) {
+                appendGroup(encoded, m_triplet[0], m_triplet[1], m_triplet[2]);
+                m_tripletCount = 0;
+            }
+        }
+
+        encoded.reserve(encoded.size() + ((inputEnd - input) / 3 + 1) * 4 * (kLineLength + 2) / kLineLength + 4);
+
+        for (; inputEnd - input >= 3; input += 3) {
+            appendGroup(encoded, input[0], input[1], input[2]);
+        }
+
+        while (input < inputEnd) {
+            m_triplet[m_tripletCount++] = *input++;
+        }
+
+    }
+
+    //
+    // Encode final partial group with padding and terminate the last line.
+    //
+
+    void finish(std::string &encoded) {
+        const char *alphabet { kAlphabet };
+        if (m_tripletCount) {
+            std::uint8_t second { m_tripletCount == 2 ? m_triplet[1] : std::uint8_t(0) };
+            appendCharacter(encoded, alphabet[m_triplet[0] >> 2]);
+            appendCharacter(encoded, alphabet[((m_triplet[0] & 0x03) << 4) | (second >> 4)]);
+            appendCharacter(encoded, (m_tripletCount == 2) ? alphabet[(second & 0x0F) << 2] : '=');
+            appendCharacter(encoded, '=');
+            m_tripletCount = 0;
+        }
+        if (m_lineLength) {
+            encoded += "\r\n";
+            m_lineLength = 0;
+        }
+    }
+
+private:
+
+    static constexpr const char *kAlphabet { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" };
+
+    void appendCharacter(std::string &encoded, char character) {
+        encoded.push_back(character);
+        if (++m_lineLength == kLineLength) {
+            encoded += "\r\n";
+            m_lineLength = 0;
+        }
+    }
+
+    void appendGroup(std::string &encoded, std::uint8_t first, std::uint8_t second, std::uint8_t third) {
+        if (m_lineLength + 4 <= kLineLength) {
+            char group[4] { kAlphabet[first >> 2], kAlphabet[((first & 0x03) << 4) | (second >> 4)],
+                kAlphabet[((second & 0x0F) << 2) | (third >> 6)], kAlphabet[third & 0x3F] };
+            encoded.append(group, 4);
+            m_lineLength += 4;
+            if (m_lineLength == kLineLength) {
+                encoded += "\r\n";
+                m_lineLength = 0;
+            }
+        } else {
+            appendCharacter(encoded, kAlphabet[first >> 2]);
+            appendCharacter(encoded, kAlphabet[((first & 0x03) << 4) | (second >> 4)]);
+            appendCharacter(encoded, kAlphabet[((second & 0x0F) << 2) | (third >> 6)]);
+            appendCharacter(encoded, kAlphabet[third & 0x3F]);
+        }
+    }
+
+    std::uint8_t m_triplet[3] {};    // Partial group of input bytes
+    int m_tripletCount { 0 };       // Bytes in partial group
+    std::size_t m_lineLength { 0 }; // Characters on current output line
+
+};
+
+#endif /* BASE64CODEC_HPP */
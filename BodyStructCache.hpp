@@ -0,0 +1,132 @@
+#ifndef BODYSTRUCTCACHE_HPP
+#define BODYSTRUCTCACHE_HPP
+
+//
+// Header: BodyStructCache
+//
+// Description: Memoized BODYSTRUCTURE attachment parsing for the mail example
+// programs. Most messages in a large mailbox share a handful of layouts
+// (newsletters, notifications) and so have identical BODYSTRUCTURE strings; the list
+// of attachments found for a string is kept and returned for any later identical
+// string without building and walking a CIMAPBodyStruct tree again. The walk
+// data passed to CIMAPBodyStruct::attachmentFn is allocated once and reused for
+// every parse, and each tree is released as soon as it has been walked.
+//
+// Dependencies: C11++, Classes (CIMAPBodyStruct).
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+//
+// Antik Classes
+//
+
+#include "CIMAPBodyStruct.hpp"
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class BodyStructCache {
+public:
+
+    //
+    // Maximum number of distinct BODYSTRUCTURE strings cached; once reached any
+    // further new strings are parsed but not added.
+    //
+
+    static constexpr std::size_t kMaxCachedBodyStructs { 4096 };
+
+    explicit BodyStructCache(bool bCache = true, std::size_t maxCached = kMaxCachedBodyStructs)
+    : m_bCache{ bCache}, m_maxCached{ maxCached}, m_attachmentData{ new Antik::IMAP::CIMAPBodyStruct::AttachmentData()} {
+    }
+
+    BodyStructCache(const BodyStructCache &orig) = delete;
+    BodyStructCache& operator=(const BodyStructCache &orig) = delete;
+
+    //
+    // Return attachments for a BODYSTRUCTURE (attachment index fields are not set).
+    // The reference is valid until the next call.
+    //
+
+    const std::vector<Antik::IMAP::CIMAPBodyStruct::Attachment>& attachments(const std::string &bodyStructure) {
+
+        if (m_bCache) {
+            auto cached = m_cache.find(bodyStructure);
+            if (cached != m_cache.end()) {
+                m_hits++;
+                return (cached->second);
+            }
+        }
+
+        m_misses++;
+
+        parse(bodyStructure);
+
+        if (m_bCache && (m_cache.size() < m_maxCached)) {
+            return (m_cache.emplace(bodyStructure, m_parsed).first->second);
+        }
+
+        return (m_parsed);
+
+    }
+
+    std::uint64_t hits() const {
+        return (m_hits);
+    }
+
+    std::uint64_t misses() const {
+        return (m_misses);
+    }
+
+private:
+
+    //
+    // Build tree for BODYSTRUCTURE and walk it collecting attachments.
+    //
+
+    void parse(const std::string &bodyStructure) {
+
+        using Antik::IMAP::CIMAPBodyStruct;
+
+        auto attachmentData = static_cast<CIMAPBodyStruct::AttachmentData *> (m_attachmentData.get());
+
+        attachmentData->attachmentsList.clear();
+
+        {
+            std::unique_ptr<CIMAPBodyStruct::BodyNode> treeBase{ new CIMAPBodyStruct::BodyNode()};
+            CIMAPBodyStruct::consructBodyStructTree(treeBase, bodyStructure);
+            CIMAPBodyStruct::walkBodyStructTree(treeBase, CIMAPBodyStruct::attachmentFn, m_attachmentData);
+        }
+
+        m_parsed.swap(attachmentData->attachmentsList);
+
+    }
+
+    bool m_bCache { true };                  // == true cache attachment lists
+    std::size_t m_maxCached { 0 };           // Maximum cached BODYSTRUCTURE strings
+    std::shared_ptr<void> m_attachmentData;  // Reused attachmentFn walk data
+    std::vector<Antik::IMAP::CIMAPBodyStruct::Attachment> m_parsed; // Last parsed attachments
+    std::unordered_map<std::string, std::vector<Antik::IMAP::CIMAPBodyStruct::Attachment>> m_cache;
+    std::uint64_t m_hits { 0 };              // Attachment lists returned from cache
+    std::uint64_t m_misses { 0 };            // BODYSTRUCTURE strings parsed
+
+};
+
+#endif /* BODYSTRUCTCACHE_HPP */
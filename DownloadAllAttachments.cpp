@@ -16,9 +16,17 @@
 //   -p [ --password ] arg    User password
 //   -m [ --mailbox ] arg     Mailbox name
 //   -d [ --destination ] arg Destination for attachments
+//   -b [ --batch ] arg (=1)  Maximum messages per attachment FETCH
+//   -n [ --connections ] arg (=1) Number of IMAP connections fetching attachments
+//   --nocache                Parse every BODYSTRUCTURE (do not reuse results for identical ones)
+//   --compress               Fetch attachments using COMPRESS=DEFLATE if the server supports it
+//
+// Note: With --compress attachments are fetched over IMAPStreamConnection sessions that
+// negotiate RFC 4978 COMPRESS=DEFLATE after login (base64 bodies shrink by about 3-4x). 
 // 
 // Dependencies: C11++, Classes (CFile, CPath, CMailIMAP, CMailIMAPParse, 
-//               CMailIMAPBodyStruct), Linux, Boost C++ Libraries.
+//               CMailIMAPBodyStruct, Base64Codec, BodyStructCache, IMAPStreamConnection),
+//               Linux, Boost C++ Libraries, zlib.
 //
  
 // =============
@@ -31,6 +39,16 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
 
 //
 // Antik Classes
@@ -42,6 +60,9 @@
 #include "CSMTP.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "Base64Codec.hpp"
+#include "BodyStructCache.hpp"
+#include "IMAPStreamConnection.hpp"
 
 using namespace Antik::IMAP;
 using namespace Antik::SMTP;
@@ -70,8 +91,115 @@ struct ParamArgData {
     std::string mailBoxName;         // Mailbox name
     std::string destinationFolder;   // Destination folder for attachments
     std::string configFileName;      // Configuration file name
+    int batchSize { 1 };             // Maximum messages per attachment FETCH
+    int connections { 1 };           // Number of IMAP connections used
+    bool bNoCache { false };         // == true parse every BODYSTRUCTURE
+    bool bCompress { false };        // == true COMPRESS=DEFLATE attachment sessions
 };
 
+//
+// Attachments fetched with one FETCH; a set of messages that all have the same
+// attachment parts.
+//
+
+struct AttachmentFetch {
+    std::vector<std::string> partNos;                        // Parts fetched from each message
+    std::vector<std::uint64_t> indexes;                      // Message indexes
+    std::vector<CIMAPBodyStruct::Attachment> attachments;    // Attachments of all messages
+};
+
+//
+// Bounded queue of fetched attachments decoded and written by a background thread
+// so that disk I/O overlaps fetching. write() blocks while more than the maximum
+// number of encoded bytes are waiting (a single larger attachment is always
+// accepted).
+//
+
+typedef std::function<void(const CPath &, const std::string &)> AttachmentWriteFn;
+
+class AttachmentWriter {
+public:
+
+    AttachmentWriter(AttachmentWriteFn writeFn, std::size_t maxQueuedBytes)
+    : m_writeFn{ writeFn}, m_maxQueuedBytes{ maxQueuedBytes}, m_writerThread{ &AttachmentWriter::writeQueued, this} {
+    }
+
+    ~AttachmentWriter() {
+        finish();
+    }
+
+    void write(const CPath &filePath, std::string &&encodedContents) {
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        m_queueSpace.wait(lock, [this, &encodedContents] {
+            return (m_queuedBytes == 0 || m_queuedBytes + encodedContents.size() <= m_maxQueuedBytes);
+        });
+        m_queuedBytes += encodedContents.size();
+        m_queue.emplace_back(filePath.toString(), std::move(encodedContents));
+        m_queueData.notify_one();
+    }
+
+    //
+    // Write any queued attachments and stop writer thread.
+    //
+
+    void finish() {
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_bFinished = true;
+        }
+        m_queueData.notify_one();
+        if (m_writerThread.joinable()) {
+            m_writerThread.join();
+        }
+    }
+
+private:
+
+    void writeQueued() {
+        for (;;) {
+            std::pair<std::string, std::string> attachment;
+            {
+                std::unique_lock<std::mutex> lock(m_queueMutex);
+                m_queueData.wait(lock, [this] { return (m_bFinished || !m_queue.empty()); });
+                if (m_queue.empty()) {
+                    return;
+                }
+                attachment = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_writeFn(CPath(attachment.first), attachment.second);
+            {
+                std::unique_lock<std::mutex> lock(m_queueMutex);
+                m_queuedBytes -= attachment.second.size();
+            }
+            m_queueSpace.notify_all();
+        }
+    }
+
+    AttachmentWriteFn m_writeFn;                             // Decode and write attachment
+    std::size_t m_maxQueuedBytes;                            // Maximum encoded bytes queued
+    std::size_t m_queuedBytes { 0 };                         // Encoded bytes queued
+    std::deque<std::pair<std::string, std::string>> m_queue; // Attachments to write (file name, contents)
+    bool m_bFinished { false };                              // == true no more attachments
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueData;
+    std::condition_variable m_queueSpace;
+    std::thread m_writerThread;                              // Declared last; started in constructor
+
+};
+
+//
+// Encoded attachment text is decoded and written in blocks of this size.
+//
+
+constexpr std::size_t kDecodeBlockSize { 1024 * 1024 };
+
+//
+// Maximum encoded attachment bytes waiting to be written.
+//
+
+constexpr std::size_t kMaxQueuedBytes { 64 * 1024 * 1024 };
+
 // ===============
 // LOCAL FUNCTIONS
 // ===============
@@ -100,7 +228,11 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("mailbox,m", po::value<std::string>(&argData.mailBoxName)->required(), "Mailbox name")
-            ("destination,d", po::value<std::string>(&argData.destinationFolder)->required(), "Destination for attachments");
+            ("destination,d", po::value<std::string>(&argData.destinationFolder)->required(), "Destination for attachments")
+            ("batch,b", po::value<int>(&argData.batchSize)->default_value(1), "Maximum messages per attachment FETCH")
+            ("connections,n", po::value<int>(&argData.connections)->default_value(1), "Number of IMAP connections fetching attachments")
+            ("nocache", "Parse every BODYSTRUCTURE (do not reuse results for identical ones)")
+            ("compress", "Fetch attachments using COMPRESS=DEFLATE if the server supports it");
 
 }
 //
@@ -150,6 +282,22 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
         po::notify(vm);
 
+        if (vm.count("nocache")) {
+            argData.bNoCache = true;
+        }
+
+        if (vm.count("compress")) {
+            argData.bCompress = true;
+        }
+
+        if (argData.batchSize < 1) {
+            throw po::error("Batch size must be at least one.");
+        }
+
+        if (argData.connections < 1) {
+            throw po::error("Number of connections must be at least one.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "DownloadAllAttachments Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -159,78 +307,231 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 }
 
 //
-// Download an attachment, decode it and write to local folder.
+// Decode an attachment and write it to local folder.
+//
+
+static void writeAttachmentFile(const CPath &fullFilePath, const std::string &encodedContents) {
+
+    if (!CFile::exists(fullFilePath)) {
+        std::string decodedString;
+        std::ofstream attachmentFileStream(fullFilePath.toString(), std::ios::binary);
+        if (attachmentFileStream.is_open()) {
+            std::cout << "Creating [" << fullFilePath.toString() << "]" << std::endl;
+            // Decode a block at a time (line breaks are skipped by the decoder)
+            Base64Decoder decoder;
+            for (std::size_t position = 0; position < encodedContents.size(); position += kDecodeBlockSize) {
+                decodedString.clear();
+                decoder.decode(encodedContents.data() + position,
+                        std::min(kDecodeBlockSize, encodedContents.size() - position), decodedString);
+                attachmentFileStream.write(decodedString.data(), decodedString.size());
+            }
+            decodedString.clear();
+            decoder.finish(decodedString);
+            attachmentFileStream.write(decodedString.data(), decodedString.size());
+        } else {
+            std::cout << "Failed to create file [" << fullFilePath.toString() << "]" << std::endl;
+        }
+    }
+
+}
+
+//
+// Fetch the attachments for a group of messages with one FETCH and queue them to be
+// written (over a CIMAP or IMAPStreamConnection session).
 //
 
-static void downloadAttachment(CIMAP& imap, const CPath &destinationFolder, CIMAPBodyStruct::Attachment &attachment) {
+template <typename IMAPConnection>
+static void fetchAttachments(IMAPConnection& imap, const CPath &destinationFolder, AttachmentFetch &attachmentFetch, AttachmentWriter &attachmentWriter) {
 
-    std::string commandLine("FETCH " + attachment.index + " BODY[" + attachment.partNo + "]");
+    std::string sequenceSet, bodyParts;
+
+    for (auto index : attachmentFetch.indexes) {
+        sequenceSet += (sequenceSet.empty() ? "" : ",") + std::to_string(index);
+    }
+    for (auto &partNo : attachmentFetch.partNos) {
+        bodyParts += (bodyParts.empty() ? "BODY[" : " BODY[") + partNo + "]";
+    }
+
+    std::string commandLine("FETCH " + sequenceSet + " (" + bodyParts + ")");
     std::string parsedResponseStr(imap.sendCommand(commandLine));
     CIMAPParse::COMMANDRESPONSE parsedResponse(CIMAPParse::parseResponse(parsedResponseStr));
 
+    parsedResponseStr.clear();
+
     if ((parsedResponse->status == CIMAPParse::RespCode::BAD) ||
             (parsedResponse->status == CIMAPParse::RespCode::NO)) {
         throw CIMAP::Exception("IMAP FETCH "+parsedResponse->errorMessage);
     }
 
-    for (auto fetchEntry : parsedResponse->fetchList) {
-
-        for (auto resp : fetchEntry.responseMap) {
-
-            if (resp.first.find("BODY[" + attachment.partNo + "]") == 0) {  
-                
-                CPath fullFilePath = { destinationFolder };
-                fullFilePath.join(attachment.fileName);
-
-                if (!CFile::exists(fullFilePath)) {
-                    std::string decodedString;
-                    std::istringstream responseStream(resp.second);
-                    std::ofstream attachmentFileStream(fullFilePath.toString(), std::ios::binary);
-                    if (attachmentFileStream.is_open()) {
-                        std::cout << "Creating [" << fullFilePath.toString() << "]" << std::endl;
-                        // Encoded lines have terminating '\r\n' the getline removes '\n'
-                        for (std::string line; std::getline(responseStream, line, '\n');) {
-                            line.pop_back(); // Remove '\r'
-                            CSMTP::decodeFromBase64(line, decodedString, line.length());
-                            attachmentFileStream.write(&decodedString[0], decodedString.length());
-                        }
-                    } else {
-                        std::cout << "Failed to create file [" << fullFilePath.toString() << "]" << std::endl;
-                    }
+    for (auto &fetchEntry : parsedResponse->fetchList) {
+        for (auto &attachment : attachmentFetch.attachments) {
+            if (attachment.index != std::to_string(fetchEntry.index)) {
+                continue;
+            }
+            for (auto &resp : fetchEntry.responseMap) {
+                if (resp.first.find("BODY[" + attachment.partNo + "]") == 0) {
+                    CPath fullFilePath = { destinationFolder };
+                    fullFilePath.join(attachment.fileName);
+                    attachmentWriter.write(fullFilePath, std::move(resp.second));
+                    break;
                 }
-
             }
         }
     }
+
 }
 
 //
-// For a passed in BODTSTRUCTURE parse and download any base64 encoded attachments.
+// For a passed in BODTSTRUCTURE parse and add any base64 encoded attachments not
+// already downloaded to the fetch groups. Messages with the same attachment
+// parts are fetched together up to batchSize messages per FETCH.
 //
 
-static void getBodyStructAttachments(CIMAP& imap, std::uint64_t index, const CPath &destinationFolder, const std::string& bodyStructure) {
+static void getBodyStructAttachments(std::uint64_t index, const CPath &destinationFolder, const std::string& bodyStructure,
+        int batchSize, BodyStructCache &bodyStructCache, std::vector<AttachmentFetch> &attachmentFetches,
+        std::set<std::string> &attachmentFiles) {
 
-    std::unique_ptr<CIMAPBodyStruct::BodyNode> treeBase{ new CIMAPBodyStruct::BodyNode()};
-    std::shared_ptr<void> attachmentData{ new CIMAPBodyStruct::AttachmentData()};
+    const std::vector<CIMAPBodyStruct::Attachment> &attachmentsList { bodyStructCache.attachments(bodyStructure) };
 
-    CIMAPBodyStruct::consructBodyStructTree(treeBase, bodyStructure);
-    CIMAPBodyStruct::walkBodyStructTree(treeBase, CIMAPBodyStruct::attachmentFn, attachmentData);
+    if (!attachmentsList.empty()) {
 
-    auto attachments = static_cast<CIMAPBodyStruct::AttachmentData *> (attachmentData.get());
+        std::vector<CIMAPBodyStruct::Attachment> messageAttachments;
+        std::vector<std::string> partNos;
 
-    if (!attachments->attachmentsList.empty()) {
-        for (auto attachment : attachments->attachmentsList) {
+        for (auto attachment : attachmentsList) {
             if (CIMAPParse::stringStartsWith (attachment.encoding, CSMTP::kEncodingBase64)) {
+                CPath fullFilePath = { destinationFolder };
+                fullFilePath.join(attachment.fileName);
+                if (CFile::exists(fullFilePath) || !attachmentFiles.insert(fullFilePath.toString()).second) {
+                    continue;
+                }
                 attachment.index = std::to_string(index);
-                downloadAttachment(imap, destinationFolder, attachment);
+                partNos.push_back(attachment.partNo);
+                messageAttachments.push_back(attachment);
             } else {
                 std::cout << "Attachment not base64 encoded but " << attachment.encoding << "]" << std::endl;
             }
         }
+
+        if (messageAttachments.empty()) {
+            return;
+        }
+
+        // Add to last fetch group for the same parts if it has room
+
+        auto attachmentFetch = std::find_if(attachmentFetches.rbegin(), attachmentFetches.rend(),
+                [&partNos](const AttachmentFetch & fetch) { return (fetch.partNos == partNos); });
+
+        if ((attachmentFetch == attachmentFetches.rend()) ||
+                (attachmentFetch->indexes.size() >= static_cast<std::size_t> (batchSize))) {
+            attachmentFetches.push_back({ partNos, {}, {} });
+            attachmentFetch = attachmentFetches.rbegin();
+        }
+
+        attachmentFetch->indexes.push_back(index);
+        attachmentFetch->attachments.insert(attachmentFetch->attachments.end(),
+                messageAttachments.begin(), messageAttachments.end());
+
     } else {
         std::cout << "No attachments present." << std::endl;
     }
 
+}
+
+//
+// SELECT mailbox.
+//
+
+template <typename IMAPConnection>
+static void selectMailBox(IMAPConnection& imap, const std::string &mailBoxName) {
+
+    std::string comandResponse { imap.sendCommand("SELECT "+mailBoxName) };
+    CIMAPParse::COMMANDRESPONSE parsedResponse { CIMAPParse::parseResponse(comandResponse) };
+    if (parsedResponse->status != CIMAPParse::RespCode::OK) {
+        throw CIMAP::Exception("IMAP SELECT "+parsedResponse->errorMessage);
+    } else if (parsedResponse->byeSent) {
+        throw CIMAP::Exception("Received BYE from server: " + parsedResponse->errorMessage);
+    }
+
+}
+
+//
+// Connect a session used to fetch attachments.
+//
+
+static void connectSession(CIMAP &imap, const ParamArgData &argData) {
+    imap.setServer(argData.serverURL);
+    imap.setUserAndPassword(argData.userName, argData.userPassword);
+    imap.connect();
+}
+
+static void connectSession(IMAPStreamConnection &imapStream, const ParamArgData &argData) {
+    imapStream.setServer(argData.serverURL);
+    imapStream.setUserAndPassword(argData.userName, argData.userPassword);
+    imapStream.setCompression(true);
+    imapStream.connect();
+    if (!imapStream.getCompressedStatus()) {
+        std::cout << "Server does not support COMPRESS=DEFLATE; fetching uncompressed." << std::endl;
+    }
+}
+
+//
+// Connect a session, SELECT the mailbox and fetch the next fetch group until there
+// are none left.
+//
+
+template <typename IMAPConnection>
+static void fetchAttachmentGroups(IMAPConnection &imap, const ParamArgData &argData, std::vector<AttachmentFetch> &attachmentFetches,
+        std::atomic<std::size_t> &nextFetch, AttachmentWriter &attachmentWriter) {
+    connectSession(imap, argData);
+    selectMailBox(imap, argData.mailBoxName);
+    for (std::size_t fetch = nextFetch++; fetch < attachmentFetches.size(); fetch = nextFetch++) {
+        fetchAttachments(imap, argData.destinationFolder, attachmentFetches[fetch], attachmentWriter);
+    }
+    imap.disconnect();
+}
+
+//
+// Fetch attachments across a pool of IMAP connections (compressed sessions with
+// --compress); each connection takes the next fetch group until there are none left.
+//
+
+static void fetchAttachmentsParallel(const ParamArgData &argData, std::vector<AttachmentFetch> &attachmentFetches,
+        AttachmentWriter &attachmentWriter) {
+
+    std::atomic<std::size_t> nextFetch { 0 };
+    std::exception_ptr workerException;
+    std::mutex exceptionMutex;
+
+    auto fetchWorker = [&]() {
+        try {
+            if (argData.bCompress) {
+                IMAPStreamConnection imapStream;
+                fetchAttachmentGroups(imapStream, argData, attachmentFetches, nextFetch, attachmentWriter);
+            } else {
+                CIMAP imap;
+                fetchAttachmentGroups(imap, argData, attachmentFetches, nextFetch, attachmentWriter);
+            }
+        } catch (...) {
+            std::unique_lock<std::mutex> lock(exceptionMutex);
+            if (!workerException) {
+                workerException = std::current_exception();
+            }
+            nextFetch = attachmentFetches.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int connection = 0; connection < std::min<int>(argData.connections, attachmentFetches.size()); connection++) {
+        workers.emplace_back(fetchWorker);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    if (workerException) {
+        std::rethrow_exception(workerException);
+    }
 
 }
 
@@ -246,13 +547,15 @@ int main(int argc, char** argv) {
         CIMAP imap;
         std::string comandResponse;
         CIMAPParse::COMMANDRESPONSE  parsedResponse;
+        std::vector<AttachmentFetch> attachmentFetches;
+        std::set<std::string> attachmentFiles;
 
         // Read in command line parameters and process
 
         procCmdLine(argc, argv, argData);
 
         // Set mail account user name and password
-        
+
         imap.setServer(argData.serverURL);
         imap.setUserAndPassword(argData.userName, argData.userPassword);
 
@@ -263,7 +566,7 @@ int main(int argc, char** argv) {
             std::cout << "Creating destination folder = [" << argData.destinationFolder << "]" << std::endl;
             CFile::createDirectory(argData.destinationFolder);
         }
-        
+
         // Connect
  
         std::cout << "Connecting to server [" << argData.serverURL << "]" << std::endl;
@@ -271,17 +574,13 @@ int main(int argc, char** argv) {
         imap.connect();
 
         // SELECT mailbox
-        
-        comandResponse=imap.sendCommand("SELECT "+argData.mailBoxName);
-        parsedResponse = CIMAPParse::parseResponse(comandResponse);
-        if (parsedResponse->status != CIMAPParse::RespCode::OK) {
-            throw CIMAP::Exception("IMAP SELECT "+parsedResponse->errorMessage);
-        } else if (parsedResponse->byeSent) {
-            throw CIMAP::Exception("Received BYE from server: " + parsedResponse->errorMessage);
-        }
+
+        selectMailBox(imap, argData.mailBoxName);
 
         // FETCH BODYSTRUCTURE for all mail
-        
+
+        BodyStructCache bodyStructCache(!argData.bNoCache);
+
         comandResponse=imap.sendCommand("FETCH 1:* BODYSTRUCTURE");
         parsedResponse = CIMAPParse::parseResponse(comandResponse);
         if (parsedResponse->status != CIMAPParse::RespCode::OK) {
@@ -293,17 +592,33 @@ int main(int argc, char** argv) {
         std::cout << "COMMAND = " << CIMAPParse::commandCodeString(parsedResponse->command) << std::endl;
 
         //  Take decoded response and get any attachments specified in BODYSTRUCTURE.
-        
+
         for (auto fetchEntry : parsedResponse->fetchList) {
             std::cout << "EMAIL INDEX [" << fetchEntry.index << "]" << std::endl;
             for (auto resp : fetchEntry.responseMap) {
                 if (resp.first.compare(kBODYSTRUCTURE) == 0) {
-                    getBodyStructAttachments(imap, fetchEntry.index, argData.destinationFolder,resp.second);
+                    getBodyStructAttachments(fetchEntry.index, argData.destinationFolder, resp.second,
+                            argData.batchSize, bodyStructCache, attachmentFetches, attachmentFiles);
                 } else {
                     std::cout << resp.first << " = " << resp.second << std::endl;
                 }
             }
         }
+
+        // Fetch attachments; they are decoded and written in the background. Compressed
+        // fetches use their own session(s) so always go through the pool.
+
+        AttachmentWriter attachmentWriter(writeAttachmentFile, kMaxQueuedBytes);
+
+        if ((argData.connections > 1) || argData.bCompress) {
+            fetchAttachmentsParallel(argData, attachmentFetches, attachmentWriter);
+        } else {
+            for (auto &attachmentFetch : attachmentFetches) {
+                fetchAttachments(imap, argData.destinationFolder, attachmentFetch, attachmentWriter);
+            }
+        }
+
+        attachmentWriter.finish();
          
         std::cout << "Disconnecting from server [" << argData.serverURL << "]" << std::endl;
 
@@ -12,8 +12,9 @@
 //   -c [ --config ] arg         Config File Name
 //   -d [ --destination ] arg    Destination folder for extract
 //   -z [ --zip ] arg            ZIP Archive Name
+//   -t [ --threads ] arg (=1)   Number of threads used to extract files
 // 
-// Dependencies: C11++, Classes (CFileZIP,Path,CFile), Linux, Boost C++ Libraries.
+// Dependencies: C11++, Classes (CFileZIP,Path,CFile), Linux, Boost C++ Libraries, zlib.
 //
 
 // =============
@@ -29,12 +30,18 @@
 #include <thread>
 #include <iomanip>
 #include <fstream>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <filesystem>
 
 //
 // Antik Classes
 //
 
 #include "CZIP.hpp"
+#include "ZIPArchiveReader.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
 
@@ -61,6 +68,7 @@ struct ParamArgData {
     std::string configFileName;        // Configuration file name
     std::string zipFileName;           // ZIP Archive File Name
     std::string destinationFolderName; // Destination folder
+    int threads { 1 };                 // Number of extraction threads
 };
 
 // ===============
@@ -86,7 +94,8 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
 
     commonOptions.add_options()
             ("destination,d", po::value<std::string>(&argData.destinationFolderName)->required(), "Destination folder for extract")
-            ("zip,z", po::value<std::string>(&argData.zipFileName)->required(), "ZIP Archive Name");
+            ("zip,z", po::value<std::string>(&argData.zipFileName)->required(), "ZIP Archive Name")
+            ("threads,t", po::value<int>(&argData.threads)->default_value(1), "Number of threads used to extract files");
 
 }
 
@@ -141,6 +150,10 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
         po::notify(vm);
 
+        if (argData.threads < 1) {
+            throw po::error("Number of threads must be at least one.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "ExtractToFolder Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -149,6 +162,99 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
 }
 
+//
+// Return destination path for an archive entry; names that would escape the
+// destination folder are rejected.
+//
+
+static std::filesystem::path destinationPath(const std::string &destinationFolderName, const std::string &fileName) {
+
+    std::filesystem::path entryPath { std::filesystem::path(fileName).lexically_normal() };
+
+    if (entryPath.is_absolute() || (!entryPath.empty() && (*entryPath.begin() == ".."))) {
+        throw std::runtime_error("Archive entry [" + fileName + "] is outside destination folder.");
+    }
+
+    return (std::filesystem::path(destinationFolderName) / entryPath);
+
+}
+
+//
+// Create in one pass every directory needed to extract a list of entries.
+//
+
+static void createDestinationDirectories(const std::string &destinationFolderName, const std::vector<std::string> &fileNames) {
+
+    std::set<std::filesystem::path> directories;
+
+    // Directory entries end in '/' so their parent path is the directory itself
+
+    for (auto &fileName : fileNames) {
+        directories.insert(destinationPath(destinationFolderName, fileName).parent_path());
+    }
+
+    for (auto &directory : directories) {
+        std::filesystem::create_directories(directory);
+    }
+
+}
+
+//
+// Extract archive in parallel. The central directory is read once and each worker
+// thread then takes the next entry and inflates it straight from the read-only
+// mapping of the archive so no file position is shared between threads.
+//
+
+static void extractArchiveParallel(const ParamArgData &argData) {
+
+    ZIPArchiveReader zipReader { argData.zipFileName };
+    std::vector<ZIPArchiveEntry> zipContents { zipReader.centralDirectory() };
+    std::vector<std::string> fileNames;
+
+    for (auto &entry : zipContents) {
+        fileNames.push_back(entry.fileName);
+    }
+
+    createDestinationDirectories(argData.destinationFolderName, fileNames);
+
+    std::atomic<std::size_t> nextEntry { 0 };
+    std::exception_ptr workerException;
+    std::mutex outputMutex;
+
+    auto extractWorker = [&]() {
+        try {
+            for (std::size_t index = nextEntry++; index < zipContents.size(); index = nextEntry++) {
+                if (zipContents[index].isDirectory()) {
+                    continue;
+                }
+                std::string fileName { destinationPath(argData.destinationFolderName, zipContents[index].fileName).string() };
+                zipReader.extract(zipContents[index], fileName);
+                std::unique_lock<std::mutex> lock(outputMutex);
+                std::cout << "Extracted [" << fileName << "]" << std::endl;
+            }
+        } catch (...) {
+            std::unique_lock<std::mutex> lock(outputMutex);
+            if (!workerException) {
+                workerException = std::current_exception();
+            }
+            nextEntry = zipContents.size();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int thread = 0; thread < argData.threads; thread++) {
+        workers.emplace_back(extractWorker);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    if (workerException) {
+        std::rethrow_exception(workerException);
+    }
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -163,7 +269,17 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
-        if (!argData.zipFileName.empty()) {
+        if (!argData.zipFileName.empty() && (argData.threads > 1)) {
+
+            // Create destination folder
+
+            if (!CFile::exists(argData.destinationFolderName)) {
+                CFile::createDirectory(argData.destinationFolderName);
+            }
+
+            extractArchiveParallel(argData);
+
+        } else if (!argData.zipFileName.empty()) {
 
             CZIP zipFile(argData.zipFileName);
 
@@ -179,14 +295,18 @@ int main(int argc, char** argv) {
             
             std::vector<CZIP::FileDetail> zipContents(zipFile.contents());
 
-            // For each file create any directory hierarchy needed and extract file.
+            // Create any directory hierarchy needed up front then extract each file.
+
+            std::vector<std::string> fileNames;
+            for (auto & file : zipContents) {
+                fileNames.push_back(file.fileName);
+            }
+
+            createDestinationDirectories(argData.destinationFolderName, fileNames);
             
             for (auto & file : zipContents) {
                 CPath destinationPath { argData.destinationFolderName };
                 destinationPath.join(file.fileName);          
-                if (!CFile::exists(destinationPath)) {
-                    CFile::createDirectory(destinationPath);
-                }
                 if (zipFile.extract(file.fileName, destinationPath.toString())) {
                     std::cout << "Extracted [" << destinationPath.toString() << "]" << std::endl;
                 }
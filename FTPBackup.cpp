@@ -2,7 +2,8 @@
 // Program: FTPBackup
 //
 // Description: Simple FTP backup program that takes a local directory and backs it up
-// to a specified FTP server using account details provided.
+// to a specified FTP server using account details provided. Files may be spread over
+// a pool of server connections.
 //
 // Dependencies: C11++, Classes (CFTP, CFile, CPath, CSocket), Boost C++ Libraries.
 //
@@ -15,6 +16,11 @@
 //   -u [ --user ] arg      Account username
 //   -p [ --password ] arg  User password
 //   -l [ --local ] arg     Local Directory to backup
+//   -n [ --connections ] arg (=1) Number of server connections used for transfer
+//   --incremental          Only backup files changed since last run
+//   --manifest arg         Incremental backup manifest file
+//   --hash                 Use content hash to detect changed files
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 
 // =============
 // INCLUDE FILES
@@ -26,14 +32,19 @@
 
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
 
 //
 // Antik Classes
 //
 
 #include "FTPUtil.hpp"
+#include "FTPConnectionPool.hpp"
+#include "BackupManifest.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
 
 using namespace Antik;
 using namespace Antik::FTP;
@@ -60,6 +71,11 @@ struct ParamArgData {
     std::string serverPort;       // FTP server port
     std::string localDirectory;   // Local directory to backup
     std::string configFileName;   // Configuration file name
+    int connections { 1 };        // Number of server connections used for transfer
+    std::string manifestFileName; // Incremental backup manifest file
+    bool bIncremental { false };  // == true only backup files changed since last run
+    bool bHash { false };         // == true use content hash to detect changed files
+    std::string statsFileName;    // Transfer stats summary file
 };
 
 // ===============
@@ -76,6 +92,15 @@ static void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -91,7 +116,12 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("port,o", po::value<std::string>(&argData.serverPort)->required(), "FTP Server port")
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory to backup");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory to backup")
+            ("connections,n", po::value<int>(&argData.connections)->default_value(1), "Number of server connections used for transfer")
+            ("incremental", "Only backup files changed since last run")
+            ("manifest", po::value<std::string>(&argData.manifestFileName), "Incremental backup manifest file")
+            ("hash", "Use content hash to detect changed files")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -140,8 +170,24 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Incremental backup using manifest
+
+        if (vm.count("incremental")) {
+            argData.bIncremental = true;
+        }
+
+        // Detect changed files using content hash
+
+        if (vm.count("hash")) {
+            argData.bHash = true;
+        }
+
         po::notify(vm);
 
+        if (argData.manifestFileName.empty()) {
+            argData.manifestFileName = defaultManifestFileName(argData.localDirectory);
+        }
+
     } catch (po::error& e) {
         std::cerr << "FTPBackup Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -167,6 +213,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("FTPBackup", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -192,17 +244,89 @@ int main(int argc, char** argv) {
 
         // Get local directory file list
         
-        listLocalRecursive(argData.localDirectory, locaFileList);
+        {
+            TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+            listLocalRecursive(argData.localDirectory, locaFileList);
+        }
+        
+        // For incremental backup only keep files changed since last run
+
+        BackupManifest previousManifest, currentManifest;
+
+        if (argData.bIncremental) {
+            previousManifest = loadBackupManifest(argData.manifestFileName);
+            locaFileList = filesChangedSinceManifest(argData.localDirectory, locaFileList,
+                                                     previousManifest, currentManifest, argData.bHash);
+            std::cout << "Files changed since last backup [" << locaFileList.size() << "]" << std::endl;
+        }
         
         // Copy file list  to FTP Server
 
-        if (!locaFileList.empty()) {
-            filesBackedUp = putFiles(ftpServer, argData.localDirectory, locaFileList);
+        TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+
+        if (!locaFileList.empty() && (argData.connections > 1)) {
+            
+            FTPServerDetails serverDetails { argData.serverName, argData.serverPort, 
+                                             argData.userName, argData.userPassword };
+            FileList directoryList, fileList;
+            
+            // Create directory hierarchy first so each file's parent exists whichever 
+            // session it goes out on.
+            
+            for (auto &file : locaFileList) {
+                if (CFile::isDirectory(file)) {
+                    directoryList.push_back(file);
+                } else {
+                    fileList.push_back(file);
+                }
+            }
+
+            if (!directoryList.empty()) {
+                filesBackedUp = putFiles(ftpServer, argData.localDirectory, directoryList);
+            }
+            
+            // Copy files over connection pool (largest first)
+            
+            std::cout << "Using [" << argData.connections << "] server connections." << std::endl;
+            
+            FileList filesPooled { transferFilesPooled(serverDetails, fileList, argData.connections,
+                    [&argData](CFTP &ftpSession, const FileList & files) {
+                        return (putFiles(ftpSession, argData.localDirectory, files));
+                    },
+                    [](const std::string & file) {
+                        return (std::filesystem::file_size(file));
+                    }, TransferStats::instance().fileCompletionFn()) };
+
+            // Back into listing (path) order, directories before their contents
+
+            std::move(filesPooled.begin(), filesPooled.end(), std::back_inserter(filesBackedUp));
+            std::sort(filesBackedUp.begin(), filesBackedUp.end());
+            
+        } else if (!locaFileList.empty()) {
+            filesBackedUp = putFiles(ftpServer, argData.localDirectory, locaFileList,
+                                     TransferStats::instance().fileCompletionFn());
+        }
+
+        transferTimer.stop();
+
+        std::string currentWorkingDirectory;
+        ftpServer.getCurrentWoringDirectory(currentWorkingDirectory);
+
+        TransferStats::instance().addTransferredFiles(argData.localDirectory, locaFileList,
+                                                      currentWorkingDirectory, filesBackedUp);
+
+        // Update manifest with files sent
+
+        if (argData.bIncremental) {
+            commitBackupManifest(argData.manifestFileName, argData.localDirectory, currentWorkingDirectory,
+                                 previousManifest, currentManifest, locaFileList, filesBackedUp);
         }
 
         // Signal success or failure
         
-        if (!filesBackedUp.empty()) {
+        if (argData.bIncremental && locaFileList.empty()) {
+            std::cout << "No files changed since last backup." << std::endl;
+        } else if (!filesBackedUp.empty()) {
             for (auto file : filesBackedUp) {
                 std::cout << "Sucessfully backed up [" << file << "]" << std::endl;
             }
@@ -214,6 +338,10 @@ int main(int argc, char** argv) {
         
         ftpServer.disconnect();
 
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
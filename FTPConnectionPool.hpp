@@ -0,0 +1,727 @@
+#ifndef FTPCONNECTIONPOOL_HPP
+#define FTPCONNECTIONPOOL_HPP
+
+//
+// Header: FTPConnectionPool
+//
+// Description: Helpers shared by the FTP example programs for pushing a file list
+// through a pool of authenticated CFTP sessions. Each session runs on its own thread
+// and takes the next file from a shared work queue as soon as it is free; so a large
+// file only ever ties up one session while the others carry on with the rest of the
+// list.
+//
+// A remote tree may also be listed with MLSD over a pool of sessions, several
+// directory listings being in flight at once and each entry coming back with its
+// size and modified time.
+//
+// CFTP has no way to restart a download part way through a file so resumable
+// restores (getFilesResumable()) are made over libcurl easy handles instead, one per
+// pooled session (each reusing its logged in connection from file to file); the
+// transfer is restarted at the file's last checkpoint with REST and written through
+// a ResumableDownload part file and journal. The same handle asks the server for a
+// file's SHA-256 (or fetches it whole when small) for remoteContentsMatch(), a check
+// that a file of unchanged size whose modified time has moved is really unchanged.
+//
+// Each resumable transfer and MLSD listing is timed into TransferStats (with the
+// bytes each request received and a round trip for it);
+// transferFilesPooled() reports each file through the completion function passed in
+// (as the FTPUtil transfers do).
+//
+// Dependencies: C11++, Classes (CFTP), FTPUtil, RecursiveListing, ResumableTransfer,
+// TransferStats, libcurl.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <iostream>
+#include <cctype>
+#include <ctime>
+#include <stdexcept>
+#include <fstream>
+#include <charconv>
+
+//
+// Antik Classes
+//
+
+#include "FTPUtil.hpp"
+#include "RecursiveListing.hpp"
+#include "ResumableTransfer.hpp"
+#include "TransferStats.hpp"
+#include "SHA256.hpp"
+
+//
+// libcurl
+//
+
+#include <curl/curl.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// FTP server/account details needed to open a session
+//
+
+struct FTPServerDetails {
+    std::string serverName;    // FTP server
+    std::string serverPort;    // FTP server port
+    std::string userName;      // FTP account user name
+    std::string userPassword;  // FTP account user name password
+};
+
+//
+// Transfer a list of files over a given session and return those transferred
+// (putFiles/getFiles).
+//
+
+typedef std::function<Antik::FileList(Antik::FTP::CFTP &, const Antik::FileList &)> FTPTransferFn;
+
+//
+// Return size of a given file; used to schedule larger files first.
+//
+
+typedef std::function<std::uintmax_t(const std::string &)> FTPFileSizeFn;
+
+//
+// Called with each file a pooled session has transferred (as for the FTPUtil
+// completion function); calls are serialised across sessions.
+//
+
+typedef std::function<void(const std::string &)> FTPFileCompletionFn;
+
+//
+// MLSD listing complete status code
+//
+
+constexpr std::uint16_t kFTPMLSDComplete { 226 };
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// FTP session used for resumable and partial file downloads (FTPS as connectFTPSession()).
+//
+
+class FTPDownloadSession {
+public:
+
+    //
+    // Class exception
+    //
+
+    struct Exception : public std::runtime_error {
+        explicit Exception(std::string const& message)
+        : std::runtime_error("FTPDownloadSession Failure: " + message) {
+        }
+    };
+
+    explicit FTPDownloadSession(const FTPServerDetails &serverDetails)
+    : m_serverURL{ "ftp://" + serverDetails.serverName + ":" + serverDetails.serverPort + "/"} {
+
+        m_curlHandle = curl_easy_init();
+        if (m_curlHandle == nullptr) {
+            throw Exception("curl_easy_init() failed.");
+        }
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_USERNAME, serverDetails.userName.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_PASSWORD, serverDetails.userPassword.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_USE_SSL, static_cast<long> (CURLUSESSL_ALL));
+        curl_easy_setopt(m_curlHandle, CURLOPT_WRITEFUNCTION, writeFunction);
+        curl_easy_setopt(m_curlHandle, CURLOPT_WRITEDATA, this);
+        curl_easy_setopt(m_curlHandle, CURLOPT_ERRORBUFFER, m_errorBuffer);
+
+    }
+
+    ~FTPDownloadSession() {
+        curl_easy_cleanup(m_curlHandle);
+    }
+
+    FTPDownloadSession(const FTPDownloadSession &orig) = delete;
+    FTPDownloadSession& operator=(const FTPDownloadSession &orig) = delete;
+
+    //
+    // Download the rest of a remote file (from download.offset()).
+    //
+
+    void getFile(const std::string &remoteFile, ResumableDownload &download) {
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_RANGE, nullptr);
+        curl_easy_setopt(m_curlHandle, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t> (download.offset()));
+
+        perform(remoteFile, [&download](const char *data, std::size_t length) {
+            download.write(data, length);
+        });
+
+    }
+
+    //
+    // Return length bytes of a remote file from an offset.
+    //
+
+    std::string getFileRange(const std::string &remoteFile, std::uint64_t offset, std::uint64_t length) {
+
+        std::string range { std::to_string(offset) + "-" + std::to_string(offset + length - 1) };
+        std::string contents;
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t> (0));
+        curl_easy_setopt(m_curlHandle, CURLOPT_RANGE, range.c_str());
+
+        perform(remoteFile, [&contents](const char *data, std::size_t length) {
+            contents.append(data, length);
+        });
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_RANGE, nullptr);
+
+        return (contents);
+
+    }
+
+    //
+    // Return the SHA-256 (hex) of a remote file as hashed by the server, with HASH
+    // (SHA-256 selected by OPTS HASH) or else XSHA256, or an empty string if it can't.
+    // The commands are sent after a CWD to the file's directory.
+    //
+
+    std::string getFileSHA256(const std::string &remoteFile) {
+
+        std::size_t lastSlash { remoteFile.find_last_of('/') };
+        std::string directory { (lastSlash == std::string::npos) ? "" : remoteFile.substr(0, lastSlash + 1) };
+        std::string fileName { remoteFile.substr((lastSlash == std::string::npos) ? 0 : lastSlash + 1) };
+        std::string directoryURL { m_serverURL + encodePath(directory) + (directory.empty() ? "" : "/") };
+        std::string replies;
+
+        struct curl_slist *commands { nullptr };
+        for (auto &command : { std::string("*OPTS HASH SHA-256"), "*HASH " + fileName, "*XSHA256 " + fileName }) {
+            struct curl_slist *appended { curl_slist_append(commands, command.c_str()) };
+            if (appended == nullptr) {
+                curl_slist_free_all(commands);
+                throw Exception("Could not build hash commands for [" + remoteFile + "]");
+            }
+            commands = appended;
+        }
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_URL, directoryURL.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(m_curlHandle, CURLOPT_POSTQUOTE, commands);
+        curl_easy_setopt(m_curlHandle, CURLOPT_HEADERFUNCTION, replyFunction);
+        curl_easy_setopt(m_curlHandle, CURLOPT_HEADERDATA, &replies);
+        m_errorBuffer[0] = '\0';
+
+        CURLcode curlResult = curl_easy_perform(m_curlHandle);
+
+        TransferStats::instance().addRoundTrips();
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_NOBODY, 0L);
+        curl_easy_setopt(m_curlHandle, CURLOPT_POSTQUOTE, nullptr);
+        curl_easy_setopt(m_curlHandle, CURLOPT_HEADERFUNCTION, nullptr);
+        curl_easy_setopt(m_curlHandle, CURLOPT_HEADERDATA, nullptr);
+        curl_slist_free_all(commands);
+
+        if (curlResult != CURLE_OK) {
+            throw Exception("[" + remoteFile + "] " + (m_errorBuffer[0] ? m_errorBuffer : curl_easy_strerror(curlResult)));
+        }
+
+        // Successful hash reply: "213 [SHA-256 <range> ]<hash>[ <file>]"
+
+        std::istringstream replyStream(replies);
+        for (std::string reply; std::getline(replyStream, reply, '\n');) {
+            if (reply.compare(0, 4, "213 ") != 0) continue;
+            std::istringstream tokenStream(reply.substr(4));
+            for (std::string token; tokenStream >> token;) {
+                if ((token.size() == 64) && std::all_of(token.begin(), token.end(),
+                        [](unsigned char ch) { return (std::isxdigit(ch)); })) {
+                    for (auto &ch : token) {
+                        ch = std::tolower(ch);
+                    }
+                    return (token);
+                }
+            }
+        }
+
+        return (std::string());
+
+    }
+
+private:
+
+    //
+    // Collect server replies (control connection lines).
+    //
+
+    static size_t replyFunction(char *data, size_t size, size_t count, void *userData) {
+        static_cast<std::string *> (userData)->append(data, size * count);
+        return (size * count);
+    }
+
+    //
+    // Transfer a remote file passing the data received to a write function.
+    //
+
+    void perform(const std::string &remoteFile, std::function<void(const char *data, std::size_t length)> writeFn) {
+
+        std::string fileURL { m_serverURL + encodePath(remoteFile) };
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_URL, fileURL.c_str());
+
+        std::uint64_t bytesReceived { 0 };
+
+        m_writeFn = [&writeFn, &bytesReceived](const char *data, std::size_t length) {
+            writeFn(data, length);
+            bytesReceived += length;
+        };
+        m_writeError = nullptr;
+        m_errorBuffer[0] = '\0';
+
+        CURLcode curlResult = curl_easy_perform(m_curlHandle);
+
+        m_writeFn = nullptr;
+
+        TransferStats::instance().addRoundTrips();
+        TransferStats::instance().addBytes(bytesReceived);
+
+        if (m_writeError) {
+            std::rethrow_exception(m_writeError);
+        }
+        if (curlResult != CURLE_OK) {
+            throw Exception("[" + remoteFile + "] " + (m_errorBuffer[0] ? m_errorBuffer : curl_easy_strerror(curlResult)));
+        }
+
+    }
+
+    //
+    // Pass received data to the write function; an exception is held until the
+    // transfer has been aborted.
+    //
+
+    static size_t writeFunction(char *data, size_t size, size_t count, void *userData) {
+        FTPDownloadSession *session { static_cast<FTPDownloadSession *> (userData) };
+        try {
+            session->m_writeFn(data, size * count);
+        } catch (...) {
+            session->m_writeError = std::current_exception();
+            return (0);
+        }
+        return (size * count);
+    }
+
+    //
+    // Escape each component of a remote path for the URL; an absolute path has its
+    // leading slash encoded so it is not taken relative to the login directory.
+    //
+
+    std::string encodePath(const std::string &remoteFile) {
+        std::string encodedPath { (!remoteFile.empty() && remoteFile.front() == '/') ? "%2F" : "" };
+        std::istringstream pathStream(remoteFile);
+        bool bFirst { true };
+        for (std::string component; std::getline(pathStream, component, '/');) {
+            if (component.empty()) continue;
+            char *encoded { curl_easy_escape(m_curlHandle, component.c_str(), static_cast<int> (component.size())) };
+            if (encoded == nullptr) {
+                throw Exception("Could not encode [" + remoteFile + "]");
+            }
+            encodedPath += (bFirst ? "" : "/") + std::string(encoded);
+            curl_free(encoded);
+            bFirst = false;
+        }
+        return (encodedPath);
+    }
+
+    CURL *m_curlHandle { nullptr };             // libcurl easy handle (keeps connection)
+    std::string m_serverURL;                    // ftp://server:port/
+    char m_errorBuffer[CURL_ERROR_SIZE] {};     // libcurl error text
+    std::function<void(const char *data, std::size_t length)> m_writeFn; // Data received
+    std::exception_ptr m_writeError;            // Error writing download
+
+};
+
+//
+// Connect a CFTP session (SSL enabled) to a server and log in.
+//
+
+inline void connectFTPSession(Antik::FTP::CFTP &ftpServer, const FTPServerDetails &serverDetails) {
+
+    ftpServer.setServerAndPort(serverDetails.serverName, serverDetails.serverPort);
+    ftpServer.setUserAndPassword(serverDetails.userName, serverDetails.userPassword);
+    ftpServer.setSslEnabled(true);
+
+    if (ftpServer.connect() != 230) {
+        throw Antik::FTP::CFTP::Exception("Unable to connect status returned = " + ftpServer.getCommandResponse());
+    }
+
+}
+
+//
+// Transfer a file list using a pool of sessions. If a size function is passed the
+// largest files are handed out first so that the small ones fill in around them
+// at the end. The returned file list is in the same order as the one passed in so
+// the caller can report it exactly as it would for a single session transfer. Any
+// exception raised by a session is re-thrown once all sessions have finished.
+//
+
+inline Antik::FileList transferFilesPooled(const FTPServerDetails &serverDetails,
+                                           const Antik::FileList &fileList,
+                                           int connections,
+                                           FTPTransferFn transferFn,
+                                           FTPFileSizeFn sizeFn = nullptr,
+                                           FTPFileCompletionFn completionFn = nullptr) {
+
+    std::vector<std::size_t> scheduleOrder(fileList.size());
+    std::vector<Antik::FileList> transferred(fileList.size());
+    std::atomic<std::size_t> nextFile { 0 };
+    std::exception_ptr transferError;
+    std::mutex transferErrorMutex;
+    std::mutex completionMutex;
+    std::vector<std::thread> sessions;
+
+    std::iota(scheduleOrder.begin(), scheduleOrder.end(), 0);
+
+    if (sizeFn) {
+        std::vector<std::uintmax_t> fileSizes;
+        fileSizes.reserve(fileList.size());
+        for (auto &file : fileList) {
+            fileSizes.push_back(sizeFn(file));
+        }
+        std::stable_sort(scheduleOrder.begin(), scheduleOrder.end(),
+                [&fileSizes](std::size_t lhs, std::size_t rhs) {
+                    return (fileSizes[lhs] > fileSizes[rhs]);
+                });
+    }
+
+    connections = std::max(1, std::min(connections, static_cast<int>(fileList.size())));
+
+    for (auto session = 0; session < connections; session++) {
+
+        sessions.emplace_back([&]() {
+
+            try {
+
+                Antik::FTP::CFTP ftpServer;
+
+                connectFTPSession(ftpServer, serverDetails);
+
+                for (auto next = nextFile++; next < scheduleOrder.size(); next = nextFile++) {
+                    transferred[scheduleOrder[next]] = transferFn(ftpServer, { fileList[scheduleOrder[next]] });
+                    if (completionFn) {
+                        std::lock_guard<std::mutex> completionLock(completionMutex);
+                        for (auto &file : transferred[scheduleOrder[next]]) {
+                            completionFn(file);
+                        }
+                    }
+                }
+
+                ftpServer.disconnect();
+
+            } catch (...) {
+                std::lock_guard<std::mutex> locker(transferErrorMutex);
+                if (!transferError) {
+                    transferError = std::current_exception();
+                }
+                nextFile = scheduleOrder.size(); // Stop other sessions taking new work
+            }
+
+        });
+
+    }
+
+    for (auto &session : sessions) {
+        session.join();
+    }
+
+    if (transferError) {
+        std::rethrow_exception(transferError);
+    }
+
+    Antik::FileList filesTransferred;
+    for (auto &files : transferred) {
+        std::move(files.begin(), files.end(), std::back_inserter(filesTransferred));
+    }
+
+    return (filesTransferred);
+
+}
+
+//
+// Local path of a remote file as FTPUtil getFiles() maps it (the remote path below the
+// current working directory appended to the local directory).
+//
+
+inline std::string ftpLocalFilePath(const std::string &localDirectory, const std::string &currentWorkingDirectory,
+                                    const std::string &remoteFile) {
+    return (localDirectory + remoteFile.substr(std::min(currentWorkingDirectory.size(), remoteFile.size())));
+}
+
+//
+// Resumable restore of remote files (not directories) over a pool of FTPDownloadSession;
+// each file goes through a part file and journal and is restarted at its last
+// checkpoint, files already restored by an earlier run being skipped. Files are
+// handed out largest first. A file that fails is reported and left to be resumed by
+// the next run; the local path of each file restored is returned in listing order.
+//
+
+inline Antik::FileList getFilesResumable(const FTPServerDetails &serverDetails, const std::string &localDirectory,
+                                         const std::string &currentWorkingDirectory, const ListedFiles &remoteFiles,
+                                         int connections) {
+
+    std::vector<std::size_t> scheduleOrder(remoteFiles.size());
+    std::vector<char> restored(remoteFiles.size()); // Not vector<bool>; set by several threads
+    std::atomic<std::size_t> nextFile { 0 };
+    std::mutex outputMutex;
+    std::vector<std::thread> sessions;
+
+    std::iota(scheduleOrder.begin(), scheduleOrder.end(), 0);
+    std::stable_sort(scheduleOrder.begin(), scheduleOrder.end(),
+            [&remoteFiles](std::size_t lhs, std::size_t rhs) {
+                return (remoteFiles[lhs].size > remoteFiles[rhs].size);
+            });
+
+    connections = std::max(1, std::min(connections, static_cast<int>(remoteFiles.size())));
+
+    for (auto session = 0; session < connections; session++) {
+
+        sessions.emplace_back([&]() {
+
+            std::unique_ptr<FTPDownloadSession> ftpSession;
+
+            for (auto next = nextFile++; next < scheduleOrder.size(); next = nextFile++) {
+                const ListedFile &remoteFile { remoteFiles[scheduleOrder[next]] };
+                std::string localFile { ftpLocalFilePath(localDirectory, currentWorkingDirectory, remoteFile.path) };
+                TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+                try {
+                    if (!ResumableDownload::alreadyRestored(localFile, remoteFile.size, remoteFile.modified)) {
+                        ResumableDownload download { localFile, remoteFile.size, remoteFile.modified };
+                        if (download.offset()) {
+                            std::lock_guard<std::mutex> locker(outputMutex);
+                            std::cout << "Resuming [" << remoteFile.path << "] from byte " << download.offset() << std::endl;
+                        }
+                        if (download.offset() < remoteFile.size) {
+                            if (!ftpSession) {
+                                ftpSession.reset(new FTPDownloadSession(serverDetails));
+                            }
+                            ftpSession->getFile(remoteFile.path, download);
+                        }
+                        download.complete();
+                    }
+                    restored[scheduleOrder[next]] = true;
+                } catch (const std::exception &e) {
+                    std::lock_guard<std::mutex> locker(outputMutex);
+                    std::cerr << "Failed to restore [" << remoteFile.path << "]: " << e.what() << std::endl;
+                    TransferStats::instance().addError();
+                }
+            }
+
+        });
+
+    }
+
+    for (auto &session : sessions) {
+        session.join();
+    }
+
+    Antik::FileList filesRestored;
+    for (std::size_t file = 0; file < remoteFiles.size(); file++) {
+        if (restored[file]) {
+            filesRestored.push_back(ftpLocalFilePath(localDirectory, currentWorkingDirectory, remoteFiles[file].path));
+        }
+    }
+
+    return (filesRestored);
+
+}
+
+//
+// Check the contents of a local file against its remote copy (of the same size): by
+// SHA-256 if the server will hash it, otherwise by fetching the whole remote copy if
+// it is no larger than kFTPCompareSize. Returns true only if the contents are known
+// to match; a larger file on a server that can't hash is never taken as unchanged.
+//
+
+constexpr std::uint64_t kFTPCompareSize { 256 * 1024 };
+
+inline bool remoteContentsMatch(FTPDownloadSession &ftpSession, const std::string &localFile,
+                                const std::string &remoteFile, std::uint64_t fileSize) {
+
+    std::string remoteHash { ftpSession.getFileSHA256(remoteFile) };
+    if (!remoteHash.empty()) {
+        return (remoteHash == sha256FileContents(localFile));
+    }
+
+    if (fileSize > kFTPCompareSize) {
+        return (false);
+    }
+
+    if (fileSize == 0) {
+        return (true);
+    }
+
+    std::ifstream localStream(localFile, std::ios::binary);
+    if (!localStream.is_open()) {
+        return (false);
+    }
+
+    std::string localContents(fileSize, '\0');
+    localStream.read(localContents.data(), fileSize);
+
+    return ((static_cast<std::uint64_t> (localStream.gcount()) == fileSize) &&
+            (ftpSession.getFileRange(remoteFile, 0, fileSize) == localContents));
+
+}
+
+//
+// Convert MLSD modify fact (YYYYMMDDHHMMSS[.sss] UTC) to a time. A malformed fact
+// is treated as a missing modified time (0).
+//
+
+inline std::time_t mlsdModifiedTime(const std::string &modifyFact) {
+
+    std::tm modifiedDateTime {};
+
+    if ((modifyFact.size() < 14) || !std::all_of(modifyFact.begin(), modifyFact.begin() + 14,
+            [](unsigned char ch) { return (std::isdigit(ch)); })) {
+        return (0);
+    }
+
+    auto field = [&modifyFact](std::size_t start, std::size_t length) {
+        int value { 0 };
+        std::from_chars(modifyFact.data() + start, modifyFact.data() + start + length, value);
+        return (value);
+    };
+
+    modifiedDateTime.tm_year = field(0, 4) - 1900;
+    modifiedDateTime.tm_mon = field(4, 2) - 1;
+    modifiedDateTime.tm_mday = field(6, 2);
+    modifiedDateTime.tm_hour = field(8, 2);
+    modifiedDateTime.tm_min = field(10, 2);
+    modifiedDateTime.tm_sec = field(12, 2);
+
+    if ((modifiedDateTime.tm_mon < 0) || (modifiedDateTime.tm_mon > 11) ||
+            (modifiedDateTime.tm_mday < 1) || (modifiedDateTime.tm_mday > 31) ||
+            (modifiedDateTime.tm_hour > 23) || (modifiedDateTime.tm_min > 59) ||
+            (modifiedDateTime.tm_sec > 60)) {
+        return (0);
+    }
+
+    return (timegm(&modifiedDateTime));
+
+}
+
+//
+// Parse the MLSD listing of a directory appending its entries; each line is
+// "fact=value;...; name".
+//
+
+inline void parseMLSDListing(const std::string &directory, const std::string &listOutput, ListedFiles &entries) {
+
+    std::istringstream listStream(listOutput);
+
+    for (std::string line; std::getline(listStream, line, '\n');) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        auto nameStart = line.find(' ');
+        if (nameStart == std::string::npos) continue;
+        ListedFile listedFile;
+        std::string type;
+        std::istringstream factStream(line.substr(0, nameStart));
+        for (std::string fact; std::getline(factStream, fact, ';');) {
+            auto valueStart = fact.find('=');
+            if (valueStart == std::string::npos) continue;
+            std::string factName { fact.substr(0, valueStart) };
+            for (auto &ch : factName) { // Fact names are case insensitive
+                ch = std::tolower(ch);
+            }
+            std::string factValue { fact.substr(valueStart + 1) };
+            if (factName == "type") {
+                type = factValue;
+            } else if (factName == "size") {
+                listedFile.size = std::strtoull(factValue.c_str(), nullptr, 10);
+            } else if (factName == "modify") {
+                listedFile.modified = mlsdModifiedTime(factValue);
+            }
+        }
+        if ((type == "cdir") || (type == "pdir")) continue;
+        listedFile.path = directory + "/" + line.substr(nameStart + 1);
+        listedFile.bDirectory = (type == "dir");
+        entries.push_back(std::move(listedFile));
+    }
+
+}
+
+//
+// Recursively list a remote directory using MLSD over a pool of sessions: the passed
+// in (connected) session and listers-1 more opened from the server details. Each
+// directory costs one listing and the size/modified time of its entries come back
+// with it. Returns false if the server doesn't support MLSD and nothing has been
+// listed; a sub-directory that cannot be listed throws (a partial listing would
+// have the caller treat its contents as missing).
+//
+
+inline bool listRemoteRecursiveMLSD(Antik::FTP::CFTP &ftpServer, const FTPServerDetails &serverDetails,
+                                    const std::string &remoteDirectory, int listers, ListingOrder order,
+                                    ListedFiles &listedFiles) {
+
+    std::vector<std::unique_ptr<Antik::FTP::CFTP>> listerSessions(std::max(1, listers));
+    bool bSupported { true };
+
+    auto disconnectListers = [&listerSessions]() {
+        for (auto &listerSession : listerSessions) {
+            if (listerSession) {
+                listerSession->disconnect();
+            }
+        }
+    };
+
+    try {
+        listedFiles = listRecursiveParallel(remoteDirectory, listerSessions.size(), order,
+                [&](std::size_t lister, const std::string &directory, ListedFiles &entries) {
+                    Antik::FTP::CFTP *listerSession { &ftpServer };
+                    if (lister != 0) {
+                        if (!listerSessions[lister]) {
+                            listerSessions[lister].reset(new Antik::FTP::CFTP());
+                            connectFTPSession(*listerSessions[lister], serverDetails);
+                        }
+                        listerSession = listerSessions[lister].get();
+                    }
+                    std::string listOutput;
+                    if (listerSession->listDirectory(directory, listOutput) != kFTPMLSDComplete) {
+                        if (directory != remoteDirectory) {
+                            throw std::runtime_error("Directory [" + directory + "] could not be listed: " +
+                                                     listerSession->getCommandResponse());
+                        }
+                        bSupported = false;
+                        return;
+                    }
+                    parseMLSDListing(directory, listOutput, entries);
+                });
+    } catch (...) {
+        try {
+            disconnectListers();
+        } catch (...) {
+            // Keep the listing error
+        }
+        throw;
+    }
+
+    disconnectListers();
+
+    return (bSupported);
+
+}
+
+#endif /* FTPCONNECTIONPOOL_HPP */
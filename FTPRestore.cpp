@@ -2,9 +2,13 @@
 // Program: FTPRestore
 //
 // Description: Simple FTP restore program that takes a remote directory and restores it
-// to a local directory.
+// to a local directory. Files may be spread over a pool of server connections, which
+// also list the remote tree concurrently (MLSD) where the server supports it. With
+// --resume each file is restored (over libcurl, restarting with REST) through a part
+// file and checkpoint journal so an interrupted restore carries on where it left off;
+// completed files are validated by size.
 //
-// Dependencies: C11++, Classes (CFTP, CFile, CPath, CSocket), Boost C++ Libraries.
+// Dependencies: C11++, Classes (CFTP, CFile, CPath, CSocket), Boost C++ Libraries, libcurl.
 //
 // FTPRestore
 // Program Options:
@@ -16,6 +20,9 @@
 //   -p [ --password ] arg  User password
 //   -r [ --remote ] arg    Remote server directory to restore
 //   -l [ --local ] arg     Local directory to use as base for restore
+//   -n [ --connections ] arg (=1) Number of server connections used for transfer
+//   --resume               Resume interrupted file restores from their last checkpoint
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 //
 
 // =============
@@ -28,14 +35,19 @@
 
 #include <iostream>
 #include <fstream>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
 
 //
 // Antik Classes
 //
 
 #include "FTPUtil.hpp"
+#include "FTPConnectionPool.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
 
 using namespace Antik;
 using namespace Antik::FTP;
@@ -63,6 +75,9 @@ struct ParamArgData {
     std::string remoteDirectory; // FTP remote directory to restore
     std::string localDirectory;  // Local directory to use as base for restore
     std::string configFileName;  // Configuration file name
+    int connections { 1 };       // Number of server connections used for transfer
+    bool bResume { false };      // == true resumable (checkpointed) restore
+    std::string statsFileName;    // Transfer stats summary file
 };
 
 // ===============
@@ -79,6 +94,15 @@ static void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -95,7 +119,10 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("remote,r", po::value<std::string>(&argData.remoteDirectory)->required(), "Remote directory to restore")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore")
+            ("connections,n", po::value<int>(&argData.connections)->default_value(1), "Number of server connections used for transfer")
+            ("resume", "Resume interrupted file restores from their last checkpoint")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -144,6 +171,12 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Resumable restore
+
+        if (vm.count("resume")) {
+            argData.bResume = true;
+        }
+
         po::notify(vm);
 
     } catch (po::error& e) {
@@ -171,6 +204,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("FTPRestore", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -195,16 +234,146 @@ int main(int argc, char** argv) {
             throw CFTP::Exception("Unable to connect status returned = " + ftpServer.getCommandResponse());
         }
 
-        // Get remote directory file list
+        // Get remote directory file list; with a connection pool (or for a resumable
+        // restore) it is listed with MLSD over the pool so directories are also known. 
         
-        listRemoteRecursive(ftpServer, argData.remoteDirectory, remoteFileList);
+        FTPServerDetails serverDetails { argData.serverName, argData.serverPort,
+                                         argData.userName, argData.userPassword };
+        ListedFiles remoteListing;
+        bool bMLSD { false };
+
+        TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+
+        if ((argData.connections > 1) || argData.bResume) {
+            bMLSD = listRemoteRecursiveMLSD(ftpServer, serverDetails, argData.remoteDirectory,
+                                            argData.connections, ListingOrder::breadthFirst, remoteListing);
+        }
+
+        if (bMLSD) {
+            remoteFileList = listedPaths(remoteListing);
+        } else {
+            listRemoteRecursive(ftpServer, argData.remoteDirectory, remoteFileList);
+        }
+
+        listingTimer.stop();
         
         // Restore files from  FTP Server
 
-        if (!remoteFileList.empty()) {
-            restoredFiles = getFiles(ftpServer, argData.localDirectory, remoteFileList);
+        if (!remoteFileList.empty() && argData.bResume) {
+
+            ListedFiles fileListing;
+            FileList directoryList;
+            std::string currentWorkingDirectory;
+
+            // Without a MLSD listing the size of each file has to be asked for (and
+            // its modified time is not known so a completed file is fetched again).
+
+            if (!bMLSD) {
+                TransferStats::PhaseTimer metadataTimer { TransferStats::Phase::metadata };
+                for (auto &file : remoteFileList) {
+                    TransferStats::OperationTimer operationTimer { TransferStats::Phase::metadata };
+                    ListedFile listedFile { file };
+                    listedFile.bDirectory = ftpServer.isDirectory(file);
+                    if (!listedFile.bDirectory) {
+                        std::size_t fileSize { 0 };
+                        ftpServer.getFileSize(file, fileSize);
+                        listedFile.size = fileSize;
+                    }
+                    remoteListing.push_back(std::move(listedFile));
+                }
+            }
+
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+
+            for (auto &listedFile : remoteListing) {
+                if (listedFile.bDirectory) {
+                    directoryList.push_back(listedFile.path);
+                } else {
+                    fileListing.push_back(listedFile);
+                }
+            }
+
+            if (!directoryList.empty()) {
+                restoredFiles = getFiles(ftpServer, argData.localDirectory, directoryList);
+            }
+
+            ftpServer.getCurrentWoringDirectory(currentWorkingDirectory);
+
+            FileList filesResumed { getFilesResumable(serverDetails, argData.localDirectory, currentWorkingDirectory,
+                                                      fileListing, argData.connections) };
+
+            std::move(filesResumed.begin(), filesResumed.end(), std::back_inserter(restoredFiles));
+            std::sort(restoredFiles.begin(), restoredFiles.end());
+
+        } else if (!remoteFileList.empty() && (argData.connections > 1)) {
+
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+
+            std::unordered_set<std::string> parentDirectories;
+            FileList directoryList, fileList;
+
+            // Restore directories first so each file's local folder exists whichever
+            // session gets it. Without a MLSD listing any listed path that is the parent
+            // of another must be a directory.
+
+            if (bMLSD) {
+                for (auto &listedFile : remoteListing) {
+                    if (listedFile.bDirectory) {
+                        directoryList.push_back(listedFile.path);
+                    } else {
+                        fileList.push_back(listedFile.path);
+                    }
+                }
+            } else {
+                for (auto &file : remoteFileList) {
+                    auto separator = file.rfind('/');
+                    if ((separator != std::string::npos) && (separator != 0)) {
+                        parentDirectories.insert(file.substr(0, separator));
+                    }
+                }
+                for (auto &file : remoteFileList) {
+                    if (parentDirectories.count(file)) {
+                        directoryList.push_back(file);
+                    } else {
+                        fileList.push_back(file);
+                    }
+                }
+            }
+
+            if (!directoryList.empty()) {
+                restoredFiles = getFiles(ftpServer, argData.localDirectory, directoryList);
+            }
+
+            // Restore files over connection pool (largest first if their sizes were listed)
+
+            std::cout << "Using [" << argData.connections << "] server connections." << std::endl;
+
+            std::unordered_map<std::string, std::uintmax_t> remoteFileSizes;
+            for (auto &listedFile : remoteListing) {
+                remoteFileSizes[listedFile.path] = listedFile.size;
+            }
+
+            FileList filesPooled { transferFilesPooled(serverDetails, fileList, argData.connections,
+                    [&argData](CFTP &ftpSession, const FileList & files) {
+                        return (getFiles(ftpSession, argData.localDirectory, files));
+                    },
+                    bMLSD ? FTPFileSizeFn([&remoteFileSizes](const std::string &file) {
+                        return (remoteFileSizes[file]);
+                    }) : FTPFileSizeFn(), TransferStats::instance().fileCompletionFn()) };
+
+            // Back into listing (path) order, directories before their contents
+
+            std::move(filesPooled.begin(), filesPooled.end(), std::back_inserter(restoredFiles));
+            std::sort(restoredFiles.begin(), restoredFiles.end());
+
+        } else if (!remoteFileList.empty()) {
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+            restoredFiles = getFiles(ftpServer, argData.localDirectory, remoteFileList,
+                                     TransferStats::instance().fileCompletionFn());
         }
 
+        TransferStats::instance().addLocalFiles(restoredFiles, argData.bResume); // Resumed bytes counted as received
+
         // Signal success or failure
         
         if (!restoredFiles.empty()) {
@@ -219,6 +388,10 @@ int main(int argc, char** argv) {
         
         ftpServer.disconnect();
 
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
@@ -2,10 +2,10 @@
 // Program: FTPSync
 //
 // Description: Simple FTP program that takes a local directory and keeps it 
-// sycnhronized with a remote server directory. Note: Im sure the sync can be done
-// in one pass (come back and look at later).
+// sycnhronized with a remote server directory (listings are diffed in one pass and,
+// with --watch, local changes are then replicated as they happen).
 //
-// Dependencies: C11++, Classes (CFTP, CFile, CPath, CSocket), Boost C++ Libraries.
+// Dependencies: C11++, Classes (CFTP, CFile, CPath, CSocket, CApprise), Boost C++ Libraries, libcurl.
 //
 // FTPSync
 // Program Options:
@@ -17,6 +17,12 @@
 //   -p [ --password ] arg  User password
 //   -r [ --remote ] arg    Remote server directory
 //   -l [ --local ] arg     Local directory
+//   --listers arg (=1)     Number of concurrent directory listers (remote sessions)
+//   --order arg (=breadth) Directory listing order (breadth or depth)
+//   --watch                Keep running and replicate local changes after the sync
+//   --debounce arg (=2000) Milliseconds a changed file must be quiet before it is sent
+//   --precheck             Skip touched but unchanged files (same size, contents match)
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 //
 
 // =============
@@ -29,8 +35,10 @@
 
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
 #include <fstream>
+#include <memory>
 
 using namespace std::chrono;
 
@@ -41,6 +49,10 @@ using namespace std::chrono;
 #include "FTPUtil.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
+#include "ReplicationQueue.hpp"
+#include "FTPConnectionPool.hpp"
+#include "RecursiveListing.hpp"
 
 using namespace Antik;
 using namespace Antik::FTP;
@@ -68,8 +80,27 @@ struct ParamArgData {
     std::string remoteDirectory; // FTP remote directory for sync
     std::string localDirectory;  // Local directory for sync with server
     std::string configFileName;  // Configuration file name
+    bool bWatch { false };       // == true replicate local changes after sync
+    int debouncePeriod { 0 };    // Quiet period (milliseconds) before a change is sent
+    int listers { 1 };           // Number of concurrent directory listers
+    std::string order;           // Directory listing order option
+    ListingOrder listingOrder { ListingOrder::breadthFirst }; // Directory listing order
+    bool bPrecheck { false };    // == true compare same size files before copying
+    std::string statsFileName;    // Transfer stats summary file
 };
 
+// Local/remote file list differences
+
+struct SyncDiff {
+    std::vector<std::string> newFiles;      // Local files not on server
+    std::vector<std::string> deletedFiles;  // Server files no longer local
+    std::vector<std::string> commonFiles;   // Local files also on server
+};
+
+// File details (stat data) from a listing keyed by path
+
+typedef std::unordered_map<std::string, ListedFile> FileDetails;
+
 // ===============
 // LOCAL FUNCTIONS
 // ===============
@@ -84,6 +115,15 @@ void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -100,7 +140,14 @@ void addCommonOptions(po::options_description& commonOptions, ParamArgData& argD
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("remote,r", po::value<std::string>(&argData.remoteDirectory)->required(), "Remote directory to restore")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore")
+            ("watch", "Keep running and replicate local changes after the sync")
+            ("debounce", po::value<int>(&argData.debouncePeriod)->default_value(ReplicationQueue::kDebouncePeriod.count()),
+                "Milliseconds a changed file must be quiet before it is sent")
+            ("listers", po::value<int>(&argData.listers)->default_value(1), "Number of concurrent directory listers (remote sessions)")
+            ("order", po::value<std::string>(&argData.order)->default_value("breadth"), "Directory listing order (breadth or depth)")
+            ("precheck", "Skip touched but unchanged files (same size, contents match)")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -149,10 +196,36 @@ void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Replicate local changes after sync
+
+        if (vm.count("watch")) {
+            argData.bWatch = true;
+        }
+
+        // Compare touched files before copying
+
+        if (vm.count("precheck")) {
+            argData.bPrecheck = true;
+        }
+
         po::notify(vm);
         
         if (argData.localDirectory.back() != '/')argData.localDirectory.push_back('/');
 
+        if (argData.debouncePeriod < 0) {
+            throw po::error("Debounce period must not be negative.");
+        }
+
+        if (argData.listers < 1) {
+            throw po::error("Number of listers must be at least one.");
+        }
+
+        try {
+            argData.listingOrder = listingOrder(argData.order);
+        } catch (std::invalid_argument &e) {
+            throw po::error(e.what());
+        }
+
     } catch (po::error& e) {
         std::cerr << "FTPSync Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -170,11 +243,163 @@ static inline std::string localFileToRemote(ParamArgData &argData, const std::st
 }
 
 //
-// Convert remote server file path to local path
+// Return local/remote file path relative to the sync directory. Note: the local
+// directory always has a trailing '/' and the remote one doesn't.
 //
 
-static inline std::string remoteFileToLocal(ParamArgData &argData, const std::string &remoteFilePath) {
-    return(argData.localDirectory+remoteFilePath.substr(argData.remoteDirectory.size()+1));
+static inline std::string localFileRelative(ParamArgData &argData, const std::string &localFilePath) {
+    return(localFilePath.substr(argData.localDirectory.size()));
+}
+
+static inline std::string remoteFileRelative(ParamArgData &argData, const std::string &remoteFilePath) {
+    return(remoteFilePath.substr(argData.remoteDirectory.size()+1));
+}
+
+//
+// Work out new, deleted and common files from the local and remote file lists.
+// Both lists are reduced to a hashed set of relative paths once so each list is
+// only walked a single time.
+//
+
+static SyncDiff diffFileLists(ParamArgData &argData, const std::vector<std::string> &localFiles, 
+                              const std::vector<std::string> &remoteFiles) {
+
+    SyncDiff syncDiff;
+    std::unordered_set<std::string> remoteRelativeFiles;
+    std::unordered_set<std::string> localRelativeFiles;
+
+    remoteRelativeFiles.reserve(remoteFiles.size());
+    localRelativeFiles.reserve(localFiles.size());
+    
+    for (auto &file : remoteFiles) {
+        remoteRelativeFiles.insert(remoteFileRelative(argData, file));
+    }
+
+    for (auto &file : localFiles) {
+        auto relativeFile = localFileRelative(argData, file);
+        if (remoteRelativeFiles.count(relativeFile)) {
+            syncDiff.commonFiles.push_back(file);
+        } else {
+            syncDiff.newFiles.push_back(file);
+        }
+        localRelativeFiles.insert(std::move(relativeFile));
+    }
+
+    for (auto &file : remoteFiles) {
+        if (!localRelativeFiles.count(remoteFileRelative(argData, file))) {
+            syncDiff.deletedFiles.push_back(file);
+        }
+    }
+
+    return (syncDiff);
+
+}
+
+//
+// Check the connection with a PWD and reconnect if it has been dropped (servers close
+// idle control connections).
+//
+
+static void keepConnectionAlive(CFTP &ftpServer, ParamArgData &argData) {
+
+    std::string currentDirectory;
+    std::uint16_t statusCode { 0 };
+
+    try {
+        statusCode = ftpServer.getCurrentWoringDirectory(currentDirectory);
+    } catch (CFTP::Exception &e) {
+        statusCode = 0;
+    }
+
+    if (statusCode != 257) {
+        std::cout << "*** Reconnecting to server ***" << std::endl;
+        try {
+            ftpServer.disconnect();
+        } catch (CFTP::Exception &e) {
+            // Connection already gone
+        }
+        if (ftpServer.connect() != 230) {
+            throw CFTP::Exception("Unable to reconnect status returned = " + ftpServer.getCommandResponse());
+        }
+        ftpServer.changeWorkingDirectory(argData.remoteDirectory);
+    }
+
+}
+
+//
+// Apply replicated local changes to the server; return those that failed.
+//
+
+static std::vector<ReplicationQueue::Change> replicateChanges(CFTP &ftpServer, ParamArgData &argData,
+        const std::vector<ReplicationQueue::Change> &changes) {
+
+    std::vector<ReplicationQueue::Change> failedChanges;
+
+    keepConnectionAlive(ftpServer, argData);
+
+    for (auto &change : changes) {
+
+        std::string remoteFile { localFileToRemote(argData, change.localPath) };
+
+        try {
+
+            switch (change.action) {
+
+                case ReplicationQueue::Action::makeDirectory:
+                case ReplicationQueue::Action::put:
+                {
+                    if (!CFile::exists(change.localPath)) { // Gone again (its removal is queued)
+                        break;
+                    }
+                    if (change.staleRemoval) { // Path has changed type; an earlier attempt may have removed it
+                        if (((*change.staleRemoval == ReplicationQueue::Action::removeDirectory) ?
+                                ftpServer.removeDirectory(remoteFile) : ftpServer.deleteFile(remoteFile)) == 250) {
+                            std::cout << "[" << remoteFile << " ] removed from server." << std::endl;
+                        }
+                    }
+                    std::vector<std::string> filesToTransfer { change.localPath };
+                    if (change.action == ReplicationQueue::Action::makeDirectory) {
+                        std::vector<std::string> directoryContents;
+                        listLocalRecursive(change.localPath, directoryContents);
+                        filesToTransfer.insert(filesToTransfer.end(), directoryContents.begin(), directoryContents.end());
+                    }
+                    std::vector<std::string> filesTransfered { putFiles(ftpServer, argData.localDirectory, filesToTransfer) };
+                    for (auto &file : filesTransfered) {
+                        std::cout << "File [" << file << " ] copied to server." << std::endl;
+                    }
+                    if (filesTransfered.size() != filesToTransfer.size()) {
+                        failedChanges.push_back(change);
+                    }
+                    break;
+                }
+
+                case ReplicationQueue::Action::remove:
+                    if (ftpServer.deleteFile(remoteFile) == 250) {
+                        std::cout << "File [" << remoteFile << " ] removed from server." << std::endl;
+                    } else {
+                        failedChanges.push_back(change);
+                    }
+                    break;
+
+                case ReplicationQueue::Action::removeDirectory:
+                    if (ftpServer.removeDirectory(remoteFile) == 250) {
+                        std::cout << "Directory [" << remoteFile << " ] removed from server." << std::endl;
+                    } else {
+                        failedChanges.push_back(change);
+                    }
+                    break;
+
+            }
+
+        } catch (CFTP::Exception &e) {
+            std::cerr << "Could not replicate [" << change.localPath << "]: " << e.what() << std::endl;
+            failedChanges.push_back(change);
+        }
+
+    }
+
+    return (failedChanges);
+
 }
 
 // ============================
@@ -194,6 +419,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("FTPSync", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -230,10 +461,42 @@ int main(int argc, char** argv) {
         ftpServer.changeWorkingDirectory(argData.remoteDirectory);
         ftpServer.getCurrentWoringDirectory(argData.remoteDirectory);
         
-        // Get local and remote file lists
-      
-        listRemoteRecursive(ftpServer, argData.remoteDirectory, remoteFiles);
-        listLocalRecursive(argData.localDirectory, localFiles);
+        // Get local and remote file lists with their stat data. The remote list comes
+        // from MLSD if supported so file metadata doesn't need a round trip per file.
+
+        auto listingStart = steady_clock::now();
+        TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+
+        FTPServerDetails serverDetails { argData.serverName, argData.serverPort,
+                                         argData.userName, argData.userPassword };
+        ListedFiles remoteListing;
+        FileDetails remoteFileDetails;
+        bool bMLSD = listRemoteRecursiveMLSD(ftpServer, serverDetails, argData.remoteDirectory,
+                                             argData.listers, argData.listingOrder, remoteListing);
+
+        if (bMLSD) {
+            remoteFiles = listedPaths(remoteListing);
+            for (auto &listedFile : remoteListing) {
+                remoteFileDetails.emplace(listedFile.path, std::move(listedFile));
+            }
+        } else {
+            std::cout << "*** Server does not support MLSD; using MDTM for modified times ***" << std::endl;
+            listRemoteRecursive(ftpServer, argData.remoteDirectory, remoteFiles);
+        }
+        
+        ListedFiles localListing { listLocalRecursiveParallel(argData.localDirectory, argData.listers, argData.listingOrder) };
+        FileDetails localFileDetails;
+
+        localFiles = listedPaths(localListing);
+        for (auto &listedFile : localListing) {
+            localFileDetails.emplace(listedFile.path, std::move(listedFile));
+        }
+
+        listingTimer.stop();
+
+        std::cout << "*** Local/remote listing took [" 
+                  << duration_cast<milliseconds>(steady_clock::now() - listingStart).count() 
+                  << "] ms ***" << std::endl;
 
         if (remoteFiles.empty()) {
             std::cout << "*** Remote server directory empty ***" << std::endl;
@@ -243,79 +506,159 @@ int main(int argc, char** argv) {
             std::cout << "*** Local directory empty ***" << std::endl;
         }
 
+        // Work out what needs to be transferred/removed
+        
+        auto diffStart = steady_clock::now();
+        
+        SyncDiff syncDiff { diffFileLists(argData, localFiles, remoteFiles) };
+
+        std::cout << "*** Local/remote file list diff took [" 
+                  << duration_cast<milliseconds>(steady_clock::now() - diffStart).count() 
+                  << "] ms ***" << std::endl;
+        
         // PASS 1) Copy new files to server
 
         std::cout << "*** Transferring any new files to server ***" << std::endl; 
       
-        std::vector<std::string> newFiles;
-        std::vector<std::string> newFilesTransfered;
-        
-        for (auto file : localFiles) {
-            if (find(remoteFiles.begin(), remoteFiles.end(), localFileToRemote(argData, file)) == remoteFiles.end()) {
-                newFiles.push_back(file);
-            }
-        }
- 
-        if (!newFiles.empty()) {
-            newFilesTransfered = putFiles(ftpServer, argData.localDirectory, newFiles);
+        if (!syncDiff.newFiles.empty()) {
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+            std::vector<std::string> newFilesTransfered { putFiles(ftpServer, argData.localDirectory, syncDiff.newFiles,
+                                                                   TransferStats::instance().fileCompletionFn()) };
             std::cout << "Number of new files transfered [" << newFilesTransfered.size() << "]" << std::endl;
-            std::copy(newFilesTransfered.begin(), newFilesTransfered.end(), std::back_inserter(remoteFiles));
+            if (TransferStats::instance().enabled()) {
+                std::string currentWorkingDirectory;
+                ftpServer.getCurrentWoringDirectory(currentWorkingDirectory);
+                TransferStats::instance().addTransferredFiles(argData.localDirectory, syncDiff.newFiles,
+                                                              currentWorkingDirectory, newFilesTransfered);
+            }
         }
 
         // PASS 2) Remove any deleted local files from server
 
         std::cout << "*** Removing any deleted local files from server ***" << std::endl; 
                
-        for (auto file : remoteFiles) {
-            if (find(localFiles.begin(), localFiles.end(), remoteFileToLocal(argData, file))==localFiles.end()) {
-                if (ftpServer.deleteFile(file) == 250) {
-                    std::cout << "File [" << file << " ] removed from server." << std::endl;
-                } else if (ftpServer.removeDirectory(file) == 250) {
-                    std::cout << "Directory [" << file << " ] removed from server." << std::endl;
-                } else {
-                    std::cerr << "File [" << file << " ] could not be removed from server." << std::endl;
-                }
+        // Remove in reverse listing order so directory contents go before the directory.
+        
+        TransferStats::PhaseTimer removalTimer { TransferStats::Phase::metadata };
+
+        for (auto it = syncDiff.deletedFiles.rbegin(); it != syncDiff.deletedFiles.rend(); ++it) {
+            auto &file = *it;
+            TransferStats::OperationTimer removalOperationTimer { TransferStats::Phase::metadata };
+            if (ftpServer.deleteFile(file) == 250) {
+                std::cout << "File [" << file << " ] removed from server." << std::endl;
+            } else if (ftpServer.removeDirectory(file) == 250) {
+                std::cout << "Directory [" << file << " ] removed from server." << std::endl;
+            } else {
+                std::cerr << "File [" << file << " ] could not be removed from server." << std::endl;
+                TransferStats::instance().addError();
             }
         }
 
-        // PASS 3) Copy any updated local files to remote server. Note: PASS 2 may
-        // have deleted some remote files but if the get modified date/time fails
-        // it is ignored and not added to remoteFileModifiedTimes.
+        removalTimer.stop();
+
+        // PASS 3) Copy any updated local files to remote server. Note: Only files
+        // present on both sides are checked. Local stat data comes from the listing.
+        // The remote modified times (UTC) and sizes come from the MLSD listing or if
+        // unsupported MDTM; if that fails the file is ignored and not added to
+        // remoteFileModifiedTimes.
         
         std::cout << "*** Copying updated local files to server ***" << std::endl; 
         
-        // Fill out remote file name, date/time modified map.
+        // Fill out remote file name, date/time modified map if no MLSD.
         
         std::unordered_map<std::string, CFTP::DateTime> remoteFileModifiedTimes;
         
-        for (auto file : remoteFiles) {
-            CFTP::DateTime modifiedDateTime;
-            if (ftpServer.getModifiedDateTime(file, modifiedDateTime)==213) {
-                remoteFileModifiedTimes[file] = modifiedDateTime;
+        if (!bMLSD) {
+            TransferStats::PhaseTimer metadataTimer { TransferStats::Phase::metadata };
+            for (auto &file : syncDiff.commonFiles) {
+                TransferStats::OperationTimer metadataOperationTimer { TransferStats::Phase::metadata };
+                CFTP::DateTime modifiedDateTime;
+                if (!localFileDetails[file].bDirectory &&
+                   (ftpServer.getModifiedDateTime(localFileToRemote(argData, file), modifiedDateTime)==213)) {
+                    remoteFileModifiedTimes[localFileToRemote(argData, file)] = modifiedDateTime;
+                }
             }
         }
 
-        for (auto file : localFiles) {
-            if (CFile::isFile(file)) {
-                auto localModifiedTime = system_clock::to_time_t(file_clock::to_sys(CFile::lastWriteTime(file)));
-                if (remoteFileModifiedTimes[localFileToRemote(argData, file)] < 
-                        static_cast<CFTP::DateTime>(std::localtime(&localModifiedTime))) {
-                    std::cout << "Server file " << localFileToRemote(argData, file) << " out of date." << std::endl;
-                    if (ftpServer.putFile(localFileToRemote(argData, file), file) == 226) {
+        // With --precheck a file that looks out of date but is the same size as its
+        // remote copy has its contents compared over a separate download session.
+
+        std::unique_ptr<FTPDownloadSession> precheckSession;
+        TransferStats::PhaseTimer updateTimer { TransferStats::Phase::transfer };
+
+        for (auto &file : syncDiff.commonFiles) {
+            auto &localFileDetail = localFileDetails[file];
+            if (!localFileDetail.bDirectory) {
+                std::string remoteFile { localFileToRemote(argData, file) };
+                bool bOutOfDate;
+                bool bSameSize { false };
+                if (bMLSD) {
+                    auto &remoteFileDetail = remoteFileDetails[remoteFile];
+                    bOutOfDate = (remoteFileDetail.modified < localFileDetail.modified) ||
+                                 (remoteFileDetail.size != localFileDetail.size);
+                    bSameSize = (remoteFileDetail.size == localFileDetail.size);
+                } else {
+                    std::time_t localModifiedTime { localFileDetail.modified };
+                    bOutOfDate = remoteFileModifiedTimes[remoteFile] < 
+                            static_cast<CFTP::DateTime>(std::localtime(&localModifiedTime));
+                    if (bOutOfDate && argData.bPrecheck) {
+                        std::size_t fileSize { 0 };
+                        bSameSize = (ftpServer.getFileSize(remoteFile, fileSize) == 213) && (fileSize == localFileDetail.size);
+                    }
+                }
+                if (bOutOfDate && argData.bPrecheck && bSameSize) {
+                    TransferStats::OperationTimer precheckTimer { TransferStats::Phase::metadata };
+                    try {
+                        if (!precheckSession) {
+                            precheckSession.reset(new FTPDownloadSession(serverDetails));
+                        }
+                        if (remoteContentsMatch(*precheckSession, file, remoteFile, localFileDetail.size)) {
+                            std::cerr << "Warning: [" << file << "] not copied; its modified time has changed "
+                                    "but its contents match server file " << remoteFile << "." << std::endl;
+                            bOutOfDate = false;
+                        }
+                    } catch (const std::exception &e) {
+                        std::cerr << "Precheck of [" << file << "] failed: " << e.what() << std::endl;
+                    }
+                }
+                if (bOutOfDate) {
+                    std::cout << "Server file " << remoteFile << " out of date." << std::endl;
+                    TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+                    if (ftpServer.putFile(remoteFile, file) == 226) {
                         std::cout << "File [" << file << " ] copied to server." << std::endl;
+                        TransferStats::instance().addLocalFiles({ file });
                     } else {
                         std::cerr << "File [" << file << " ] not copied to server." << std::endl;
+                        TransferStats::instance().addError();
                     }
                 }
             }
         }
         
+        updateTimer.stop();
+
+        std::cout << "*** Files synchronized with server ***" << std::endl; 
+
+        // Keep the connection and replicate changes from now on
+
+        if (argData.bWatch) {
+            replicateLocalChanges(argData.localDirectory, milliseconds(argData.debouncePeriod),
+                    [&](const std::vector<ReplicationQueue::Change> &changes) {
+                        return (replicateChanges(ftpServer, argData, changes));
+                    },
+                    [&]() {
+                        keepConnectionAlive(ftpServer, argData);
+                    });
+        }
+
         // Disconnect 
 
         ftpServer.disconnect();
-
-        std::cout << "*** Files synchronized with server ***" << std::endl; 
               
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
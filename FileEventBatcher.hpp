@@ -0,0 +1,237 @@
+#ifndef FILEEVENTBATCHER_HPP
+#define FILEEVENTBATCHER_HPP
+
+//
+// Header: FileEventBatcher
+//
+// Description: Batched, coalesced delivery of CApprise file events. A reader thread
+// takes events from CApprise::getNextEvent() into a bounded queue (the reader blocks
+// when it is full) and getEvents() returns them a batch at a time. A change event
+// for a path that already has an undelivered add or change event queued is folded
+// into it; add/change events are held for a coalesce window before delivery so that
+// a burst of writes to a file (a build directory storm) becomes a single event.
+// Event order is preserved apart from folded change events.
+//
+// Dependencies: C11++, Classes (CApprise).
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+//
+// Antik Classes
+//
+
+#include "CApprise.hpp"
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class FileEventBatcher {
+public:
+
+    //
+    // Default maximum number of queued events and coalesce window.
+    //
+
+    static constexpr std::size_t kMaxQueuedEvents { 64 * 1024 };
+    static constexpr std::chrono::milliseconds kCoalesceWindow { 100 };
+
+    //
+    // Start reading events from a watcher (which must already be watching).
+    //
+
+    explicit FileEventBatcher(Antik::File::CApprise &fileWatcher, std::chrono::milliseconds coalesceWindow = kCoalesceWindow,
+            std::size_t maxQueued = kMaxQueuedEvents)
+    : m_fileWatcher{ fileWatcher}, m_coalesceWindow{ coalesceWindow}, m_maxQueued{ maxQueued} {
+        m_readerThread = std::thread(&FileEventBatcher::readEvents, this);
+    }
+
+    //
+    // The watcher must be stopped first for the reader thread to finish.
+    //
+
+    ~FileEventBatcher() {
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_bStopping = true;
+        }
+        m_queueSpace.notify_all();
+        if (m_readerThread.joinable()) {
+            m_readerThread.join();
+        }
+    }
+
+    FileEventBatcher(const FileEventBatcher &orig) = delete;
+    FileEventBatcher& operator=(const FileEventBatcher &orig) = delete;
+
+    //
+    // Wait up to a timeout for events then return up to maxCount of them (appended to
+    // events). Returns the number of events returned; zero on timeout or once the
+    // watcher has stopped and all events have been delivered.
+    //
+
+    std::size_t getEvents(std::vector<Antik::File::CApprise::Event> &events, std::size_t maxCount,
+            std::chrono::milliseconds timeOut) {
+
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        auto deadline = std::chrono::steady_clock::now() + timeOut;
+        std::size_t delivered { 0 };
+
+        while (!m_queue.empty() || !m_bFinished) {
+            auto now = std::chrono::steady_clock::now();
+            if (!m_queue.empty() && (m_bFinished || !isHeld(m_queue.front(), now))) {
+                break;
+            }
+            auto wakeUp = deadline;
+            if (!m_queue.empty() && (m_queue.front().queued + m_coalesceWindow < wakeUp)) {
+                wakeUp = m_queue.front().queued + m_coalesceWindow;
+            }
+            if (now >= deadline) {
+                return (0);
+            }
+            m_queueEvents.wait_until(lock, wakeUp);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        while (!m_queue.empty() && (delivered < maxCount) && (m_bFinished || !isHeld(m_queue.front(), now))) {
+            QueuedEvent &front { m_queue.front() };
+            auto pending = m_pendingChanges.find(front.event.message);
+            if ((pending != m_pendingChanges.end()) && (pending->second == &front)) {
+                m_pendingChanges.erase(pending);
+            }
+            events.push_back(std::move(front.event));
+            m_queue.pop_front();
+            delivered++;
+        }
+
+        if (delivered) {
+            m_queueSpace.notify_one();
+        }
+
+        return (delivered);
+
+    }
+
+    //
+    // == false once the watcher has stopped and every event has been delivered.
+    //
+
+    bool stillWatching() {
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        return (!m_bFinished || !m_queue.empty());
+    }
+
+    //
+    // Number of change events folded into an earlier queued event.
+    //
+
+    std::uint64_t coalesced() {
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        return (m_coalesced);
+    }
+
+private:
+
+    struct QueuedEvent {
+        Antik::File::CApprise::Event event;              // File event
+        std::chrono::steady_clock::time_point queued;    // When it was queued
+    };
+
+    static bool isFoldable(Antik::File::CApprise::EventId id) {
+        return ((id == Antik::File::CApprise::Event_add) || (id == Antik::File::CApprise::Event_change));
+    }
+
+    bool isHeld(const QueuedEvent &queuedEvent, std::chrono::steady_clock::time_point now) const {
+        return (isFoldable(queuedEvent.event.id) && (now < queuedEvent.queued + m_coalesceWindow));
+    }
+
+    //
+    // Reader thread: queue events until the watcher stops.
+    //
+
+    void readEvents() {
+
+        while (m_fileWatcher.stillWatching()) {
+
+            Antik::File::CApprise::Event fileEvent;
+            m_fileWatcher.getNextEvent(fileEvent);
+            if (fileEvent.id == Antik::File::CApprise::Event_none) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+
+            if (fileEvent.id == Antik::File::CApprise::Event_change) {
+                if (m_pendingChanges.count(fileEvent.message)) {
+                    m_coalesced++;
+                    continue;
+                }
+            }
+
+            m_queueSpace.wait(lock, [this]() {
+                return ((m_queue.size() < m_maxQueued) || m_bStopping);
+            });
+            if (m_bStopping) {
+                break;
+            }
+
+            // Queue references stay valid as the deque is only added to / removed
+            // from at its ends.
+
+            m_queue.push_back({ std::move(fileEvent), std::chrono::steady_clock::now()});
+            if (isFoldable(m_queue.back().event.id)) {
+                m_pendingChanges[m_queue.back().event.message] = &m_queue.back();
+            } else {
+                m_pendingChanges.erase(m_queue.back().event.message);
+            }
+
+            lock.unlock();
+            m_queueEvents.notify_one();
+
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_bFinished = true;
+        }
+        m_queueEvents.notify_all();
+
+    }
+
+    Antik::File::CApprise &m_fileWatcher;            // Event source
+    std::chrono::milliseconds m_coalesceWindow;      // Hold add/change events for
+    std::size_t m_maxQueued { 0 };                   // Queued events limit
+    std::mutex m_queueMutex;                         // Queue guard
+    std::condition_variable m_queueEvents;           // Events queued / reader finished
+    std::condition_variable m_queueSpace;            // Events delivered / stopping
+    std::deque<QueuedEvent> m_queue;                 // Undelivered events
+    std::unordered_map<std::string, QueuedEvent *> m_pendingChanges; // Path to queued add/change event
+    std::uint64_t m_coalesced { 0 };                 // Folded change events
+    bool m_bFinished { false };                      // == true reader thread done
+    bool m_bStopping { false };                      // == true batcher being destroyed
+    std::thread m_readerThread;                      // Reader thread
+
+};
+
+#endif /* FILEEVENTBATCHER_HPP */
@@ -3,8 +3,11 @@
 //
 // Description: Program that uses CApprise class to log files events on passed in folders and
 // file. Any folders created in the watched directory are automatically added to the watch list.
+// In batch mode (--batch) events are taken a batch at a time, repeated change events for a
+// file within the coalesce window (--coalesce milliseconds) are folded into one, and each
+// batch is written to stdout in one block.
 //
-// Dependencies: C11++, Classes (CApprise, CFile, CPath),
+// Dependencies: C11++, Classes (CApprise, CFile, CPath, FileEventBatcher),
 //               Linux, Boost C++ Libraries.
 //
 
@@ -27,6 +30,7 @@
 #include "CApprise.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "FileEventBatcher.hpp"
 
 using namespace Antik::File;
 
@@ -50,8 +54,17 @@ namespace po = boost::program_options;
 struct ParamArgData {
     std::string configFileName;
     std::string watchList;
+    bool bBatch { false };     // == true batched, coalesced event output
+    int coalesceWindow { 0 };  // Coalesce window (milliseconds)
 };
 
+//
+// Maximum events output per batch and batch wait timeout
+//
+
+constexpr std::size_t kMaxBatchEvents { 4096 };
+constexpr std::chrono::milliseconds kBatchTimeOut { 1000 };
+
 // ===============
 // LOCAL FUNCTIONS
 // ===============
@@ -76,7 +89,10 @@ static void exitWithError(CApprise &fileWatcher, const std::string &errMsg) {
 static void addCommonOptions(po::options_description& commonOptions, ParamArgData& argData) {
 
     commonOptions.add_options()
-            ("watchlist,w", po::value<std::string>(&argData.watchList)->required(), "Folder/file watch list");
+            ("watchlist,w", po::value<std::string>(&argData.watchList)->required(), "Folder/file watch list")
+            ("batch,b", "Output events in batches with repeated changes coalesced")
+            ("coalesce", po::value<int>(&argData.coalesceWindow)->default_value(FileEventBatcher::kCoalesceWindow.count()),
+                "Coalesce window for change events in milliseconds (batch mode)");
 
 }
 
@@ -125,8 +141,18 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Batched event output
+
+        if (vm.count("batch")) {
+            argData.bBatch = true;
+        }
+
         po::notify(vm);
 
+        if (argData.coalesceWindow < 0) {
+            throw po::error("Coalesce window must not be negative.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "FileFolderWatcher Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -169,6 +195,33 @@ static const std::string getEventName(CApprise::EventId id) {
 
 }
 
+//
+// Output events in batches; each batch is formatted into one buffer and written
+// and flushed once.
+//
+
+static void outputEventBatches(CApprise &fileWatcher, const ParamArgData &argData) {
+
+    FileEventBatcher eventBatcher(fileWatcher, std::chrono::milliseconds(argData.coalesceWindow));
+    std::vector<CApprise::Event> fileEvents;
+    std::string output;
+
+    fileEvents.reserve(kMaxBatchEvents);
+
+    while (eventBatcher.stillWatching()) {
+        fileEvents.clear();
+        if (eventBatcher.getEvents(fileEvents, kMaxBatchEvents, kBatchTimeOut)) {
+            output.clear();
+            for (auto &fileEvent : fileEvents) {
+                output += getEventName(fileEvent.id) + " [" + fileEvent.message + "]\n";
+            }
+            std::cout.write(output.data(), output.size());
+            std::cout.flush();
+        }
+    }
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -204,10 +257,14 @@ int main(int argc, char** argv) {
         
         // Get events and output
         
-        while(fileWatcher.stillWatching()) {
-            CApprise::Event fileEvent;
-            fileWatcher.getNextEvent(fileEvent);
-            std::cout << getEventName(fileEvent.id) << " [" << fileEvent.message << "]" << std::endl;
+        if (argData.bBatch) {
+            outputEventBatches(fileWatcher, argData);
+        } else {
+            while (fileWatcher.stillWatching()) {
+                CApprise::Event fileEvent;
+                fileWatcher.getNextEvent(fileEvent);
+                std::cout << getEventName(fileEvent.id) << " [" << fileEvent.message << "]" << std::endl;
+            }
         }
         
         // Stop watching for events
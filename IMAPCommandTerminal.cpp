@@ -3,10 +3,19 @@
 //
 // Description: A Simple IMAP command console/terminal that logs on to a given IMAP server
 // and executes commands typed in. The raw command responses are echoed back as default but 
-// parsed responses are displayed if specified in program options.
+// parsed responses are displayed if specified in program options. With --script the
+// commands are instead read from a file (one per line, "#" comments) and pipelined
+// with up to --depth in flight; responses are matched back to their commands by tag
+// and per-command latency percentiles reported at the end. Commands that change the
+// selected mailbox or message numbers (SELECT, EXPUNGE etc.) are only sent once all
+// before them have completed. Untagged lines carry no tag so with more than one command
+// in flight they are shown with the next command to complete (by position, not by what
+// they answer); for that reason --parsed needs --depth 1. With --parsed each response is
+// also parsed and the parse time reported separately; any parse failure gives a failure
+// exit status.
 // 
 // Dependencies: C11++, Classes (CFile, CPath, CMailIMAP, CMailIMAPParse, CMailIMAPBodyStruct),
-//               Linux, Boost C++ Libraries.
+//               IMAPStreamConnection, Linux, Boost C++ Libraries.
 //
 // IMAPCommandTerminal
 // Program Options:
@@ -17,6 +26,10 @@
 //   -p [ --password ] arg User password
 //   --parsed              Response parsed
 //   --bodystruct          Parsed output includes bodystructs
+//   --script arg          Run commands from script file ("-" for stdin) in batch mode
+//   --depth arg (=1)      Batch mode commands in flight
+//   --repeat arg (=1)     Batch mode times to run script
+//   --timings arg         Batch mode per-command timings CSV file
 
 // =============
 // INCLUDE FILES
@@ -29,6 +42,22 @@
 #include <iostream>
 #include <deque>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//
+// Linux
+//
+
+#include <strings.h>
 
 //
 // Antik Classes
@@ -39,6 +68,7 @@
 #include "CIMAPBodyStruct.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "IMAPStreamConnection.hpp"
 
 using namespace Antik::IMAP;
 using namespace Antik::File;
@@ -64,6 +94,43 @@ struct ParamArgData {
     std::string configFileName;  // Configuration file name
     bool bParsed { false };      // true output parsed
     bool bBodystruct { false };  // Parsed output includes BODYSTRUCTS
+    std::string scriptFileName;  // Batch mode command script
+    int depth { 1 };             // Batch mode commands in flight
+    int repeat { 1 };            // Batch mode times to run script
+    std::string timingsFileName; // Batch mode per-command timings file
+};
+
+//
+// Batch mode command sent and waiting on its response
+//
+
+struct PendingCommand {
+    std::string command;                             // Command (without tag)
+    std::chrono::steady_clock::time_point sent;      // When sent
+    bool bBarrier { false };                         // == true nothing sent until done
+};
+
+//
+// Batch mode command timing
+//
+
+struct CommandTiming {
+    std::string tag;             // Command tag
+    std::string command;         // Command (without tag)
+    double latency { 0.0 };      // Seconds from send to tagged response
+    double parseTime { 0.0 };    // Seconds to parse response
+    bool bOK { false };          // == true tagged status OK
+    bool bParseError { false };  // == true response failed to parse
+};
+
+//
+// Commands that change the selected mailbox/state or message numbers; later commands
+// depend on them so they are not pipelined (RFC 3501 5.5).
+//
+
+static const std::unordered_set<std::string> kBarrierCommands {
+    "SELECT", "EXAMINE", "CLOSE", "UNSELECT", "EXPUNGE", "UID EXPUNGE", "LOGOUT",
+    "STARTTLS", "AUTHENTICATE", "LOGIN", "ENABLE", "COMPRESS"
 };
 
 // ===============
@@ -94,7 +161,11 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("parsed", "Response parsed")
-            ("bodystruct", "Parsed output includes bodystructs");
+            ("bodystruct", "Parsed output includes bodystructs")
+            ("script", po::value<std::string>(&argData.scriptFileName), "Run commands from script file (\"-\" for stdin) in batch mode")
+            ("depth", po::value<int>(&argData.depth)->default_value(1), "Batch mode commands in flight")
+            ("repeat", po::value<int>(&argData.repeat)->default_value(1), "Batch mode times to run script")
+            ("timings", po::value<std::string>(&argData.timingsFileName), "Batch mode per-command timings CSV file");
 
 }
 
@@ -157,6 +228,24 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
         po::notify(vm);
 
+        // Batch mode settings
+
+        if (argData.depth < 1) {
+            throw po::error("Depth must be at least 1.");
+        }
+
+        if (argData.bParsed && (argData.depth > 1) && !argData.scriptFileName.empty()) {
+            throw po::error("Parsed output needs --depth 1 (untagged responses can't be matched to pipelined commands).");
+        }
+
+        if (argData.repeat < 1) {
+            throw po::error("Repeat must be at least 1.");
+        }
+
+        if (!argData.timingsFileName.empty() && argData.scriptFileName.empty()) {
+            throw po::error("Timings are only recorded in batch mode (--script).");
+        }
+
     } catch (po::error& e) {
         std::cerr << "IMAPCommandTerminal Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -345,6 +434,284 @@ static void processIMAPResponse([[maybe_unused]] CIMAP& imap, CIMAPParse::COMMAN
 
 }
 
+//
+// Upper case command name (with the command after any UID prefix).
+//
+
+static std::string commandName(const std::string &command) {
+
+    std::istringstream commandStream(command);
+    std::string name, uidCommand;
+
+    commandStream >> name >> uidCommand;
+    if (name.size() == 3 && ::strcasecmp(name.c_str(), "UID") == 0) {
+        name += " " + uidCommand;
+    }
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+    return (name);
+
+}
+
+//
+// Read batch mode script; one command per line with blank lines and "#" comments
+// skipped and "exit" ending it.
+//
+
+static std::vector<std::string> readScript(const std::string &scriptFileName) {
+
+    std::ifstream scriptFileStream;
+    std::vector<std::string> script;
+
+    if (scriptFileName != "-") {
+        scriptFileStream.open(scriptFileName);
+        if (!scriptFileStream.is_open()) {
+            throw std::runtime_error("Could not open script file [" + scriptFileName + "]");
+        }
+    }
+    std::istream &scriptStream { (scriptFileName != "-") ? scriptFileStream : std::cin };
+
+    for (std::string commandLine; std::getline(scriptStream, commandLine);) {
+        if (!commandLine.empty() && (commandLine.back() == '\r')) {
+            commandLine.pop_back();
+        }
+        if (commandLine.empty() || (commandLine[0] == '#')) {
+            continue;
+        }
+        if (commandLine.compare("exit") == 0) {
+            break;
+        }
+        if ((commandName(commandLine) == "IDLE") || (commandLine.back() == '}')) {
+            throw std::runtime_error("IDLE and commands with literals cannot be run in batch mode [" + commandLine + "]");
+        }
+        script.push_back(commandLine);
+    }
+
+    if (script.empty()) {
+        throw std::runtime_error("Script file [" + scriptFileName + "] contains no commands.");
+    }
+
+    return (script);
+
+}
+
+//
+// Parse a batch mode command response (and any BODYSTRUCTUREs if asked for)
+// recording how long it took.
+//
+
+static void parseTimed(const ParamArgData &argData, const std::string &commandResponse, CommandTiming &timing) {
+
+    auto parseStart = std::chrono::steady_clock::now();
+
+    try {
+        CIMAPParse::COMMANDRESPONSE parsedResponse { CIMAPParse::parseResponse(commandResponse) };
+        if (argData.bBodystruct) {
+            for (auto &fetchEntry : parsedResponse->fetchList) {
+                if (fetchEntry.responseMap.count(kBODYSTRUCTURE)) {
+                    std::unique_ptr<CIMAPBodyStruct::BodyNode> treeBase { new CIMAPBodyStruct::BodyNode() };
+                    CIMAPBodyStruct::consructBodyStructTree(treeBase, fetchEntry.responseMap[kBODYSTRUCTURE]);
+                }
+            }
+        }
+    } catch (CIMAPParse::Exception &e) {
+        timing.bParseError = true;
+        std::cerr << "PARSE ERROR [" << timing.tag << " " << timing.command << "] " << e.what() << std::endl;
+        std::cerr << "RESPONSE IN ERRROR: [" << commandResponse << "]" << std::endl;
+    }
+
+    timing.parseTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count();
+
+}
+
+//
+// Percentile (nearest rank) of sorted times in milliseconds.
+//
+
+static double percentileMilliseconds(const std::vector<double> &sortedTimes, double percentile) {
+    if (sortedTimes.empty()) {
+        return (0.0);
+    }
+    std::size_t rank = static_cast<std::size_t> (std::ceil(percentile / 100.0 * sortedTimes.size()));
+    return (sortedTimes[std::max<std::size_t>(rank, 1) - 1] * 1000.0);
+}
+
+//
+// Display batch mode latency (and parse time) percentiles per command.
+//
+
+static void reportBatch(const ParamArgData &argData, const std::vector<CommandTiming> &timings, double elapsed) {
+
+    std::map<std::string, std::vector<const CommandTiming *>> commandTimings;
+    std::size_t failed { 0 }, parseErrors { 0 };
+
+    for (auto &timing : timings) {
+        commandTimings[commandName(timing.command)].push_back(&timing);
+        commandTimings["ALL"].push_back(&timing);
+        failed += !timing.bOK;
+        parseErrors += timing.bParseError;
+    }
+
+    std::cout << std::string(120, '*') << std::endl;
+    std::cout << "COMMANDS [" << timings.size() << "] FAILED [" << failed << "]";
+    if (argData.bParsed) {
+        std::cout << " PARSE ERRORS [" << parseErrors << "]";
+    }
+    std::cout << " DEPTH [" << argData.depth << "] ELAPSED [" << elapsed << "s] RATE [" <<
+            ((elapsed > 0) ? timings.size() / elapsed : 0) << " commands/s]" << std::endl;
+
+    std::cout << std::left << std::setw(16) << "COMMAND" << std::right << std::setw(8) << "COUNT" <<
+            std::setw(8) << "FAILED" << std::setw(10) << "P50 ms" << std::setw(10) << "P90 ms" <<
+            std::setw(10) << "P99 ms" << std::setw(10) << "MAX ms";
+    if (argData.bParsed) {
+        std::cout << std::setw(12) << "PARSE P50" << std::setw(12) << "PARSE P99" << std::setw(12) << "PARSE MAX";
+    }
+    std::cout << std::endl << std::fixed << std::setprecision(3);
+
+    for (auto &command : commandTimings) {
+        std::vector<double> latencies, parseTimes;
+        std::size_t commandFailed { 0 };
+        for (auto timing : command.second) {
+            latencies.push_back(timing->latency);
+            parseTimes.push_back(timing->parseTime);
+            commandFailed += !timing->bOK;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::sort(parseTimes.begin(), parseTimes.end());
+        std::cout << std::left << std::setw(16) << command.first << std::right << std::setw(8) << latencies.size() <<
+                std::setw(8) << commandFailed << std::setw(10) << percentileMilliseconds(latencies, 50) <<
+                std::setw(10) << percentileMilliseconds(latencies, 90) << std::setw(10) << percentileMilliseconds(latencies, 99) <<
+                std::setw(10) << percentileMilliseconds(latencies, 100);
+        if (argData.bParsed) {
+            std::cout << std::setw(12) << percentileMilliseconds(parseTimes, 50) <<
+                    std::setw(12) << percentileMilliseconds(parseTimes, 99) << std::setw(12) << percentileMilliseconds(parseTimes, 100);
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << std::defaultfloat << std::string(120, '+') << std::endl;
+
+}
+
+//
+// Write batch mode per-command timings as CSV.
+//
+
+static void writeTimings(const std::string &timingsFileName, const std::vector<CommandTiming> &timings) {
+
+    std::ofstream timingsStream(timingsFileName, std::ios::trunc);
+
+    timingsStream << "tag,command,status,latencySeconds,parseSeconds" << std::endl;
+    for (auto &timing : timings) {
+        std::string command { timing.command };
+        for (std::size_t quote = command.find('"'); quote != std::string::npos; quote = command.find('"', quote + 2)) {
+            command.insert(quote, 1, '"');
+        }
+        timingsStream << timing.tag << ",\"" << command << "\"," <<
+                (timing.bParseError ? "PARSE ERROR" : (timing.bOK ? "OK" : "FAILED")) << "," <<
+                timing.latency << "," << timing.parseTime << "\n";
+    }
+
+    if (!timingsStream) {
+        throw std::runtime_error("Could not write timings to [" + timingsFileName + "]");
+    }
+
+}
+
+//
+// Batch mode. Commands are sent without waiting until depth are in flight. A barrier
+// command is only sent once nothing is in flight and nothing more is sent until it
+// completes. With --parsed (which needs --depth 1 as untagged responses can't be
+// matched to one of several pipelined commands) each response is parsed as soon as
+// it completes. Returns false if any response failed to parse.
+//
+
+static bool runBatch(const ParamArgData &argData) {
+
+    std::vector<std::string> script { readScript(argData.scriptFileName) };
+    std::size_t totalCommands { script.size() * argData.repeat };
+    std::size_t nextCommand { 0 };
+    std::unordered_map<std::string, PendingCommand> pendingCommands;
+    std::vector<CommandTiming> timings;
+    bool bBarrierInFlight { false };
+    IMAPStreamConnection imapStream;
+
+    imapStream.setServer(argData.serverURL);
+    imapStream.setUserAndPassword(argData.userName, argData.userPassword);
+
+    imapStream.connect();
+
+    timings.reserve(totalCommands);
+
+    auto runStart = std::chrono::steady_clock::now();
+
+    while ((nextCommand < totalCommands) || !pendingCommands.empty()) {
+
+        // Top up commands in flight
+
+        while (!bBarrierInFlight && (nextCommand < totalCommands) &&
+                (pendingCommands.size() < static_cast<std::size_t> (argData.depth))) {
+            const std::string &command { script[nextCommand % script.size()] };
+            bool bBarrier { kBarrierCommands.count(commandName(command)) != 0 };
+            if (bBarrier && !pendingCommands.empty()) {
+                break;
+            }
+            pendingCommands[imapStream.sendCommandPipelined(command)] = { command, std::chrono::steady_clock::now(), bBarrier };
+            bBarrierInFlight = bBarrier;
+            nextCommand++;
+        }
+
+        // Wait for next command to complete
+
+        std::string tag;
+        std::string commandResponse { imapStream.readPipelinedResponse(tag) };
+        auto completed = std::chrono::steady_clock::now();
+
+        auto pendingCommand = pendingCommands.find(tag);
+        if (pendingCommand == pendingCommands.end()) {
+            throw IMAPStreamConnection::Exception("Response for unknown tag [" + tag + "]");
+        }
+
+        CommandTiming timing;
+        timing.tag = tag;
+        timing.command = pendingCommand->second.command;
+        timing.latency = std::chrono::duration<double>(completed - pendingCommand->second.sent).count();
+        timing.bOK = IMAPStreamConnection::bStatusOK(commandResponse);
+        timings.push_back(timing);
+
+        if (!timing.bOK) {
+            std::size_t statusLine { commandResponse.rfind("\r\n", commandResponse.size() - 3) };
+            statusLine = (statusLine == std::string::npos) ? 0 : statusLine + 2;
+            std::cout << "COMMAND FAILED [" << tag << " " << timing.command << "] " << commandResponse.substr(statusLine) << std::flush;
+        }
+
+        if (pendingCommand->second.bBarrier) {
+            bBarrierInFlight = false;
+        }
+        pendingCommands.erase(pendingCommand);
+
+        if (argData.bParsed) {
+            parseTimed(argData, commandResponse, timings.back());
+        }
+
+    }
+
+    double elapsed { std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count() };
+
+    imapStream.disconnect();
+
+    reportBatch(argData, timings, elapsed);
+
+    if (!argData.timingsFileName.empty()) {
+        writeTimings(argData.timingsFileName, timings);
+    }
+
+    return (std::none_of(timings.begin(), timings.end(), [](const CommandTiming & timing) {
+        return (timing.bParseError);
+    }));
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -364,6 +731,12 @@ int main(int argc, char** argv) {
         std::cout << "SERVER [" << argData.serverURL << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
 
+        // Batch mode
+
+        if (!argData.scriptFileName.empty()) {
+            exit(runBatch(argData) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
         // Set mail account user name and password
 
         imap.setServer(argData.serverURL);
@@ -0,0 +1,637 @@
+#ifndef IMAPSTREAMCONNECTION_HPP
+#define IMAPSTREAMCONNECTION_HPP
+
+//
+// Header: IMAPStreamConnection
+//
+// Description: IMAP connection for the mail example programs that reads command
+// responses incrementally instead of returning them as one string. Like CIMAP it
+// uses libcurl in connect only mode (so imap:// and imaps:// URLs are supported)
+// but any {n} literal in a response may be handed to a caller supplied sink in
+// chunks as it arrives; a sunk literal is replaced by an empty one ({0}) in the
+// response returned so that it can still be parsed with CIMAPParse without the
+// literal data ever being held in memory. It also supports IDLE, reading
+// unsolicited responses without blocking so that many connections may be watched
+// from one event loop, and pipelining (commands sent without waiting and their
+// responses read back as they complete). If asked for, COMPRESS=DEFLATE (RFC 4978)
+// is negotiated after login when the server advertises it; everything sent and
+// received from then on is deflated/inflated as a stream.
+//
+// Dependencies: C11++, libcurl, Linux, zlib.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <poll.h>
+
+//
+// libcurl
+//
+
+#include <curl/curl.h>
+
+//
+// zlib
+//
+
+#include <zlib.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// Literal sink. begin() is passed the response text preceding the literal and its
+// length and returns true if the literal is to be sunk (false keeps it inline in the
+// returned response); data() is then called with each chunk and end() once it has
+// all been received.
+//
+
+struct IMAPLiteralSink {
+    std::function<bool(const std::string &responsePrefix, std::uint64_t length)> begin;
+    std::function<void(const char *data, std::size_t length)> data;
+    std::function<void()> end;
+};
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class IMAPStreamConnection {
+public:
+
+    //
+    // Class exception
+    //
+
+    struct Exception : public std::runtime_error {
+        explicit Exception(std::string const& message)
+        : std::runtime_error("IMAPStreamConnection Failure: " + message) {
+        }
+    };
+
+    //
+    // Socket wait timeout (milliseconds) and receive chunk size
+    //
+
+    static constexpr int kWaitTimeOut { 60 * 1000 };
+    static constexpr std::size_t kReadChunkSize { 64 * 1024 };
+
+    IMAPStreamConnection() {
+    }
+
+    ~IMAPStreamConnection() {
+        endCompression();
+        if (m_curlHandle) {
+            curl_easy_cleanup(m_curlHandle);
+        }
+    }
+
+    IMAPStreamConnection(const IMAPStreamConnection &orig) = delete;
+    IMAPStreamConnection& operator=(const IMAPStreamConnection &orig) = delete;
+
+    void setServer(const std::string &serverURL) {
+        m_serverURL = serverURL;
+    }
+
+    void setUserAndPassword(const std::string &userName, const std::string &userPassword) {
+        m_userName = userName;
+        m_userPassword = userPassword;
+    }
+
+    //
+    // Negotiate COMPRESS=DEFLATE on connect if the server supports it.
+    //
+
+    void setCompression(bool bCompression) {
+        m_bCompression = bCompression;
+    }
+
+    //
+    // Connect to server and login. In connect only mode libcurl still performs the
+    // IMAP protocol connect (greeting, CAPABILITY, STARTTLS and login with the
+    // supplied credentials) before returning the connection for our own commands.
+    //
+
+    void connect() {
+
+        m_curlHandle = curl_easy_init();
+        if (!m_curlHandle) {
+            throw Exception("Could not allocate curl handle.");
+        }
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_URL, m_serverURL.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_USERNAME, m_userName.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_PASSWORD, m_userPassword.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_CONNECT_ONLY, 1L);
+
+        CURLcode result = curl_easy_perform(m_curlHandle);
+        if (result != CURLE_OK) {
+            throw Exception(std::string("Could not connect to server. ") + curl_easy_strerror(result));
+        }
+
+        result = curl_easy_getinfo(m_curlHandle, CURLINFO_ACTIVESOCKET, &m_socket);
+        if ((result != CURLE_OK) || (m_socket == CURL_SOCKET_BAD)) {
+            throw Exception("Could not get connection socket.");
+        }
+
+        m_bConnected = true;
+
+        if (m_bCompression) {
+            startCompression();
+        }
+
+    }
+
+    //
+    // LOGOUT and close connection.
+    //
+
+    void disconnect() {
+        if (m_bConnected) {
+            m_bConnected = false;
+            try {
+                sendCommand("LOGOUT");
+            } catch (...) {
+                // Connection is being closed anyway
+            }
+        }
+        endCompression();
+        if (m_curlHandle) {
+            curl_easy_cleanup(m_curlHandle);
+            m_curlHandle = nullptr;
+        }
+    }
+
+    bool getConnectedStatus() const {
+        return (m_bConnected);
+    }
+
+    //
+    // == true COMPRESS=DEFLATE is active on the connection.
+    //
+
+    bool getCompressedStatus() const {
+        return (m_bCompressed);
+    }
+
+    //
+    // Send a command and read its response up to and including the tagged status
+    // line. Literals are streamed to the sink if one is given (and it accepts them);
+    // otherwise they are returned inline in the response as CIMAP::sendCommand does.
+    //
+
+    std::string sendCommand(const std::string &command, const IMAPLiteralSink *literalSink = nullptr) {
+
+        std::string tag { nextTag() };
+
+        sendAll(tag + " " + command + "\r\n");
+
+        return (readResponse(tag, literalSink));
+
+    }
+
+    //
+    // Send a command without waiting for its response and return its tag. Responses
+    // to pipelined commands are read with readPipelinedResponse() (commands containing
+    // literals cannot be pipelined as they wait on a server continuation).
+    //
+
+    std::string sendCommandPipelined(const std::string &command) {
+
+        std::string tag { nextTag() };
+
+        sendAll(tag + " " + command + "\r\n");
+
+        return (tag);
+
+    }
+
+    //
+    // Read the response of the next pipelined command to complete (up to and including
+    // its tagged status line) returning its tag in completedTag. Any untagged responses
+    // received since the last command completed are included; they carry no tag so are
+    // attributed by position (to the next command to complete), which with several
+    // commands in flight need not be the command they answer.
+    //
+
+    std::string readPipelinedResponse(std::string &completedTag) {
+        return (readResponse("", nullptr, &completedTag));
+    }
+
+    //
+    // Send IDLE and wait for the server continuation. Any unsolicited responses are
+    // then read with readUnsolicited() until endIdle() is called.
+    //
+
+    void startIdle() {
+        m_idleTag = nextTag();
+        sendAll(m_idleTag + " IDLE\r\n");
+        for (;;) {
+            std::string line { readLine() };
+            if (line.compare(0, 1, "+") == 0) {
+                return;
+            } else if (line.compare(0, m_idleTag.size() + 1, m_idleTag + " ") == 0) {
+                m_idleTag.clear();
+                throw Exception("IDLE failed [" + line + "]");
+            }
+            m_unsolicitedLines.push_back(line);
+        }
+    }
+
+    //
+    // Send DONE to end IDLE and return the rest of its response up to and including
+    // the tagged status line.
+    //
+
+    std::string endIdle() {
+        std::string response;
+        sendAll("DONE\r\n");
+        for (;;) {
+            std::string line { readLine() };
+            response += line + "\r\n";
+            if (line.compare(0, m_idleTag.size() + 1, m_idleTag + " ") == 0) {
+                break;
+            }
+        }
+        m_idleTag.clear();
+        return (response);
+    }
+
+    //
+    // Read any complete unsolicited response lines (IDLE or NOTIFY) that have arrived
+    // without waiting; returns true if there were any.
+    //
+
+    bool readUnsolicited(std::vector<std::string> &lines) {
+        std::size_t lineEnd;
+        for (;;) {
+            while ((lineEnd = m_readBuffer.find("\r\n", m_readPosition)) != std::string::npos) {
+                m_unsolicitedLines.push_back(m_readBuffer.substr(m_readPosition, lineEnd - m_readPosition));
+                m_readPosition = lineEnd + 2;
+            }
+            if (!receiveMore(false)) {
+                break;
+            }
+        }
+        bool bLines { !m_unsolicitedLines.empty() };
+        lines.insert(lines.end(), m_unsolicitedLines.begin(), m_unsolicitedLines.end());
+        m_unsolicitedLines.clear();
+        return (bLines);
+    }
+
+    //
+    // Are there complete unsolicited lines already received (for example along with
+    // the IDLE continuation or a command's tagged response) ? The socket will not
+    // become readable for these so they should be read before waiting on it.
+    //
+
+    bool hasBufferedLines() const {
+        return (!m_unsolicitedLines.empty() || (m_readBuffer.find("\r\n", m_readPosition) != std::string::npos));
+    }
+
+    //
+    // Connection socket (for use with poll/epoll).
+    //
+
+    curl_socket_t getSocket() const {
+        return (m_socket);
+    }
+
+    //
+    // Is the tagged status in a response OK ?
+    //
+
+    static bool bStatusOK(const std::string &response) {
+        std::size_t lastLine = response.rfind("\r\n", response.size() - 3);
+        lastLine = (lastLine == std::string::npos) ? 0 : lastLine + 2;
+        std::size_t status = response.find(' ', lastLine);
+        return ((status != std::string::npos) && (response.compare(status + 1, 2, "OK") == 0));
+    }
+
+private:
+
+    std::string nextTag() {
+        std::string tag { std::to_string(++m_tagCount) };
+        return ("A" + std::string(tag.size() < 6 ? 6 - tag.size() : 0, '0') + tag);
+    }
+
+    //
+    // Read a response up to and including the tagged status line for tag (or for any
+    // tag if empty, returning it in completedTag).
+    //
+
+    std::string readResponse(const std::string &tag, const IMAPLiteralSink *literalSink, std::string *completedTag = nullptr) {
+
+        std::string response, responseLine;
+
+        for (;;) {
+
+            std::string segment { readLine() };
+            std::uint64_t literalLength { 0 };
+
+            responseLine += segment;
+
+            if (literalAtEnd(segment, literalLength)) {
+                if (literalSink && literalSink->begin && literalSink->begin(responseLine, literalLength)) {
+                    responseLine.erase(responseLine.rfind('{'));
+                    responseLine += "{0}\r\n";
+                    readLiteral(literalLength, literalSink);
+                } else {
+                    responseLine += "\r\n";
+                    readLiteral(literalLength, nullptr, &responseLine);
+                }
+                continue;
+            }
+
+            response += responseLine + "\r\n";
+
+            if (tag.empty() ? bTaggedLine(responseLine) : (responseLine.compare(0, tag.size() + 1, tag + " ") == 0)) {
+                if (completedTag) {
+                    *completedTag = responseLine.substr(0, responseLine.find(' '));
+                }
+                break;
+            }
+
+            responseLine.clear();
+
+        }
+
+        return (response);
+
+    }
+
+    //
+    // Is a response line tagged (not untagged "*" or a "+" continuation) ?
+    //
+
+    static bool bTaggedLine(const std::string &line) {
+        return (!line.empty() && (line[0] != '*') && (line[0] != '+'));
+    }
+
+    //
+    // Does a response line end with a literal ({n} or {n+}) ?
+    //
+
+    static bool literalAtEnd(const std::string &line, std::uint64_t &literalLength) {
+        if (line.empty() || (line.back() != '}')) {
+            return (false);
+        }
+        std::size_t literalStart = line.rfind('{');
+        if (literalStart == std::string::npos) {
+            return (false);
+        }
+        const char *lengthStart = line.c_str() + literalStart + 1;
+        char *lengthEnd { nullptr };
+        literalLength = std::strtoull(lengthStart, &lengthEnd, 10);
+        if ((lengthEnd == lengthStart) || ((*lengthEnd != '}') && (*lengthEnd != '+'))) {
+            return (false);
+        }
+        return (true);
+    }
+
+    //
+    // Wait for the socket to be readable/writeable.
+    //
+
+    void waitOnSocket(bool bRecv) {
+        struct pollfd pollSocket { m_socket, static_cast<short> (bRecv ? POLLIN : POLLOUT), 0 };
+        int result = poll(&pollSocket, 1, kWaitTimeOut);
+        if (result == 0) {
+            throw Exception("Timeout waiting on server.");
+        } else if (result < 0) {
+            throw Exception(std::string("Error waiting on socket. ") + std::strerror(errno));
+        }
+    }
+
+    //
+    // Send RFC 4978 COMPRESS DEFLATE if the server advertises it; raw deflate (no
+    // zlib header) is used in both directions once it has returned OK. Anything
+    // already received past the OK is compressed so is inflated.
+    //
+
+    void startCompression() {
+
+        std::string capabilities { sendCommand("CAPABILITY") };
+        std::size_t capabilityLine { capabilities.find("* CAPABILITY ") };
+        if (capabilityLine == std::string::npos) {
+            return;
+        }
+        capabilities = capabilities.substr(capabilityLine, capabilities.find("\r\n", capabilityLine) - capabilityLine) + " ";
+        for (auto &character : capabilities) {
+            character = std::toupper(static_cast<unsigned char> (character));
+        }
+        if (capabilities.find(" COMPRESS=DEFLATE ") == std::string::npos) {
+            return;
+        }
+
+        if (!bStatusOK(sendCommand("COMPRESS DEFLATE"))) {
+            return;
+        }
+
+        if (deflateInit2(&m_deflateStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw Exception("Could not initialise deflate.");
+        }
+        if (inflateInit2(&m_inflateStream, -MAX_WBITS) != Z_OK) {
+            deflateEnd(&m_deflateStream);
+            throw Exception("Could not initialise inflate.");
+        }
+        m_bCompressed = true;
+
+        std::string compressed { m_readBuffer.substr(m_readPosition) };
+        m_readBuffer.clear();
+        m_readPosition = 0;
+        if (!compressed.empty()) {
+            appendReceived(compressed.data(), compressed.size());
+        }
+
+    }
+
+    void endCompression() {
+        if (m_bCompressed) {
+            deflateEnd(&m_deflateStream);
+            inflateEnd(&m_inflateStream);
+            m_bCompressed = false;
+        }
+    }
+
+    //
+    // Send data (deflated with a sync flush so the server gets all of it now).
+    //
+
+    void sendAll(const std::string &data) {
+
+        if (!m_bCompressed) {
+            sendRaw(data.data(), data.size());
+            return;
+        }
+
+        std::string compressed;
+        char chunk[kReadChunkSize];
+
+        m_deflateStream.next_in = reinterpret_cast<Bytef *> (const_cast<char *> (data.data()));
+        m_deflateStream.avail_in = data.size();
+        do {
+            m_deflateStream.next_out = reinterpret_cast<Bytef *> (chunk);
+            m_deflateStream.avail_out = sizeof (chunk);
+            if (deflate(&m_deflateStream, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+                throw Exception("Error deflating command.");
+            }
+            compressed.append(chunk, sizeof (chunk) - m_deflateStream.avail_out);
+        } while (m_deflateStream.avail_out == 0);
+
+        sendRaw(compressed.data(), compressed.size());
+
+    }
+
+    void sendRaw(const char *data, std::size_t size) {
+        std::size_t bytesSent { 0 };
+        while (bytesSent < size) {
+            std::size_t sent { 0 };
+            CURLcode result = curl_easy_send(m_curlHandle, data + bytesSent, size - bytesSent, &sent);
+            if (result == CURLE_AGAIN) {
+                waitOnSocket(false);
+                continue;
+            } else if (result != CURLE_OK) {
+                throw Exception(std::string("Error sending command. ") + curl_easy_strerror(result));
+            }
+            bytesSent += sent;
+        }
+    }
+
+    //
+    // Receive more data into the read buffer; if not waiting returns false when there
+    // is none available.
+    //
+
+    bool receiveMore(bool bWait = true) {
+        char chunk[kReadChunkSize];
+        for (;;) {
+            std::size_t received { 0 };
+            CURLcode result = curl_easy_recv(m_curlHandle, chunk, sizeof (chunk), &received);
+            if (result == CURLE_AGAIN) {
+                if (!bWait) {
+                    return (false);
+                }
+                waitOnSocket(true);
+                continue;
+            } else if (result != CURLE_OK) {
+                throw Exception(std::string("Error reading response. ") + curl_easy_strerror(result));
+            } else if (received == 0) {
+                m_bConnected = false;
+                throw Exception("Connection closed by server.");
+            }
+            appendReceived(chunk, received);
+            return (true);
+        }
+    }
+
+    //
+    // Add received data (inflated if compressed) to the read buffer.
+    //
+
+    void appendReceived(const char *data, std::size_t size) {
+
+        m_readBuffer.erase(0, m_readPosition);
+        m_readPosition = 0;
+
+        if (!m_bCompressed) {
+            m_readBuffer.append(data, size);
+            return;
+        }
+
+        char chunk[kReadChunkSize];
+
+        m_inflateStream.next_in = reinterpret_cast<Bytef *> (const_cast<char *> (data));
+        m_inflateStream.avail_in = size;
+        do {
+            m_inflateStream.next_out = reinterpret_cast<Bytef *> (chunk);
+            m_inflateStream.avail_out = sizeof (chunk);
+            int result = inflate(&m_inflateStream, Z_SYNC_FLUSH);
+            if ((result != Z_OK) && (result != Z_BUF_ERROR)) {
+                throw Exception("Error inflating response.");
+            }
+            m_readBuffer.append(chunk, sizeof (chunk) - m_inflateStream.avail_out);
+        } while (m_inflateStream.avail_out == 0);
+
+    }
+
+    //
+    // Read a response line (without its CRLF).
+    //
+
+    std::string readLine() {
+        std::size_t lineEnd;
+        while ((lineEnd = m_readBuffer.find("\r\n", m_readPosition)) == std::string::npos) {
+            receiveMore();
+        }
+        std::string line { m_readBuffer.substr(m_readPosition, lineEnd - m_readPosition) };
+        m_readPosition = lineEnd + 2;
+        return (line);
+    }
+
+    //
+    // Read literal passing it to sink in chunks or appending it to a response.
+    //
+
+    void readLiteral(std::uint64_t literalLength, const IMAPLiteralSink *literalSink, std::string *response = nullptr) {
+        while (literalLength) {
+            if (m_readPosition == m_readBuffer.size()) {
+                receiveMore();
+            }
+            std::size_t available = std::min<std::uint64_t>(m_readBuffer.size() - m_readPosition, literalLength);
+            if (literalSink) {
+                literalSink->data(m_readBuffer.data() + m_readPosition, available);
+            } else {
+                response->append(m_readBuffer, m_readPosition, available);
+            }
+            m_readPosition += available;
+            literalLength -= available;
+        }
+        if (literalSink && literalSink->end) {
+            literalSink->end();
+        }
+        if (m_readPosition == m_readBuffer.size()) {
+            m_readBuffer.clear();
+            m_readPosition = 0;
+        }
+    }
+
+    std::string m_serverURL;               // IMAP server URL
+    std::string m_userName;                // Account user name
+    std::string m_userPassword;            // Account password
+    CURL *m_curlHandle { nullptr };        // curl connect only handle
+    curl_socket_t m_socket { CURL_SOCKET_BAD }; // Connection socket
+    bool m_bConnected { false };           // == true connected and logged in
+    std::uint64_t m_tagCount { 0 };        // Command tag counter
+    std::string m_readBuffer;              // Received data not yet consumed
+    std::size_t m_readPosition { 0 };      // Position of unconsumed data in buffer
+    std::string m_idleTag;                 // Tag of IDLE in progress
+    std::vector<std::string> m_unsolicitedLines; // Unsolicited lines not yet returned
+    bool m_bCompression { false };         // == true negotiate COMPRESS=DEFLATE
+    bool m_bCompressed { false };          // == true COMPRESS=DEFLATE active
+    z_stream m_deflateStream {};           // Command deflate stream
+    z_stream m_inflateStream {};           // Response inflate stream
+
+};
+
+#endif /* IMAPSTREAMCONNECTION_HPP */
@@ -0,0 +1,380 @@
+#ifndef MAILARCHIVEWRITER_HPP
+#define MAILARCHIVEWRITER_HPP
+
+//
+// Header: MailArchiveWriter
+//
+// Description: Output side of the mail archive programs. Each e-mail is written from
+// the fetched response (or a streamed part file) straight to its destination with
+// writev(), either as its own .eml file or appended to a single mboxrd style pack
+// file per mailbox (a "From uid-<UID>@ArchiveMailBox <date>" separator line and
+// ">From " quoting) so that a mailbox need not become millions of tiny files.
+//
+// Archived e-mails are passed to a record function (used to update the mailbox
+// index) once written; in sync mode they are first made durable in batches, one
+// fdatasync() per file (or just one for the pack file) and one fsync() of the
+// folder per batch, so that the index never records an e-mail that could be lost.
+//
+// Dependencies: C11++, Linux.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <climits>
+
+//
+// Linux
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class MailArchiveWriter {
+public:
+
+    //
+    // Class exception
+    //
+
+    struct Exception : public std::runtime_error {
+        explicit Exception(std::string const& message)
+        : std::runtime_error("MailArchiveWriter Failure: " + message) {
+        }
+    };
+
+    //
+    // Record function called for each archived e-mail with its UID and archived name
+    // (.eml file name or "<pack file>#<offset>").
+    //
+
+    typedef std::function<void(std::uint64_t uid, const std::string &archivedName)> RecordFn;
+
+    //
+    // Pack file name and number of e-mails made durable together in sync mode.
+    //
+
+    static constexpr const char *kPackFileName { "ArchiveMailBox.mbox" };
+    static constexpr std::size_t kSyncBatchSize { 64 };
+
+    MailArchiveWriter(const std::string &folder, bool bPack, bool bSync, RecordFn recordFn)
+    : m_folder{ folder}, m_bPack{ bPack}, m_bSync{ bSync}, m_recordFn{ recordFn} {
+    }
+
+    ~MailArchiveWriter() {
+        try {
+            commit();
+        } catch (...) {
+            // Un-committed e-mails are not recorded and so are fetched again next run
+        }
+        if (m_packFd != -1) {
+            close(m_packFd);
+        }
+    }
+
+    MailArchiveWriter(const MailArchiveWriter &orig) = delete;
+    MailArchiveWriter& operator=(const MailArchiveWriter &orig) = delete;
+
+    //
+    // Where an e-mail is written (for progress output).
+    //
+
+    std::string destination(const std::string &emlFileName) const {
+        return (folderPath(m_bPack ? kPackFileName : emlFileName));
+    }
+
+    //
+    // Archive an e-mail held in memory.
+    //
+
+    void write(std::uint64_t uid, const std::string &emlFileName, const char *data, std::size_t length) {
+
+        if (m_bPack) {
+            appendToPack(uid, data, length);
+            return;
+        }
+
+        std::string emlFilePath { folderPath(emlFileName) };
+        int fd = open(emlFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            throw Exception("Could not create [" + emlFilePath + "]: " + std::strerror(errno));
+        }
+
+        std::vector<struct iovec> iov { { const_cast<char *> (data), length } };
+        if (!length || (data[length - 1] != '\n')) {
+            iov.push_back({ const_cast<char *> ("\n"), 1 });
+        }
+
+        try {
+            writeAll(fd, iov);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+
+        written(uid, emlFileName, fd);
+
+    }
+
+    //
+    // Archive an e-mail streamed to a part file (which is renamed or appended to the
+    // pack file and removed).
+    //
+
+    void writeFile(std::uint64_t uid, const std::string &emlFileName, const std::string &partFileName) {
+
+        if (m_bPack) {
+            int fd = open(partFileName.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                throw Exception("Could not open [" + partFileName + "]: " + std::strerror(errno));
+            }
+            struct stat fileStat {};
+            fstat(fd, &fileStat);
+            void *mapped { MAP_FAILED };
+            if (fileStat.st_size > 0) {
+                mapped = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            close(fd);
+            if ((fileStat.st_size > 0) && (mapped == MAP_FAILED)) {
+                throw Exception("Could not map [" + partFileName + "]: " + std::strerror(errno));
+            }
+            try {
+                appendToPack(uid, static_cast<const char *> (mapped != MAP_FAILED ? mapped : ""), fileStat.st_size);
+            } catch (...) {
+                if (mapped != MAP_FAILED) munmap(mapped, fileStat.st_size);
+                throw;
+            }
+            if (mapped != MAP_FAILED) {
+                munmap(mapped, fileStat.st_size);
+            }
+            unlink(partFileName.c_str());
+            return;
+        }
+
+        int fd { -1 };
+        if (m_bSync) {
+            fd = open(partFileName.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                throw Exception("Could not open [" + partFileName + "]: " + std::strerror(errno));
+            }
+        }
+
+        std::string emlFilePath { folderPath(emlFileName) };
+        if (rename(partFileName.c_str(), emlFilePath.c_str()) == -1) {
+            if (fd != -1) close(fd);
+            throw Exception("Could not rename [" + partFileName + "]: " + std::strerror(errno));
+        }
+
+        written(uid, emlFileName, fd);
+
+    }
+
+    //
+    // Make any pending e-mails durable and record them.
+    //
+
+    void commit() {
+
+        if (m_pending.empty()) {
+            return;
+        }
+
+        if (m_bSync) {
+            for (auto &pending : m_pending) {
+                if ((pending.fd != -1) && (fdatasync(pending.fd) == -1)) {
+                    throw Exception("fdatasync() failed: " + std::string(std::strerror(errno)));
+                }
+            }
+            if ((m_packFd != -1) && (fdatasync(m_packFd) == -1)) {
+                throw Exception("fdatasync() failed: " + std::string(std::strerror(errno)));
+            }
+            int folderFd = open(m_folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (folderFd != -1) {
+                fsync(folderFd);
+                close(folderFd);
+            }
+        }
+
+        for (auto &pending : m_pending) {
+            if (pending.fd != -1) {
+                close(pending.fd);
+                pending.fd = -1;
+            }
+            m_recordFn(pending.uid, pending.archivedName);
+        }
+
+        m_pending.clear();
+
+    }
+
+    //
+    // Call a record function for each e-mail in a folder's pack file (used when
+    // rebuilding a mailbox index).
+    //
+
+    static void scanPackFile(const std::string &folder, RecordFn recordFn) {
+
+        std::ifstream packStream(folder + "/" + kPackFileName, std::ios::binary);
+        std::uint64_t offset { 0 };
+        const std::string kSeparator { "From uid-" };
+
+        for (std::string line; std::getline(packStream, line);) {
+            if (line.compare(0, kSeparator.size(), kSeparator) == 0) {
+                std::uint64_t uid { std::strtoull(line.c_str() + kSeparator.size(), nullptr, 10) };
+                if (uid) {
+                    recordFn(uid, std::string(kPackFileName) + "#" + std::to_string(offset));
+                }
+            }
+            offset += line.size() + 1;
+        }
+
+    }
+
+private:
+
+    struct PendingEmail {
+        std::uint64_t uid;         // E-mail UID
+        std::string archivedName;  // Name recorded in index
+        int fd;                    // File to sync (-1 none)
+    };
+
+    std::string folderPath(const std::string &fileName) const {
+        return (m_folder + "/" + fileName);
+    }
+
+    //
+    // E-mail written; record it now or, in sync mode, once the batch is durable.
+    //
+
+    void written(std::uint64_t uid, const std::string &archivedName, int fd) {
+        if (!m_bSync && (fd != -1)) {
+            close(fd);
+            fd = -1;
+        }
+        m_pending.push_back({ uid, archivedName, fd});
+        if (!m_bSync || (m_pending.size() >= kSyncBatchSize)) {
+            commit();
+        }
+    }
+
+    //
+    // Write all of an I/O vector (IOV_MAX entries at a time) handling short writes.
+    //
+
+    static void writeAll(int fd, std::vector<struct iovec> &iov) {
+        std::size_t first { 0 };
+        while (first < iov.size()) {
+            int count = static_cast<int> (std::min<std::size_t>(iov.size() - first, IOV_MAX));
+            ssize_t bytesWritten = writev(fd, &iov[first], count);
+            if (bytesWritten == -1) {
+                if (errno == EINTR) continue;
+                throw Exception("write failed: " + std::string(std::strerror(errno)));
+            }
+            while ((first < iov.size()) && (static_cast<std::size_t> (bytesWritten) >= iov[first].iov_len)) {
+                bytesWritten -= iov[first].iov_len;
+                first++;
+            }
+            if (bytesWritten) {
+                iov[first].iov_base = static_cast<char *> (iov[first].iov_base) + bytesWritten;
+                iov[first].iov_len -= bytesWritten;
+            }
+        }
+    }
+
+    //
+    // Append an e-mail to the pack file: separator line, body with any (possibly
+    // already quoted) "From " line quoted with '>' and a blank line. The body is
+    // written from where it is; only the quote characters are added.
+    //
+
+    void appendToPack(std::uint64_t uid, const char *data, std::size_t length) {
+
+        if (m_packFd == -1) {
+            std::string packFilePath { folderPath(kPackFileName) };
+            m_packFd = open(packFilePath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (m_packFd == -1) {
+                throw Exception("Could not open [" + packFilePath + "]: " + std::strerror(errno));
+            }
+            m_packOffset = lseek(m_packFd, 0, SEEK_END);
+        }
+
+        std::time_t now { std::time(nullptr) };
+        char date[32] {};
+        std::strftime(date, sizeof (date), "%a %b %e %H:%M:%S %Y", std::gmtime(&now));
+        std::string separator { "From uid-" + std::to_string(uid) + "@ArchiveMailBox " + date + "\n" };
+
+        std::vector<struct iovec> iov { { separator.data(), separator.size() } };
+        const char *end { data + length };
+        const char *segmentStart { data };
+
+        for (const char *lineStart = data; lineStart < end;) {
+            const char *quoted { lineStart };
+            while ((quoted < end) && (*quoted == '>')) {
+                quoted++;
+            }
+            if ((end - quoted >= 5) && (std::memcmp(quoted, "From ", 5) == 0)) {
+                if (lineStart != segmentStart) {
+                    iov.push_back({ const_cast<char *> (segmentStart), static_cast<std::size_t> (lineStart - segmentStart) });
+                }
+                iov.push_back({ const_cast<char *> (">"), 1 });
+                segmentStart = lineStart;
+            }
+            const char *lineEnd = static_cast<const char *> (std::memchr(lineStart, '\n', end - lineStart));
+            lineStart = lineEnd ? lineEnd + 1 : end;
+        }
+
+        if (segmentStart != end) {
+            iov.push_back({ const_cast<char *> (segmentStart), static_cast<std::size_t> (end - segmentStart) });
+        }
+        iov.push_back({ const_cast<char *> ((length && (data[length - 1] == '\n')) ? "\n" : "\n\n"),
+            static_cast<std::size_t> ((length && (data[length - 1] == '\n')) ? 1 : 2) });
+
+        std::size_t appendLength { 0 };
+        for (auto &vector : iov) {
+            appendLength += vector.iov_len;
+        }
+
+        writeAll(m_packFd, iov);
+
+        std::string archivedName { std::string(kPackFileName) + "#" + std::to_string(m_packOffset) };
+        m_packOffset += appendLength;
+
+        written(uid, archivedName, -1);
+
+    }
+
+    std::string m_folder;                  // Mailbox archive folder
+    bool m_bPack { false };                // == true append to pack file
+    bool m_bSync { false };                // == true make durable before recording
+    RecordFn m_recordFn;                   // Record archived e-mail
+    int m_packFd { -1 };                   // Pack file (opened on first use)
+    std::uint64_t m_packOffset { 0 };      // Pack file size
+    std::vector<PendingEmail> m_pending;   // Written but not yet recorded
+
+};
+
+#endif /* MAILARCHIVEWRITER_HPP */
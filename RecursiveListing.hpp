@@ -0,0 +1,282 @@
+#ifndef RECURSIVELISTING_HPP
+#define RECURSIVELISTING_HPP
+
+//
+// Header: RecursiveListing
+//
+// Description: Concurrent recursive directory listing for the transport example
+// programs. A shared queue of directories still to list is served by a number of
+// listers (for a remote tree each has its own server session) so several directory
+// listings are in flight at once; the queue is taken from the front (breadth first,
+// the fan-out grows quickly) or the back (depth first, fewer directories held
+// pending). Each entry is returned with its stat data (directory flag, size and
+// modified time) so callers need not stat each file again. Entries are returned
+// sorted by path which puts every directory before its contents. Symbolic links are
+// not followed (so a link can't make the walk cycle); they and any other special
+// files are left out of the listing. Each directory listing is timed into
+// TransferStats and counted as a round trip.
+//
+// Dependencies: C11++, TransferStats.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <filesystem>
+#include <chrono>
+#include <ctime>
+
+//
+// Antik Classes
+//
+
+#include "TransferStats.hpp"
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// Listed file/directory and its stat data
+//
+
+struct ListedFile {
+    std::string path;             // Full path
+    bool bDirectory { false };    // == true directory
+    std::uint64_t size { 0 };     // File size
+    std::time_t modified { 0 };   // Last modified time (UTC)
+};
+
+typedef std::vector<ListedFile> ListedFiles;
+
+//
+// Order directories are taken from the queue of those still to list
+//
+
+enum class ListingOrder {
+    breadthFirst,
+    depthFirst
+};
+
+//
+// List a directory (not recursively) for a given lister appending its entries.
+//
+
+typedef std::function<void(std::size_t lister, const std::string &directory, ListedFiles &entries)> ListDirectoryFn;
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// Convert listing order option ("breadth"/"depth") to ListingOrder.
+//
+
+inline ListingOrder listingOrder(const std::string &order) {
+    if (order == "breadth") {
+        return (ListingOrder::breadthFirst);
+    } else if (order == "depth") {
+        return (ListingOrder::depthFirst);
+    }
+    throw std::invalid_argument("Listing order must be breadth or depth.");
+}
+
+//
+// Return path of a file in a directory.
+//
+
+inline std::string listingPath(const std::string &directory, const std::string &fileName) {
+    return ((!directory.empty() && (directory.back() == '/')) ? directory + fileName : directory + "/" + fileName);
+}
+
+//
+// Recursively list a directory tree with a number of concurrent listers. The first
+// error stops the listers and is rethrown.
+//
+
+inline ListedFiles listRecursiveParallel(const std::string &rootDirectory, std::size_t listers,
+                                         ListingOrder order, ListDirectoryFn listDirectoryFn) {
+
+    std::deque<std::string> directoriesToList { rootDirectory };
+    std::size_t activeListers { 0 };
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::exception_ptr listingError;
+    ListedFiles listedFiles;
+
+    auto lister = [&](std::size_t listerNo) {
+
+        ListedFiles entries;
+
+        for (;;) {
+
+            std::string directory;
+
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueChanged.wait(lock, [&]() {
+                    return (!directoriesToList.empty() || (activeListers == 0) || listingError);
+                });
+                if (directoriesToList.empty() || listingError) {
+                    break;
+                }
+                if (order == ListingOrder::breadthFirst) {
+                    directory = std::move(directoriesToList.front());
+                    directoriesToList.pop_front();
+                } else {
+                    directory = std::move(directoriesToList.back());
+                    directoriesToList.pop_back();
+                }
+                activeListers++;
+            }
+
+            entries.clear();
+
+            try {
+                TransferStats::OperationTimer listingTimer { TransferStats::Phase::listing };
+                TransferStats::instance().addRoundTrips();
+                listDirectoryFn(listerNo, directory, entries);
+            } catch (...) {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                if (!listingError) {
+                    listingError = std::current_exception();
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                for (auto &entry : entries) {
+                    if (entry.bDirectory) {
+                        directoriesToList.push_back(entry.path);
+                    }
+                }
+                std::move(entries.begin(), entries.end(), std::back_inserter(listedFiles));
+                activeListers--;
+            }
+
+            queueChanged.notify_all();
+
+        }
+
+    };
+
+    std::vector<std::thread> listerThreads;
+    for (std::size_t listerNo = 1; listerNo < listers; listerNo++) {
+        listerThreads.emplace_back(lister, listerNo);
+    }
+
+    lister(0);
+
+    for (auto &listerThread : listerThreads) {
+        listerThread.join();
+    }
+
+    if (listingError) {
+        std::rethrow_exception(listingError);
+    }
+
+    std::sort(listedFiles.begin(), listedFiles.end(), [](const ListedFile &lhs, const ListedFile &rhs) {
+        return (lhs.path < rhs.path);
+    });
+
+    return (listedFiles);
+
+}
+
+//
+// Stat a local directory entry (without following a symbolic link) and add it to a
+// listing if it is a directory or regular file. An entry removed since it was read
+// is skipped; any other stat failure throws.
+//
+
+inline void listLocalEntry(const std::filesystem::directory_entry &directoryEntry, const std::string &path,
+                           ListedFiles &entries) {
+
+    std::error_code errorCode;
+
+    auto statSucceeded = [&]() {
+        if (errorCode && (errorCode != std::errc::no_such_file_or_directory)) {
+            throw std::filesystem::filesystem_error("Could not stat file", path, errorCode);
+        }
+        return (!errorCode);
+    };
+
+    std::filesystem::file_status fileStatus { directoryEntry.symlink_status(errorCode) };
+    if (!statSucceeded() || (!std::filesystem::is_directory(fileStatus) && !std::filesystem::is_regular_file(fileStatus))) {
+        return;
+    }
+
+    ListedFile listedFile;
+    listedFile.path = path;
+    listedFile.bDirectory = std::filesystem::is_directory(fileStatus);
+    if (!listedFile.bDirectory) {
+        listedFile.size = directoryEntry.file_size(errorCode);
+        if (!statSucceeded()) {
+            return;
+        }
+    }
+    auto lastWriteTime = directoryEntry.last_write_time(errorCode);
+    if (!statSucceeded()) {
+        return;
+    }
+    listedFile.modified = std::chrono::system_clock::to_time_t(std::chrono::file_clock::to_sys(lastWriteTime));
+
+    entries.push_back(std::move(listedFile));
+
+}
+
+//
+// Recursively list a local directory with a number of concurrent listers. A
+// directory removed while listing is skipped; a directory that cannot be read
+// throws.
+//
+
+inline ListedFiles listLocalRecursiveParallel(const std::string &localDirectory, std::size_t listers,
+                                              ListingOrder order = ListingOrder::breadthFirst) {
+
+    return (listRecursiveParallel(localDirectory, listers, order,
+            [](std::size_t, const std::string &directory, ListedFiles &entries) {
+                std::error_code errorCode;
+                std::filesystem::directory_iterator directoryEntry { directory, errorCode };
+                if (errorCode == std::errc::no_such_file_or_directory) {
+                    return;
+                }
+                for (; !errorCode && (directoryEntry != std::filesystem::directory_iterator()); directoryEntry.increment(errorCode)) {
+                    listLocalEntry(*directoryEntry, listingPath(directory, directoryEntry->path().filename().string()), entries);
+                }
+                if (errorCode) {
+                    throw std::filesystem::filesystem_error("Could not list directory", directory, errorCode);
+                }
+            }));
+
+}
+
+//
+// Return the paths of a listing.
+//
+
+inline std::vector<std::string> listedPaths(const ListedFiles &listedFiles) {
+    std::vector<std::string> paths;
+    paths.reserve(listedFiles.size());
+    for (auto &listedFile : listedFiles) {
+        paths.push_back(listedFile.path);
+    }
+    return (paths);
+}
+
+#endif /* RECURSIVELISTING_HPP */
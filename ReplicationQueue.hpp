@@ -0,0 +1,322 @@
+#ifndef REPLICATIONQUEUE_HPP
+#define REPLICATIONQUEUE_HPP
+
+//
+// Header: ReplicationQueue
+//
+// Description: Continuous replication of a local directory for the backup/sync
+// example programs. CApprise events for the directory are turned into pending
+// changes (put, remove, make directory, remove directory) keyed by path, the latest
+// event for a path replacing any earlier one; a change only becomes due once its
+// path has been quiet for the debounce period, so a file being written is sent once
+// when it is complete. Due changes are handed to a transport specific apply function
+// (which uses its already connected session) in an order that creates directories
+// before their contents and removes contents before their directories; any that fail
+// are retried after a further debounce period up to kMaxAttempts times, then every
+// kRetryPeriod until kMaxRetries attempts in all have failed when they are reported
+// and given up (unless a newer change for the path replaces them first). A path that
+// changes between file and directory keeps the removal of its old remote entry,
+// which the apply function makes before creating the new one.
+//
+// Dependencies: C11++, Classes (CApprise, FileEventBatcher).
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <optional>
+
+//
+// Antik Classes
+//
+
+#include "CApprise.hpp"
+#include "FileEventBatcher.hpp"
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class ReplicationQueue {
+public:
+
+    //
+    // Pending change for a local path
+    //
+
+    enum class Action {         // Declared in the order changes are applied
+        makeDirectory,    // Create directory (and copy any contents) on server
+        put,              // Copy file to server
+        remove,           // Remove file from server
+        removeDirectory   // Remove directory from server
+    };
+
+    struct Change {
+        Action action;          // Change to make
+        std::string localPath;  // Local file/directory
+        int attempts { 0 };     // Previous failed attempts
+        std::optional<Action> staleRemoval; // Remove old remote entry of other type first
+    };
+
+    //
+    // Apply function returns any changes that failed (to be retried); keep alive
+    // function is called when the session has been idle for kKeepAlivePeriod.
+    //
+
+    typedef std::function<std::vector<Change>(const std::vector<Change> &changes)> ApplyFn;
+    typedef std::function<void()> KeepAliveFn;
+
+    //
+    // Default debounce period, keep alive period and maximum events taken at once
+    //
+
+    static constexpr std::chrono::milliseconds kDebouncePeriod { 2000 };
+    static constexpr std::chrono::seconds kKeepAlivePeriod { 60 };
+    static constexpr std::size_t kMaxBatchEvents { 4096 };
+    static constexpr int kMaxAttempts { 3 };
+    static constexpr std::chrono::seconds kRetryPeriod { 60 };
+    static constexpr int kMaxRetries { 60 };
+
+    explicit ReplicationQueue(std::chrono::milliseconds debouncePeriod = kDebouncePeriod)
+    : m_debouncePeriod{ debouncePeriod} {
+    }
+
+    //
+    // Queue change for a file event (errors are reported and ignored).
+    //
+
+    void add(const Antik::File::CApprise::Event &fileEvent) {
+
+        using Antik::File::CApprise;
+
+        Action action;
+
+        switch (fileEvent.id) {
+            case CApprise::Event_add:
+            case CApprise::Event_change:
+                action = Action::put;
+                break;
+            case CApprise::Event_unlink:
+                action = Action::remove;
+                break;
+            case CApprise::Event_addir:
+                action = Action::makeDirectory;
+                break;
+            case CApprise::Event_unlinkdir:
+                action = Action::removeDirectory;
+                break;
+            case CApprise::Event_error:
+                std::cerr << "Watch error [" << fileEvent.message << "]" << std::endl;
+                return;
+            default:
+                return;
+        }
+
+        // The contents of a directory still to be made (at any depth) are copied with it
+
+        for (std::string ancestor { parentDirectory(fileEvent.message) }; !ancestor.empty();
+                ancestor = parentDirectory(ancestor)) {
+            auto pending = m_pending.find(ancestor);
+            if ((pending != m_pending.end()) && (pending->second.action == Action::makeDirectory)) {
+                pending->second.due = std::chrono::steady_clock::now() + m_debouncePeriod;
+                return;
+            }
+        }
+
+        // A file that has become a directory (or the reverse) still has its old remote
+        // entry to remove; if the path then goes again that entry is what is removed.
+
+        std::optional<Action> staleRemoval;
+        auto previous = m_pending.find(fileEvent.message);
+        if (previous != m_pending.end()) {
+            staleRemoval = previous->second.staleRemoval;
+            if (((action == Action::makeDirectory) && (previous->second.action == Action::remove)) ||
+                    ((action == Action::put) && (previous->second.action == Action::removeDirectory))) {
+                staleRemoval = previous->second.action;
+            } else if (staleRemoval && ((action == Action::remove) || (action == Action::removeDirectory))) {
+                action = *staleRemoval;
+                staleRemoval.reset();
+            }
+        }
+
+        m_pending[fileEvent.message] = { action, std::chrono::steady_clock::now() + m_debouncePeriod, 0, staleRemoval};
+
+    }
+
+    //
+    // Re-queue a failed change (unless a newer one for the path is pending); once it
+    // has failed kMaxAttempts times it is only retried every kRetryPeriod and after
+    // kMaxRetries failures it is reported and dropped.
+    //
+
+    void retry(const Change &change) {
+        if (m_pending.count(change.localPath)) {
+            return;
+        }
+        if (change.attempts + 1 >= kMaxRetries) {
+            std::cerr << "Giving up replicating [" << change.localPath << "] after ["
+                    << kMaxRetries << "] attempts" << std::endl;
+            return;
+        }
+        std::chrono::milliseconds retryPeriod { m_debouncePeriod };
+        if (change.attempts + 1 >= kMaxAttempts) {
+            if (change.attempts + 1 == kMaxAttempts) {
+                std::cerr << "Replicating [" << change.localPath << "] keeps failing; retrying every ["
+                        << kRetryPeriod.count() << "] seconds" << std::endl;
+            }
+            retryPeriod = kRetryPeriod;
+        }
+        m_pending[change.localPath] = { change.action, std::chrono::steady_clock::now() + retryPeriod,
+            change.attempts + 1, change.staleRemoval};
+    }
+
+    //
+    // Remove and return changes that are due in the order they should be applied.
+    //
+
+    std::vector<Change> takeDue() {
+
+        std::vector<Change> due;
+        auto now = std::chrono::steady_clock::now();
+
+        for (auto pending = m_pending.begin(); pending != m_pending.end();) {
+            if (pending->second.due <= now) {
+                due.push_back({ pending->second.action, pending->first, pending->second.attempts,
+                    pending->second.staleRemoval});
+                pending = m_pending.erase(pending);
+            } else {
+                pending++;
+            }
+        }
+
+        // A file replacing a directory goes with the directory removals so that the
+        // old directory's contents have gone first.
+
+        auto applyOrder = [](const Change &change) {
+            return ((change.staleRemoval == Action::removeDirectory) ? Action::removeDirectory : change.action);
+        };
+
+        std::sort(due.begin(), due.end(), [&applyOrder](const Change &lhs, const Change &rhs) {
+            if (applyOrder(lhs) != applyOrder(rhs)) {
+                return (applyOrder(lhs) < applyOrder(rhs));
+            }
+            if (applyOrder(lhs) == Action::removeDirectory) {
+                return (lhs.localPath.size() > rhs.localPath.size());
+            }
+            return (lhs.localPath.size() < rhs.localPath.size());
+        });
+
+        return (due);
+
+    }
+
+    //
+    // Time until the next change is due (at most maxWait).
+    //
+
+    std::chrono::milliseconds timeUntilDue(std::chrono::milliseconds maxWait) const {
+        auto now = std::chrono::steady_clock::now();
+        auto wait = maxWait;
+        for (auto &pending : m_pending) {
+            auto untilDue = std::chrono::duration_cast<std::chrono::milliseconds>(pending.second.due - now);
+            wait = std::max(std::chrono::milliseconds(0), std::min(wait, untilDue));
+        }
+        return (wait);
+    }
+
+    bool empty() const {
+        return (m_pending.empty());
+    }
+
+private:
+
+    struct PendingChange {
+        Action action;                               // Change to make
+        std::chrono::steady_clock::time_point due;   // When path has been quiet long enough
+        int attempts;                                // Previous failed attempts
+        std::optional<Action> staleRemoval;          // Remove old remote entry of other type first
+    };
+
+    static std::string parentDirectory(const std::string &path) {
+        std::size_t lastSlash { path.find_last_of('/') };
+        return ((lastSlash == std::string::npos) ? std::string() : path.substr(0, lastSlash));
+    }
+
+    std::chrono::milliseconds m_debouncePeriod;              // Quiet period before a change is due
+    std::unordered_map<std::string, PendingChange> m_pending; // Path to pending change
+
+};
+
+//
+// Watch a local directory and apply its changes until the watch stops (or the
+// program is terminated). The directory should already have been synchronized
+// from a full listing.
+//
+
+static inline void replicateLocalChanges(const std::string &localDirectory, std::chrono::milliseconds debouncePeriod,
+        ReplicationQueue::ApplyFn applyFn, ReplicationQueue::KeepAliveFn keepAliveFn = nullptr) {
+
+    using Antik::File::CApprise;
+
+    CApprise fileWatcher;
+    ReplicationQueue replicationQueue { debouncePeriod };
+    std::vector<CApprise::Event> fileEvents;
+    auto lastActive = std::chrono::steady_clock::now();
+
+    fileWatcher.addWatch(localDirectory);
+    fileWatcher.startWatching();
+
+    std::cout << "*** Replicating changes to [" << localDirectory << "] ***" << std::endl;
+
+    FileEventBatcher eventBatcher { fileWatcher };
+
+    try {
+
+        while (eventBatcher.stillWatching()) {
+
+            fileEvents.clear();
+            eventBatcher.getEvents(fileEvents, ReplicationQueue::kMaxBatchEvents,
+                    replicationQueue.timeUntilDue(std::chrono::duration_cast<std::chrono::milliseconds>(ReplicationQueue::kKeepAlivePeriod)));
+            for (auto &fileEvent : fileEvents) {
+                replicationQueue.add(fileEvent);
+            }
+
+            std::vector<ReplicationQueue::Change> dueChanges { replicationQueue.takeDue() };
+            if (!dueChanges.empty()) {
+                for (auto &failedChange : applyFn(dueChanges)) {
+                    replicationQueue.retry(failedChange);
+                }
+                lastActive = std::chrono::steady_clock::now();
+            } else if (keepAliveFn && (std::chrono::steady_clock::now() - lastActive >= ReplicationQueue::kKeepAlivePeriod)) {
+                keepAliveFn();
+                lastActive = std::chrono::steady_clock::now();
+            }
+
+        }
+
+    } catch (...) {
+        fileWatcher.stopWatching(); // Reader thread must finish before eventBatcher goes
+        throw;
+    }
+
+    fileWatcher.stopWatching();
+
+}
+
+#endif /* REPLICATIONQUEUE_HPP */
@@ -0,0 +1,265 @@
+#ifndef RESUMABLETRANSFER_HPP
+#define RESUMABLETRANSFER_HPP
+
+//
+// Header: ResumableTransfer
+//
+// Description: Resumable file restore shared by the restore example programs. A file
+// being restored is written to "<file>.part" and its progress checkpointed every
+// kCheckpointBytes to a sidecar journal "<file>.part.journal":
+//
+//   # Antik restore journal 1
+//   <remote size>\t<remote modified time>\t<bytes checkpointed>
+//
+// The part file is fdatasync'ed before each checkpoint so the journalled bytes are
+// always on disk. A later run for the same remote file (size and modified time
+// unchanged) carries on from the last checkpoint instead of byte zero; if the remote
+// modified time is not known the part file is restarted, as size alone can't show
+// that the remote file is unchanged. On completion
+// the size (and optionally a SHA-256 hash) is validated, the modified time set to the
+// remote one and the part file renamed into place; a file already restored that way
+// is skipped by a later run.
+//
+// Dependencies: C11++, SHA256, Linux.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+//
+// Linux
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+//
+// Antik Classes
+//
+
+#include "SHA256.hpp"
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class ResumableDownload {
+public:
+
+    //
+    // Class exception
+    //
+
+    struct Exception : public std::runtime_error {
+        explicit Exception(std::string const& message)
+        : std::runtime_error("ResumableDownload Failure: " + message) {
+        }
+    };
+
+    //
+    // Bytes written between checkpoints and journal header
+    //
+
+    static constexpr std::uint64_t kCheckpointBytes { 16 * 1024 * 1024 };
+    static constexpr const char *kJournalHeader { "# Antik restore journal 1" };
+
+    //
+    // Open (or resume) the part file for a remote file of a given size and modified
+    // time (0 if not known, in which case the part file is always restarted).
+    //
+
+    ResumableDownload(const std::string &localFilePath, std::uint64_t remoteSize, std::time_t remoteModified)
+    : m_localFilePath{ localFilePath}, m_partFilePath{ localFilePath + ".part"},
+    m_journalFilePath{ localFilePath + ".part.journal"}, m_remoteSize{ remoteSize}, m_remoteModified{ remoteModified} {
+
+        std::uint64_t checkpointed { 0 };
+
+        std::ifstream journalStream(m_journalFilePath);
+        std::string header;
+        std::uint64_t journalSize { 0 };
+        std::time_t journalModified { 0 };
+        if (std::getline(journalStream, header) && (header == kJournalHeader) &&
+                (journalStream >> journalSize >> journalModified >> checkpointed) &&
+                remoteModified && (journalSize == remoteSize) && (journalModified == remoteModified)) {
+            struct stat partStat {};
+            if (stat(m_partFilePath.c_str(), &partStat) == 0) {
+                m_offset = std::min<std::uint64_t>(checkpointed, partStat.st_size);
+            }
+        }
+
+        m_partFd = open(m_partFilePath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (m_partFd == -1) {
+            throw Exception("Could not open [" + m_partFilePath + "]: " + std::strerror(errno));
+        }
+
+        // Anything after the last checkpoint may not have reached the disk
+
+        if ((ftruncate(m_partFd, m_offset) == -1) || (lseek(m_partFd, m_offset, SEEK_SET) == -1)) {
+            close(m_partFd);
+            throw Exception("Could not position [" + m_partFilePath + "]: " + std::strerror(errno));
+        }
+
+        m_checkpointed = m_offset;
+        writeJournal();
+
+    }
+
+    //
+    // The part file and journal are left for the next run if not completed.
+    //
+
+    ~ResumableDownload() {
+        if (m_partFd != -1) {
+            close(m_partFd);
+        }
+    }
+
+    ResumableDownload(const ResumableDownload &orig) = delete;
+    ResumableDownload& operator=(const ResumableDownload &orig) = delete;
+
+    //
+    // == true local file already fully restored (by a previous run) from this remote file.
+    //
+
+    static bool alreadyRestored(const std::string &localFilePath, std::uint64_t remoteSize, std::time_t remoteModified) {
+        struct stat localStat {};
+        return ((stat(localFilePath.c_str(), &localStat) == 0) && S_ISREG(localStat.st_mode) &&
+                (static_cast<std::uint64_t> (localStat.st_size) == remoteSize) && remoteModified &&
+                (localStat.st_mtime == remoteModified) && (access((localFilePath + ".part").c_str(), F_OK) != 0));
+    }
+
+    //
+    // Offset to restart the transfer from.
+    //
+
+    std::uint64_t offset() const {
+        return (m_offset);
+    }
+
+    //
+    // Append data to the part file checkpointing as needed.
+    //
+
+    void write(const char *data, std::size_t length) {
+
+        while (length) {
+            ssize_t written = ::write(m_partFd, data, length);
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                throw Exception("Write to [" + m_partFilePath + "] failed: " + std::strerror(errno));
+            }
+            data += written;
+            length -= written;
+            m_offset += written;
+        }
+
+        if (m_offset - m_checkpointed >= kCheckpointBytes) {
+            checkpoint();
+        }
+
+    }
+
+    //
+    // Validate the restored file by size and (if passed) SHA-256 hash then rename it
+    // into place. A file failing validation is discarded so the next run restarts it.
+    //
+
+    void complete(const std::string &expectedHash = "") {
+
+        if (fdatasync(m_partFd) == -1) {
+            throw Exception("fdatasync() failed: " + std::string(std::strerror(errno)));
+        }
+        close(m_partFd);
+        m_partFd = -1;
+
+        std::string failure;
+        if (m_offset != m_remoteSize) {
+            failure = "size " + std::to_string(m_offset) + " != " + std::to_string(m_remoteSize);
+        } else if (!expectedHash.empty() && (sha256FileContents(m_partFilePath) != expectedHash)) {
+            failure = "SHA-256 hash mismatch";
+        }
+
+        if (!failure.empty()) {
+            unlink(m_partFilePath.c_str());
+            unlink(m_journalFilePath.c_str());
+            throw Exception("[" + m_localFilePath + "] failed validation (" + failure + ")");
+        }
+
+        if (m_remoteModified) {
+            struct utimbuf modifiedTimes { m_remoteModified, m_remoteModified };
+            utime(m_partFilePath.c_str(), &modifiedTimes);
+        }
+
+        if (rename(m_partFilePath.c_str(), m_localFilePath.c_str()) == -1) {
+            throw Exception("Could not rename [" + m_partFilePath + "]: " + std::strerror(errno));
+        }
+
+        unlink(m_journalFilePath.c_str());
+
+    }
+
+private:
+
+    //
+    // Make written data durable then record it in the journal.
+    //
+
+    void checkpoint() {
+        if (fdatasync(m_partFd) == -1) {
+            throw Exception("fdatasync() failed: " + std::string(std::strerror(errno)));
+        }
+        m_checkpointed = m_offset;
+        writeJournal();
+    }
+
+    //
+    // Write the journal to a temporary file and rename it over the old one.
+    //
+
+    void writeJournal() {
+        std::string temporaryFileName { m_journalFilePath + ".tmp" };
+        {
+            std::ofstream journalStream(temporaryFileName, std::ios::trunc);
+            journalStream << kJournalHeader << "\n" << m_remoteSize << '\t' << m_remoteModified << '\t' << m_checkpointed << "\n";
+            journalStream.flush();
+            if (!journalStream) {
+                throw Exception("Could not write journal [" + temporaryFileName + "]");
+            }
+        }
+        if (rename(temporaryFileName.c_str(), m_journalFilePath.c_str()) == -1) {
+            throw Exception("Could not rename [" + temporaryFileName + "]: " + std::strerror(errno));
+        }
+    }
+
+    std::string m_localFilePath;        // Restored file
+    std::string m_partFilePath;         // File being written
+    std::string m_journalFilePath;      // Sidecar progress journal
+    std::uint64_t m_remoteSize { 0 };   // Remote file size
+    std::time_t m_remoteModified { 0 }; // Remote file modified time
+    int m_partFd { -1 };                // Part file
+    std::uint64_t m_offset { 0 };       // Bytes in part file
+    std::uint64_t m_checkpointed { 0 }; // Bytes recorded in journal
+
+};
+
+#endif /* RESUMABLETRANSFER_HPP */
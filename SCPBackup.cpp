@@ -16,6 +16,10 @@
 //   -p [ --password ] arg  User password
 //   -r [ --remote ] arg    Remote server directory to restore
 //   -l [ --local ] arg     Local Directory to backup
+//   --incremental          Only backup files changed since last run
+//   --manifest arg         Incremental backup manifest file
+//   --hash                 Use content hash to detect changed files
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 
 // =============
 // INCLUDE FILES
@@ -27,6 +31,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <filesystem>
 
 //
 // Antik Classes
@@ -34,8 +39,11 @@
 
 #include "SSHSessionUtil.hpp"
 #include "SCPUtil.hpp"
+#include "CSCP.hpp"
+#include "BackupManifest.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
 
 using namespace Antik;
 using namespace Antik::SSH;
@@ -63,8 +71,18 @@ struct ParamArgData {
     std::string remoteDirectory;  // SSH remote directory to restore
     std::string localDirectory;   // Local directory to backup
     std::string configFileName;   // Configuration file name
+    std::string manifestFileName; // Incremental backup manifest file
+    bool bIncremental { false };  // == true only backup files changed since last run
+    bool bHash { false };         // == true use content hash to detect changed files
+    std::string statsFileName;    // Transfer stats summary file
 };
 
+//
+// SCP file write buffer size
+//
+
+constexpr std::size_t kSCPWriteBufferSize { 64 * 1024 };
+
 // ===============
 // LOCAL FUNCTIONS
 // ===============
@@ -79,6 +97,15 @@ static void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -95,7 +122,11 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("remote,r", po::value<std::string>(&argData.remoteDirectory)->required(), "Remote directory for backup")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory to backup");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory to backup")
+            ("incremental", "Only backup files changed since last run")
+            ("manifest", po::value<std::string>(&argData.manifestFileName), "Incremental backup manifest file")
+            ("hash", "Use content hash to detect changed files")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -144,8 +175,24 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Incremental backup using manifest
+
+        if (vm.count("incremental")) {
+            argData.bIncremental = true;
+        }
+
+        // Detect changed files using content hash
+
+        if (vm.count("hash")) {
+            argData.bHash = true;
+        }
+
         po::notify(vm);
 
+        if (argData.manifestFileName.empty()) {
+            argData.manifestFileName = defaultManifestFileName(argData.localDirectory);
+        }
+
     } catch (po::error& e) {
         std::cerr << "SCPBackup Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -154,6 +201,112 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
 }
 
+//
+// Return permissions of a local file for SCP push.
+//
+
+static int localFilePermissions(const std::filesystem::path &localPath) {
+    return (static_cast<int>(std::filesystem::status(localPath).permissions()) & 0777);
+}
+
+//
+// Copy a list of local files to the SCP server in one recursive SCP session. The
+// remote directories on each files path are entered (and created if needed) before
+// it is pushed; a listed directory is created the same way (so empty ones are too).
+// The remote path of each file and directory sent is returned.
+//
+
+static FileList putFileList(CSSHSession &sshSession, const ParamArgData &argData, const FileList &localFileList) {
+
+    CSCP scpServer { sshSession, SSH_SCP_WRITE | SSH_SCP_RECURSIVE, argData.remoteDirectory };
+    std::vector<std::string> currentDirectory;
+    std::vector<char> writeBuffer(kSCPWriteBufferSize);
+    FileList filesBackedUp;
+
+    scpServer.open();
+
+    try {
+
+        for (auto &localFile : localFileList) {
+
+            bool bDirectory { CFile::isDirectory(localFile) };
+            if (!bDirectory && !CFile::isFile(localFile)) {
+                continue;
+            }
+
+            auto relativePath = std::filesystem::path(localFile).lexically_relative(argData.localDirectory);
+            std::vector<std::string> fileDirectory;
+            for (auto &component : (bDirectory ? relativePath : relativePath.parent_path())) {
+                if (!component.empty() && (component != ".")) {
+                    fileDirectory.push_back(component.string());
+                }
+            }
+
+            // Leave any directories not on the files path then enter those that are
+
+            std::size_t common = 0;
+            while ((common < currentDirectory.size()) && (common < fileDirectory.size()) &&
+                    (currentDirectory[common] == fileDirectory[common])) {
+                common++;
+            }
+
+            while (currentDirectory.size() > common) {
+                scpServer.leaveDirectory();
+                currentDirectory.pop_back();
+            }
+
+            std::filesystem::path localDirectory { argData.localDirectory };
+            for (auto &directory : currentDirectory) {
+                localDirectory /= directory;
+            }
+            
+            for (; common < fileDirectory.size(); common++) {
+                localDirectory /= fileDirectory[common];
+                scpServer.pushDirectory(fileDirectory[common], localFilePermissions(localDirectory));
+                currentDirectory.push_back(fileDirectory[common]);
+            }
+
+            if (bDirectory) {
+                if (!fileDirectory.empty()) {
+                    std::string remoteDirectory { argData.remoteDirectory };
+                    for (auto &directory : fileDirectory) {
+                        remoteDirectory += "/" + directory;
+                    }
+                    filesBackedUp.push_back(remoteDirectory);
+                }
+                continue;
+            }
+
+            // Push file
+
+            TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+
+            std::ifstream localFileStream(localFile, std::ios::binary);
+            if (!localFileStream.is_open()) {
+                throw std::runtime_error("Could not open local file [" + localFile + "]");
+            }
+
+            scpServer.pushFile(relativePath.filename().string(), std::filesystem::file_size(localFile), 
+                               localFilePermissions(localFile));
+            while (localFileStream.read(writeBuffer.data(), writeBuffer.size()), localFileStream.gcount() > 0) {
+                scpServer.write(writeBuffer.data(), localFileStream.gcount());
+            }
+
+            filesBackedUp.push_back(argData.remoteDirectory + "/" + relativePath.generic_string());
+
+        }
+
+    } catch (...) {
+        scpServer.close();
+        throw;
+    }
+
+    scpServer.close();
+
+    return (filesBackedUp);
+
+}
+
 //
 // Perform backup of files.
 //
@@ -166,9 +319,52 @@ static void performBackup(CSSHSession &sshSession, ParamArgData argData) {
         FileMapper fileMapper{ argData.localDirectory, argData.remoteDirectory};
         FileList filesBackedUp;
         
-        // Copy files to SCP Server
- 
-        filesBackedUp = putFiles(sshSession, fileMapper);
+        if (argData.bIncremental) {
+
+            // Copy only files changed since last run and update manifest
+
+            BackupManifest previousManifest { loadBackupManifest(argData.manifestFileName) };
+            BackupManifest currentManifest;
+            TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+            FileList changedFiles { filesChangedSinceManifest(argData.localDirectory, 
+                                    CFile::directoryContentsList(argData.localDirectory),
+                                    previousManifest, currentManifest, argData.bHash) };
+            listingTimer.stop();
+
+            std::cout << "Files changed since last backup [" << changedFiles.size() << "]" << std::endl;
+
+            if (changedFiles.empty()) {
+                std::cout << "No files changed since last backup." << std::endl;
+            } else {
+                TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+                filesBackedUp = putFileList(sshSession, argData, changedFiles);
+                TransferStats::instance().addTransferredFiles(argData.localDirectory, changedFiles,
+                                                              argData.remoteDirectory, filesBackedUp);
+            }
+            
+            commitBackupManifest(argData.manifestFileName, argData.localDirectory, argData.remoteDirectory,
+                                 previousManifest, currentManifest, changedFiles, filesBackedUp);
+            
+            if (changedFiles.empty()) {
+                return;
+            }
+            
+        } else {
+
+            // Copy files to SCP Server (the library lists them so for stats they are
+            // listed again afterwards)
+
+            {
+                TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+                filesBackedUp = putFiles(sshSession, fileMapper, TransferStats::instance().fileCompletionFn());
+            }
+
+            if (TransferStats::instance().enabled()) {
+                TransferStats::instance().addTransferredFiles(argData.localDirectory,
+                        CFile::directoryContentsList(argData.localDirectory), argData.remoteDirectory, filesBackedUp);
+            }
+
+        }
 
         // Signal success or failure
         
@@ -208,6 +404,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("SCPBackup", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -252,6 +454,10 @@ int main(int argc, char** argv) {
         
         sshSession.disconnect();
 
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
@@ -2,9 +2,13 @@
 // Program: SCPRestore
 //
 // Description: Simple SCP restore program that takes a remote directory and restores it
-// to a local directory.
+// to a local directory. SCP cannot restart a transfer part way through a file so with
+// --resume the restore is instead made over SFTP on the same SSH session, each file
+// going through a part file and checkpoint journal so an interrupted restore carries
+// on where it left off; --verify also checks each file against a SHA-256 hash
+// computed on the server.
 //
-// Dependencies: C11++, Classes (CSCP, CSSHSession, CPath, CFile), Boost C++ Libraries.
+// Dependencies: C11++, Classes (CSCP, CSFTP, CSSHSession, CPath, CFile), Boost C++ Libraries.
 //
 // SCPRestore
 // Program Options:
@@ -16,6 +20,9 @@
 //   -p [ --password ] arg  User password
 //   -r [ --remote ] arg    Remote server directory to restore
 //   -l [ --local ] arg     Local directory to use as base for restore
+//   --resume               Resume interrupted file restores (over SFTP) from their last checkpoint
+//   --verify               Verify restored files against a server SHA-256 hash (--resume)
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 //
 
 // =============
@@ -35,8 +42,10 @@
 
 #include "SSHSessionUtil.hpp"
 #include "SCPUtil.hpp"
+#include "SFTPTransferUtil.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
 
 using namespace Antik;
 using namespace Antik::SSH;
@@ -64,6 +73,9 @@ struct ParamArgData {
     std::string remoteDirectory; // SSH remote directory to restore
     std::string localDirectory;  // Local directory to use as base for restore
     std::string configFileName;  // Configuration file name
+    bool bResume { false };      // == true resumable (checkpointed) restore over SFTP
+    bool bVerify { false };      // == true verify restored files with SHA-256 hash
+    std::string statsFileName;    // Transfer stats summary file
 };
 
 // ===============
@@ -80,6 +92,15 @@ static void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -96,7 +117,10 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("remote,r", po::value<std::string>(&argData.remoteDirectory)->required(), "Remote directory to restore")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore")
+            ("resume", "Resume interrupted file restores (over SFTP) from their last checkpoint")
+            ("verify", "Verify restored files against a server SHA-256 hash (--resume)")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -145,8 +169,22 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Resumable restore
+
+        if (vm.count("resume")) {
+            argData.bResume = true;
+        }
+
+        if (vm.count("verify")) {
+            argData.bVerify = true;
+        }
+
         po::notify(vm);
 
+        if (argData.bVerify && !argData.bResume) {
+            throw po::error("--verify is only used with --resume.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "SCPRestore Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -168,9 +206,29 @@ static void performRestore(CSSHSession &sshSession, ParamArgData argData) {
         FileList remoteFileList;
         FileList restoredFiles;
 
-        // Restore files from  SCP Server
+        // Restore files from  SCP Server (resumable restores over SFTP)
  
-        restoredFiles = getFiles(sshSession, fileMapper);
+        if (argData.bResume) {
+            CSFTP sftpServer { sshSession };
+            sftpServer.open();
+            try {
+                TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+                ListedFiles remoteListing { listRemoteRecursiveParallel({ &sftpServer }, argData.remoteDirectory,
+                                                                        ListingOrder::breadthFirst) };
+                listingTimer.stop();
+                TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+                restoredFiles = getFilesResumable(sftpServer, fileMapper, remoteListing, SFTPTransferOptions(), argData.bVerify);
+            } catch (...) {
+                sftpServer.close();
+                throw;
+            }
+            sftpServer.close();
+        } else {
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+            restoredFiles = getFiles(sshSession, fileMapper, TransferStats::instance().fileCompletionFn());
+        }
+
+        TransferStats::instance().addLocalFiles(restoredFiles);
 
         // Signal success or failure
 
@@ -209,6 +267,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("SCPRestore", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -253,6 +317,10 @@ int main(int argc, char** argv) {
  
         sshSession.disconnect();
 
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
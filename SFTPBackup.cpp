@@ -2,9 +2,14 @@
 // Program: SFTPBackup
 //
 // Description: Simple SFTP backup program that takes a local directory and backs it up
-// to a specified SFTP server using account details provided.
+// to a specified SFTP server using account details provided. With --watch the program then
+// keeps running and replicates each local change over the same SFTP session (kept alive
+// when idle and replaced by a new session if the server drops it). With --delta
+// a file already on the server is delta copied: the server hashes each block of its copy
+// and only the blocks that differ locally are sent. With --channels N files are spread
+// over N SFTP channels on the one SSH session.
 //
-// Dependencies: C11++, Classes (CSFTP, CSSHSession, CFile, CPath), Boost C++ Libraries.
+// Dependencies: C11++, Classes (CSFTP, CSSHSession, CFile, CPath, CApprise), Boost C++ Libraries.
 //
 // SFTPBackup
 // Program Options:
@@ -16,6 +21,17 @@
 //   -p [ --password ] arg  User password
 //   -r [ --remote ] arg    Remote server directory to restore
 //   -l [ --local ] arg     Local Directory to backup
+//   -i [ --inflight ] arg (=1)     Requests in flight per file (> 1 pipelines transfers)
+//   -k [ --chunk ] arg (=32768)    Bytes per pipelined read/write request (at most 261120)
+//   -n [ --channels ] arg (=1)     Number of SFTP channels (on the one session) used for transfer
+//   --incremental          Only backup files changed since last run
+//   --manifest arg         Incremental backup manifest file
+//   --hash                 Use content hash to detect changed files
+//   --watch                Keep running and replicate local changes after the backup
+//   --debounce arg (=2000) Milliseconds a changed file must be quiet before it is sent
+//   --delta                Only send changed blocks of files already on the server
+//   --delta-block arg (=1048576)   Delta copy block size in bytes
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 
 // =============
 // INCLUDE FILES
@@ -27,6 +43,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 
 //
 // Antik Classes
@@ -34,8 +51,12 @@
 
 #include "SSHSessionUtil.hpp"
 #include "SFTPUtil.hpp"
+#include "SFTPTransferUtil.hpp"
+#include "BackupManifest.hpp"
+#include "ReplicationQueue.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
 
 using namespace Antik;
 using namespace Antik::SSH;
@@ -63,6 +84,16 @@ struct ParamArgData {
     std::string remoteDirectory;  // SSH remote directory to restore
     std::string localDirectory;   // Local directory to backup
     std::string configFileName;   // Configuration file name
+    SFTPTransferOptions transferOptions; // Pipelined transfer options
+    int channels { 1 };           // Number of SFTP channels used for transfer
+    std::string manifestFileName; // Incremental backup manifest file
+    bool bIncremental { false };  // == true only backup files changed since last run
+    bool bHash { false };         // == true use content hash to detect changed files
+    bool bWatch { false };        // == true replicate local changes after backup
+    int debouncePeriod { 0 };     // Quiet period (milliseconds) before a change is sent
+    bool bDelta { false };        // == true delta copy files already on server
+    std::uint32_t deltaBlockSize { 0 }; // Delta copy block size
+    std::string statsFileName;    // Transfer stats summary file
 };
 
 // ===============
@@ -79,6 +110,15 @@ static void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -95,7 +135,19 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("remote,r", po::value<std::string>(&argData.remoteDirectory)->required(), "Remote directory for backup")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory to backup");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory to backup")
+            ("inflight,i", po::value<std::uint32_t>(&argData.transferOptions.inflight)->default_value(1), "Requests in flight per file (> 1 pipelines transfers)")
+            ("chunk,k", po::value<std::uint32_t>(&argData.transferOptions.chunkSize)->default_value(32 * 1024), "Bytes per pipelined read/write request (at most 261120)")
+            ("channels,n", po::value<int>(&argData.channels)->default_value(1), "Number of SFTP channels (on the one session) used for transfer")
+            ("incremental", "Only backup files changed since last run")
+            ("manifest", po::value<std::string>(&argData.manifestFileName), "Incremental backup manifest file")
+            ("hash", "Use content hash to detect changed files")
+            ("watch", "Keep running and replicate local changes after the backup")
+            ("debounce", po::value<int>(&argData.debouncePeriod)->default_value(ReplicationQueue::kDebouncePeriod.count()),
+                "Milliseconds a changed file must be quiet before it is sent")
+            ("delta", "Only send changed blocks of files already on the server")
+            ("delta-block", po::value<std::uint32_t>(&argData.deltaBlockSize)->default_value(1024 * 1024), "Delta copy block size in bytes")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -144,8 +196,56 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Incremental backup using manifest
+
+        if (vm.count("incremental")) {
+            argData.bIncremental = true;
+        }
+
+        // Detect changed files using content hash
+
+        if (vm.count("hash")) {
+            argData.bHash = true;
+        }
+
+        // Replicate local changes after backup
+
+        if (vm.count("watch")) {
+            argData.bWatch = true;
+        }
+
+        // Delta copy files already on server
+
+        if (vm.count("delta")) {
+            argData.bDelta = true;
+        }
+
         po::notify(vm);
 
+        if (argData.manifestFileName.empty()) {
+            argData.manifestFileName = defaultManifestFileName(argData.localDirectory);
+        }
+
+        if ((argData.transferOptions.chunkSize == 0) ||
+                (argData.transferOptions.chunkSize > SFTPTransferOptions::kMaxChunkSize)) {
+            throw po::error("Transfer chunk size must be between 1 and " +
+                    std::to_string(SFTPTransferOptions::kMaxChunkSize) + " bytes.");
+        }
+
+        if (argData.debouncePeriod < 0) {
+            throw po::error("Debounce period must not be negative.");
+        }
+
+        if (argData.bDelta) {
+            if (argData.deltaBlockSize == 0) {
+                throw po::error("Delta copy block size must be greater than zero.");
+            }
+            if (argData.channels > 1) {
+                throw po::error("Delta copy uses a single SFTP channel.");
+            }
+            argData.transferOptions.deltaBlockSize = argData.deltaBlockSize;
+        }
+
     } catch (po::error& e) {
         std::cerr << "SFTPBackup Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -155,7 +255,158 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 }
 
 //
-// Perform backup of files.
+// Copy a file list over the backup session's SFTP channel and argData.channels-1 more
+// opened on the same SSH session.
+//
+
+static FileList putFilesOverChannels(CSFTP &sftpServer, FileMapper &fileMapper, const FileList &localFileList,
+                                     const ParamArgData &argData) {
+
+    std::vector<std::unique_ptr<CSFTP>> extraChannels;
+    std::vector<CSFTP *> sftpChannels { &sftpServer };
+    FileList filesBackedUp;
+
+    try {
+        for (auto channel = 1; channel < argData.channels; channel++) {
+            extraChannels.emplace_back(new CSFTP { sftpServer.getSession() });
+            extraChannels.back()->open();
+            sftpChannels.push_back(extraChannels.back().get());
+        }
+        filesBackedUp = putFilesMultiChannel(sftpChannels, fileMapper, localFileList, argData.transferOptions);
+    } catch (...) {
+        for (auto &extraChannel : extraChannels) {
+            try {
+                extraChannel->close();
+            } catch (...) {
+            }
+        }
+        throw;
+    }
+
+    for (auto &extraChannel : extraChannels) {
+        extraChannel->close();
+    }
+
+    return (filesBackedUp);
+
+}
+
+//
+// Check the watch session with a stat of the remote directory (which also keeps it
+// alive) and if it has been lost connect a new one to replace it. Returns false if
+// the server cannot be reached.
+//
+
+static bool keepSessionAlive(CSFTP *&sftpServer, std::unique_ptr<SFTPSession> &watchSession,
+                             const ParamArgData &argData) {
+
+    try {
+        CSFTP::FileAttributes remoteDirectoryAttributes;
+        sftpServer->getFileAttributes(argData.remoteDirectory, remoteDirectoryAttributes);
+        return (true);
+    } catch (const std::exception &e) {
+        std::cout << "*** Reconnecting to server ***" << std::endl;
+    }
+
+    try {
+        std::unique_ptr<SFTPSession> newSession { new SFTPSession };
+        openSFTPSession(*newSession, argData.serverName, argData.serverPort, argData.userName, argData.userPassword);
+        if (watchSession) {
+            try {
+                closeSFTPSession(*watchSession);
+            } catch (...) {
+                // Session already gone
+            }
+        }
+        watchSession = std::move(newSession);
+        sftpServer = watchSession->sftpServer.get();
+    } catch (const std::exception &e) {
+        std::cerr << "Unable to reconnect to server: " << e.what() << std::endl;
+        return (false);
+    }
+
+    return (true);
+
+}
+
+//
+// Apply replicated local changes to the SFTP server; return those that failed.
+//
+
+static std::vector<ReplicationQueue::Change> replicateChanges(CSFTP &sftpServer, FileMapper &fileMapper, 
+        const ParamArgData &argData, const std::vector<ReplicationQueue::Change> &changes) {
+
+    std::vector<ReplicationQueue::Change> failedChanges;
+
+    for (auto &change : changes) {
+
+        try {
+
+            switch (change.action) {
+
+                case ReplicationQueue::Action::makeDirectory:
+                case ReplicationQueue::Action::put:
+                {
+                    if (!CFile::exists(change.localPath)) { // Gone again (its removal is queued)
+                        break;
+                    }
+                    if (change.staleRemoval) { // Path has changed type; an earlier attempt may have removed it
+                        try {
+                            if (*change.staleRemoval == ReplicationQueue::Action::removeDirectory) {
+                                sftpServer.removeDirectory(fileMapper.toRemote(change.localPath));
+                            } else {
+                                sftpServer.removeLink(fileMapper.toRemote(change.localPath));
+                            }
+                            std::cout << "Removed [" << fileMapper.toRemote(change.localPath) << "]" << std::endl;
+                        } catch (const std::exception &) {
+                        }
+                    }
+                    FileList filesToBackup { change.localPath };
+                    if (change.action == ReplicationQueue::Action::makeDirectory) {
+                        FileList directoryContents;
+                        listLocalRecursive(change.localPath, directoryContents);
+                        filesToBackup.insert(filesToBackup.end(), directoryContents.begin(), directoryContents.end());
+                    }
+                    FileList filesBackedUp;
+                    if ((argData.transferOptions.inflight > 1) || argData.bDelta) {
+                        filesBackedUp = putFiles(sftpServer, fileMapper, filesToBackup, argData.transferOptions);
+                    } else {
+                        filesBackedUp = putFiles(sftpServer, fileMapper, filesToBackup);
+                    }
+                    for (auto &file : filesBackedUp) {
+                        std::cout << "Sucessfully backed up [" << file << "]" << std::endl;
+                    }
+                    if (filesBackedUp.size() != filesToBackup.size()) {
+                        failedChanges.push_back(change);
+                    }
+                    break;
+                }
+
+                case ReplicationQueue::Action::remove:
+                    sftpServer.removeLink(fileMapper.toRemote(change.localPath));
+                    std::cout << "Removed [" << fileMapper.toRemote(change.localPath) << "]" << std::endl;
+                    break;
+
+                case ReplicationQueue::Action::removeDirectory:
+                    sftpServer.removeDirectory(fileMapper.toRemote(change.localPath));
+                    std::cout << "Removed [" << fileMapper.toRemote(change.localPath) << "]" << std::endl;
+                    break;
+
+            }
+
+        } catch (const std::exception &e) {
+            std::cerr << "Could not replicate [" << change.localPath << "]: " << e.what() << std::endl;
+            failedChanges.push_back(change);
+        }
+
+    }
+
+    return (failedChanges);
+
+}
+
+//
+// Perform backup of files (and for --watch then replicate local changes).
 //
 
 static void performBackup(CSSHSession &sshSession, ParamArgData argData) {
@@ -174,17 +425,50 @@ static void performBackup(CSSHSession &sshSession, ParamArgData argData) {
         
         // Get local directory file list
         
-        listLocalRecursive(argData.localDirectory, locaFileList);
+        {
+            TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+            listLocalRecursive(argData.localDirectory, locaFileList);
+        }
+        
+        // For incremental backup only keep files changed since last run
+
+        BackupManifest previousManifest, currentManifest;
+
+        if (argData.bIncremental) {
+            previousManifest = loadBackupManifest(argData.manifestFileName);
+            locaFileList = filesChangedSinceManifest(argData.localDirectory, locaFileList,
+                                                     previousManifest, currentManifest, argData.bHash);
+            std::cout << "Files changed since last backup [" << locaFileList.size() << "]" << std::endl;
+        }
         
         // Copy file list to SFTP Server
 
         if (!locaFileList.empty()) {
-            filesBackedUp = putFiles(sftpServer, fileMapper, locaFileList);
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+            if (argData.channels > 1) {
+                filesBackedUp = putFilesOverChannels(sftpServer, fileMapper, locaFileList, argData);
+            } else if ((argData.transferOptions.inflight > 1) || argData.bDelta) {
+                filesBackedUp = putFiles(sftpServer, fileMapper, locaFileList, argData.transferOptions);
+            } else {
+                filesBackedUp = putFiles(sftpServer, fileMapper, locaFileList, TransferStats::instance().fileCompletionFn());
+            }
+            TransferStats::instance().addTransferredFiles(argData.localDirectory, locaFileList,
+                                                          argData.remoteDirectory, filesBackedUp,
+                                                          (argData.channels > 1) || (argData.transferOptions.inflight > 1) || argData.bDelta);
+        }
+
+        // Update manifest with files sent
+
+        if (argData.bIncremental) {
+            commitBackupManifest(argData.manifestFileName, argData.localDirectory, argData.remoteDirectory,
+                                 previousManifest, currentManifest, locaFileList, filesBackedUp);
         }
 
         // Signal success or failure
         
-        if (!filesBackedUp.empty()) {
+        if (argData.bIncremental && locaFileList.empty()) {
+            std::cout << "No files changed since last backup." << std::endl;
+        } else if (!filesBackedUp.empty()) {
             for (auto file : filesBackedUp) {
                 std::cout << "Sucessfully backed up [" << file << "]" << std::endl;
             }
@@ -192,6 +476,33 @@ static void performBackup(CSSHSession &sshSession, ParamArgData argData) {
             std::cout << "Backup failed."<< std::endl;
         }
 
+        // Keep the session and replicate changes from now on
+
+        if (argData.bWatch) {
+            CSFTP *watchServer { &sftpServer };
+            std::unique_ptr<SFTPSession> watchSession;
+            try {
+                replicateLocalChanges(argData.localDirectory, std::chrono::milliseconds(argData.debouncePeriod),
+                        [&](const std::vector<ReplicationQueue::Change> &changes) {
+                            if (!keepSessionAlive(watchServer, watchSession, argData)) {
+                                return (changes); // Retried when the server is back
+                            }
+                            return (replicateChanges(*watchServer, fileMapper, argData, changes));
+                        },
+                        [&]() {
+                            keepSessionAlive(watchServer, watchSession, argData);
+                        });
+            } catch (...) {
+                if (watchSession) {
+                    watchSession->sshSession.disconnect();
+                }
+                throw;
+            }
+            if (watchSession) {
+                closeSFTPSession(*watchSession);
+            }
+        }
+
         // Disconnect session
         
         sftpServer.close();
@@ -224,6 +535,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("SFTPBackup", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -268,6 +585,10 @@ int main(int argc, char** argv) {
         
         sshSession.disconnect();
 
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
@@ -2,7 +2,12 @@
 // Program: SFTPRestore
 //
 // Description: Simple SFTP restore program that takes a remote directory and restores it
-// to a local directory.
+// to a local directory. The remote tree may be listed by several listers at once, each
+// with its own SSH session (--listers); such a listing skips (and reports) symbolic
+// links and special files, which a single lister restores as before. With --resume
+// each file is restored through a part file and checkpoint journal so an interrupted
+// restore carries on where it left off; --verify also checks each file against a
+// SHA-256 hash computed on the server.
 //
 // Dependencies: C11++, Classes (CSFTP, CSSHSession, CPath, CFile), Boost C++ Libraries.
 //
@@ -16,6 +21,14 @@
 //   -p [ --password ] arg  User password
 //   -r [ --remote ] arg    Remote server directory to restore
 //   -l [ --local ] arg     Local directory to use as base for restore
+//   -i [ --inflight ] arg (=1)     Requests in flight per file (> 1 pipelines transfers)
+//   -k [ --chunk ] arg (=32768)    Bytes per pipelined read/write request (at most 261120)
+//   --listers arg (=1)     Number of concurrent directory listers (SSH sessions); more
+//                          than one skips symbolic links
+//   --order arg (=breadth) Directory listing order (breadth or depth)
+//   --resume               Resume interrupted file restores from their last checkpoint
+//   --verify               Verify restored files against a server SHA-256 hash (--resume)
+//   --stats arg            Write transfer stats summary (JSON, Prometheus textfile if .prom)
 //
 
 // =============
@@ -28,6 +41,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 
 //
 // Antik Classes
@@ -35,8 +49,10 @@
 
 #include "SSHSessionUtil.hpp"
 #include "SFTPUtil.hpp"
+#include "SFTPTransferUtil.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "TransferStats.hpp"
 
 using namespace Antik;
 using namespace Antik::SSH;
@@ -64,6 +80,13 @@ struct ParamArgData {
     std::string remoteDirectory; // SSH remote directory to restore
     std::string localDirectory;  // Local directory to use as base for restore
     std::string configFileName;  // Configuration file name
+    SFTPTransferOptions transferOptions; // Pipelined transfer options
+    int listers { 1 };           // Number of concurrent directory listers
+    std::string order;           // Directory listing order option
+    ListingOrder listingOrder { ListingOrder::breadthFirst }; // Directory listing order
+    bool bResume { false };      // == true resumable (checkpointed) restore
+    bool bVerify { false };      // == true verify restored files with SHA-256 hash
+    std::string statsFileName;    // Transfer stats summary file
 };
 
 // ===============
@@ -80,6 +103,15 @@ static void exitWithError(std::string errMsg) {
 
     std::cout.flush();
     std::cerr << errMsg << std::endl;
+
+    // Stats for the failed run
+
+    try {
+        TransferStats::instance().addError();
+        TransferStats::instance().write();
+    } catch (...) {
+    }
+
     exit(EXIT_FAILURE);
 
 }
@@ -96,7 +128,14 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
             ("remote,r", po::value<std::string>(&argData.remoteDirectory)->required(), "Remote directory to restore")
-            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore");
+            ("local,l", po::value<std::string>(&argData.localDirectory)->required(), "Local directory as base for restore")
+            ("inflight,i", po::value<std::uint32_t>(&argData.transferOptions.inflight)->default_value(1), "Requests in flight per file (> 1 pipelines transfers)")
+            ("chunk,k", po::value<std::uint32_t>(&argData.transferOptions.chunkSize)->default_value(32 * 1024), "Bytes per pipelined read/write request (at most 261120)")
+            ("listers", po::value<int>(&argData.listers)->default_value(1), "Number of concurrent directory listers (SSH sessions); more than one skips symbolic links")
+            ("order", po::value<std::string>(&argData.order)->default_value("breadth"), "Directory listing order (breadth or depth)")
+            ("resume", "Resume interrupted file restores from their last checkpoint")
+            ("verify", "Verify restored files against a server SHA-256 hash (--resume)")
+            ("stats", po::value<std::string>(&argData.statsFileName), "Write transfer stats summary (JSON, Prometheus textfile if .prom)");
 
 }
 
@@ -145,8 +184,38 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             }
         }
 
+        // Resumable restore
+
+        if (vm.count("resume")) {
+            argData.bResume = true;
+        }
+
+        if (vm.count("verify")) {
+            argData.bVerify = true;
+        }
+
         po::notify(vm);
 
+        if (argData.bVerify && !argData.bResume) {
+            throw po::error("--verify is only used with --resume.");
+        }
+
+        if ((argData.transferOptions.chunkSize == 0) ||
+                (argData.transferOptions.chunkSize > SFTPTransferOptions::kMaxChunkSize)) {
+            throw po::error("Transfer chunk size must be between 1 and " +
+                    std::to_string(SFTPTransferOptions::kMaxChunkSize) + " bytes.");
+        }
+
+        if (argData.listers < 1) {
+            throw po::error("Number of listers must be at least one.");
+        }
+
+        try {
+            argData.listingOrder = listingOrder(argData.order);
+        } catch (std::invalid_argument &e) {
+            throw po::error(e.what());
+        }
+
     } catch (po::error& e) {
         std::cerr << "SFTPRestore Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -155,6 +224,63 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
 }
 
+//
+// List the remote directory with the restore session and argData.listers-1 more. A
+// single lister uses the library listing (symbolic links included); its entries
+// only carry stat data (followed through any link) when --resume needs it.
+//
+
+static ListedFiles listRemoteDirectory(CSFTP &sftpServer, const ParamArgData &argData) {
+
+    std::vector<std::unique_ptr<SFTPSession>> sftpListers;
+    std::vector<CSFTP *> listers { &sftpServer };
+    ListedFiles remoteListing;
+
+    if (argData.listers == 1) {
+        FileList remoteFileList;
+        listRemoteRecursive(sftpServer, argData.remoteDirectory, remoteFileList);
+        for (auto &remoteFile : remoteFileList) {
+            ListedFile listedFile;
+            listedFile.path = remoteFile;
+            if (argData.bResume) {
+                TransferStats::OperationTimer metadataTimer { TransferStats::Phase::metadata };
+                CSFTP::FileAttributes fileAttributes;
+                sftpServer.getFileAttributes(remoteFile, fileAttributes);
+                TransferStats::instance().addRoundTrips();
+                listedFile.bDirectory = sftpServer.isADirectory(fileAttributes);
+                listedFile.size = fileAttributes->size;
+                listedFile.modified = fileAttributes->mtime;
+            }
+            remoteListing.push_back(std::move(listedFile));
+        }
+        return (remoteListing);
+    }
+
+    try {
+
+        for (int lister = 1; lister < argData.listers; lister++) {
+            sftpListers.emplace_back(new SFTPSession());
+            openSFTPSession(*sftpListers.back(), argData.serverName, argData.serverPort, argData.userName, argData.userPassword);
+            listers.push_back(sftpListers.back()->sftpServer.get());
+        }
+
+        remoteListing = listRemoteRecursiveParallel(listers, argData.remoteDirectory, argData.listingOrder);
+
+    } catch (...) {
+        for (auto &sftpLister : sftpListers) {
+            closeSFTPSession(*sftpLister);
+        }
+        throw;
+    }
+
+    for (auto &sftpLister : sftpListers) {
+        closeSFTPSession(*sftpLister);
+    }
+
+    return (remoteListing);
+
+}
+
 //
 // Perform restore of backed up  files.
 //
@@ -173,16 +299,32 @@ static void performRestore(CSSHSession &sshSession, ParamArgData argData) {
 
         sftpServer.open();
 
-        // Get remote directory file list
+        // Get remote directory file list (with stat data)
 
-        listRemoteRecursive(sftpServer, argData.remoteDirectory, remoteFileList);
+        TransferStats::PhaseTimer listingTimer { TransferStats::Phase::listing };
+        ListedFiles remoteListing { listRemoteDirectory(sftpServer, argData) };
+        listingTimer.stop();
+
+        remoteFileList = listedPaths(remoteListing);
 
         // Restore files from  SFTP Server
 
         if (!remoteFileList.empty()) {
-            restoredFiles = getFiles(sftpServer, fileMapper, remoteFileList);
+            TransferStats::PhaseTimer transferTimer { TransferStats::Phase::transfer };
+            if (argData.bResume) {
+                restoredFiles = getFilesResumable(sftpServer, fileMapper, remoteListing, argData.transferOptions, argData.bVerify);
+            } else if ((argData.transferOptions.inflight > 1) && (argData.listers > 1)) {
+                restoredFiles = getFiles(sftpServer, fileMapper, remoteListing, argData.transferOptions);
+            } else if (argData.transferOptions.inflight > 1) {
+                restoredFiles = getFiles(sftpServer, fileMapper, remoteFileList, argData.transferOptions);
+            } else {
+                restoredFiles = getFiles(sftpServer, fileMapper, remoteFileList,
+                                         TransferStats::instance().fileCompletionFn());
+            }
         }
 
+        TransferStats::instance().addLocalFiles(restoredFiles, argData.bResume || (argData.transferOptions.inflight > 1));
+
         // Signal success or failure
 
         if (!restoredFiles.empty()) {
@@ -225,6 +367,12 @@ int main(int argc, char** argv) {
 
         procCmdLine(argc, argv, argData);
 
+        // Record transfer stats if asked for
+
+        if (!argData.statsFileName.empty()) {
+            TransferStats::instance().enable("SFTPRestore", argData.statsFileName);
+        }
+
         std::cout << "SERVER [" << argData.serverName << "]" << std::endl;
         std::cout << "SERVER PORT [" << argData.serverPort << "]" << std::endl;
         std::cout << "USER [" << argData.userName << "]" << std::endl;
@@ -269,6 +417,10 @@ int main(int argc, char** argv) {
  
         sshSession.disconnect();
 
+        // Write transfer stats
+
+        TransferStats::instance().write();
+
     //
     // Catch any errors
     //    
@@ -0,0 +1,892 @@
+#ifndef SFTPTRANSFERUTIL_HPP
+#define SFTPTRANSFERUTIL_HPP
+
+//
+// Header: SFTPTransferUtil
+//
+// Description: Pipelined SFTP file transfer shared by the SFTP example programs.
+// Rather than one blocking read/write per chunk a configurable number of requests
+// are kept in flight on each file handle so that throughput is no longer capped
+// at chunk size divided by round trip time. Each request carries its own offset and
+// id so the server may complete them in any order; replies are collected oldest
+// first which keeps local file reads/writes sequential.
+//
+// libssh 0.11+ sftp_aio_* is used for reads and writes; on earlier versions reads
+// use sftp_async_read_* and writes fall back to one request at a time.
+//
+// A file list may also be spread across several SFTP channels on the one SSH session,
+// a single thread keeping asynchronous writes in flight on all of them.
+//
+// A remote tree may be listed by several listers (each an SFTP session of its own so
+// their READDIR requests really are in flight together) with each entry's stat data
+// returned; getFiles() can then restore from the listing without a stat per file.
+// openSFTPSession() connects such a session (as it does the --watch session that
+// replaces one the server has dropped).
+//
+// getFilesResumable() restores from a listing through ResumableDownload so that an
+// interrupted restore carries on from each file's last checkpoint (the remote read
+// starting at that offset); a restored file may also be checked against a SHA-256
+// hash computed on the server (sha256sum run over a SSH exec channel).
+//
+// putFiles() may also delta copy a file already on the server: the server hashes
+// each block of its copy (again over an exec channel) and only the local blocks
+// whose hashes differ are written, in place.
+//
+// Each file transferred (and attribute fetched) is timed into TransferStats, which
+// is also given the bytes each request moved and a round trip for each request.
+//
+// Dependencies: C11++, Classes (CSFTP, CSSHSession, CFile), SSHSessionUtil, SFTPUtil,
+// RecursiveListing, ResumableTransfer, TransferStats, libssh.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
+#include <functional>
+#include <sstream>
+
+//
+// Antik Classes
+//
+
+#include "SSHSessionUtil.hpp"
+#include "SFTPUtil.hpp"
+#include "CFile.hpp"
+#include "RecursiveListing.hpp"
+#include "ResumableTransfer.hpp"
+#include "SHA256.hpp"
+#include "TransferStats.hpp"
+
+//
+// libssh
+//
+
+#include <libssh/sftp.h>
+#include <fcntl.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// Pipelined transfer options.
+//
+
+struct SFTPTransferOptions {
+    static constexpr std::uint32_t kMaxChunkSize { 255 * 1024 }; // Largest read/write an OpenSSH server accepts
+    std::uint32_t inflight { 16 };         // Maximum requests outstanding per file
+    std::uint32_t chunkSize { 32 * 1024 }; // Bytes per read/write request
+    std::uint32_t deltaBlockSize { 0 };    // Delta copy block size (0 == copy whole files)
+};
+
+//
+// Outstanding request queue for a file; any requests still queued when it goes out
+// of scope (ie. on an error) are released.
+//
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+
+struct SFTPRequestQueue {
+    ~SFTPRequestQueue() {
+        for (auto &aio : pending) {
+            sftp_aio_free(aio);
+        }
+    }
+    std::deque<sftp_aio> pending;
+};
+
+#else
+
+struct SFTPRequestQueue {
+    std::deque<std::uint32_t> pending;
+};
+
+#endif
+
+//
+// Per channel state for putFilesMultiChannel(): the file being copied over the
+// channel and its outstanding writes.
+//
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+
+struct SFTPChannelTransfer {
+    std::size_t file { 0 };                       // Index of file in list
+    std::ifstream localFile;                      // Local file being copied
+    std::string remoteFile;                       // Its remote path
+    Antik::SSH::CSFTP::FileHandle remoteHandle;   // Open remote file
+    SFTPRequestQueue requests;                    // Writes outstanding
+    std::deque<std::size_t> requestLengths;       // Bytes in each write
+    bool bEndOfFile { false };                    // == true whole file requested
+    bool bCopying { false };                      // == true file in progress
+    std::chrono::steady_clock::time_point start;  // When the copy started
+};
+
+#endif
+
+//
+// SSH session of its own with an SFTP channel on it.
+//
+
+struct SFTPSession {
+    Antik::SSH::CSSHSession sshSession;
+    Antik::SSH::ServerVerificationContext verificationContext { &sshSession };
+    std::unique_ptr<Antik::SSH::CSFTP> sftpServer;
+};
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// Copy a local file to the server keeping up to options.inflight writes outstanding.
+//
+
+inline void putFilePipelined(Antik::SSH::CSFTP &sftpServer, const std::string &localFilePath,
+                             const std::string &remoteFilePath, const SFTPTransferOptions &options) {
+
+    std::ifstream localFile(localFilePath, std::ios::binary);
+
+    if (!localFile.is_open()) {
+        throw std::runtime_error("Could not open local file [" + localFilePath + "]");
+    }
+
+    auto permissions = static_cast<Antik::SSH::CSFTP::FilePermissions>(std::filesystem::status(localFilePath).permissions());
+    Antik::SSH::CSFTP::FileHandle remoteFile { sftpServer.openFile(remoteFilePath, O_CREAT | O_WRONLY | O_TRUNC, permissions) };
+    std::vector<char> writeBuffer(options.chunkSize);
+
+    TransferStats::instance().addRoundTrips();
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+
+    SFTPRequestQueue requests;
+    std::deque<std::size_t> requestLengths;
+    bool bEndOfFile { false };
+
+    do {
+
+        while (!bEndOfFile && (requests.pending.size() < options.inflight)) {
+            localFile.read(writeBuffer.data(), writeBuffer.size());
+            if (localFile.gcount() == 0) {
+                bEndOfFile = true;
+                break;
+            }
+            sftp_aio aio;
+            if (sftp_aio_begin_write(remoteFile.get(), writeBuffer.data(), localFile.gcount(), &aio) < 0) {
+                throw std::runtime_error("SFTP write request for [" + remoteFilePath + "] failed.");
+            }
+            requests.pending.push_back(aio);
+            requestLengths.push_back(localFile.gcount());
+        }
+
+        if (!requests.pending.empty()) {
+            auto written = sftp_aio_wait_write(&requests.pending.front());
+            requests.pending.pop_front();
+            if (written < 0) {
+                throw std::runtime_error("SFTP write to [" + remoteFilePath + "] failed.");
+            }
+            if (static_cast<std::size_t>(written) != requestLengths.front()) {
+                throw std::runtime_error("SFTP write to [" + remoteFilePath + "] was short (" +
+                                         std::to_string(written) + " of " + std::to_string(requestLengths.front()) + " bytes).");
+            }
+            requestLengths.pop_front();
+            TransferStats::instance().addRoundTrips();
+            TransferStats::instance().addBytes(written);
+        }
+
+    } while (!requests.pending.empty());
+
+#else
+
+    while (localFile.read(writeBuffer.data(), writeBuffer.size()), localFile.gcount() > 0) {
+        if (sftp_write(remoteFile.get(), writeBuffer.data(), localFile.gcount()) != localFile.gcount()) {
+            throw std::runtime_error("SFTP write to [" + remoteFilePath + "] failed.");
+        }
+        TransferStats::instance().addRoundTrips();
+        TransferStats::instance().addBytes(localFile.gcount());
+    }
+
+#endif
+
+    sftpServer.closeFile(remoteFile);
+    TransferStats::instance().addRoundTrips();
+
+}
+
+//
+// Read a remote file of a given size from an offset passing each chunk read (in file
+// order) to a write function and keeping up to options.inflight reads outstanding.
+// A short read discards the requests behind it and carries on from the bytes
+// received; the file ending early (or any failed read) throws.
+//
+
+inline void readFilePipelined(Antik::SSH::CSFTP &sftpServer, const std::string &remoteFilePath,
+                              std::uint64_t offset, std::uint64_t remoteFileSize,
+                              std::function<void(const char *data, std::size_t length)> writeFn,
+                              const SFTPTransferOptions &options) {
+
+    Antik::SSH::CSFTP::FileHandle remoteFile { sftpServer.openFile(remoteFilePath, O_RDONLY, 0) };
+    std::vector<char> readBuffer(options.chunkSize);
+    std::uint64_t bytesRequested { offset };
+    std::uint64_t bytesReceived { offset };
+    std::deque<std::uint32_t> requestLengths;
+    SFTPRequestQueue requests;
+
+    TransferStats::instance().addRoundTrips();
+
+    if (offset) {
+        sftpServer.seekFile64(remoteFile, offset);
+    }
+
+    do {
+
+        while ((requests.pending.size() < options.inflight) && (bytesRequested < remoteFileSize)) {
+            auto bytesToRead = static_cast<std::uint32_t>(std::min<std::uint64_t>(options.chunkSize, remoteFileSize - bytesRequested));
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+            sftp_aio aio;
+            if (sftp_aio_begin_read(remoteFile.get(), bytesToRead, &aio) < 0) {
+                throw std::runtime_error("SFTP read request for [" + remoteFilePath + "] failed.");
+            }
+            requests.pending.push_back(aio);
+#else
+            auto requestId = sftp_async_read_begin(remoteFile.get(), bytesToRead);
+            if (requestId < 0) {
+                throw std::runtime_error("SFTP read request for [" + remoteFilePath + "] failed.");
+            }
+            requests.pending.push_back(static_cast<std::uint32_t>(requestId));
+#endif
+            requestLengths.push_back(bytesToRead);
+            bytesRequested += bytesToRead;
+        }
+
+        if (!requests.pending.empty()) {
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+            auto bytesRead = sftp_aio_wait_read(&requests.pending.front(), readBuffer.data(), readBuffer.size());
+#else
+            auto bytesRead = sftp_async_read(remoteFile.get(), readBuffer.data(), readBuffer.size(), requests.pending.front());
+#endif
+            requests.pending.pop_front();
+            if (bytesRead < 0) {
+                throw std::runtime_error("SFTP read from [" + remoteFilePath + "] failed.");
+            }
+            if (bytesRead == 0) {
+                throw std::runtime_error("SFTP read from [" + remoteFilePath + "] ended at " +
+                                         std::to_string(bytesReceived) + " of " + std::to_string(remoteFileSize) + " bytes.");
+            }
+            TransferStats::instance().addRoundTrips();
+            TransferStats::instance().addBytes(bytesRead);
+            writeFn(readBuffer.data(), bytesRead);
+            bytesReceived += bytesRead;
+            if (static_cast<std::uint64_t>(bytesRead) < requestLengths.front()) {
+                while (!requests.pending.empty()) {
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+                    sftp_aio_wait_read(&requests.pending.front(), readBuffer.data(), readBuffer.size());
+#else
+                    sftp_async_read(remoteFile.get(), readBuffer.data(), readBuffer.size(), requests.pending.front());
+#endif
+                    requests.pending.pop_front();
+                    TransferStats::instance().addRoundTrips();
+                }
+                requestLengths.clear();
+                sftpServer.seekFile64(remoteFile, bytesReceived);
+                bytesRequested = bytesReceived;
+            } else {
+                requestLengths.pop_front();
+            }
+        }
+
+    } while (!requests.pending.empty() || (bytesRequested < remoteFileSize));
+
+    sftpServer.closeFile(remoteFile);
+    TransferStats::instance().addRoundTrips();
+
+    if (bytesReceived != remoteFileSize) {
+        throw std::runtime_error("SFTP read from [" + remoteFilePath + "] received " +
+                                 std::to_string(bytesReceived) + " of " + std::to_string(remoteFileSize) + " bytes.");
+    }
+
+}
+
+//
+// Copy a remote file of a given size to a local file keeping up to options.inflight
+// reads outstanding.
+//
+
+inline void getFilePipelined(Antik::SSH::CSFTP &sftpServer, const std::string &remoteFilePath,
+                             std::uint64_t remoteFileSize, const std::string &localFilePath,
+                             const SFTPTransferOptions &options) {
+
+    std::ofstream localFile(localFilePath, std::ios::binary | std::ios::trunc);
+
+    if (!localFile.is_open()) {
+        throw std::runtime_error("Could not create local file [" + localFilePath + "]");
+    }
+
+    readFilePipelined(sftpServer, remoteFilePath, 0, remoteFileSize,
+            [&localFile, &localFilePath](const char *data, std::size_t length) {
+                if (!localFile.write(data, length)) {
+                    throw std::runtime_error("Write to local file [" + localFilePath + "] failed.");
+                }
+            }, options);
+
+    localFile.close();
+    if (!localFile) {
+        throw std::runtime_error("Could not write local file [" + localFilePath + "]");
+    }
+
+}
+
+//
+// Quote a path for the remote shell.
+//
+
+inline std::string remoteShellQuote(const std::string &path) {
+    std::string quotedPath { "'" };
+    for (auto character : path) {
+        quotedPath += (character == '\'') ? std::string("'\\''") : std::string(1, character);
+    }
+    return (quotedPath + "'");
+}
+
+//
+// Run a command on the server over a SSH exec channel on the session and return its
+// standard output; throws if it cannot be run or exits with a non-zero status.
+//
+
+inline std::string remoteCommandOutput(Antik::SSH::CSSHSession &sshSession, const std::string &command) {
+
+    std::string output;
+    char readBuffer[4096];
+    int exitStatus { -1 };
+
+    ssh_channel channel { ssh_channel_new(sshSession.getSession()) };
+    if (channel == nullptr) {
+        throw std::runtime_error("Could not open channel for remote command.");
+    }
+
+    if ((ssh_channel_open_session(channel) == SSH_OK) && (ssh_channel_request_exec(channel, command.c_str()) == SSH_OK)) {
+        int bytesRead;
+        while ((bytesRead = ssh_channel_read(channel, readBuffer, sizeof (readBuffer), 0)) > 0) {
+            output.append(readBuffer, bytesRead);
+        }
+        ssh_channel_send_eof(channel);
+        exitStatus = ssh_channel_get_exit_status(channel);
+    }
+
+    ssh_channel_close(channel);
+    ssh_channel_free(channel);
+
+    TransferStats::instance().addRoundTrips();
+    TransferStats::instance().addBytes(output.size());
+
+    if (exitStatus != 0) {
+        throw std::runtime_error("Remote command failed [" + command + "]");
+    }
+
+    return (output);
+
+}
+
+//
+// == true line starts with a hex SHA-256 hash (sha256sum output).
+//
+
+inline bool isSHA256Line(const std::string &line) {
+    return ((line.size() >= 64) && (line.find_first_not_of("0123456789abcdef") >= 64));
+}
+
+//
+// Return the SHA-256 hash of a remote file computed on the server by sha256sum.
+//
+
+inline std::string remoteFileSHA256(Antik::SSH::CSSHSession &sshSession, const std::string &remoteFilePath) {
+
+    std::string output { remoteCommandOutput(sshSession, "sha256sum -- " + remoteShellQuote(remoteFilePath)) };
+
+    if (!isSHA256Line(output)) {
+        throw std::runtime_error("Could not get SHA-256 hash of [" + remoteFilePath + "] from server.");
+    }
+
+    return (output.substr(0, 64));
+
+}
+
+//
+// Return the SHA-256 hash of each blockSize block of a remote file of a given size
+// computed on the server in one pass over the file (GNU split piping each block to
+// sha256sum) and returned as a list in block order.
+//
+
+inline std::vector<std::string> remoteBlockSHA256(Antik::SSH::CSSHSession &sshSession, const std::string &remoteFilePath,
+                                                  std::uint64_t remoteFileSize, std::uint32_t blockSize) {
+
+    std::uint64_t blockCount { (remoteFileSize + blockSize - 1) / blockSize };
+    std::string command { "split -b " + std::to_string(blockSize) + " --filter=sha256sum < " + remoteShellQuote(remoteFilePath) };
+
+    std::istringstream outputStream { remoteCommandOutput(sshSession, command) };
+    std::vector<std::string> blockHashes;
+
+    for (std::string line; std::getline(outputStream, line);) {
+        if (!isSHA256Line(line)) {
+            throw std::runtime_error("Bad block hash for [" + remoteFilePath + "] from server.");
+        }
+        blockHashes.push_back(line.substr(0, 64));
+    }
+
+    if (blockHashes.size() != blockCount) {
+        throw std::runtime_error("Block hash count mismatch for [" + remoteFilePath + "] from server.");
+    }
+
+    return (blockHashes);
+
+}
+
+//
+// Delta copy of a local file to an existing remote copy: the server hashes each
+// options.deltaBlockSize block of its copy, the local file is hashed block by block
+// and only blocks that differ (plus any the file has grown by) are written in place.
+// Returns false (with nothing sent) if the remote file is missing, not a regular file,
+// empty or larger than the local file (it could not be truncated); the caller then
+// copies the whole file. Otherwise the number of bytes sent is returned in bytesSent.
+//
+
+inline bool putFileDelta(Antik::SSH::CSFTP &sftpServer, const std::string &localFilePath,
+                         const std::string &remoteFilePath, const SFTPTransferOptions &options,
+                         std::uint64_t &bytesSent) {
+
+    std::uint64_t localFileSize { std::filesystem::file_size(localFilePath) };
+    Antik::SSH::CSFTP::FileAttributes fileAttributes;
+
+    TransferStats::instance().addRoundTrips();
+
+    try {
+        sftpServer.getFileAttributes(remoteFilePath, fileAttributes);
+    } catch (const std::exception &) {
+        return (false); // Not on server
+    }
+
+    if (!sftpServer.isARegularFile(fileAttributes) || (fileAttributes->size == 0) ||
+            (fileAttributes->size > localFileSize)) {
+        return (false);
+    }
+
+    std::vector<std::string> remoteBlockHashes { remoteBlockSHA256(sftpServer.getSession(), remoteFilePath,
+                                                                   fileAttributes->size, options.deltaBlockSize) };
+
+    std::ifstream localFile(localFilePath, std::ios::binary);
+    if (!localFile.is_open()) {
+        throw std::runtime_error("Could not open local file [" + localFilePath + "]");
+    }
+
+    Antik::SSH::CSFTP::FileHandle remoteFile { sftpServer.openFile(remoteFilePath, O_WRONLY, 0) };
+    std::vector<char> blockBuffer(options.deltaBlockSize);
+    SHA256 blockHash;
+
+    TransferStats::instance().addRoundTrips();
+
+    bytesSent = 0;
+
+    for (std::uint64_t block = 0; localFile.read(blockBuffer.data(), blockBuffer.size()), localFile.gcount() > 0; block++) {
+        std::size_t blockBytes { static_cast<std::size_t> (localFile.gcount()) };
+        if (block < remoteBlockHashes.size()) {
+            blockHash.update(blockBuffer.data(), blockBytes);
+            if (blockHash.final() == remoteBlockHashes[block]) {
+                continue;
+            }
+        }
+        sftpServer.seekFile64(remoteFile, block * options.deltaBlockSize);
+        for (std::size_t offset = 0; offset < blockBytes; offset += options.chunkSize) {
+            std::size_t bytesToWrite { std::min<std::size_t>(options.chunkSize, blockBytes - offset) };
+            if (sftp_write(remoteFile.get(), blockBuffer.data() + offset, bytesToWrite) != static_cast<ssize_t> (bytesToWrite)) {
+                throw std::runtime_error("SFTP write to [" + remoteFilePath + "] failed.");
+            }
+            TransferStats::instance().addRoundTrips();
+        }
+        TransferStats::instance().addBytes(blockBytes);
+        bytesSent += blockBytes;
+    }
+
+    sftpServer.closeFile(remoteFile);
+    TransferStats::instance().addRoundTrips();
+
+    return (true);
+
+}
+
+//
+// Pipelined version of SFTPUtil putFiles(). Directories are passed to the library
+// putFiles() so they are created in list order before any file they contain. With
+// options.deltaBlockSize set files already on the server are delta copied. The
+// remote path of each file/directory copied is returned.
+//
+
+inline Antik::FileList putFiles(Antik::SSH::CSFTP &sftpServer, Antik::SSH::FileMapper &fileMapper,
+                                const Antik::FileList &localFileList, const SFTPTransferOptions &options) {
+
+    Antik::FileList successList;
+
+    for (auto &localFile : localFileList) {
+        if (Antik::File::CFile::isDirectory(localFile)) {
+            auto directories = Antik::SSH::putFiles(sftpServer, fileMapper, { localFile });
+            std::move(directories.begin(), directories.end(), std::back_inserter(successList));
+        } else {
+            std::string remoteFile { fileMapper.toRemote(localFile) };
+            TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+            std::uint64_t bytesSent { 0 };
+            if (options.deltaBlockSize && putFileDelta(sftpServer, localFile, remoteFile, options, bytesSent)) {
+                std::cout << "Delta copied [" << localFile << "] (" << bytesSent << " of "
+                          << std::filesystem::file_size(localFile) << " bytes sent)" << std::endl;
+            } else {
+                putFilePipelined(sftpServer, localFile, remoteFile, options);
+            }
+            successList.push_back(remoteFile);
+        }
+    }
+
+    return (successList);
+
+}
+
+//
+// Pipelined version of SFTPUtil getFiles(). Directories are passed to the library
+// getFiles() to recreate locally. The local path of each file/directory copied
+// is returned.
+//
+
+inline Antik::FileList getFiles(Antik::SSH::CSFTP &sftpServer, Antik::SSH::FileMapper &fileMapper,
+                                const Antik::FileList &remoteFileList, const SFTPTransferOptions &options) {
+
+    Antik::FileList successList;
+
+    for (auto &remoteFile : remoteFileList) {
+        Antik::SSH::CSFTP::FileAttributes fileAttributes;
+        {
+            TransferStats::OperationTimer metadataTimer { TransferStats::Phase::metadata };
+            sftpServer.getFileAttributes(remoteFile, fileAttributes);
+            TransferStats::instance().addRoundTrips();
+        }
+        if (sftpServer.isARegularFile(fileAttributes)) {
+            std::string localFile { fileMapper.toLocal(remoteFile) };
+            TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+            getFilePipelined(sftpServer, remoteFile, fileAttributes->size, localFile, options);
+            successList.push_back(localFile);
+        } else {
+            auto others = Antik::SSH::getFiles(sftpServer, fileMapper, { remoteFile });
+            std::move(others.begin(), others.end(), std::back_inserter(successList));
+        }
+    }
+
+    return (successList);
+
+}
+
+//
+// Version of getFiles() that takes a remote listing; the listed size of each file is
+// used so no file is stat'ed again.
+//
+
+inline Antik::FileList getFiles(Antik::SSH::CSFTP &sftpServer, Antik::SSH::FileMapper &fileMapper,
+                                const ListedFiles &remoteListing, const SFTPTransferOptions &options) {
+
+    Antik::FileList successList;
+
+    for (auto &remoteFile : remoteListing) {
+        if (!remoteFile.bDirectory) {
+            std::string localFile { fileMapper.toLocal(remoteFile.path) };
+            TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+            getFilePipelined(sftpServer, remoteFile.path, remoteFile.size, localFile, options);
+            successList.push_back(localFile);
+        } else {
+            auto directories = Antik::SSH::getFiles(sftpServer, fileMapper, { remoteFile.path });
+            std::move(directories.begin(), directories.end(), std::back_inserter(successList));
+        }
+    }
+
+    return (successList);
+
+}
+
+//
+// Resumable version of the listing based getFiles(). Each file goes through a part
+// file and journal (ResumableDownload) and is read from its last checkpoint; files
+// already restored by an earlier run are skipped. If bVerify is set each file is
+// also checked against a server computed SHA-256 hash. A file that fails is reported
+// and left to be resumed by the next run; the local path of each file/directory
+// restored is returned.
+//
+
+inline Antik::FileList getFilesResumable(Antik::SSH::CSFTP &sftpServer, Antik::SSH::FileMapper &fileMapper,
+                                         const ListedFiles &remoteListing, const SFTPTransferOptions &options,
+                                         bool bVerify) {
+
+    Antik::FileList successList;
+
+    for (auto &remoteFile : remoteListing) {
+        if (!remoteFile.bDirectory) {
+            std::string localFile { fileMapper.toLocal(remoteFile.path) };
+            TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+            try {
+                if (!ResumableDownload::alreadyRestored(localFile, remoteFile.size, remoteFile.modified)) {
+                    ResumableDownload download { localFile, remoteFile.size, remoteFile.modified };
+                    if (download.offset()) {
+                        std::cout << "Resuming [" << remoteFile.path << "] from byte " << download.offset() << std::endl;
+                    }
+                    if (download.offset() < remoteFile.size) {
+                        readFilePipelined(sftpServer, remoteFile.path, download.offset(), remoteFile.size,
+                                [&download](const char *data, std::size_t length) {
+                                    download.write(data, length);
+                                }, options);
+                    }
+                    download.complete(bVerify ? remoteFileSHA256(sftpServer.getSession(), remoteFile.path) : "");
+                }
+                successList.push_back(localFile);
+            } catch (const std::exception &e) {
+                std::cerr << "Failed to restore [" << remoteFile.path << "]: " << e.what() << std::endl;
+                TransferStats::instance().addError();
+            }
+        } else {
+            auto directories = Antik::SSH::getFiles(sftpServer, fileMapper, { remoteFile.path });
+            std::move(directories.begin(), directories.end(), std::back_inserter(successList));
+        }
+    }
+
+    return (successList);
+
+}
+
+//
+// Recursively list a remote directory with one lister per passed in SFTP session
+// (each must be on its own SSH session as calls into a session are not concurrent).
+// Symbolic links are not followed (a link to a parent would make the walk cycle and
+// a dangling one can't be stat'ed) and are left out along with any special files;
+// each one skipped is reported.
+//
+
+inline ListedFiles listRemoteRecursiveParallel(const std::vector<Antik::SSH::CSFTP *> &sftpListers,
+                                               const std::string &remoteDirectory, ListingOrder order) {
+
+    return (listRecursiveParallel(remoteDirectory, sftpListers.size(), order,
+            [&sftpListers](std::size_t lister, const std::string &directory, ListedFiles &entries) {
+                Antik::SSH::CSFTP &sftpServer { *sftpListers[lister] };
+                Antik::SSH::CSFTP::DirectoryHandle directoryHandle { sftpServer.openDirectory(directory) };
+                Antik::SSH::CSFTP::FileAttributes fileAttributes;
+                while (sftpServer.readDirectory(directoryHandle, fileAttributes)) {
+                    std::string fileName { fileAttributes->name };
+                    if ((fileName == ".") || (fileName == "..")) {
+                        continue;
+                    }
+                    if (!sftpServer.isADirectory(fileAttributes) && !sftpServer.isARegularFile(fileAttributes)) {
+                        std::cerr << ("Skipped " + std::string(sftpServer.isASymbolicLink(fileAttributes) ?
+                                "symbolic link" : "special file") + " [" + listingPath(directory, fileName) + "]\n");
+                        continue; // Listed attributes are of the link itself
+                    }
+                    ListedFile listedFile;
+                    listedFile.path = listingPath(directory, fileName);
+                    listedFile.bDirectory = sftpServer.isADirectory(fileAttributes);
+                    listedFile.size = fileAttributes->size;
+                    listedFile.modified = fileAttributes->mtime;
+                    entries.push_back(std::move(listedFile));
+                }
+                sftpServer.closeDirectory(directoryHandle);
+            }));
+
+}
+
+//
+// Copy a local file list to the server over several (open) SFTP channels on the one
+// SSH session, all driven from this thread: each channel copies a file at a time
+// with up to options.inflight asynchronous writes outstanding, and the channels are
+// topped up and their oldest reply collected in turn so that requests on all of
+// them are in flight together. A channel that finishes a file takes the next one.
+// Directories are created first, in list order, over the first channel so that a
+// file never lands before its parent exists. The remote path of each file/directory
+// copied is returned in list order.
+//
+
+inline Antik::FileList putFilesMultiChannel(const std::vector<Antik::SSH::CSFTP *> &sftpChannels,
+                                            Antik::SSH::FileMapper &fileMapper,
+                                            const Antik::FileList &localFileList,
+                                            const SFTPTransferOptions &options) {
+
+    Antik::FileList successList;
+    Antik::FileList fileList;
+
+    for (auto &localFile : localFileList) {
+        if (Antik::File::CFile::isDirectory(localFile)) {
+            auto directories = Antik::SSH::putFiles(*sftpChannels.front(), fileMapper, { localFile });
+            std::move(directories.begin(), directories.end(), std::back_inserter(successList));
+        } else {
+            fileList.push_back(localFile);
+        }
+    }
+
+    if (fileList.empty()) {
+        return (successList);
+    }
+
+    std::vector<std::string> transferred(fileList.size());
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+
+    std::vector<SFTPChannelTransfer> channelTransfers(std::min(sftpChannels.size(), fileList.size()));
+    std::vector<char> writeBuffer(options.chunkSize);
+    std::size_t nextFile { 0 };
+    bool bTransferring;
+
+    // Start a channel on the next file (it is left idle when there are none left).
+
+    auto startFile = [&](std::size_t channel) {
+        SFTPChannelTransfer &transfer { channelTransfers[channel] };
+        if (nextFile == fileList.size()) {
+            return;
+        }
+        transfer.file = nextFile++;
+        transfer.localFile = std::ifstream(fileList[transfer.file], std::ios::binary);
+        if (!transfer.localFile.is_open()) {
+            throw std::runtime_error("Could not open local file [" + fileList[transfer.file] + "]");
+        }
+        transfer.remoteFile = fileMapper.toRemote(fileList[transfer.file]);
+        auto permissions = static_cast<Antik::SSH::CSFTP::FilePermissions>(std::filesystem::status(fileList[transfer.file]).permissions());
+        transfer.remoteHandle = sftpChannels[channel]->openFile(transfer.remoteFile, O_CREAT | O_WRONLY | O_TRUNC, permissions);
+        transfer.bEndOfFile = false;
+        transfer.bCopying = true;
+        transfer.start = std::chrono::steady_clock::now();
+        TransferStats::instance().addRoundTrips();
+    };
+
+    for (std::size_t channel = 0; channel < channelTransfers.size(); channel++) {
+        startFile(channel);
+    }
+
+    do {
+
+        bTransferring = false;
+
+        for (std::size_t channel = 0; channel < channelTransfers.size(); channel++) {
+
+            SFTPChannelTransfer &transfer { channelTransfers[channel] };
+
+            if (!transfer.bCopying) {
+                continue;
+            }
+
+            bTransferring = true;
+
+            while (!transfer.bEndOfFile && (transfer.requests.pending.size() < options.inflight)) {
+                transfer.localFile.read(writeBuffer.data(), writeBuffer.size());
+                if (transfer.localFile.gcount() == 0) {
+                    transfer.bEndOfFile = true;
+                    break;
+                }
+                sftp_aio aio;
+                if (sftp_aio_begin_write(transfer.remoteHandle.get(), writeBuffer.data(), transfer.localFile.gcount(), &aio) < 0) {
+                    throw std::runtime_error("SFTP write request for [" + transfer.remoteFile + "] failed.");
+                }
+                transfer.requests.pending.push_back(aio);
+                transfer.requestLengths.push_back(transfer.localFile.gcount());
+            }
+
+            if (!transfer.requests.pending.empty()) {
+                auto written = sftp_aio_wait_write(&transfer.requests.pending.front());
+                transfer.requests.pending.pop_front();
+                if (written < 0) {
+                    throw std::runtime_error("SFTP write to [" + transfer.remoteFile + "] failed.");
+                }
+                if (static_cast<std::size_t>(written) != transfer.requestLengths.front()) {
+                    throw std::runtime_error("SFTP write to [" + transfer.remoteFile + "] was short (" +
+                                             std::to_string(written) + " of " + std::to_string(transfer.requestLengths.front()) + " bytes).");
+                }
+                transfer.requestLengths.pop_front();
+                TransferStats::instance().addRoundTrips();
+                TransferStats::instance().addBytes(written);
+            }
+
+            if (transfer.bEndOfFile && transfer.requests.pending.empty()) {
+                sftpChannels[channel]->closeFile(transfer.remoteHandle);
+                transfer.localFile.close();
+                transfer.bCopying = false;
+                TransferStats::instance().addRoundTrips();
+                TransferStats::instance().record(TransferStats::Phase::transfer, std::chrono::steady_clock::now() - transfer.start);
+                transferred[transfer.file] = transfer.remoteFile;
+                startFile(channel);
+            }
+
+        }
+
+    } while (bTransferring);
+
+#else
+
+    for (std::size_t file = 0; file < fileList.size(); file++) {
+        std::string remoteFile { fileMapper.toRemote(fileList[file]) };
+        TransferStats::OperationTimer transferTimer { TransferStats::Phase::transfer };
+        putFilePipelined(*sftpChannels[file % sftpChannels.size()], fileList[file], remoteFile, options);
+        transferred[file] = remoteFile;
+    }
+
+#endif
+
+    for (auto &remoteFile : transferred) {
+        if (!remoteFile.empty()) {
+            successList.push_back(remoteFile);
+        }
+    }
+
+    return (successList);
+
+}
+
+//
+// Connect, verify and authorize a SSH session of its own then open an SFTP channel on
+// it (for a lister, or a session replacing one the server has dropped).
+//
+
+inline void openSFTPSession(SFTPSession &sftpSession, const std::string &serverName, const std::string &serverPort,
+                            const std::string &userName, const std::string &userPassword) {
+
+    sftpSession.sshSession.setServer(serverName);
+    sftpSession.sshSession.setPort(std::stoi(serverPort));
+    sftpSession.sshSession.setUser(userName);
+    sftpSession.sshSession.setUserPassword(userPassword);
+
+    sftpSession.sshSession.connect();
+
+    if (!Antik::SSH::verifyKnownServer(sftpSession.sshSession, sftpSession.verificationContext)) {
+        throw std::runtime_error("Unable to verify server.");
+    }
+
+    if (!Antik::SSH::userAuthorize(sftpSession.sshSession)) {
+        throw std::runtime_error("Server unable to authorize client");
+    }
+
+    sftpSession.sftpServer.reset(new Antik::SSH::CSFTP { sftpSession.sshSession });
+    sftpSession.sftpServer->open();
+
+}
+
+//
+// Close the SFTP channel and disconnect a session from openSFTPSession().
+//
+
+inline void closeSFTPSession(SFTPSession &sftpSession) {
+    if (sftpSession.sftpServer) {
+        sftpSession.sftpServer->close();
+    }
+    sftpSession.sshSession.disconnect();
+}
+
+#endif /* SFTPTRANSFERUTIL_HPP */
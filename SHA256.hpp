@@ -0,0 +1,169 @@
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+//
+// Header: SHA256
+//
+// Description: SHA-256 (FIPS 180-4) used by the transfer example programs to check
+// file contents against a hash computed by sha256sum on the server. Data may be
+// hashed incrementally (update() then final()) or a whole file at once.
+//
+// Dependencies: C11++.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class SHA256 {
+public:
+
+    //
+    // Add data to the hash.
+    //
+
+    void update(const char *data, std::size_t length) {
+        m_totalBytes += length;
+        while (length) {
+            std::size_t bytesToCopy { std::min(length, sizeof (m_block) - m_blockBytes) };
+            std::memcpy(m_block + m_blockBytes, data, bytesToCopy);
+            m_blockBytes += bytesToCopy;
+            data += bytesToCopy;
+            length -= bytesToCopy;
+            if (m_blockBytes == sizeof (m_block)) {
+                processBlock(m_block);
+                m_blockBytes = 0;
+            }
+        }
+    }
+
+    //
+    // Pad and return the hash as hex; the object is reset ready for new data.
+    //
+
+    std::string final() {
+
+        std::uint64_t totalBits { m_totalBytes * 8 };
+
+        // Padding: 0x80, zeros then message length in bits (big endian)
+
+        m_block[m_blockBytes++] = 0x80;
+        if (m_blockBytes > 56) {
+            std::memset(m_block + m_blockBytes, 0, sizeof (m_block) - m_blockBytes);
+            processBlock(m_block);
+            m_blockBytes = 0;
+        }
+        std::memset(m_block + m_blockBytes, 0, 56 - m_blockBytes);
+        for (int byte = 0; byte < 8; byte++) {
+            m_block[63 - byte] = static_cast<unsigned char> (totalBits >> (byte * 8));
+        }
+        processBlock(m_block);
+
+        std::ostringstream hashStream;
+        for (auto word : m_state) {
+            hashStream << std::hex << std::setw(8) << std::setfill('0') << word;
+        }
+
+        *this = SHA256();
+
+        return (hashStream.str());
+
+    }
+
+private:
+
+    static std::uint32_t rotateRight(std::uint32_t value, int bits) {
+        return ((value >> bits) | (value << (32 - bits)));
+    }
+
+    void processBlock(const unsigned char *block) {
+
+        static const std::uint32_t kRoundConstants[64] {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        std::uint32_t schedule[64];
+        for (int word = 0; word < 16; word++) {
+            schedule[word] = (static_cast<std::uint32_t> (block[word * 4]) << 24) | (block[word * 4 + 1] << 16) |
+                    (block[word * 4 + 2] << 8) | block[word * 4 + 3];
+        }
+        for (int word = 16; word < 64; word++) {
+            std::uint32_t s0 = rotateRight(schedule[word - 15], 7) ^ rotateRight(schedule[word - 15], 18) ^ (schedule[word - 15] >> 3);
+            std::uint32_t s1 = rotateRight(schedule[word - 2], 17) ^ rotateRight(schedule[word - 2], 19) ^ (schedule[word - 2] >> 10);
+            schedule[word] = schedule[word - 16] + s0 + schedule[word - 7] + s1;
+        }
+
+        std::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+        std::uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+        for (int round = 0; round < 64; round++) {
+            std::uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+            std::uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + kRoundConstants[round] + schedule[round];
+            std::uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+            std::uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+        m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+
+    }
+
+    std::uint32_t m_state[8] { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                               0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 }; // Hash state
+    unsigned char m_block[64] {};   // Partial block
+    std::size_t m_blockBytes { 0 }; // Bytes in partial block
+    std::uint64_t m_totalBytes { 0 }; // Bytes hashed
+
+};
+
+//
+// SHA-256 of a file's contents returned as hex.
+//
+
+inline std::string sha256FileContents(const std::string &filePath) {
+
+    std::ifstream fileStream(filePath, std::ios::binary);
+    if (!fileStream.is_open()) {
+        throw std::runtime_error("Could not open [" + filePath + "] to hash.");
+    }
+
+    SHA256 fileHash;
+    std::vector<char> readBuffer(64 * 1024);
+    while (fileStream.read(readBuffer.data(), readBuffer.size()), fileStream.gcount() > 0) {
+        fileHash.update(readBuffer.data(), fileStream.gcount());
+    }
+
+    return (fileHash.final());
+
+}
+
+#endif /* SHA256_HPP */
@@ -18,8 +18,20 @@
 //   -s [ --subject ] arg     Email subject
 //   -c [ --contents ] arg    File containing email contents
 //   -a [ --attachments ] arg File Attachments List
+//   -m [ --manifest ] arg    Bulk send messages listed in manifest file
+//   -t [ --report ] arg      Bulk send report file (default stdout)
+//   -n [ --connections ] arg (=1) Number of SMTP connections used for bulk send
 //
-// Dependencies: C11++, Classes (CMailSMTP, CFileMIME, CFile, CPath),
+// In bulk mode each line of the manifest is a message with tab separated fields:
+// recipients, subject, contents file and optionally an attachments list. All of the
+// messages are sent over one (or --connections) persistent authenticated SMTP
+// sessions, pipelining commands where the server supports it, and a line giving the
+// manifest line number, SENT/PARTIAL/FAILED, recipients and server reply is written
+// to the report for each. PARTIAL means the message was sent but some recipients
+// were refused; these are listed after the reply. The program exits with a failure
+// status if any message was not sent to all of its recipients.
+//
+// Dependencies: C11++, Classes (CMailSMTP, CFileMIME, CFile, CPath, SMTPSession),
 //               Linux, Boost C++ Libraries.
 //
 
@@ -33,6 +45,12 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 //
 // Antik Classes
@@ -42,6 +60,7 @@
 #include "CMIME.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
+#include "SMTPSession.hpp"
 
 using namespace Antik::SMTP;
 using namespace Antik::File;
@@ -71,6 +90,21 @@ struct ParamArgData {
     std::string subject;           // Email subject
     std::string mailContentsFile;  // File containing email contents
     std::string attachmentList;    // List of attachments
+    std::string manifestFileName;  // Bulk send manifest file
+    std::string reportFileName;    // Bulk send report file
+    int connections { 1 };         // Number of SMTP connections used for bulk send
+};
+
+//
+// Bulk send manifest entry
+//
+
+struct ManifestEntry {
+    std::size_t lineNo;            // Manifest file line number
+    std::string recipients;        // List of recipeints
+    std::string subject;           // Email subject
+    std::string mailContentsFile;  // File containing email contents
+    std::string attachmentList;    // List of attachments
 };
 
 // ===============
@@ -101,10 +135,13 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("server,s", po::value<std::string>(&argData.serverURL)->required(), "SMTP Server URL and port")
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
-            ("recipients,r", po::value<std::string>(&argData.recipients)->required(), "Recipients list")
-            ("subject,b", po::value<std::string>(&argData.subject)->required(), "Email subject")
-            ("contents,o", po::value<std::string>(&argData.mailContentsFile)->required(), "File containing email contents")
-            ("attachments,a", po::value<std::string>(&argData.attachmentList)->required(), "File Attachments List");
+            ("recipients,r", po::value<std::string>(&argData.recipients), "Recipients list")
+            ("subject,b", po::value<std::string>(&argData.subject), "Email subject")
+            ("contents,o", po::value<std::string>(&argData.mailContentsFile), "File containing email contents")
+            ("attachments,a", po::value<std::string>(&argData.attachmentList), "File Attachments List")
+            ("manifest,m", po::value<std::string>(&argData.manifestFileName), "Bulk send messages listed in manifest file")
+            ("report,t", po::value<std::string>(&argData.reportFileName), "Bulk send report file (default stdout)")
+            ("connections,n", po::value<int>(&argData.connections)->default_value(1), "Number of SMTP connections used for bulk send");
 
 }
 
@@ -157,6 +194,20 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
         po::notify(vm);
 
+        // Single message needs all its details
+
+        if (argData.manifestFileName.empty()) {
+            for (auto option : { "recipients", "subject", "contents", "attachments"}) {
+                if (!vm.count(option)) {
+                    throw po::error(std::string("the option '--") + option + "' is required but missing");
+                }
+            }
+        }
+
+        if (argData.connections < 1) {
+            throw po::error("Number of connections must be at least one.");
+        }
+
     } catch (po::error& e) {
         std::cerr << "SMTPSendMail Error: " << e.what() << std::endl << std::endl;
         std::cerr << commandLine << std::endl;
@@ -165,6 +216,200 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 
 }
 
+//
+// Split a comma separated list removing leading/trailing spaces from each item.
+//
+
+static std::vector<std::string> splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::istringstream listStream(list);
+    for (std::string item; std::getline(listStream, item, ',');) {
+        item.erase(0, item.find_first_not_of(' '));
+        item.erase(item.find_last_not_of(' ') + 1);
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return (items);
+}
+
+//
+// Read mail contents file into message lines.
+//
+
+static void readMailContents(const std::string &mailContentsFile, std::vector<std::string> &mailMessage) {
+    if (CFile::exists(mailContentsFile)) {
+        std::ifstream mailContentsStream(mailContentsFile);
+        if (mailContentsStream.is_open()) {
+            for (std::string line; std::getline(mailContentsStream, line, '\n');) {
+                mailMessage.push_back(line);
+            }
+        }
+    }
+}
+
+//
+// Add any attachments. Note all base64 encoded.
+//
+
+static void addAttachments(CSMTP &mail, const std::string &attachmentList, std::ostream &progress) {
+    for (auto &attachment : splitList(attachmentList)) {
+        if (CFile::exists(attachment)) {
+            progress << "Attaching file [" << attachment << "]" << std::endl;
+            mail.addFileAttachment(attachment, Antik::File::CMIME::getFileMIMEType(attachment), "base64");
+        } else {
+            progress << "File does not exist [" << attachment << "]" << std::endl;
+        }
+    }
+}
+
+//
+// Read bulk mail manifest. Each line (blank lines and those starting with '#' are
+// ignored) is a message with tab separated fields: recipients, subject, contents
+// file and (optionally) attachments list.
+//
+
+static std::vector<ManifestEntry> readManifest(const std::string &manifestFileName) {
+
+    std::vector<ManifestEntry> manifest;
+    std::ifstream manifestStream(manifestFileName);
+    std::size_t lineNo { 0 };
+
+    if (!manifestStream.is_open()) {
+        throw std::runtime_error("Could not open manifest file [" + manifestFileName + "]");
+    }
+
+    for (std::string line; std::getline(manifestStream, line);) {
+        lineNo++;
+        if (!line.empty() && (line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty() || (line.front() == '#')) {
+            continue;
+        }
+        std::vector<std::string> fields;
+        std::istringstream lineStream(line);
+        for (std::string field; std::getline(lineStream, field, '\t');) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 3) {
+            throw std::runtime_error("Manifest line " + std::to_string(lineNo) + " has too few fields.");
+        }
+        manifest.push_back({ lineNo, fields[0], fields[1], fields[2], (fields.size() > 3) ? fields[3] : ""});
+    }
+
+    return (manifest);
+
+}
+
+//
+// Envelope address from a recipient ("Name <address>" or "address").
+//
+
+static std::string envelopeAddress(const std::string &recipient) {
+    std::size_t addressStart = recipient.find('<');
+    if (addressStart != std::string::npos) {
+        return (recipient.substr(addressStart + 1, recipient.find('>', addressStart) - addressStart - 1));
+    }
+    return (recipient);
+}
+
+//
+// Send all the messages in a manifest over persistent SMTP sessions (one per
+// connection, each taking the next message until there are none left); messages
+// are composed with CSMTP and the result for each written to the report. Returns
+// the number of messages not sent to all of their recipients.
+//
+
+static std::size_t sendBulkMail(const ParamArgData &argData, const std::vector<ManifestEntry> &manifest, std::ostream &report) {
+
+    std::atomic<std::size_t> nextMessage { 0 };
+    std::atomic<std::size_t> messagesFailed { 0 };
+    std::mutex reportMutex;
+
+    auto reportResult = [&](const ManifestEntry &entry, bool bSent, const std::string &result,
+            const std::vector<std::string> &rejectedRecipients = {}) {
+        std::string status { bSent ? (rejectedRecipients.empty() ? "SENT" : "PARTIAL") : "FAILED" };
+        std::string details { result };
+        for (auto &rejected : rejectedRecipients) {
+            details += "; rejected " + rejected;
+        }
+        if (status != "SENT") {
+            messagesFailed++;
+        }
+        std::unique_lock<std::mutex> lock(reportMutex);
+        report << entry.lineNo << '\t' << status << '\t' << entry.recipients << '\t' << details << '\n';
+        report.flush();
+        std::cout << (bSent ? (rejectedRecipients.empty() ? "Sent" : "Partially sent") : "Failed") << " message ["
+                << entry.lineNo << "] to [" << entry.recipients << "] " << details << std::endl;
+    };
+
+    auto sendWorker = [&]() {
+
+        SMTPSession session;
+
+        session.setServer(argData.serverURL);
+        session.setUserAndPassword(argData.userName, argData.userPassword);
+
+        for (std::size_t message = nextMessage++; message < manifest.size(); message = nextMessage++) {
+
+            const ManifestEntry &entry { manifest[message] };
+            std::string mailText;
+            std::vector<std::string> recipients;
+
+            // Compose message
+
+            try {
+                CSMTP mail;
+                std::vector<std::string> mailMessage;
+                std::ostringstream progress;
+                mail.setFromAddress("<" + argData.userName + ">");
+                mail.setToAddress(entry.recipients);
+                mail.setMailSubject(entry.subject);
+                readMailContents(entry.mailContentsFile, mailMessage);
+                mail.setMailMessage(mailMessage);
+                addAttachments(mail, entry.attachmentList, progress);
+                mailText = mail.getMailFull();
+                for (auto &recipient : splitList(entry.recipients)) {
+                    recipients.push_back(envelopeAddress(recipient));
+                }
+            } catch (const std::exception &e) {
+                reportResult(entry, false, e.what());
+                continue;
+            }
+
+            // Send it (reconnecting if the session has been lost)
+
+            try {
+                if (!session.getConnectedStatus()) {
+                    session.disconnect();
+                    session.connect();
+                }
+                SMTPSession::Reply reply { session.sendMessage(argData.userName, recipients, mailText) };
+                reportResult(entry, reply.code == 250, reply.text, reply.rejectedRecipients);
+            } catch (const std::exception &e) {
+                session.disconnect();
+                reportResult(entry, false, e.what());
+            }
+
+        }
+
+        session.disconnect();
+
+    };
+
+    std::vector<std::thread> workers;
+    for (int connection = 0; connection < std::min<int>(argData.connections, manifest.size()); connection++) {
+        workers.emplace_back(sendWorker);
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    return (messagesFailed);
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -185,6 +430,29 @@ int main(int argc, char** argv) {
         
         CSMTP::init(true);
 
+        // Bulk send
+
+        if (!argData.manifestFileName.empty()) {
+            std::vector<ManifestEntry> manifest { readManifest(argData.manifestFileName) };
+            std::cout << "Sending [" << manifest.size() << "] messages from [" << argData.manifestFileName << "]" << std::endl;
+            std::size_t messagesFailed { 0 };
+            if (!argData.reportFileName.empty()) {
+                std::ofstream reportStream(argData.reportFileName);
+                if (!reportStream.is_open()) {
+                    throw std::runtime_error("Could not create report file [" + argData.reportFileName + "]");
+                }
+                messagesFailed = sendBulkMail(argData, manifest, reportStream);
+            } else {
+                messagesFailed = sendBulkMail(argData, manifest, std::cout);
+            }
+            CSMTP::closedown();
+            if (messagesFailed) {
+                std::cerr << "[" << messagesFailed << "] messages were not sent to all recipients" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            exit(EXIT_SUCCESS);
+        }
+
         // Set server and account details
         
         mail.setServer(argData.serverURL);
@@ -202,33 +470,15 @@ int main(int argc, char** argv) {
         // Set mail contents
         
         if (!argData.configFileName.empty()) {
-            if (CFile::exists(argData.mailContentsFile)) {
-                std::ifstream mailContentsStream(argData.mailContentsFile);
-                if (mailContentsStream.is_open()) {
-                    for (std::string line; std::getline(mailContentsStream, line, '\n');) {
-                        mailMessage.push_back(line);
-                    }
-                    mail.setMailMessage(mailMessage);
-                }
+            readMailContents(argData.mailContentsFile, mailMessage);
+            if (!mailMessage.empty()) {
+                mail.setMailMessage(mailMessage);
             }
         }
 
         // Add any attachments. Note all base64 encoded.
         
-        if (!argData.attachmentList.empty()) {
-            std::istringstream attachListStream(argData.attachmentList);
-            for (std::string attachment; std::getline(attachListStream, attachment, ',');) {
-                attachment = attachment.substr(attachment.find_first_not_of(' '));
-                attachment = attachment.substr(0, attachment.find_last_not_of(' ') + 1);
-                if (CFile::exists(attachment)){
-                    std::cout << "Attaching file [" << attachment << "]" << std::endl;
-                    mail.addFileAttachment(attachment, Antik::File::CMIME::getFileMIMEType(attachment), "base64");
-                } else {
-                    std::cout << "File does not exist [" << attachment << "]" << std::endl;
-                }
-
-            }
-        }
+        addAttachments(mail, argData.attachmentList, std::cout);
       
         // Send mail
         
@@ -0,0 +1,389 @@
+#ifndef SMTPSESSION_HPP
+#define SMTPSESSION_HPP
+
+//
+// Header: SMTPSession
+//
+// Description: Persistent SMTP session for the mail example programs that sends any
+// number of messages over one authenticated connection. libcurl is used in connect
+// only mode, so it performs the greeting, EHLO, STARTTLS and AUTH (smtp:// and
+// smtps:// URLs are supported; TLS is required so credentials never go over a
+// plaintext connection), after which each message is sent with MAIL FROM,
+// RCPT TO and DATA. If the server advertises PIPELINING (RFC 2920) the envelope
+// commands and DATA for a message are sent in one write and their replies read
+// together.
+//
+// Dependencies: C11++, libcurl, Linux.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <poll.h>
+#include <unistd.h>
+
+//
+// libcurl
+//
+
+#include <curl/curl.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class SMTPSession {
+public:
+
+    //
+    // Class exception
+    //
+
+    struct Exception : public std::runtime_error {
+        explicit Exception(std::string const& message)
+        : std::runtime_error("SMTPSession Failure: " + message) {
+        }
+    };
+
+    //
+    // Server reply (code and text of last line) and any recipients refused by the
+    // server ("address: reply" for each).
+    //
+
+    struct Reply {
+        int code { 0 };
+        std::string text;
+        std::vector<std::string> rejectedRecipients;
+    };
+
+    //
+    // Socket wait timeout (milliseconds) and receive chunk size
+    //
+
+    static constexpr int kWaitTimeOut { 60 * 1000 };
+    static constexpr std::size_t kReadChunkSize { 16 * 1024 };
+
+    SMTPSession() {
+    }
+
+    ~SMTPSession() {
+        if (m_curlHandle) {
+            curl_easy_cleanup(m_curlHandle);
+        }
+    }
+
+    SMTPSession(const SMTPSession &orig) = delete;
+    SMTPSession& operator=(const SMTPSession &orig) = delete;
+
+    void setServer(const std::string &serverURL) {
+        m_serverURL = serverURL;
+    }
+
+    void setUserAndPassword(const std::string &userName, const std::string &userPassword) {
+        m_userName = userName;
+        m_userPassword = userPassword;
+    }
+
+    //
+    // Connect and authenticate then re-issue EHLO to find out whether the server
+    // supports PIPELINING.
+    //
+
+    void connect() {
+
+        m_curlHandle = curl_easy_init();
+        if (!m_curlHandle) {
+            throw Exception("Could not allocate curl handle.");
+        }
+
+        curl_easy_setopt(m_curlHandle, CURLOPT_URL, m_serverURL.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_USERNAME, m_userName.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_PASSWORD, m_userPassword.c_str());
+        curl_easy_setopt(m_curlHandle, CURLOPT_USE_SSL, static_cast<long> (CURLUSESSL_ALL));
+        curl_easy_setopt(m_curlHandle, CURLOPT_CONNECT_ONLY, 1L);
+
+        CURLcode result = curl_easy_perform(m_curlHandle);
+        if (result != CURLE_OK) {
+            throw Exception(std::string("Could not connect to server. ") + curl_easy_strerror(result));
+        }
+
+        result = curl_easy_getinfo(m_curlHandle, CURLINFO_ACTIVESOCKET, &m_socket);
+        if ((result != CURLE_OK) || (m_socket == CURL_SOCKET_BAD)) {
+            throw Exception("Could not get connection socket.");
+        }
+
+        char hostName[256] { "localhost" };
+        gethostname(hostName, sizeof (hostName) - 1);
+
+        std::string capabilities;
+        sendAll("EHLO " + std::string(hostName) + "\r\n");
+        Reply reply { readReply(&capabilities) };
+        if (reply.code != 250) {
+            throw Exception("EHLO failed [" + reply.text + "]");
+        }
+
+        m_bPipelining = (capabilities.find("\nPIPELINING\n") != std::string::npos);
+        m_bConnected = true;
+
+    }
+
+    //
+    // QUIT and close connection.
+    //
+
+    void disconnect() {
+        if (m_bConnected) {
+            m_bConnected = false;
+            try {
+                sendAll("QUIT\r\n");
+                readReply();
+            } catch (...) {
+                // Connection is being closed anyway
+            }
+        }
+        if (m_curlHandle) {
+            curl_easy_cleanup(m_curlHandle);
+            m_curlHandle = nullptr;
+        }
+    }
+
+    bool getConnectedStatus() const {
+        return (m_bConnected);
+    }
+
+    bool bPipelining() const {
+        return (m_bPipelining);
+    }
+
+    //
+    // Send a message (complete with headers) to a list of recipient addresses. A
+    // rejected message is reported in the returned reply (code other than 250) and
+    // the session reset for the next; connection errors throw an exception. Any
+    // recipients refused are listed in the reply (even if the message was sent to
+    // the others).
+    //
+
+    Reply sendMessage(const std::string &fromAddress, const std::vector<std::string> &recipients, const std::string &message) {
+
+        std::string mailFrom { "MAIL FROM:<" + fromAddress + ">\r\n" };
+        std::size_t recipientsAccepted { 0 };
+        std::vector<std::string> rejectedRecipients;
+        Reply failedReply;
+
+        if (m_bPipelining) {
+            std::string pipelined { mailFrom };
+            for (auto &recipient : recipients) {
+                pipelined += "RCPT TO:<" + recipient + ">\r\n";
+            }
+            sendAll(pipelined + "DATA\r\n");
+        } else {
+            sendAll(mailFrom);
+        }
+
+        // Envelope replies (all are read when pipelined)
+
+        Reply reply { readReply() };
+        bool bSenderAccepted { reply.code == 250 };
+        if (!bSenderAccepted) {
+            failedReply = reply;
+        }
+
+        for (auto &recipient : recipients) {
+            if (!m_bPipelining) {
+                if (!bSenderAccepted) {
+                    break;
+                }
+                sendAll("RCPT TO:<" + recipient + ">\r\n");
+            }
+            reply = readReply();
+            if ((reply.code == 250) || (reply.code == 251)) {
+                recipientsAccepted++;
+            } else {
+                rejectedRecipients.push_back(recipient + ": " + reply.text);
+                if (!failedReply.code) {
+                    failedReply = reply;
+                }
+            }
+        }
+
+        if (!bSenderAccepted) {
+            rejectedRecipients.clear(); // Recipients were never tried
+        }
+
+        bool bEnvelopeOK { bSenderAccepted && (recipientsAccepted != 0) };
+        if (!bEnvelopeOK && !failedReply.code) {
+            failedReply = { 554, "554 No recipients accepted", {} };
+        }
+
+        // DATA (already sent if pipelining) and message contents; a pipelining
+        // server may accept DATA after a failed envelope so an empty message is
+        // sent to end it.
+
+        if (!m_bPipelining && bEnvelopeOK) {
+            sendAll("DATA\r\n");
+        }
+
+        if (m_bPipelining || bEnvelopeOK) {
+            reply = readReply();
+            if (reply.code == 354) {
+                sendAll(bEnvelopeOK ? dotStuffed(message) + ".\r\n" : ".\r\n");
+                reply = readReply();
+                if (bEnvelopeOK) {
+                    reply.rejectedRecipients = std::move(rejectedRecipients);
+                    return (reply);
+                }
+            } else if (bEnvelopeOK || !failedReply.code) {
+                failedReply = reply;
+            }
+        }
+
+        sendAll("RSET\r\n");
+        readReply();
+
+        failedReply.rejectedRecipients = std::move(rejectedRecipients);
+        return (failedReply);
+
+    }
+
+private:
+
+    //
+    // Normalise line endings to CRLF, dot-stuff lines and terminate the last line.
+    //
+
+    static std::string dotStuffed(const std::string &message) {
+        std::string stuffed;
+        stuffed.reserve(message.size() + message.size() / 64 + 2);
+        bool bLineStart { true };
+        for (std::size_t position = 0; position < message.size(); position++) {
+            char ch { message[position] };
+            if (bLineStart && (ch == '.')) {
+                stuffed.push_back('.');
+            }
+            if ((ch == '\n') && (stuffed.empty() || (stuffed.back() != '\r'))) {
+                stuffed.push_back('\r');
+            }
+            stuffed.push_back(ch);
+            bLineStart = (ch == '\n');
+        }
+        if (!bLineStart) {
+            stuffed += "\r\n";
+        }
+        return (stuffed);
+    }
+
+    //
+    // Wait for the socket to be readable/writeable.
+    //
+
+    void waitOnSocket(bool bRecv) {
+        struct pollfd pollSocket { m_socket, static_cast<short> (bRecv ? POLLIN : POLLOUT), 0 };
+        int result = poll(&pollSocket, 1, kWaitTimeOut);
+        if (result == 0) {
+            throw Exception("Timeout waiting on server.");
+        } else if (result < 0) {
+            throw Exception(std::string("Error waiting on socket. ") + std::strerror(errno));
+        }
+    }
+
+    void sendAll(const std::string &data) {
+        std::size_t bytesSent { 0 };
+        while (bytesSent < data.size()) {
+            std::size_t sent { 0 };
+            CURLcode result = curl_easy_send(m_curlHandle, data.data() + bytesSent, data.size() - bytesSent, &sent);
+            if (result == CURLE_AGAIN) {
+                waitOnSocket(false);
+                continue;
+            } else if (result != CURLE_OK) {
+                m_bConnected = false;
+                throw Exception(std::string("Error sending command. ") + curl_easy_strerror(result));
+            }
+            bytesSent += sent;
+        }
+    }
+
+    //
+    // Read a reply line (without its CRLF).
+    //
+
+    std::string readLine() {
+        std::size_t lineEnd;
+        while ((lineEnd = m_readBuffer.find("\r\n", m_readPosition)) == std::string::npos) {
+            char chunk[kReadChunkSize];
+            std::size_t received { 0 };
+            CURLcode result = curl_easy_recv(m_curlHandle, chunk, sizeof (chunk), &received);
+            if (result == CURLE_AGAIN) {
+                waitOnSocket(true);
+                continue;
+            } else if ((result != CURLE_OK) || (received == 0)) {
+                m_bConnected = false;
+                throw Exception("Connection closed by server.");
+            }
+            m_readBuffer.erase(0, m_readPosition);
+            m_readPosition = 0;
+            m_readBuffer.append(chunk, received);
+        }
+        std::string line { m_readBuffer.substr(m_readPosition, lineEnd - m_readPosition) };
+        m_readPosition = lineEnd + 2;
+        return (line);
+    }
+
+    //
+    // Read a (possibly multi-line) reply; the text of each line after the code is
+    // optionally returned one per line.
+    //
+
+    Reply readReply(std::string *replyLines = nullptr) {
+        Reply reply;
+        if (replyLines) {
+            *replyLines = "\n";
+        }
+        for (;;) {
+            std::string line { readLine() };
+            if (line.size() < 3) {
+                throw Exception("Invalid reply [" + line + "]");
+            }
+            if (replyLines) {
+                *replyLines += (line.size() > 4 ? line.substr(4) : "") + "\n";
+            }
+            if ((line.size() == 3) || (line[3] != '-')) {
+                reply.code = std::atoi(line.substr(0, 3).c_str());
+                reply.text = line;
+                return (reply);
+            }
+        }
+    }
+
+    std::string m_serverURL;               // SMTP server URL
+    std::string m_userName;                // Account user name
+    std::string m_userPassword;            // Account password
+    CURL *m_curlHandle { nullptr };        // curl connect only handle
+    curl_socket_t m_socket { CURL_SOCKET_BAD }; // Connection socket
+    bool m_bConnected { false };           // == true connected and authenticated
+    bool m_bPipelining { false };          // == true server supports PIPELINING
+    std::string m_readBuffer;              // Received data not yet consumed
+    std::size_t m_readPosition { 0 };      // Position of unconsumed data in buffer
+
+};
+
+#endif /* SMTPSESSION_HPP */
@@ -0,0 +1,476 @@
+#ifndef TRANSFERSTATS_HPP
+#define TRANSFERSTATS_HPP
+
+//
+// Header: TransferStats
+//
+// Description: Transfer instrumentation for the FTP/SFTP/SCP example programs. For
+// each phase of a run (listing, transfer and metadata) the wall time spent and the
+// latency of each operation in it (a directory listed, a file transferred, a size or
+// modified time fetched) are recorded along with counts of files, bytes, server round
+// trips and errors. Bytes are those actually sent or received, so a delta copy or a
+// resumed download counts only what went over the wire; round trips are the requests
+// made by the transfer/listing helpers (where a library call makes the transfer its
+// requests can't be seen and are not counted).
+// One instance is kept per program run so that pool threads and the transfer helpers
+// record into it without it being passed through every call; recording is a no-op
+// until it is enabled (--stats FILE). Each phase keeps an exact operation count, sum,
+// maximum and histogram but only a fixed size random sample (reservoir) of latencies
+// from which the percentiles are estimated, so a long run's memory stays bounded. At
+// exit a summary is written as JSON or, if the file name ends in ".prom", as a
+// Prometheus textfile collector file.
+//
+// Where a transfer is made by a library call that only reports each file as it
+// completes (fileCompletionFn()) a file's transfer latency is the time since the
+// previous file completed, so it includes any gap between files (directories made,
+// files skipped or failed); the summary notes this against the transfer phase.
+//
+// Dependencies: C11++.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <array>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <stdexcept>
+#include <random>
+#include <cstdio>
+#include <cstdint>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+class TransferStats {
+public:
+
+    //
+    // Run phases
+    //
+
+    enum class Phase {
+        listing,
+        transfer,
+        metadata
+    };
+
+    static constexpr std::size_t kPhaseCount { 3 };
+    static constexpr const char *kPhaseNames[kPhaseCount] { "listing", "transfer", "metadata" };
+
+    //
+    // What an operation latency measures in each phase (written with the summary)
+    //
+
+    static constexpr const char *kPhaseLatencyMeasures[kPhaseCount] {
+        "directory listing time",
+        "per file transfer time or, where only completions are reported, time since the previous file completed (includes gaps between files)",
+        "size/modified time fetch, compare or removal time"
+    };
+
+    //
+    // Latency histogram bucket upper bounds (seconds)
+    //
+
+    static constexpr std::array<double, 12> kBucketBounds {
+        0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 5.0, 30.0
+    };
+
+    //
+    // Latencies sampled per phase for percentiles
+    //
+
+    static constexpr std::size_t kReservoirSize { 4096 };
+
+    //
+    // Time an operation (its latency is recorded) or a whole phase (added to its
+    // wall time) for the lifetime of the object; a phase timer may be stopped early.
+    //
+
+    class OperationTimer {
+    public:
+        explicit OperationTimer(Phase phase) : m_phase{ phase}, m_start{ std::chrono::steady_clock::now()} {
+        }
+        ~OperationTimer() {
+            TransferStats::instance().record(m_phase, std::chrono::steady_clock::now() - m_start);
+        }
+        OperationTimer(const OperationTimer &orig) = delete;
+        OperationTimer& operator=(const OperationTimer &orig) = delete;
+    private:
+        Phase m_phase;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    class PhaseTimer {
+    public:
+        explicit PhaseTimer(Phase phase) : m_phase{ phase}, m_start{ std::chrono::steady_clock::now()} {
+        }
+        ~PhaseTimer() {
+            stop();
+        }
+        void stop() {
+            if (!m_bStopped) {
+                TransferStats::instance().addPhaseTime(m_phase, std::chrono::steady_clock::now() - m_start);
+                m_bStopped = true;
+            }
+        }
+        PhaseTimer(const PhaseTimer &orig) = delete;
+        PhaseTimer& operator=(const PhaseTimer &orig) = delete;
+    private:
+        Phase m_phase;
+        std::chrono::steady_clock::time_point m_start;
+        bool m_bStopped { false };
+    };
+
+    //
+    // Program run instance.
+    //
+
+    static TransferStats& instance() {
+        static TransferStats transferStats;
+        return (transferStats);
+    }
+
+    //
+    // Start recording (before any transfer threads are started).
+    //
+
+    void enable(const std::string &programName, const std::string &statsFileName) {
+        m_programName = programName;
+        m_statsFileName = statsFileName;
+        m_runStart = std::chrono::steady_clock::now();
+        m_bEnabled = true;
+    }
+
+    bool enabled() const {
+        return (m_bEnabled);
+    }
+
+    //
+    // Record the latency of an operation in a phase.
+    //
+
+    void record(Phase phase, std::chrono::steady_clock::duration latency) {
+        if (m_bEnabled) {
+            double seconds { std::chrono::duration<double>(latency).count() };
+            std::lock_guard<std::mutex> locker(m_statsMutex);
+            PhaseStats &phaseStats { m_phases[static_cast<std::size_t> (phase)] };
+            phaseStats.operations++;
+            phaseStats.latencySum += seconds;
+            phaseStats.latencyMax = std::max(phaseStats.latencyMax, seconds);
+            for (std::size_t bucket = 0; bucket < kBucketBounds.size(); bucket++) {
+                if (seconds <= kBucketBounds[bucket]) {
+                    phaseStats.bucketCounts[bucket]++;
+                }
+            }
+            if (phaseStats.reservoir.size() < kReservoirSize) {
+                phaseStats.reservoir.push_back(seconds);
+            } else {
+                std::uniform_int_distribution<std::uint64_t> slot(0, phaseStats.operations - 1);
+                auto replaced = slot(m_random);
+                if (replaced < kReservoirSize) {
+                    phaseStats.reservoir[replaced] = seconds;
+                }
+            }
+        }
+    }
+
+    //
+    // Add to the wall time of a phase.
+    //
+
+    void addPhaseTime(Phase phase, std::chrono::steady_clock::duration wallTime) {
+        if (m_bEnabled) {
+            std::lock_guard<std::mutex> locker(m_statsMutex);
+            m_phases[static_cast<std::size_t> (phase)].wallSeconds += std::chrono::duration<double>(wallTime).count();
+        }
+    }
+
+    //
+    // Count bytes actually sent or received and requests made to the server.
+    //
+
+    void addBytes(std::uint64_t bytes) {
+        if (m_bEnabled) {
+            std::lock_guard<std::mutex> locker(m_statsMutex);
+            m_bytes += bytes;
+        }
+    }
+
+    void addRoundTrips(std::uint64_t roundTrips = 1) {
+        if (m_bEnabled) {
+            std::lock_guard<std::mutex> locker(m_statsMutex);
+            m_roundTrips += roundTrips;
+        }
+    }
+
+    //
+    // Count transferred local files (directories are ignored). Unless the transfer
+    // helpers have already counted the bytes they moved (bBytesCounted) each file was
+    // copied whole by a library call and its size is added to the bytes.
+    //
+
+    void addLocalFiles(const std::vector<std::string> &localFiles, bool bBytesCounted = false) {
+        if (m_bEnabled) {
+            std::uint64_t files { 0 }, bytes { 0 };
+            for (auto &localFile : localFiles) {
+                std::error_code errorCode;
+                if (std::filesystem::is_regular_file(localFile, errorCode)) {
+                    files++;
+                    if (!bBytesCounted) {
+                        bytes += std::filesystem::file_size(localFile, errorCode);
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> locker(m_statsMutex);
+            m_files += files;
+            m_bytes += bytes;
+        }
+    }
+
+    //
+    // Count the local files of a transfer that were sent (as addLocalFiles()) and an
+    // error for each candidate file that was not. A candidate (under localDirectory)
+    // was sent if a path in filesTransferred (under transferredDirectory) has the same
+    // relative path; directories are ignored.
+    //
+
+    void addTransferredFiles(const std::string &localDirectory, const std::vector<std::string> &candidateFiles,
+                             const std::string &transferredDirectory, const std::vector<std::string> &filesTransferred,
+                             bool bBytesCounted = false) {
+        if (m_bEnabled) {
+            std::unordered_set<std::string> transferredPaths;
+            for (auto &file : filesTransferred) {
+                transferredPaths.insert(relativePath(transferredDirectory, file));
+            }
+            std::vector<std::string> localFiles;
+            std::uint64_t filesNotTransferred { 0 };
+            for (auto &candidateFile : candidateFiles) {
+                std::error_code errorCode;
+                if (!std::filesystem::is_regular_file(candidateFile, errorCode)) {
+                    continue;
+                }
+                if (transferredPaths.count(relativePath(localDirectory, candidateFile))) {
+                    localFiles.push_back(candidateFile);
+                } else {
+                    filesNotTransferred++;
+                }
+            }
+            addLocalFiles(localFiles, bBytesCounted);
+            addError(filesNotTransferred);
+        }
+    }
+
+    void addError(std::uint64_t errors = 1) {
+        if (m_bEnabled) {
+            std::lock_guard<std::mutex> locker(m_statsMutex);
+            m_errors += errors;
+        }
+    }
+
+    //
+    // Completion function for the library getFiles()/putFiles() that records the time
+    // since the previous file completed (or the function was made) in the transfer
+    // phase. This is not the file's own transfer time as it includes any gap between
+    // files. nullptr when not enabled so the library does no extra work.
+    //
+
+    std::function<void(const std::string &)> fileCompletionFn() {
+        if (!m_bEnabled) {
+            return (nullptr);
+        }
+        auto lastCompleted = std::make_shared<std::chrono::steady_clock::time_point>(std::chrono::steady_clock::now());
+        return ([this, lastCompleted](const std::string &) {
+            auto now = std::chrono::steady_clock::now();
+            record(Phase::transfer, now - *lastCompleted);
+            *lastCompleted = now;
+        });
+    }
+
+    //
+    // Write summary to the stats file (if enabled); it is written to a temporary file
+    // and renamed so a collector never sees part of it.
+    //
+
+    void write() {
+
+        if (!m_bEnabled) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> locker(m_statsMutex);
+
+        double elapsedSeconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - m_runStart).count() };
+        std::string temporaryFileName { m_statsFileName + ".tmp" };
+
+        {
+            std::ofstream statsStream(temporaryFileName, std::ios::trunc);
+            if (!statsStream.is_open()) {
+                throw std::runtime_error("Could not create stats file [" + temporaryFileName + "]");
+            }
+            if (std::filesystem::path(m_statsFileName).extension() == ".prom") {
+                writePrometheus(statsStream, elapsedSeconds);
+            } else {
+                writeJSON(statsStream, elapsedSeconds);
+            }
+        }
+
+        if (std::rename(temporaryFileName.c_str(), m_statsFileName.c_str()) != 0) {
+            throw std::runtime_error("Could not rename stats file [" + temporaryFileName + "]");
+        }
+
+    }
+
+private:
+
+    struct PhaseStats {
+        double wallSeconds { 0.0 };       // Wall time spent in phase
+        std::uint64_t operations { 0 };   // Operations timed
+        double latencySum { 0.0 };        // Total of their latencies (seconds)
+        double latencyMax { 0.0 };        // Largest latency (seconds)
+        std::array<std::uint64_t, kBucketBounds.size()> bucketCounts {}; // Latencies at or below each bound
+        std::vector<double> reservoir;    // Sample of latencies (at most kReservoirSize)
+    };
+
+    TransferStats() = default;
+
+    //
+    // Path of a file relative to a directory (lexically, each normalised).
+    //
+
+    static std::string relativePath(std::string directory, const std::string &filePath) {
+        while ((directory.size() > 1) && (directory.back() == '/')) {
+            directory.pop_back();
+        }
+        return (std::filesystem::path(filePath).lexically_normal().lexically_relative(
+                std::filesystem::path(directory).lexically_normal()).generic_string());
+    }
+
+    //
+    // Value at a given percentile of sorted (sampled) latencies (nearest rank).
+    //
+
+    static double percentile(const std::vector<double> &sortedLatencies, double percent) {
+        if (sortedLatencies.empty()) {
+            return (0.0);
+        }
+        std::size_t rank = static_cast<std::size_t> (percent / 100.0 * sortedLatencies.size() + 0.5);
+        return (sortedLatencies[std::min(sortedLatencies.size() - 1, (rank > 0) ? rank - 1 : 0)]);
+    }
+
+    void writeJSON(std::ofstream &statsStream, double elapsedSeconds) const {
+
+        statsStream << "{\n";
+        statsStream << "  \"program\": \"" << m_programName << "\",\n";
+        statsStream << "  \"elapsedSeconds\": " << elapsedSeconds << ",\n";
+        statsStream << "  \"files\": " << m_files << ",\n";
+        statsStream << "  \"bytes\": " << m_bytes << ",\n";
+        statsStream << "  \"bytesPerSecond\": " << ((elapsedSeconds > 0.0) ? m_bytes / elapsedSeconds : 0.0) << ",\n";
+        statsStream << "  \"roundTrips\": " << m_roundTrips << ",\n";
+        statsStream << "  \"errors\": " << m_errors << ",\n";
+        statsStream << "  \"phases\": {\n";
+
+        for (std::size_t phase = 0; phase < kPhaseCount; phase++) {
+            const PhaseStats &phaseStats { m_phases[phase] };
+            std::vector<double> sortedLatencies { phaseStats.reservoir };
+            std::sort(sortedLatencies.begin(), sortedLatencies.end());
+            statsStream << "    \"" << kPhaseNames[phase] << "\": {\n";
+            statsStream << "      \"wallSeconds\": " << phaseStats.wallSeconds << ",\n";
+            statsStream << "      \"latencyMeasures\": \"" << kPhaseLatencyMeasures[phase] << "\",\n";
+            statsStream << "      \"operations\": " << phaseStats.operations << ",\n";
+            statsStream << "      \"latencySamples\": " << sortedLatencies.size() << ",\n";
+            statsStream << "      \"latencySeconds\": { \"sum\": " << phaseStats.latencySum
+                    << ", \"p50\": " << percentile(sortedLatencies, 50)
+                    << ", \"p90\": " << percentile(sortedLatencies, 90)
+                    << ", \"p99\": " << percentile(sortedLatencies, 99)
+                    << ", \"max\": " << phaseStats.latencyMax << " },\n";
+            statsStream << "      \"buckets\": [";
+            for (std::size_t bucket = 0; bucket < kBucketBounds.size(); bucket++) {
+                statsStream << ((bucket == 0) ? " " : ", ") << "{ \"le\": " << kBucketBounds[bucket] << ", \"count\": " << phaseStats.bucketCounts[bucket] << " }";
+            }
+            statsStream << " ]\n";
+            statsStream << "    }" << ((phase + 1 < kPhaseCount) ? "," : "") << "\n";
+        }
+
+        statsStream << "  }\n";
+        statsStream << "}\n";
+
+    }
+
+    void writePrometheus(std::ofstream &statsStream, double elapsedSeconds) const {
+
+        std::string program { "program=\"" + m_programName + "\"" };
+
+        statsStream << "# HELP antik_transfer_files_total Files transferred.\n";
+        statsStream << "# TYPE antik_transfer_files_total counter\n";
+        statsStream << "antik_transfer_files_total{" << program << "} " << m_files << "\n";
+        statsStream << "# HELP antik_transfer_bytes_total Bytes transferred.\n";
+        statsStream << "# TYPE antik_transfer_bytes_total counter\n";
+        statsStream << "antik_transfer_bytes_total{" << program << "} " << m_bytes << "\n";
+        statsStream << "# HELP antik_transfer_round_trips_total Requests made to the server.\n";
+        statsStream << "# TYPE antik_transfer_round_trips_total counter\n";
+        statsStream << "antik_transfer_round_trips_total{" << program << "} " << m_roundTrips << "\n";
+        statsStream << "# HELP antik_transfer_errors_total Errors.\n";
+        statsStream << "# TYPE antik_transfer_errors_total counter\n";
+        statsStream << "antik_transfer_errors_total{" << program << "} " << m_errors << "\n";
+        statsStream << "# HELP antik_transfer_run_seconds Run wall time.\n";
+        statsStream << "# TYPE antik_transfer_run_seconds gauge\n";
+        statsStream << "antik_transfer_run_seconds{" << program << "} " << elapsedSeconds << "\n";
+
+        statsStream << "# HELP antik_transfer_phase_seconds Wall time spent in phase.\n";
+        statsStream << "# TYPE antik_transfer_phase_seconds gauge\n";
+        for (std::size_t phase = 0; phase < kPhaseCount; phase++) {
+            statsStream << "antik_transfer_phase_seconds{" << program << ",phase=\"" << kPhaseNames[phase] << "\"} "
+                    << m_phases[phase].wallSeconds << "\n";
+        }
+
+        statsStream << "# HELP antik_transfer_operation_seconds Latency of operations in phase (transfer: "
+                "per file, or where only completions are reported the time since the previous completion "
+                "including gaps).\n";
+        statsStream << "# TYPE antik_transfer_operation_seconds histogram\n";
+        for (std::size_t phase = 0; phase < kPhaseCount; phase++) {
+            const PhaseStats &phaseStats { m_phases[phase] };
+            std::string labels { program + ",phase=\"" + kPhaseNames[phase] + "\"" };
+            for (std::size_t bucket = 0; bucket < kBucketBounds.size(); bucket++) {
+                statsStream << "antik_transfer_operation_seconds_bucket{" << labels << ",le=\"" << kBucketBounds[bucket] << "\"} " << phaseStats.bucketCounts[bucket] << "\n";
+            }
+            statsStream << "antik_transfer_operation_seconds_bucket{" << labels << ",le=\"+Inf\"} " << phaseStats.operations << "\n";
+            statsStream << "antik_transfer_operation_seconds_sum{" << labels << "} " << phaseStats.latencySum << "\n";
+            statsStream << "antik_transfer_operation_seconds_count{" << labels << "} " << phaseStats.operations << "\n";
+        }
+
+    }
+
+    bool m_bEnabled { false };                      // == true recording
+    std::string m_programName;                      // Program (metric label)
+    std::string m_statsFileName;                    // Summary file
+    std::chrono::steady_clock::time_point m_runStart; // When recording started
+    std::mutex m_statsMutex;                        // Recording from several threads
+    std::array<PhaseStats, kPhaseCount> m_phases;   // Per phase stats
+    std::uint64_t m_files { 0 };                    // Files transferred
+    std::uint64_t m_bytes { 0 };                    // Bytes sent/received
+    std::uint64_t m_roundTrips { 0 };               // Requests made to server
+    std::mt19937_64 m_random;                       // Reservoir sampling
+    std::uint64_t m_errors { 0 };                   // Errors
+
+};
+
+#endif /* TRANSFERSTATS_HPP */
@@ -17,10 +17,20 @@
 //   -m [ --mailbox ] arg  Mailbox name
 //   -l [ --poll ]         Check status using NOOP
 //   -w [ --wait ]         Wait for new mail
-//   
+//   -M [ --mailboxes ] arg Comma separated list of mailboxes to watch
+//   --nonotify            Watch mailboxes using IDLE even if server supports NOTIFY
 //
-// Dependencies: C11++, Classes (CMailIMAP, CMailIMAPParse, CFile, CPath),
-//               Linux, Boost C++ Libraries.
+// With --mailboxes all the mailboxes are watched from one process (using NOTIFY
+// where the server supports it, otherwise an IDLE connection per mailbox on an epoll
+// event loop) and each change in a mailbox's message count is written to stdout as a
+// JSON line, e.g. {"time":1700000000,"mailbox":"INBOX","event":"new","previous":10,"exists":11},
+// with any progress messages going to stderr. IDLE is re-issued before the server
+// times it out, failed connections are re-established with jittered backoff and every
+// five minutes an "event":"stats" line with each mailbox's round trip and reconnect
+// counters is written. NOOP polling (--poll) adapts its interval to mailbox activity.
+//
+// Dependencies: C11++, Classes (CMailIMAP, CMailIMAPParse, CFile, CPath,
+//               IMAPStreamConnection), Linux, Boost C++ Libraries.
 //
 
 // =============
@@ -35,6 +45,23 @@
 #include <chrono>
 #include <thread>
 #include <fstream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <random>
+
+//
+// Linux
+//
+
+#include <sys/epoll.h>
+#include <unistd.h>
 
 //
 // Antik Classes
@@ -42,6 +69,7 @@
 
 #include "CIMAP.hpp"
 #include "CIMAPParse.hpp"
+#include "IMAPStreamConnection.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
 
@@ -72,13 +100,126 @@ struct ParamArgData {
     std::string configFileName;     // Configuration file name
     bool bPolls { false };          // ==true then use NOOP
     bool bWaitForNewMail { false }; // ==true wait for a new message to arrive
+    std::string mailBoxList;        // Comma separated mailboxes to watch
+    bool bNoNotify { false };       // ==true do not use NOTIFY
 };
 
 //
-// Polling period between NOOP in seconds;
+// Polling period between NOOP in seconds; it adapts to mailbox activity, dropping
+// to the minimum after a change and backing off (doubling) while the mailbox is
+// quiet up to the maximum.
 //
 
 constexpr int kPollPeriod = 15;
+constexpr int kMinPollPeriod = 5;
+constexpr int kMaxPollPeriod = 120;
+
+//
+// IDLE is ended and re-issued this often (before the usual 29 minute server
+// timeout); NOTIFY connections send a NOOP.
+//
+
+constexpr std::chrono::seconds kIdleRefreshPeriod { 25 * 60 };
+
+//
+// Reconnect delay range; the delay doubles for each failed attempt and is
+// jittered between half and all of its value.
+//
+
+constexpr std::chrono::milliseconds kMinReconnectDelay { 1000 };
+constexpr std::chrono::milliseconds kMaxReconnectDelay { 5 * 60 * 1000 };
+
+//
+// Period between writing counters for each mailbox to the event stream.
+//
+
+constexpr std::chrono::seconds kStatsPeriod { 5 * 60 };
+
+//
+// Adaptive NOOP polling interval.
+//
+
+struct PollInterval {
+    int seconds { kPollPeriod };
+    void activity() {
+        seconds = kMinPollPeriod;
+    }
+    void quiet() {
+        seconds = std::min(seconds * 2, kMaxPollPeriod);
+    }
+};
+
+//
+// Jittered exponential reconnect backoff.
+//
+
+struct ReconnectBackoff {
+    int attempts { 0 };
+    std::chrono::milliseconds next(std::mt19937 &randomGenerator) {
+        std::chrono::milliseconds delay { kMinReconnectDelay };
+        for (int attempt = 0; (attempt < attempts) && (delay < kMaxReconnectDelay); attempt++) {
+            delay *= 2;
+        }
+        delay = std::min(delay, kMaxReconnectDelay);
+        attempts++;
+        std::uniform_int_distribution<std::int64_t> jitter(delay.count() / 2, delay.count());
+        return (std::chrono::milliseconds(jitter(randomGenerator)));
+    }
+    void reset() {
+        attempts = 0;
+    }
+};
+
+//
+// Per mailbox counters written to the event stream.
+//
+
+struct MailBoxCounters {
+    std::uint64_t events { 0 };            // Message count changes reported
+    std::uint64_t roundTrips { 0 };        // Command round trips
+    std::uint64_t totalRoundTripMs { 0 };  // Total round trip time
+    std::uint64_t maxRoundTripMs { 0 };    // Longest round trip
+    std::uint64_t idleRefreshes { 0 };     // IDLE re-issued before timeout
+    std::uint64_t reconnects { 0 };        // Connection failures
+};
+
+//
+// Watched mailbox (IDLE connection, last message count and next deadline).
+//
+
+struct MailBoxWatch {
+    std::string mailBoxName;                           // Mailbox name
+    std::unique_ptr<IMAPStreamConnection> imapStream;  // IDLE connection (null if disconnected)
+    std::uint64_t exists { 0 };                        // Last EXISTS
+    bool bBaseline { false };                          // == true exists is valid
+    std::chrono::steady_clock::time_point deadline;    // IDLE refresh or reconnect time
+    ReconnectBackoff backoff;                          // Reconnect backoff
+    MailBoxCounters counters;                          // Mailbox counters
+};
+
+//
+// epoll instance closed on scope exit.
+//
+
+struct EpollDescriptor {
+    EpollDescriptor() : fd{ epoll_create1(0)} {
+        if (fd < 0) {
+            throw std::runtime_error(std::string("epoll_create1() failed: ") + std::strerror(errno));
+        }
+    }
+    ~EpollDescriptor() {
+        close(fd);
+    }
+    EpollDescriptor(const EpollDescriptor &orig) = delete;
+    EpollDescriptor& operator=(const EpollDescriptor &orig) = delete;
+    int fd;
+};
+
+//
+// Maximum events returned by one epoll_wait().
+//
+
+constexpr int kMaxEpollEvents = 64;
 
 // ===============
 // LOCAL FUNCTIONS
@@ -98,6 +239,27 @@ static void exitWithError(std::string errMsg) {
 
 }
 
+//
+// Split comma separated mailbox list.
+//
+
+static std::vector<std::string> splitMailBoxList(const std::string &mailBoxList) {
+
+    std::vector<std::string> mailBoxes;
+    std::istringstream mailBoxStream(mailBoxList);
+
+    for (std::string mailBox; std::getline(mailBoxStream, mailBox, ',');) {
+        mailBox.erase(0, mailBox.find_first_not_of(' '));
+        mailBox.erase(mailBox.find_last_not_of(' ') + 1);
+        if (!mailBox.empty()) {
+            mailBoxes.push_back(mailBox);
+        }
+    }
+
+    return (mailBoxes);
+
+}
+
 //
 // Add options common to both command line and config file
 //
@@ -108,7 +270,9 @@ static void addCommonOptions(po::options_description& commonOptions, ParamArgDat
             ("server,s", po::value<std::string>(&argData.serverURL)->required(), "IMAP Server URL and port")
             ("user,u", po::value<std::string>(&argData.userName)->required(), "Account username")
             ("password,p", po::value<std::string>(&argData.userPassword)->required(), "User password")
-            ("mailbox,m", po::value<std::string>(&argData.mailBoxName)->required(), "Mailbox name")
+            ("mailbox,m", po::value<std::string>(&argData.mailBoxName), "Mailbox name")
+            ("mailboxes,M", po::value<std::string>(&argData.mailBoxList), "Comma separated list of mailboxes to watch")
+            ("nonotify", "Watch mailboxes using IDLE even if server supports NOTIFY")
             ("wait,w", "Wait for new mail")
             ("poll,l", "Check status using NOOP");
 
@@ -173,6 +337,14 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
             argData.bWaitForNewMail = true;
         }
 
+        if (vm.count("nonotify")) {
+            argData.bNoNotify = true;
+        }
+
+        if (argData.mailBoxName.empty() && splitMailBoxList(argData.mailBoxList).empty()) {
+            throw po::error("A mailbox or list of mailboxes must be specified.");
+        }
+
 
     } catch (po::error& e) {
         std::cerr << "WaitForMailBoxEvent Error: " << e.what() << std::endl << std::endl;
@@ -232,6 +404,547 @@ static std::string sendCommand(CIMAP& imap, [[maybe_unused]] const std::string&
 
 }
 
+//
+// Mailbox name without any enclosing quotes.
+//
+
+static std::string unquotedMailBoxName(const std::string &mailBoxName) {
+    if ((mailBoxName.size() >= 2) && (mailBoxName.front() == '\"') && (mailBoxName.back() == '\"')) {
+        return (mailBoxName.substr(1, mailBoxName.size() - 2));
+    }
+    return (mailBoxName);
+}
+
+//
+// Escape string for JSON event output.
+//
+
+static std::string jsonString(const std::string &value) {
+    std::string escaped { "\"" };
+    for (unsigned char ch : value) {
+        if ((ch == '\"') || (ch == '\\')) {
+            escaped.push_back('\\');
+            escaped.push_back(ch);
+        } else if (ch < 0x20) {
+            char hex[8];
+            std::snprintf(hex, sizeof (hex), "\\u%04x", ch);
+            escaped += hex;
+        } else {
+            escaped.push_back(ch);
+        }
+    }
+    return (escaped + "\"");
+}
+
+//
+// Write a mailbox event as a single JSON line to stdout.
+//
+
+static void writeMailBoxEvent(const std::string &mailBoxName, std::uint64_t previousExists, std::uint64_t exists) {
+
+    std::cout << "{\"time\":" << std::time(nullptr)
+            << ",\"mailbox\":" << jsonString(unquotedMailBoxName(mailBoxName))
+            << ",\"event\":\"" << ((exists > previousExists) ? "new" : "expunge")
+            << "\",\"previous\":" << previousExists
+            << ",\"exists\":" << exists << "}\n" << std::flush;
+
+}
+
+//
+// Parse an unsolicited "* STATUS mailbox (MESSAGES n ...)" line returning the mailbox
+// name and message count.
+//
+
+static bool parseStatusLine(const std::string &line, std::string &mailBoxName, std::uint64_t &messages) {
+
+    const std::string kStatus { "* STATUS " };
+
+    if (line.compare(0, kStatus.size(), kStatus) != 0) {
+        return (false);
+    }
+
+    std::size_t nameEnd;
+    if (line[kStatus.size()] == '\"') {
+        nameEnd = line.find('\"', kStatus.size() + 1);
+        if (nameEnd == std::string::npos) {
+            return (false);
+        }
+        mailBoxName = line.substr(kStatus.size() + 1, nameEnd - kStatus.size() - 1);
+    } else {
+        nameEnd = line.find(' ', kStatus.size());
+        if (nameEnd == std::string::npos) {
+            return (false);
+        }
+        mailBoxName = line.substr(kStatus.size(), nameEnd - kStatus.size());
+    }
+
+    std::size_t messagesStart = line.find("MESSAGES ", nameEnd);
+    if (messagesStart == std::string::npos) {
+        return (false);
+    }
+
+    messages = std::strtoull(line.c_str() + messagesStart + 9, nullptr, 10);
+
+    return (true);
+
+}
+
+//
+// Connect a stream connection to the server.
+//
+
+static void connectStream(IMAPStreamConnection &imapStream, const ParamArgData &argData) {
+    imapStream.setServer(argData.serverURL);
+    imapStream.setUserAndPassword(argData.userName, argData.userPassword);
+    imapStream.connect();
+}
+
+//
+// Does server advertise NOTIFY (RFC 5465) ?
+//
+
+static bool serverSupportsNotify(IMAPStreamConnection &imapStream) {
+    std::string capabilities { imapStream.sendCommand("CAPABILITY") };
+    std::size_t capabilityLine { capabilities.find("* CAPABILITY ") };
+    if (capabilityLine == std::string::npos) {
+        return (false);
+    }
+    capabilities = capabilities.substr(capabilityLine, capabilities.find("\r\n", capabilityLine) - capabilityLine) + " ";
+    return (capabilities.find(" NOTIFY ") != std::string::npos);
+}
+
+//
+// Wait for readable sockets on an epoll instance; returns the indexes of the ready
+// connections.
+//
+
+static std::vector<std::size_t> waitForEvents(int epollFd, int timeOut) {
+
+    std::vector<std::size_t> ready;
+    struct epoll_event events[kMaxEpollEvents];
+
+    int eventCount = epoll_wait(epollFd, events, kMaxEpollEvents, timeOut);
+    if (eventCount < 0) {
+        if (errno == EINTR) {
+            return (ready);
+        }
+        throw std::runtime_error(std::string("epoll_wait() failed: ") + std::strerror(errno));
+    }
+
+    for (int event = 0; event < eventCount; event++) {
+        ready.push_back(events[event].data.u64);
+    }
+
+    return (ready);
+
+}
+
+//
+// Add connection socket to epoll instance.
+//
+
+static void addToEpoll(int epollFd, IMAPStreamConnection &imapStream, std::size_t index) {
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, imapStream.getSocket(), &event) < 0) {
+        throw std::runtime_error(std::string("epoll_ctl() failed: ") + std::strerror(errno));
+    }
+}
+
+//
+// Record the time taken by a command round trip.
+//
+
+static void recordRoundTrip(MailBoxCounters &counters, std::chrono::steady_clock::time_point start) {
+    std::uint64_t roundTripMs = std::chrono::duration_cast<std::chrono::milliseconds>
+            (std::chrono::steady_clock::now() - start).count();
+    counters.roundTrips++;
+    counters.totalRoundTripMs += roundTripMs;
+    counters.maxRoundTripMs = std::max(counters.maxRoundTripMs, roundTripMs);
+}
+
+//
+// Write a mailbox's counters as a single JSON line to stdout.
+//
+
+static void writeMailBoxStats(const std::string &mailBoxName, const MailBoxCounters &counters) {
+
+    std::cout << "{\"time\":" << std::time(nullptr)
+            << ",\"mailbox\":" << jsonString(unquotedMailBoxName(mailBoxName))
+            << ",\"event\":\"stats\",\"events\":" << counters.events
+            << ",\"roundTrips\":" << counters.roundTrips
+            << ",\"averageRoundTripMs\":" << (counters.roundTrips ? counters.totalRoundTripMs / counters.roundTrips : 0)
+            << ",\"maxRoundTripMs\":" << counters.maxRoundTripMs
+            << ",\"idleRefreshes\":" << counters.idleRefreshes
+            << ",\"reconnects\":" << counters.reconnects << "}\n" << std::flush;
+
+}
+
+//
+// Milliseconds from now until a deadline (zero if passed).
+//
+
+static int millisecondsUntil(std::chrono::steady_clock::time_point deadline) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return (static_cast<int> (std::max<std::int64_t>(remaining, 0)));
+}
+
+//
+// Process STATUS lines from a NOTIFY connection writing an event for any mailbox
+// whose message count has changed.
+//
+
+static void processStatusLines(const std::vector<std::string> &lines, std::unordered_map<std::string, std::uint64_t> &exists,
+        std::unordered_map<std::string, MailBoxCounters> &counters) {
+    for (auto &line : lines) {
+        std::string mailBoxName;
+        std::uint64_t messages { 0 };
+        if (parseStatusLine(line, mailBoxName, messages)) {
+            if (exists.count(mailBoxName) && (exists[mailBoxName] != messages)) {
+                writeMailBoxEvent(mailBoxName, exists[mailBoxName], messages);
+                counters[mailBoxName].events++;
+            }
+            exists[mailBoxName] = messages;
+        } else if (line.find("* BYE") == 0) {
+            throw CIMAP::Exception("Received BYE from server: " + line);
+        }
+    }
+}
+
+//
+// Split a response into lines.
+//
+
+static std::vector<std::string> responseLines(const std::string &commandResponse) {
+    std::vector<std::string> lines;
+    std::istringstream responseStream(commandResponse);
+    for (std::string line; std::getline(responseStream, line);) {
+        if (!line.empty() && (line.back() == '\r')) line.pop_back();
+        lines.push_back(line);
+    }
+    return (lines);
+}
+
+//
+// Watch mailboxes with a single NOTIFY connection; message counts come from the
+// unsolicited STATUS responses the server sends as mailboxes change. A NOOP is
+// sent every IDLE refresh period to keep the session from being timed out. Message
+// counts and counters are kept by the caller across reconnects so that changes
+// while disconnected are still reported.
+//
+
+static void watchMailBoxesNotify(IMAPStreamConnection &imapStream, const std::vector<std::string> &mailBoxes,
+        std::unordered_map<std::string, std::uint64_t> &exists, std::unordered_map<std::string, MailBoxCounters> &counters) {
+
+    std::string mailBoxList;
+    MailBoxCounters connectionCounters;
+
+    for (auto &mailBox : mailBoxes) {
+        std::string command { "STATUS " + mailBox + " (MESSAGES)" };
+        auto start = std::chrono::steady_clock::now();
+        std::string commandResponse { imapStream.sendCommand(command) };
+        recordRoundTrip(connectionCounters, start);
+        if (!IMAPStreamConnection::bStatusOK(commandResponse)) {
+            throw CIMAP::Exception(command + ": failed.");
+        }
+        processStatusLines(responseLines(commandResponse), exists, counters);
+        mailBoxList += (mailBoxList.empty() ? "" : " ") + mailBox;
+    }
+
+    for (auto &mailBox : exists) {
+        std::cerr << "Current Messages [" << mailBox.first << "] [" << mailBox.second << "]" << std::endl;
+    }
+
+    std::string command { "NOTIFY SET (mailboxes (" + mailBoxList + ") (MessageNew MessageExpunge))" };
+    if (!IMAPStreamConnection::bStatusOK(imapStream.sendCommand(command))) {
+        throw CIMAP::Exception(command + ": failed.");
+    }
+
+    std::cerr << "Waiting on mailboxes using NOTIFY" << std::endl;
+
+    EpollDescriptor epoll;
+    addToEpoll(epoll.fd, imapStream, 0);
+
+    auto keepAliveDeadline = std::chrono::steady_clock::now() + kIdleRefreshPeriod;
+    auto statsDeadline = std::chrono::steady_clock::now() + kStatsPeriod;
+
+    for (;;) {
+
+        std::vector<std::string> lines;
+
+        int timeOut { millisecondsUntil(std::min(keepAliveDeadline, statsDeadline)) };
+        if ((imapStream.hasBufferedLines() || !waitForEvents(epoll.fd, timeOut).empty()) && imapStream.readUnsolicited(lines)) {
+            processStatusLines(lines, exists, counters);
+        }
+
+        if (std::chrono::steady_clock::now() >= keepAliveDeadline) {
+            auto start = std::chrono::steady_clock::now();
+            processStatusLines(responseLines(imapStream.sendCommand("NOOP")), exists, counters);
+            recordRoundTrip(connectionCounters, start);
+            keepAliveDeadline = std::chrono::steady_clock::now() + kIdleRefreshPeriod;
+        }
+
+        if (std::chrono::steady_clock::now() >= statsDeadline) {
+            for (auto &mailBox : exists) {
+                MailBoxCounters mailBoxCounters { connectionCounters };
+                mailBoxCounters.events = counters[mailBox.first].events;
+                mailBoxCounters.reconnects = counters[mailBox.first].reconnects;
+                writeMailBoxStats(mailBox.first, mailBoxCounters);
+            }
+            statsDeadline += kStatsPeriod;
+        }
+
+    }
+
+}
+
+//
+// Connect (or reconnect) a watched mailbox, SELECT it and start IDLE. A change in
+// EXISTS since it was last connected is reported as an event.
+//
+
+static void connectMailBoxWatch(MailBoxWatch &watch, const ParamArgData &argData, int epollFd, std::size_t index) {
+
+    watch.imapStream.reset(new IMAPStreamConnection());
+    connectStream(*watch.imapStream, argData);
+
+    std::string command { "SELECT " + watch.mailBoxName };
+    auto start = std::chrono::steady_clock::now();
+    CIMAPParse::COMMANDRESPONSE parsedResponse { parseCommandResponse(command, watch.imapStream->sendCommand(command)) };
+    recordRoundTrip(watch.counters, start);
+
+    if (parsedResponse->responseMap.find("EXISTS") != parsedResponse->responseMap.end()) {
+        std::uint64_t newExists { std::strtoull(parsedResponse->responseMap["EXISTS"].c_str(), nullptr, 10) };
+        if (watch.bBaseline && (newExists != watch.exists)) {
+            writeMailBoxEvent(watch.mailBoxName, watch.exists, newExists);
+            watch.counters.events++;
+        }
+        watch.exists = newExists;
+        watch.bBaseline = true;
+        std::cerr << "Current Messages [" << watch.mailBoxName << "] [" << watch.exists << "]" << std::endl;
+    }
+
+    start = std::chrono::steady_clock::now();
+    watch.imapStream->startIdle();
+    recordRoundTrip(watch.counters, start);
+
+    addToEpoll(epollFd, *watch.imapStream, index);
+
+    watch.deadline = std::chrono::steady_clock::now() + kIdleRefreshPeriod;
+    watch.backoff.reset();
+
+}
+
+//
+// End a mailbox's IDLE, compare EXISTS in its response and re-issue IDLE. This is
+// done when unsolicited responses arrive and also before the server IDLE timeout.
+//
+
+static void restartMailBoxIdle(MailBoxWatch &watch, const std::vector<std::string> &lines) {
+
+    std::string commandResponse;
+    for (auto &line : lines) {
+        commandResponse += line + "\r\n";
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    commandResponse += watch.imapStream->endIdle();
+    recordRoundTrip(watch.counters, start);
+
+    CIMAPParse::COMMANDRESPONSE parsedResponse { parseCommandResponse("IDLE", commandResponse) };
+    if (parsedResponse->responseMap.find("EXISTS") != parsedResponse->responseMap.end()) {
+        std::uint64_t newExists { std::strtoull(parsedResponse->responseMap["EXISTS"].c_str(), nullptr, 10) };
+        if (newExists != watch.exists) {
+            writeMailBoxEvent(watch.mailBoxName, watch.exists, newExists);
+            watch.counters.events++;
+            watch.exists = newExists;
+        }
+    }
+
+    start = std::chrono::steady_clock::now();
+    watch.imapStream->startIdle();
+    recordRoundTrip(watch.counters, start);
+
+    watch.deadline = std::chrono::steady_clock::now() + kIdleRefreshPeriod;
+
+}
+
+//
+// Handle any unsolicited lines a mailbox connection has already received (with its
+// IDLE continuation say); the socket will not signal these.
+//
+
+static void drainMailBoxWatch(MailBoxWatch &watch) {
+
+    while (watch.imapStream->hasBufferedLines()) {
+        std::vector<std::string> lines;
+        if (!watch.imapStream->readUnsolicited(lines)) {
+            break;
+        }
+        restartMailBoxIdle(watch, lines);
+    }
+
+}
+
+//
+// Drop a failed mailbox connection and schedule its reconnect.
+//
+
+static void dropMailBoxWatch(MailBoxWatch &watch, int epollFd, const std::string &error, std::mt19937 &randomGenerator) {
+
+    if (watch.imapStream) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, watch.imapStream->getSocket(), nullptr);
+        watch.imapStream.reset();
+    }
+
+    auto delay = watch.backoff.next(randomGenerator);
+    watch.deadline = std::chrono::steady_clock::now() + delay;
+    watch.counters.reconnects++;
+
+    std::cerr << "Mailbox [" << watch.mailBoxName << "] connection failed (" << error << "); reconnecting in "
+            << delay.count() << "ms" << std::endl;
+
+}
+
+//
+// Watch mailboxes with one IDLE connection each multiplexed on an epoll event loop.
+// When a connection has unsolicited responses its IDLE is ended and the complete
+// response parsed so that EXISTS can be compared as for a single mailbox. Each
+// connection has a deadline: either its IDLE refresh or, if it has failed, its next
+// reconnect attempt (with jittered exponential backoff); the loop waits until the
+// earliest deadline.
+//
+
+static void watchMailBoxesIdle(const ParamArgData &argData, const std::vector<std::string> &mailBoxes) {
+
+    std::vector<MailBoxWatch> watches(mailBoxes.size());
+    std::mt19937 randomGenerator { std::random_device{}() };
+    EpollDescriptor epoll;
+
+    auto statsDeadline = std::chrono::steady_clock::now() + kStatsPeriod;
+
+    for (std::size_t index = 0; index < mailBoxes.size(); index++) {
+        watches[index].mailBoxName = mailBoxes[index];
+        watches[index].deadline = std::chrono::steady_clock::now();
+    }
+
+    std::cerr << "Waiting on mailboxes using IDLE" << std::endl;
+
+    for (;;) {
+
+        // Reconnects and IDLE refreshes that are due
+
+        for (std::size_t index = 0; index < watches.size(); index++) {
+            MailBoxWatch &watch { watches[index] };
+            if (std::chrono::steady_clock::now() < watch.deadline) {
+                continue;
+            }
+            try {
+                if (!watch.imapStream) {
+                    connectMailBoxWatch(watch, argData, epoll.fd, index);
+                } else {
+                    restartMailBoxIdle(watch, {});
+                    watch.counters.idleRefreshes++;
+                }
+            } catch (const std::exception &e) {
+                dropMailBoxWatch(watch, epoll.fd, e.what(), randomGenerator);
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= statsDeadline) {
+            for (auto &watch : watches) {
+                writeMailBoxStats(watch.mailBoxName, watch.counters);
+            }
+            statsDeadline += kStatsPeriod;
+        }
+
+        // Responses already received (after a connect or IDLE restart) before waiting
+
+        for (auto &watch : watches) {
+            if (!watch.imapStream) {
+                continue;
+            }
+            try {
+                drainMailBoxWatch(watch);
+            } catch (const std::exception &e) {
+                dropMailBoxWatch(watch, epoll.fd, e.what(), randomGenerator);
+            }
+        }
+
+        // Wait for responses until the next deadline
+
+        auto nextDeadline = statsDeadline;
+        for (auto &watch : watches) {
+            nextDeadline = std::min(nextDeadline, watch.deadline);
+        }
+
+        for (auto index : waitForEvents(epoll.fd, millisecondsUntil(nextDeadline))) {
+            MailBoxWatch &watch { watches[index] };
+            if (!watch.imapStream) {
+                continue;
+            }
+            try {
+                std::vector<std::string> lines;
+                if (watch.imapStream->readUnsolicited(lines)) {
+                    restartMailBoxIdle(watch, lines);
+                }
+            } catch (const std::exception &e) {
+                dropMailBoxWatch(watch, epoll.fd, e.what(), randomGenerator);
+            }
+        }
+
+    }
+
+}
+
+//
+// Watch a list of mailboxes writing an event line for each change in message count.
+// NOTIFY is used if the server supports it otherwise IDLE on a connection per mailbox.
+// A failed NOTIFY connection is re-established with jittered exponential backoff.
+//
+
+static void watchMailBoxes(const ParamArgData &argData) {
+
+    std::vector<std::string> mailBoxes { splitMailBoxList(argData.mailBoxList) };
+    std::unordered_map<std::string, std::uint64_t> exists;
+    std::unordered_map<std::string, MailBoxCounters> counters;
+    ReconnectBackoff backoff;
+    std::mt19937 randomGenerator { std::random_device{}() };
+
+    for (;;) {
+
+        IMAPStreamConnection imapStream;
+
+        try {
+
+            std::cerr << "Connecting to server [" << argData.serverURL << "]" << std::endl;
+
+            connectStream(imapStream, argData);
+
+            if (argData.bNoNotify || !serverSupportsNotify(imapStream)) {
+                imapStream.disconnect();
+                watchMailBoxesIdle(argData, mailBoxes);
+                return;
+            }
+
+            backoff.reset();
+
+            watchMailBoxesNotify(imapStream, mailBoxes, exists, counters);
+
+        } catch (const std::exception &e) {
+            auto delay = backoff.next(randomGenerator);
+            for (auto &mailBox : exists) {
+                counters[mailBox.first].reconnects++;
+            }
+            std::cerr << "Connection failed (" << e.what() << "); reconnecting in " << delay.count() << "ms" << std::endl;
+            std::this_thread::sleep_for(delay);
+        }
+
+    }
+
+}
+
 // ============================
 // ===== MAIN ENTRY POINT =====
 // ============================
@@ -245,11 +958,19 @@ int main(int argc, char** argv) {
         std::string comandResponse, command;
         CIMAPParse::COMMANDRESPONSE parsedResponse;
         int exists = 0, newExists = 0;
+        PollInterval pollInterval;
 
         // Read in command line parameters and process
 
         procCmdLine(argc, argv, argData);
 
+        // Watch list of mailboxes (runs until error or killed)
+
+        if (!argData.mailBoxList.empty()) {
+            watchMailBoxes(argData);
+            exit(EXIT_SUCCESS);
+        }
+
         // Set mail account user name and password
 
         imap.setServer(argData.serverURL);
@@ -291,8 +1012,12 @@ int main(int argc, char** argv) {
                     command = "NOOP";
                     comandResponse = sendCommand(imap, argData.mailBoxName, command);
                     parsedResponse = parseCommandResponse(command, comandResponse);
-                    if (parsedResponse->responseMap.size() >= 1) break;
-                    std::this_thread::sleep_for(std::chrono::seconds(kPollPeriod));
+                    if (parsedResponse->responseMap.size() >= 1) {
+                        pollInterval.activity();
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::seconds(pollInterval.seconds));
+                    pollInterval.quiet();
                 }
             }
 
@@ -11,7 +11,7 @@
 //   -c [ --config ] arg         Config File Name
 //   -z [ --zip ] arg            ZIP Archive Name
 // 
-// Dependencies: C11++, Classes (CFileZIPIO,CFile,CPath), Linux, Boost C++ Libraries.
+// Dependencies: C11++, Classes (CFile,CPath), Linux, Boost C++ Libraries, zlib.
 //
 
 // =============
@@ -30,11 +30,10 @@
 // Antik Classes
 //
 
-#include "CZIPIO.hpp"
+#include "ZIPArchiveReader.hpp"
 #include "CPath.hpp"
 #include "CFile.hpp"
 
-using namespace Antik::ZIP;
 using namespace Antik::File;
 
 //
@@ -149,7 +148,7 @@ static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
 // Output byte array (in hex).
 //
 
-static void dumpBytes(std::vector<std::uint8_t>& bytes) {
+static void dumpBytes(std::span<const std::uint8_t> bytes) {
 
     std::uint32_t byteCount = 1;
     std::cout << std::hex;
@@ -164,7 +163,7 @@ static void dumpBytes(std::vector<std::uint8_t>& bytes) {
 // Output End Of Central Directory record information.
 //
 
-static void dumpEOCentralDirectoryRecord(CZIPIO::EOCentralDirectoryRecord& endOfCentralDirectory) {
+static void dumpEOCentralDirectoryRecord(const ZIPEOCentralDirectoryView& endOfCentralDirectory) {
 
     std::cout << "End Of Central Directory Record" << "\n";
     std::cout << "-------------------------------\n" << "\n";
@@ -173,9 +172,9 @@ static void dumpEOCentralDirectoryRecord(CZIPIO::EOCentralDirectoryRecord& endOf
     std::cout << "Number Of Central Directory Entries       : " << endOfCentralDirectory.numberOfCentralDirRecords << "\n";
     std::cout << "Total Number Of Central Directory Entries : " << endOfCentralDirectory.totalCentralDirRecords << "\n";
     std::cout << "Central Directory Offset                  : " << endOfCentralDirectory.offsetCentralDirRecords << "\n";
-    std::cout << "Comment length                            : " << endOfCentralDirectory.commentLength << "\n";
+    std::cout << "Comment length                            : " << endOfCentralDirectory.comment.size() << "\n";
 
-    if (endOfCentralDirectory.commentLength) {
+    if (!endOfCentralDirectory.comment.empty()) {
         std::cout << "Comment                                   : " << endOfCentralDirectory.comment << "\n";
     }
 
@@ -187,60 +186,52 @@ static void dumpEOCentralDirectoryRecord(CZIPIO::EOCentralDirectoryRecord& endOf
 // Output Central Directory File Header record information.
 //
 
-static void dumpCentralDirectoryFileHeader(CZIPIO& zipFile, CZIPIO::CentralDirectoryFileHeader& fileHeader, std::uint32_t number) {
+static void dumpCentralDirectoryFileHeader(const ZIPDirectoryEntryView& fileHeader, std::uint64_t number) {
 
     std::cout << "Central Directory File Header No: " << number << "\n";
     std::cout << "--------------------------------\n" << "\n";
 
-    std::cout << "File Name Length        : " << fileHeader.fileNameLength << "\n";
+    std::cout << "File Name Length        : " << fileHeader.fileName.size() << "\n";
     std::cout << "File Name               : " << fileHeader.fileName << "\n";
     std::cout << "General Bit Flag        : " << fileHeader.bitFlag << "\n";
-    std::cout << "Compressed Size         : " << fileHeader.compressedSize << "\n";
+    std::cout << "Compressed Size         : " << fileHeader.rawCompressedSize << "\n";
     std::cout << "Compression Method      : " << fileHeader.compression << "\n";
     std::cout << "CRC 32                  : " << fileHeader.crc32 << "\n";
     std::cout << "Creator Version         : " << fileHeader.creatorVersion << "\n";
     std::cout << "Start Disk Number       : " << fileHeader.diskNoStart << "\n";
     std::cout << "External File Attribute : " << fileHeader.externalFileAttrib << "\n";
     std::cout << "Extractor Version       : " << fileHeader.extractorVersion << "\n";
-    std::cout << "File HeaderOffset       : " << fileHeader.fileHeaderOffset << "\n";
+    std::cout << "File HeaderOffset       : " << fileHeader.rawFileHeaderOffset << "\n";
     std::cout << "Internal File Attribute : " << fileHeader.internalFileAttrib << "\n";
     std::cout << "Modification Date       : " << fileHeader.modificationDate << "\n";
     std::cout << "Modification Time       : " << fileHeader.modificationTime << "\n";
-    std::cout << "Uncompressed Size       : " << fileHeader.uncompressedSize << "\n";
-    std::cout << "File Comment Length     : " << fileHeader.fileCommentLength << "\n";
-    std::cout << "Extra Field Length      : " << fileHeader.extraFieldLength << "\n";
+    std::cout << "Uncompressed Size       : " << fileHeader.rawUncompressedSize << "\n";
+    std::cout << "File Comment Length     : " << fileHeader.fileComment.size() << "\n";
+    std::cout << "Extra Field Length      : " << fileHeader.extraField.size() << "\n";
 
-    if (fileHeader.fileCommentLength) {
+    if (!fileHeader.fileComment.empty()) {
         std::cout << "Comment                 : " << fileHeader.fileComment << "\n";
     }
 
-    if (fileHeader.extraFieldLength) {
+    if (!fileHeader.extraField.empty()) {
         std::cout << "Extra Field             :\n";
         dumpBytes(fileHeader.extraField);
     }
 
-    // For file header data > 32 bits display ZIP64 values.
+    // For file header data > 32 bits display ZIP64 values (already decoded by the reader).
 
-    if (zipFile.fieldOverflow(fileHeader.compressedSize) ||
-            zipFile.fieldOverflow(fileHeader.uncompressedSize) ||
-            zipFile.fieldOverflow(fileHeader.fileHeaderOffset)) {
+    if (fileHeader.bZip64) {
 
-        CZIPIO::Zip64ExtendedInfoExtraField extra;
-
-        extra.compressedSize = fileHeader.compressedSize;
-        extra.fileHeaderOffset = fileHeader.fileHeaderOffset;
-        extra.originalSize = fileHeader.uncompressedSize;
         std::cout << "\nZIP64 extension data :\n";
         std::cout << "+++++++++++++++++++++\n";
-        zipFile.getZip64ExtendedInfoExtraField(extra, fileHeader.extraField);
-        if (zipFile.fieldOverflow(fileHeader.compressedSize)) {
-            std::cout << "Compressed Size         : " << extra.compressedSize << "\n";
+        if (ZIPArchiveReader::fieldOverflow(fileHeader.rawCompressedSize)) {
+            std::cout << "Compressed Size         : " << fileHeader.compressedSize << "\n";
         }
-        if (zipFile.fieldOverflow(fileHeader.uncompressedSize)) {
-            std::cout << "Uncompressed Size       : " << extra.originalSize << "\n";
+        if (ZIPArchiveReader::fieldOverflow(fileHeader.rawUncompressedSize)) {
+            std::cout << "Uncompressed Size       : " << fileHeader.uncompressedSize << "\n";
         }
-        if (zipFile.fieldOverflow(fileHeader.fileHeaderOffset)) {
-            std::cout << "File HeaderOffset       : " << extra.fileHeaderOffset << "\n";
+        if (ZIPArchiveReader::fieldOverflow(fileHeader.rawFileHeaderOffset)) {
+            std::cout << "File HeaderOffset       : " << fileHeader.fileHeaderOffset << "\n";
         }
 
     }
@@ -265,31 +256,23 @@ int main(int argc, char** argv) {
 
         if (!argData.zipFileName.empty()) {
 
-            CZIPIO zipFile;
-            CZIPIO::EOCentralDirectoryRecord endOfCentralDirectory;
-
-            //  Open zip file for read
-
-            zipFile.openZIPFile(argData.zipFileName, std::ios::in);
+            //  Map zip file for read
 
-            // Read End Of Central Directory and display info
+            ZIPArchiveReader zipFile { argData.zipFileName };
 
-            zipFile.getZIPRecord(endOfCentralDirectory);
-            dumpEOCentralDirectoryRecord(endOfCentralDirectory);
+            // Display End Of Central Directory info
 
-            // Move to start of Central Directory and loop displaying entries.
+            dumpEOCentralDirectoryRecord(zipFile.endOfCentralDirectory());
 
-            zipFile.positionInZIPFile(endOfCentralDirectory.offsetCentralDirRecords);
-
-            for (auto entryNumber = 0; entryNumber < endOfCentralDirectory.numberOfCentralDirRecords; entryNumber++) {
-                CZIPIO::CentralDirectoryFileHeader fileHeader;
-                zipFile.getZIPRecord(fileHeader);
-                dumpCentralDirectoryFileHeader(zipFile, fileHeader, entryNumber);
-            }
+            // Walk Central Directory in place displaying entries.
 
-            // Close archive.
+            std::uint64_t entryNumber { 0 };
+            zipFile.forEachEntry([&entryNumber](const ZIPDirectoryEntryView & fileHeader) {
+                dumpCentralDirectoryFileHeader(fileHeader, entryNumber++);
+                return (true);
+            });
 
-            zipFile.closeZIPFile();
+            // Archive is unmapped when the reader goes out of scope.
 
         }
 
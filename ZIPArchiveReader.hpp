@@ -0,0 +1,536 @@
+#ifndef ZIPARCHIVEREADER_HPP
+#define ZIPARCHIVEREADER_HPP
+
+//
+// Header: ZIPArchiveReader
+//
+// Description: ZIP archive reader used by the ZIP example programs. The archive is
+// memory mapped read-only and its central directory is walked in place; entries are
+// returned as lightweight views (names, comments and extra fields refer straight into
+// the mapping and ZIP64 values are already decoded) that are only copied into owning
+// strings if asked. Entries are inflated straight from the mapping and as the mapping
+// is never modified they may be extracted by several threads at the same time. Stored
+// and deflated entries (including ZIP64) are supported.
+//
+// Dependencies: C11++, Linux, zlib.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+//
+// Linux
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+//
+// zlib
+//
+
+#include <zlib.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// Central directory entry details needed for extraction.
+//
+
+struct ZIPArchiveEntry {
+    std::string fileName;                   // Name of entry in archive
+    std::uint16_t bitFlag { 0 };            // General purpose bit flag
+    std::uint16_t compression { 0 };        // Compression method
+    std::uint32_t crc32 { 0 };              // CRC32 of uncompressed data
+    std::uint64_t compressedSize { 0 };     // Compressed size
+    std::uint64_t uncompressedSize { 0 };   // Uncompressed size
+    std::uint64_t fileHeaderOffset { 0 };   // Offset of local file header
+    std::uint32_t externalFileAttrib { 0 }; // External file attributes
+    bool isDirectory() const {
+        return (!fileName.empty() && (fileName.back() == '/'));
+    }
+};
+
+//
+// Central directory file header as a view into the mapped archive. The name,
+// comment and extra field are only valid while the reader exists; sizes and
+// offset hold their ZIP64 values where the 32 bit field overflowed (the raw
+// fields are kept for display).
+//
+
+struct ZIPDirectoryEntryView {
+    std::uint16_t creatorVersion { 0 };
+    std::uint16_t extractorVersion { 0 };
+    std::uint16_t bitFlag { 0 };
+    std::uint16_t compression { 0 };
+    std::uint16_t modificationTime { 0 };
+    std::uint16_t modificationDate { 0 };
+    std::uint32_t crc32 { 0 };
+    std::uint32_t rawCompressedSize { 0 };
+    std::uint32_t rawUncompressedSize { 0 };
+    std::uint16_t diskNoStart { 0 };
+    std::uint16_t internalFileAttrib { 0 };
+    std::uint32_t externalFileAttrib { 0 };
+    std::uint32_t rawFileHeaderOffset { 0 };
+    std::uint64_t compressedSize { 0 };
+    std::uint64_t uncompressedSize { 0 };
+    std::uint64_t fileHeaderOffset { 0 };
+    std::string_view fileName;
+    std::string_view fileComment;
+    std::span<const std::uint8_t> extraField;
+    bool bZip64 { false };
+    ZIPArchiveEntry toEntry() const {
+        ZIPArchiveEntry entry;
+        entry.fileName = fileName;
+        entry.bitFlag = bitFlag;
+        entry.compression = compression;
+        entry.crc32 = crc32;
+        entry.compressedSize = compressedSize;
+        entry.uncompressedSize = uncompressedSize;
+        entry.fileHeaderOffset = fileHeaderOffset;
+        entry.externalFileAttrib = externalFileAttrib;
+        return (entry);
+    }
+};
+
+//
+// End of central directory details (ZIP64 values where present).
+//
+
+struct ZIPEOCentralDirectoryView {
+    std::uint16_t diskNumber { 0 };
+    std::uint16_t startDiskNumber { 0 };
+    std::uint64_t numberOfCentralDirRecords { 0 };
+    std::uint64_t totalCentralDirRecords { 0 };
+    std::uint64_t sizeOfCentralDirRecords { 0 };
+    std::uint64_t offsetCentralDirRecords { 0 };
+    std::string_view comment;
+    bool bZip64 { false };
+};
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// Read central directory of and extract entries from a memory mapped ZIP archive.
+//
+
+class ZIPArchiveReader {
+public:
+
+    //
+    // ZIP record signatures/constants
+    //
+
+    static constexpr std::uint32_t kFileHeaderSignature { 0x04034b50 };
+    static constexpr std::uint32_t kCentralDirectorySignature { 0x02014b50 };
+    static constexpr std::uint32_t kZip64EOCentralDirectorySignature { 0x06064b50 };
+    static constexpr std::uint32_t kZip64EOCentralDirectoryLocatorSignature { 0x07064b50 };
+    static constexpr std::uint32_t kEOCentralDirectorySignature { 0x06054b50 };
+    static constexpr std::uint16_t kZip64ExtraFieldId { 0x0001 };
+    static constexpr std::uint16_t kStored { 0 };
+    static constexpr std::uint16_t kDeflated { 8 };
+    static constexpr std::uint32_t kField32Overflow { 0xFFFFFFFF };
+    static constexpr std::uint16_t kField16Overflow { 0xFFFF };
+    static constexpr std::size_t kFileHeaderSize { 30 };
+    static constexpr std::size_t kCentralDirectoryHeaderSize { 46 };
+    static constexpr std::size_t kEOCentralDirectorySize { 22 };
+    static constexpr std::size_t kZip64EOCentralDirectoryLocatorSize { 20 };
+    static constexpr std::size_t kZip64EOCentralDirectorySize { 56 };
+    static constexpr std::size_t kMaxCommentSize { 0xFFFF };
+    static constexpr std::size_t kInflateBlockSize { 64 * 1024 };
+
+    explicit ZIPArchiveReader(const std::string &zipFileName) : m_zipFileName(zipFileName) {
+
+        int zipFileDescriptor = ::open(zipFileName.c_str(), O_RDONLY);
+        if (zipFileDescriptor == -1) {
+            throw std::runtime_error("Could not open ZIP archive [" + zipFileName + "]");
+        }
+
+        struct stat fileStatus;
+        if (::fstat(zipFileDescriptor, &fileStatus) == -1) {
+            ::close(zipFileDescriptor);
+            throw std::runtime_error("Could not get size of ZIP archive [" + zipFileName + "]");
+        }
+        m_zipFileSize = fileStatus.st_size;
+
+        if (m_zipFileSize < kEOCentralDirectorySize) {
+            ::close(zipFileDescriptor);
+            throw std::runtime_error("[" + zipFileName + "] is not a ZIP archive.");
+        }
+
+        // The mapping stays valid once the descriptor is closed
+
+        void *mapping = ::mmap(nullptr, m_zipFileSize, PROT_READ, MAP_SHARED, zipFileDescriptor, 0);
+        ::close(zipFileDescriptor);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Could not map ZIP archive [" + zipFileName + "]");
+        }
+        m_zipFileMapping = static_cast<const std::uint8_t *> (mapping);
+
+        try {
+            findCentralDirectory();
+        } catch (...) {
+            ::munmap(const_cast<std::uint8_t *> (m_zipFileMapping), m_zipFileSize);
+            throw;
+        }
+
+    }
+
+    ~ZIPArchiveReader() {
+        ::munmap(const_cast<std::uint8_t *> (m_zipFileMapping), m_zipFileSize);
+    }
+
+    ZIPArchiveReader(const ZIPArchiveReader &orig) = delete;
+    ZIPArchiveReader& operator=(const ZIPArchiveReader &orig) = delete;
+
+    //
+    // End of central directory record details.
+    //
+
+    const ZIPEOCentralDirectoryView& endOfCentralDirectory() const {
+        return (m_endOfCentralDirectory);
+    }
+
+    //
+    // Call a function with a view of each central directory entry in turn; nothing
+    // is copied or allocated per entry. Return false from the function to stop.
+    //
+
+    void forEachEntry(const std::function<bool(const ZIPDirectoryEntryView &)> &entryFn) const {
+
+        const std::uint8_t *centralDirectory { m_zipFileMapping + m_endOfCentralDirectory.offsetCentralDirRecords };
+        std::uint64_t centralDirectorySize { m_endOfCentralDirectory.sizeOfCentralDirRecords };
+        std::uint64_t position { 0 };
+        ZIPDirectoryEntryView entryView;
+
+        for (std::uint64_t entryNumber = 0; entryNumber < m_endOfCentralDirectory.numberOfCentralDirRecords; entryNumber++) {
+            position += parseDirectoryEntry(centralDirectory + position, centralDirectorySize - position, entryView);
+            if (!entryFn(entryView)) {
+                break;
+            }
+        }
+
+    }
+
+    //
+    // Return views of all central directory entries.
+    //
+
+    std::vector<ZIPDirectoryEntryView> entryViews() const {
+
+        std::vector<ZIPDirectoryEntryView> entries;
+
+        entries.reserve(m_endOfCentralDirectory.numberOfCentralDirRecords);
+        forEachEntry([&entries](const ZIPDirectoryEntryView & entryView) {
+            entries.push_back(entryView);
+            return (true);
+        });
+
+        return (entries);
+
+    }
+
+    //
+    // Return all central directory entries materialized (owning their names).
+    //
+
+    std::vector<ZIPArchiveEntry> centralDirectory() const {
+
+        std::vector<ZIPArchiveEntry> entries;
+
+        entries.reserve(m_endOfCentralDirectory.numberOfCentralDirRecords);
+        forEachEntry([&entries](const ZIPDirectoryEntryView & entryView) {
+            entries.push_back(entryView.toEntry());
+            return (true);
+        });
+
+        return (entries);
+
+    }
+
+    //
+    // Extract an entry to a file checking its size and CRC. The compressed data is
+    // inflated straight from the mapping so this is safe to call from several threads
+    // at once.
+    //
+
+    void extract(const ZIPArchiveEntry &entry, const std::string &destinationFileName) const {
+
+        if ((entry.compression != kStored) && (entry.compression != kDeflated)) {
+            throw std::runtime_error("Unsupported compression method for [" + entry.fileName + "]");
+        }
+
+        // Data starts after local file header name and extra field
+
+        if (entry.fileHeaderOffset + kFileHeaderSize > m_zipFileSize) {
+            throw std::runtime_error("Invalid local file header for [" + entry.fileName + "]");
+        }
+
+        const std::uint8_t *fileHeader { m_zipFileMapping + entry.fileHeaderOffset };
+        if (getField<std::uint32_t>(fileHeader) != kFileHeaderSignature) {
+            throw std::runtime_error("Invalid local file header for [" + entry.fileName + "]");
+        }
+
+        std::uint64_t dataOffset { entry.fileHeaderOffset + kFileHeaderSize +
+            getField<std::uint16_t>(fileHeader + 26) + getField<std::uint16_t>(fileHeader + 28) };
+        if ((dataOffset > m_zipFileSize) || (entry.compressedSize > m_zipFileSize - dataOffset)) {
+            throw std::runtime_error("Entry data for [" + entry.fileName + "] past end of ZIP archive.");
+        }
+
+        const std::uint8_t *data { m_zipFileMapping + dataOffset };
+
+        std::ofstream destinationStream(destinationFileName, std::ios::binary | std::ios::trunc);
+        if (!destinationStream.is_open()) {
+            throw std::runtime_error("Could not create file [" + destinationFileName + "]");
+        }
+
+        std::uint64_t uncompressedSize { 0 };
+        std::uint32_t crc { 0 };
+
+        if (entry.compression == kStored) {
+
+            for (std::uint64_t position = 0; position < entry.compressedSize; position += kInflateBlockSize) {
+                std::size_t blockSize = std::min<std::uint64_t>(entry.compressedSize - position, kInflateBlockSize);
+                crc = crc32(crc, data + position, blockSize);
+                destinationStream.write(reinterpret_cast<const char *> (data + position), blockSize);
+            }
+            uncompressedSize = entry.compressedSize;
+
+        } else {
+
+            std::vector<char> inflateBuffer(kInflateBlockSize);
+            std::uint64_t bytesLeft { entry.compressedSize };
+            z_stream zlibStream {};
+            int inflateStatus { Z_OK };
+
+            if (inflateInit2(&zlibStream, -MAX_WBITS) != Z_OK) {
+                throw std::runtime_error("Could not initialise inflate for [" + entry.fileName + "]");
+            }
+
+            zlibStream.next_in = const_cast<Bytef *> (data);
+
+            while (inflateStatus != Z_STREAM_END) {
+                if (zlibStream.avail_in == 0) {
+                    if (bytesLeft == 0) break;
+                    zlibStream.avail_in = std::min<std::uint64_t>(bytesLeft, kInflateBlockSize);
+                    bytesLeft -= zlibStream.avail_in;
+                }
+                zlibStream.next_out = reinterpret_cast<Bytef *> (inflateBuffer.data());
+                zlibStream.avail_out = inflateBuffer.size();
+                inflateStatus = inflate(&zlibStream, Z_NO_FLUSH);
+                if ((inflateStatus != Z_OK) && (inflateStatus != Z_STREAM_END)) {
+                    inflateEnd(&zlibStream);
+                    throw std::runtime_error("Error inflating [" + entry.fileName + "]");
+                }
+                std::size_t bytesInflated = inflateBuffer.size() - zlibStream.avail_out;
+                crc = crc32(crc, reinterpret_cast<Bytef *> (inflateBuffer.data()), bytesInflated);
+                uncompressedSize += bytesInflated;
+                destinationStream.write(inflateBuffer.data(), bytesInflated);
+            }
+
+            inflateEnd(&zlibStream);
+
+        }
+
+        destinationStream.close();
+
+        if (!destinationStream) {
+            throw std::runtime_error("Error writing file [" + destinationFileName + "]");
+        }
+        if ((uncompressedSize != entry.uncompressedSize) || (crc != entry.crc32)) {
+            throw std::runtime_error("Size/CRC mismatch extracting [" + entry.fileName + "]");
+        }
+
+    }
+
+    //
+    // Does a 32 bit field hold the ZIP64 overflow marker ?
+    //
+
+    static bool fieldOverflow(std::uint64_t field) {
+        return (field == kField32Overflow);
+    }
+
+private:
+
+    //
+    // Little endian field input
+    //
+
+    template <typename T>
+    static T getField(const std::uint8_t *field) {
+        T value { 0 };
+        for (std::size_t byte = 0; byte < sizeof (T); byte++) {
+            value |= static_cast<T> (field[byte]) << (byte * 8);
+        }
+        return (value);
+    }
+
+    //
+    // Fill in a view of the central directory entry at record and return its length.
+    //
+
+    std::size_t parseDirectoryEntry(const std::uint8_t *record, std::uint64_t bytesLeft, ZIPDirectoryEntryView &entryView) const {
+
+        if ((bytesLeft < kCentralDirectoryHeaderSize) ||
+                (getField<std::uint32_t>(record) != kCentralDirectorySignature)) {
+            throw std::runtime_error("Invalid central directory in ZIP archive [" + m_zipFileName + "]");
+        }
+
+        std::uint16_t fileNameLength { getField<std::uint16_t>(record + 28) };
+        std::uint16_t extraFieldLength { getField<std::uint16_t>(record + 30) };
+        std::uint16_t fileCommentLength { getField<std::uint16_t>(record + 32) };
+        std::size_t recordLength { kCentralDirectoryHeaderSize + fileNameLength + extraFieldLength + fileCommentLength };
+
+        if (recordLength > bytesLeft) {
+            throw std::runtime_error("Invalid central directory in ZIP archive [" + m_zipFileName + "]");
+        }
+
+        entryView.creatorVersion = getField<std::uint16_t>(record + 4);
+        entryView.extractorVersion = getField<std::uint16_t>(record + 6);
+        entryView.bitFlag = getField<std::uint16_t>(record + 8);
+        entryView.compression = getField<std::uint16_t>(record + 10);
+        entryView.modificationTime = getField<std::uint16_t>(record + 12);
+        entryView.modificationDate = getField<std::uint16_t>(record + 14);
+        entryView.crc32 = getField<std::uint32_t>(record + 16);
+        entryView.rawCompressedSize = getField<std::uint32_t>(record + 20);
+        entryView.rawUncompressedSize = getField<std::uint32_t>(record + 24);
+        entryView.diskNoStart = getField<std::uint16_t>(record + 34);
+        entryView.internalFileAttrib = getField<std::uint16_t>(record + 36);
+        entryView.externalFileAttrib = getField<std::uint32_t>(record + 38);
+        entryView.rawFileHeaderOffset = getField<std::uint32_t>(record + 42);
+        entryView.fileName = std::string_view(reinterpret_cast<const char *> (record + kCentralDirectoryHeaderSize), fileNameLength);
+        entryView.extraField = std::span<const std::uint8_t>(record + kCentralDirectoryHeaderSize + fileNameLength, extraFieldLength);
+        entryView.fileComment = std::string_view(reinterpret_cast<const char *> (record + kCentralDirectoryHeaderSize +
+                                                 fileNameLength + extraFieldLength), fileCommentLength);
+
+        entryView.compressedSize = entryView.rawCompressedSize;
+        entryView.uncompressedSize = entryView.rawUncompressedSize;
+        entryView.fileHeaderOffset = entryView.rawFileHeaderOffset;
+        entryView.bZip64 = fieldOverflow(entryView.compressedSize) || fieldOverflow(entryView.uncompressedSize) ||
+                fieldOverflow(entryView.fileHeaderOffset);
+
+        if (entryView.bZip64) {
+            decodeZip64ExtraField(entryView.extraField, entryView.uncompressedSize, entryView.compressedSize,
+                                  entryView.fileHeaderOffset);
+        }
+
+        return (recordLength);
+
+    }
+
+    //
+    // Replace any overflowed fields with their values from a ZIP64 extra field.
+    //
+
+    static void decodeZip64ExtraField(std::span<const std::uint8_t> extraField, std::uint64_t &uncompressedSize,
+                                      std::uint64_t &compressedSize, std::uint64_t &fileHeaderOffset) {
+
+        std::size_t position { 0 };
+
+        while (position + 4 <= extraField.size()) {
+            std::uint16_t fieldId { getField<std::uint16_t>(&extraField[position]) };
+            std::uint16_t fieldSize { getField<std::uint16_t>(&extraField[position + 2]) };
+            if (position + 4 + fieldSize > extraField.size()) {
+                break;
+            }
+            if (fieldId == kZip64ExtraFieldId) {
+                const std::uint8_t *field = &extraField[position + 4];
+                std::size_t fieldPosition { 0 };
+                for (auto value : { &uncompressedSize, &compressedSize, &fileHeaderOffset }) {
+                    if (fieldOverflow(*value) && (fieldPosition + 8 <= fieldSize)) {
+                        *value = getField<std::uint64_t>(field + fieldPosition);
+                        fieldPosition += 8;
+                    }
+                }
+                break;
+            }
+            position += 4 + fieldSize;
+        }
+
+    }
+
+    //
+    // Locate central directory from the (ZIP64) end of central directory record.
+    //
+
+    void findCentralDirectory() {
+
+        std::uint64_t searchStart { m_zipFileSize - std::min<std::uint64_t>(m_zipFileSize, kEOCentralDirectorySize + kMaxCommentSize) };
+        std::uint64_t recordPosition { m_zipFileSize - kEOCentralDirectorySize + 1 };
+
+        do {
+            if (recordPosition-- == searchStart) {
+                throw std::runtime_error("[" + m_zipFileName + "] is not a ZIP archive.");
+            }
+        } while (getField<std::uint32_t>(m_zipFileMapping + recordPosition) != kEOCentralDirectorySignature);
+
+        const std::uint8_t *record { m_zipFileMapping + recordPosition };
+        std::uint16_t commentLength { getField<std::uint16_t>(record + 20) };
+
+        m_endOfCentralDirectory.diskNumber = getField<std::uint16_t>(record + 4);
+        m_endOfCentralDirectory.startDiskNumber = getField<std::uint16_t>(record + 6);
+        m_endOfCentralDirectory.numberOfCentralDirRecords = getField<std::uint16_t>(record + 8);
+        m_endOfCentralDirectory.totalCentralDirRecords = getField<std::uint16_t>(record + 10);
+        m_endOfCentralDirectory.sizeOfCentralDirRecords = getField<std::uint32_t>(record + 12);
+        m_endOfCentralDirectory.offsetCentralDirRecords = getField<std::uint32_t>(record + 16);
+        m_endOfCentralDirectory.comment = std::string_view(reinterpret_cast<const char *> (record + kEOCentralDirectorySize),
+                std::min<std::uint64_t>(commentLength, m_zipFileSize - recordPosition - kEOCentralDirectorySize));
+
+        // ZIP64 end of central directory record
+
+        if ((m_endOfCentralDirectory.totalCentralDirRecords == kField16Overflow) ||
+                fieldOverflow(m_endOfCentralDirectory.sizeOfCentralDirRecords) ||
+                fieldOverflow(m_endOfCentralDirectory.offsetCentralDirRecords)) {
+            if (recordPosition < kZip64EOCentralDirectoryLocatorSize) {
+                throw std::runtime_error("Missing ZIP64 records in ZIP archive [" + m_zipFileName + "]");
+            }
+            const std::uint8_t *locator { record - kZip64EOCentralDirectoryLocatorSize };
+            std::uint64_t zip64RecordOffset { getField<std::uint64_t>(locator + 8) };
+            if ((getField<std::uint32_t>(locator) != kZip64EOCentralDirectoryLocatorSignature) ||
+                    (zip64RecordOffset + kZip64EOCentralDirectorySize > m_zipFileSize) ||
+                    (getField<std::uint32_t>(m_zipFileMapping + zip64RecordOffset) != kZip64EOCentralDirectorySignature)) {
+                throw std::runtime_error("Missing ZIP64 records in ZIP archive [" + m_zipFileName + "]");
+            }
+            const std::uint8_t *zip64Record { m_zipFileMapping + zip64RecordOffset };
+            m_endOfCentralDirectory.numberOfCentralDirRecords = getField<std::uint64_t>(zip64Record + 24);
+            m_endOfCentralDirectory.totalCentralDirRecords = getField<std::uint64_t>(zip64Record + 32);
+            m_endOfCentralDirectory.sizeOfCentralDirRecords = getField<std::uint64_t>(zip64Record + 40);
+            m_endOfCentralDirectory.offsetCentralDirRecords = getField<std::uint64_t>(zip64Record + 48);
+            m_endOfCentralDirectory.bZip64 = true;
+        }
+
+        if ((m_endOfCentralDirectory.offsetCentralDirRecords > m_zipFileSize) ||
+                (m_endOfCentralDirectory.sizeOfCentralDirRecords > m_zipFileSize - m_endOfCentralDirectory.offsetCentralDirRecords)) {
+            throw std::runtime_error("Invalid central directory in ZIP archive [" + m_zipFileName + "]");
+        }
+
+    }
+
+    std::string m_zipFileName;                          // ZIP archive name
+    const std::uint8_t *m_zipFileMapping { nullptr };   // Read-only archive mapping
+    std::uint64_t m_zipFileSize { 0 };                  // Archive size
+    ZIPEOCentralDirectoryView m_endOfCentralDirectory;  // End of central directory details
+
+};
+
+#endif /* ZIPARCHIVEREADER_HPP */
@@ -0,0 +1,637 @@
+#ifndef ZIPARCHIVEWRITER_HPP
+#define ZIPARCHIVEWRITER_HPP
+
+//
+// Header: ZIPArchiveWriter
+//
+// Description: Sequential ZIP archive writer used by the ZIP example programs. It never
+// seeks so the archive may be sent to any sink (file, pipe, socket or callback). An
+// entry is either added already compressed in memory (its sizes and CRC are then in
+// the local file header) or compressed on the fly straight to the sink in blocks, with
+// the sizes and CRC following the data in a data descriptor (general purpose bit flag
+// bit 3). ZIP64 extra fields and end of central directory records are written as
+// needed.
+//
+// A large file may also be deflated in independent chunks (as pigz does) so that
+// several threads can compress it: each chunk is primed with the 32K of file data
+// before it and ends on a byte boundary with a sync flush so the chunks written one
+// after the other form a single deflate stream; their CRCs are combined.
+//
+// An entry compressed whole is deflated unless that does not reduce its size in which
+// case it is stored. A streamed or chunked entry is always deflated as the method goes
+// in its header before any data; any block (or chunk) that does not shrink goes out as
+// a stored deflate block so the entry is at most a few bytes per 64K larger than stored.
+//
+// Dependencies: C11++, Linux, zlib.
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <filesystem>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+
+//
+// Linux
+//
+
+#include <unistd.h>
+
+//
+// zlib
+//
+
+#include <zlib.h>
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+//
+// Archive output sink
+//
+
+typedef std::function<void(const char *, std::size_t)> ZIPSinkFn;
+
+//
+// Archive entry compressed into memory ready to be written.
+//
+
+struct ZIPCompressedEntry {
+    std::string entryName;                     // Name of entry in archive
+    std::uint16_t compression { 0 };           // Compression method (0 stored, 8 deflated)
+    std::uint32_t crc32 { 0 };                 // CRC32 of uncompressed data
+    std::uint64_t uncompressedSize { 0 };      // Uncompressed size
+    std::uint16_t modificationTime { 0 };      // MSDOS modification time
+    std::uint16_t modificationDate { 0 };      // MSDOS modification date
+    std::uint32_t externalFileAttrib { 0 };    // Unix file mode (high 16 bits)
+    std::vector<char> data;                    // Stored/compressed data
+};
+
+//
+// Independently deflated chunk of a file (see ZIPArchiveWriter::deflateChunk()).
+//
+
+struct ZIPDeflatedChunk {
+    std::uint32_t crc32 { 0 };                 // CRC32 of chunk data
+    std::uint64_t uncompressedSize { 0 };      // Chunk data size
+    std::vector<char> data;                    // Deflated chunk
+};
+
+// ================
+// PUBLIC FUNCTIONS
+// ================
+
+//
+// Write ZIP archive records to a sink.
+//
+
+class ZIPArchiveWriter {
+public:
+
+    //
+    // ZIP record signatures/constants
+    //
+
+    static constexpr std::uint32_t kFileHeaderSignature { 0x04034b50 };
+    static constexpr std::uint32_t kDataDescriptorSignature { 0x08074b50 };
+    static constexpr std::uint32_t kCentralDirectorySignature { 0x02014b50 };
+    static constexpr std::uint32_t kZip64EOCentralDirectorySignature { 0x06064b50 };
+    static constexpr std::uint32_t kZip64EOCentralDirectoryLocatorSignature { 0x07064b50 };
+    static constexpr std::uint32_t kEOCentralDirectorySignature { 0x06054b50 };
+    static constexpr std::uint16_t kZip64ExtraFieldId { 0x0001 };
+    static constexpr std::uint16_t kZIPVersion20 { 20 };
+    static constexpr std::uint16_t kZIPVersion45 { 45 };
+    static constexpr std::uint16_t kZIPCreatorUnix { 3 << 8 };
+    static constexpr std::uint16_t kDataDescriptorFlag { 0x0008 };
+    static constexpr std::uint16_t kStored { 0 };
+    static constexpr std::uint16_t kDeflated { 8 };
+    static constexpr std::uint32_t kField32Overflow { 0xFFFFFFFF };
+    static constexpr std::uint16_t kField16Overflow { 0xFFFF };
+    static constexpr std::size_t kStreamBlockSize { 64 * 1024 };
+    static constexpr std::size_t kChunkSize { 1024 * 1024 };
+    static constexpr std::size_t kDictionarySize { 32 * 1024 };
+
+    explicit ZIPArchiveWriter(ZIPSinkFn sink) : m_sink(std::move(sink)) {
+    }
+
+    ZIPArchiveWriter(const ZIPArchiveWriter &orig) = delete;
+    ZIPArchiveWriter& operator=(const ZIPArchiveWriter &orig) = delete;
+
+    //
+    // Add entry already compressed into memory.
+    //
+
+    void add(const ZIPCompressedEntry &entry) {
+
+        CentralDirectoryEntry directoryEntry { entryDetails(entry) };
+        directoryEntry.compressedSize = entry.data.size();
+        directoryEntry.uncompressedSize = entry.uncompressedSize;
+        directoryEntry.crc32 = entry.crc32;
+        directoryEntry.bZip64 = fieldOverflow(directoryEntry.compressedSize) || fieldOverflow(directoryEntry.uncompressedSize);
+
+        writeFileHeader(directoryEntry);
+        write(entry.data.data(), entry.data.size());
+
+        m_centralDirectory.push_back(directoryEntry);
+
+    }
+
+    //
+    // Add a file compressing it in blocks straight to the sink; its sizes and CRC are
+    // written in a data descriptor after the data. A file of one block is compressed
+    // whole (and stored if it does not shrink); a larger one is always deflated.
+    //
+
+    void addStreamed(const std::string &fileName, const std::string &entryName) {
+
+        std::uint64_t fileSize { std::filesystem::file_size(fileName) };
+
+        if (fileSize <= kStreamBlockSize) {
+            add(compressFile(fileName, entryName));
+            return;
+        }
+
+        std::ifstream fileStream(fileName, std::ios::binary);
+        if (!fileStream.is_open()) {
+            throw std::runtime_error("Could not open file [" + fileName + "]");
+        }
+
+        ZIPCompressedEntry entry;
+        setEntryDetails(entry, fileName, entryName);
+        entry.compression = kDeflated;
+
+        std::vector<char> readBuffer(kStreamBlockSize);
+        std::vector<char> compressedBuffer(deflateBound(nullptr, kStreamBlockSize) + 64);
+        z_stream zlibStream {};
+
+        CentralDirectoryEntry directoryEntry { entryDetails(entry) };
+        directoryEntry.bitFlag |= kDataDescriptorFlag;
+        directoryEntry.bZip64 = streamedZip64(fileSize);
+
+        writeFileHeader(directoryEntry);
+
+        if (deflateInit2(&zlibStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Could not initialise deflate for [" + fileName + "]");
+        }
+
+        do {
+
+            fileStream.read(readBuffer.data(), readBuffer.size());
+            std::size_t bytesRead = fileStream.gcount();
+            bool bLastBlock = (bytesRead < readBuffer.size());
+
+            directoryEntry.crc32 = crc32(directoryEntry.crc32, reinterpret_cast<Bytef *> (readBuffer.data()), bytesRead);
+            directoryEntry.uncompressedSize += bytesRead;
+
+            zlibStream.next_in = reinterpret_cast<Bytef *> (readBuffer.data());
+            zlibStream.avail_in = bytesRead;
+            do {
+                zlibStream.next_out = reinterpret_cast<Bytef *> (compressedBuffer.data());
+                zlibStream.avail_out = compressedBuffer.size();
+                deflate(&zlibStream, bLastBlock ? Z_FINISH : Z_NO_FLUSH);
+                std::size_t compressedBytes = compressedBuffer.size() - zlibStream.avail_out;
+                write(compressedBuffer.data(), compressedBytes);
+                directoryEntry.compressedSize += compressedBytes;
+            } while (zlibStream.avail_out == 0);
+
+            if (bLastBlock) break;
+
+        } while (true);
+
+        deflateEnd(&zlibStream);
+
+        writeDataDescriptor(directoryEntry);
+
+        m_centralDirectory.push_back(directoryEntry);
+
+    }
+
+    //
+    // Start an entry for a file whose deflated chunks (deflateChunk()) are then passed
+    // in file order to addChunk(); endChunked() finishes the entry.
+    //
+
+    void beginChunked(const std::string &fileName, const std::string &entryName) {
+
+        ZIPCompressedEntry entry;
+        setEntryDetails(entry, fileName, entryName);
+        entry.compression = kDeflated;
+
+        m_chunkedEntry = entryDetails(entry);
+        m_chunkedEntry.bitFlag |= kDataDescriptorFlag;
+        m_chunkedEntry.bZip64 = streamedZip64(std::filesystem::file_size(fileName));
+
+        writeFileHeader(m_chunkedEntry);
+
+    }
+
+    void addChunk(const ZIPDeflatedChunk &chunk) {
+        write(chunk.data.data(), chunk.data.size());
+        m_chunkedEntry.crc32 = crc32_combine(m_chunkedEntry.crc32, chunk.crc32, chunk.uncompressedSize);
+        m_chunkedEntry.compressedSize += chunk.data.size();
+        m_chunkedEntry.uncompressedSize += chunk.uncompressedSize;
+    }
+
+    void endChunked() {
+        writeDataDescriptor(m_chunkedEntry);
+        m_centralDirectory.push_back(m_chunkedEntry);
+    }
+
+    //
+    // Write central directory and end of central directory records.
+    //
+
+    void close() {
+
+        std::uint64_t centralDirectoryOffset { m_offset };
+
+        for (auto &directoryEntry : m_centralDirectory) {
+            writeCentralDirectoryEntry(directoryEntry);
+        }
+
+        std::uint64_t centralDirectorySize { m_offset - centralDirectoryOffset };
+        std::uint64_t numberOfEntries { m_centralDirectory.size() };
+        std::string record;
+
+        if (fieldOverflow(centralDirectoryOffset) || fieldOverflow(centralDirectorySize) ||
+                (numberOfEntries >= kField16Overflow)) {
+
+            std::uint64_t zip64EOCentralDirectoryOffset { m_offset };
+
+            putField(record, kZip64EOCentralDirectorySignature);
+            putField(record, static_cast<std::uint64_t> (44));
+            putField(record, static_cast<std::uint16_t> (kZIPCreatorUnix | kZIPVersion45));
+            putField(record, kZIPVersion45);
+            putField(record, static_cast<std::uint32_t> (0));
+            putField(record, static_cast<std::uint32_t> (0));
+            putField(record, numberOfEntries);
+            putField(record, numberOfEntries);
+            putField(record, centralDirectorySize);
+            putField(record, centralDirectoryOffset);
+
+            putField(record, kZip64EOCentralDirectoryLocatorSignature);
+            putField(record, static_cast<std::uint32_t> (0));
+            putField(record, zip64EOCentralDirectoryOffset);
+            putField(record, static_cast<std::uint32_t> (1));
+
+        }
+
+        putField(record, kEOCentralDirectorySignature);
+        putField(record, static_cast<std::uint16_t> (0));
+        putField(record, static_cast<std::uint16_t> (0));
+        putField(record, static_cast<std::uint16_t> (std::min<std::uint64_t>(numberOfEntries, kField16Overflow)));
+        putField(record, static_cast<std::uint16_t> (std::min<std::uint64_t>(numberOfEntries, kField16Overflow)));
+        putField(record, static_cast<std::uint32_t> (std::min<std::uint64_t>(centralDirectorySize, kField32Overflow)));
+        putField(record, static_cast<std::uint32_t> (std::min<std::uint64_t>(centralDirectoryOffset, kField32Overflow)));
+        putField(record, static_cast<std::uint16_t> (0));
+
+        write(record.data(), record.size());
+
+        m_centralDirectory.clear();
+
+    }
+
+    //
+    // Return a sink that writes to a file descriptor (for example a pipe or socket).
+    //
+
+    static ZIPSinkFn fileDescriptorSink(int fileDescriptor) {
+        return [fileDescriptor](const char *data, std::size_t size) {
+            while (size) {
+                ssize_t bytesWritten = ::write(fileDescriptor, data, size);
+                if (bytesWritten < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error("Error writing ZIP archive to file descriptor.");
+                }
+                data += bytesWritten;
+                size -= bytesWritten;
+            }
+        };
+    }
+
+    //
+    // Bytes written to sink so far.
+    //
+
+    std::uint64_t bytesWritten() const {
+        return (m_offset);
+    }
+
+    //
+    // Fill in the name, times and attributes of an entry for a given file.
+    //
+
+    static void setEntryDetails(ZIPCompressedEntry &entry, const std::string &fileName, const std::string &entryName) {
+
+        auto lastWriteTime = std::chrono::system_clock::to_time_t(
+                std::chrono::file_clock::to_sys(std::filesystem::last_write_time(fileName)));
+        std::tm localTime {};
+
+        localtime_r(&lastWriteTime, &localTime);
+
+        entry.entryName = entryName;
+        entry.modificationTime = (localTime.tm_hour << 11) | (localTime.tm_min << 5) | (localTime.tm_sec / 2);
+        entry.modificationDate = ((localTime.tm_year - 80) << 9) | ((localTime.tm_mon + 1) << 5) | localTime.tm_mday;
+        entry.externalFileAttrib = (static_cast<std::uint32_t> (std::filesystem::status(fileName).permissions()) | 0100000) << 16;
+
+    }
+
+    //
+    // Number of chunks a file of a given size is deflated in by deflateChunk().
+    //
+
+    static std::uint64_t chunkCount(std::uint64_t fileSize) {
+        return (std::max<std::uint64_t>(1, (fileSize + kChunkSize - 1) / kChunkSize));
+    }
+
+    //
+    // Deflate chunk number chunkIndex (of kChunkSize bytes) of a file independently of
+    // the others. The chunk is primed with the data before it and ends with a sync flush
+    // (the last with the final block); a chunk that does not shrink is written as stored
+    // deflate blocks.
+    //
+
+    static ZIPDeflatedChunk deflateChunk(const std::string &fileName, std::uint64_t chunkIndex, bool bLastChunk) {
+
+        std::ifstream fileStream(fileName, std::ios::binary);
+        if (!fileStream.is_open()) {
+            throw std::runtime_error("Could not open file [" + fileName + "]");
+        }
+
+        std::uint64_t chunkOffset { chunkIndex * kChunkSize };
+        std::size_t dictionarySize { static_cast<std::size_t> (std::min<std::uint64_t>(chunkOffset, kDictionarySize)) };
+        std::vector<char> chunkData(dictionarySize + kChunkSize);
+
+        fileStream.seekg(chunkOffset - dictionarySize);
+        fileStream.read(chunkData.data(), chunkData.size());
+        if (static_cast<std::size_t> (fileStream.gcount()) < dictionarySize) {
+            throw std::runtime_error("File [" + fileName + "] changed while being archived.");
+        }
+
+        ZIPDeflatedChunk chunk;
+        const Bytef *dictionary { reinterpret_cast<Bytef *> (chunkData.data()) };
+        Bytef *data { reinterpret_cast<Bytef *> (chunkData.data()) + dictionarySize };
+
+        chunk.uncompressedSize = fileStream.gcount() - dictionarySize;
+        chunk.crc32 = crc32(0, data, chunk.uncompressedSize);
+
+        for (int level : { Z_DEFAULT_COMPRESSION, Z_NO_COMPRESSION }) {
+            z_stream zlibStream {};
+            if (deflateInit2(&zlibStream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("Could not initialise deflate for [" + fileName + "]");
+            }
+            if (dictionarySize && (level != Z_NO_COMPRESSION)) {
+                deflateSetDictionary(&zlibStream, dictionary, dictionarySize);
+            }
+            chunk.data.resize(deflateBound(&zlibStream, chunk.uncompressedSize) + 16);
+            zlibStream.next_in = data;
+            zlibStream.avail_in = chunk.uncompressedSize;
+            zlibStream.next_out = reinterpret_cast<Bytef *> (chunk.data.data());
+            zlibStream.avail_out = chunk.data.size();
+            int result = deflate(&zlibStream, bLastChunk ? Z_FINISH : Z_SYNC_FLUSH);
+            chunk.data.resize(zlibStream.total_out);
+            deflateEnd(&zlibStream);
+            if ((bLastChunk && (result != Z_STREAM_END)) || (!bLastChunk && ((result != Z_OK) || zlibStream.avail_in))) {
+                throw std::runtime_error("Could not deflate chunk of [" + fileName + "]");
+            }
+            if (chunk.data.size() < chunk.uncompressedSize) {
+                break;
+            }
+        }
+
+        return (chunk);
+
+    }
+
+    //
+    // Read a file and compress it into memory; if deflate does not make it smaller the
+    // file is stored instead.
+    //
+
+    static ZIPCompressedEntry compressFile(const std::string &fileName, const std::string &entryName) {
+
+        ZIPCompressedEntry entry;
+        std::ifstream fileStream(fileName, std::ios::binary);
+
+        if (!fileStream.is_open()) {
+            throw std::runtime_error("Could not open file [" + fileName + "]");
+        }
+
+        setEntryDetails(entry, fileName, entryName);
+
+        std::vector<char> fileData(std::filesystem::file_size(fileName));
+        fileStream.read(fileData.data(), fileData.size());
+        fileData.resize(fileStream.gcount());
+
+        entry.uncompressedSize = fileData.size();
+        entry.crc32 = crc32(0, reinterpret_cast<Bytef *> (fileData.data()), fileData.size());
+
+        uLongf compressedSize = compressBound(fileData.size());
+        std::vector<char> compressedData(compressedSize);
+        z_stream zlibStream {};
+
+        if (deflateInit2(&zlibStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Could not initialise deflate for [" + fileName + "]");
+        }
+        zlibStream.next_in = reinterpret_cast<Bytef *> (fileData.data());
+        zlibStream.avail_in = fileData.size();
+        zlibStream.next_out = reinterpret_cast<Bytef *> (compressedData.data());
+        zlibStream.avail_out = compressedData.size();
+        deflate(&zlibStream, Z_FINISH);
+        compressedSize = zlibStream.total_out;
+        deflateEnd(&zlibStream);
+
+        if (compressedSize < fileData.size()) {
+            compressedData.resize(compressedSize);
+            entry.compression = kDeflated;
+            entry.data = std::move(compressedData);
+        } else {
+            entry.compression = kStored;
+            entry.data = std::move(fileData);
+        }
+
+        return (entry);
+
+    }
+
+private:
+
+    //
+    // Central directory details kept for each entry written.
+    //
+
+    struct CentralDirectoryEntry {
+        std::string fileName;
+        std::uint16_t bitFlag { 0 };
+        std::uint16_t compression { 0 };
+        std::uint16_t modificationTime { 0 };
+        std::uint16_t modificationDate { 0 };
+        std::uint32_t crc32 { 0 };
+        std::uint64_t compressedSize { 0 };
+        std::uint64_t uncompressedSize { 0 };
+        std::uint32_t externalFileAttrib { 0 };
+        std::uint64_t fileHeaderOffset { 0 };
+        bool bZip64 { false };
+    };
+
+    //
+    // Little endian field output
+    //
+
+    template <typename T>
+    static void putField(std::string &record, T field) {
+        for (std::size_t byte = 0; byte < sizeof (T); byte++) {
+            record.push_back(static_cast<char> ((field >> (byte * 8)) & 0xFF));
+        }
+    }
+
+    static bool fieldOverflow(std::uint64_t field) {
+        return (field >= kField32Overflow);
+    }
+
+    //
+    // Could a deflated entry (sizes not known up front) of a given file size need ZIP64
+    // sizes ? Allows for stored block and chunk overheads.
+    //
+
+    static bool streamedZip64(std::uint64_t fileSize) {
+        return (fileSize >= (kField32Overflow - (fileSize / 1000) - kStreamBlockSize));
+    }
+
+    CentralDirectoryEntry entryDetails(const ZIPCompressedEntry &entry) const {
+        CentralDirectoryEntry directoryEntry;
+        directoryEntry.fileName = entry.entryName;
+        directoryEntry.compression = entry.compression;
+        directoryEntry.modificationTime = entry.modificationTime;
+        directoryEntry.modificationDate = entry.modificationDate;
+        directoryEntry.externalFileAttrib = entry.externalFileAttrib;
+        directoryEntry.fileHeaderOffset = m_offset;
+        return (directoryEntry);
+    }
+
+    void write(const char *data, std::size_t size) {
+        if (size) {
+            m_sink(data, size);
+            m_offset += size;
+        }
+    }
+
+    //
+    // Data descriptor following a streamed entry (ZIP64 sizes are 8 bytes)
+    //
+
+    void writeDataDescriptor(const CentralDirectoryEntry &directoryEntry) {
+
+        std::string descriptor;
+        putField(descriptor, kDataDescriptorSignature);
+        putField(descriptor, directoryEntry.crc32);
+        if (directoryEntry.bZip64) {
+            putField(descriptor, directoryEntry.compressedSize);
+            putField(descriptor, directoryEntry.uncompressedSize);
+        } else {
+            putField(descriptor, static_cast<std::uint32_t> (directoryEntry.compressedSize));
+            putField(descriptor, static_cast<std::uint32_t> (directoryEntry.uncompressedSize));
+        }
+        write(descriptor.data(), descriptor.size());
+
+    }
+
+    void writeFileHeader(const CentralDirectoryEntry &directoryEntry) {
+
+        std::string record;
+        bool bDescriptor = directoryEntry.bitFlag & kDataDescriptorFlag;
+
+        putField(record, kFileHeaderSignature);
+        putField(record, directoryEntry.bZip64 ? kZIPVersion45 : kZIPVersion20);
+        putField(record, directoryEntry.bitFlag);
+        putField(record, directoryEntry.compression);
+        putField(record, directoryEntry.modificationTime);
+        putField(record, directoryEntry.modificationDate);
+        putField(record, bDescriptor ? 0 : directoryEntry.crc32);
+        if (directoryEntry.bZip64) {
+            putField(record, kField32Overflow);
+            putField(record, kField32Overflow);
+        } else {
+            putField(record, static_cast<std::uint32_t> (bDescriptor ? 0 : directoryEntry.compressedSize));
+            putField(record, static_cast<std::uint32_t> (bDescriptor ? 0 : directoryEntry.uncompressedSize));
+        }
+        putField(record, static_cast<std::uint16_t> (directoryEntry.fileName.size()));
+        putField(record, static_cast<std::uint16_t> (directoryEntry.bZip64 ? 20 : 0));
+        record += directoryEntry.fileName;
+        if (directoryEntry.bZip64) {
+            putField(record, kZip64ExtraFieldId);
+            putField(record, static_cast<std::uint16_t> (16));
+            putField(record, static_cast<std::uint64_t> (bDescriptor ? 0 : directoryEntry.uncompressedSize));
+            putField(record, static_cast<std::uint64_t> (bDescriptor ? 0 : directoryEntry.compressedSize));
+        }
+
+        write(record.data(), record.size());
+
+    }
+
+    void writeCentralDirectoryEntry(const CentralDirectoryEntry &directoryEntry) {
+
+        std::string record, extraField;
+
+        if (fieldOverflow(directoryEntry.uncompressedSize)) {
+            putField(extraField, directoryEntry.uncompressedSize);
+        }
+        if (fieldOverflow(directoryEntry.compressedSize)) {
+            putField(extraField, directoryEntry.compressedSize);
+        }
+        if (fieldOverflow(directoryEntry.fileHeaderOffset)) {
+            putField(extraField, directoryEntry.fileHeaderOffset);
+        }
+
+        bool bZip64 = !extraField.empty() || directoryEntry.bZip64;
+
+        putField(record, kCentralDirectorySignature);
+        putField(record, static_cast<std::uint16_t> (kZIPCreatorUnix | (bZip64 ? kZIPVersion45 : kZIPVersion20)));
+        putField(record, bZip64 ? kZIPVersion45 : kZIPVersion20);
+        putField(record, directoryEntry.bitFlag);
+        putField(record, directoryEntry.compression);
+        putField(record, directoryEntry.modificationTime);
+        putField(record, directoryEntry.modificationDate);
+        putField(record, directoryEntry.crc32);
+        putField(record, static_cast<std::uint32_t> (std::min<std::uint64_t>(directoryEntry.compressedSize, kField32Overflow)));
+        putField(record, static_cast<std::uint32_t> (std::min<std::uint64_t>(directoryEntry.uncompressedSize, kField32Overflow)));
+        putField(record, static_cast<std::uint16_t> (directoryEntry.fileName.size()));
+        putField(record, static_cast<std::uint16_t> (extraField.empty() ? 0 : extraField.size() + 4));
+        putField(record, static_cast<std::uint16_t> (0));
+        putField(record, static_cast<std::uint16_t> (0));
+        putField(record, static_cast<std::uint16_t> (0));
+        putField(record, directoryEntry.externalFileAttrib);
+        putField(record, static_cast<std::uint32_t> (std::min<std::uint64_t>(directoryEntry.fileHeaderOffset, kField32Overflow)));
+        record += directoryEntry.fileName;
+        if (!extraField.empty()) {
+            putField(record, kZip64ExtraFieldId);
+            putField(record, static_cast<std::uint16_t> (extraField.size()));
+            record += extraField;
+        }
+
+        write(record.data(), record.size());
+
+    }
+
+    ZIPSinkFn m_sink;                                 // Archive output
+    std::uint64_t m_offset { 0 };                     // Current offset in archive
+    std::vector<CentralDirectoryEntry> m_centralDirectory; // Entries written so far
+    CentralDirectoryEntry m_chunkedEntry;             // Chunked entry being written
+
+};
+
+#endif /* ZIPARCHIVEWRITER_HPP */
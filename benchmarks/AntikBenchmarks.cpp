@@ -0,0 +1,923 @@
+//
+// Program: AntikBenchmarks
+//
+// Description: Benchmarks for the Antik library paths the example programs spend
+// their time in (ZIP add/extract and central directory reads, base64, MIME encoded
+// word decoding and IMAP response/body structure parsing) along with the local
+// replacements for some of them. All input is synthetic and generated from a fixed
+// seed (the IMAP responses are generated FETCH responses around hand written body
+// structures, not captured server traffic) so runs are reproducible; each benchmark
+// is run once to warm up and then timed for a number of iterations. Results are written as JSON
+// (to stdout or a file) for tracking in CI; progress goes to stderr.
+//
+// Dependencies: C11++, Classes (CZIP, CZIPIO, CSMTP, CMIME, CIMAPParse, CIMAPBodyStruct),
+//               Boost C++ Libraries, Linux, zlib.
+//
+// AntikBenchmarks
+// Program Options:
+//   --help                 Print help messages
+//   -i [ --iterations ] arg (=5) Timed iterations of each benchmark
+//   -f [ --filter ] arg    Only run benchmarks whose name contains this
+//   -o [ --output ] arg    JSON results file (default stdout)
+//   -w [ --work ] arg      Directory under which generated corpora are created
+//   -s [ --scale ] arg (=1) Corpus size multiplier
+//   -l [ --list ]          List benchmark names and exit
+//
+
+// =============
+// INCLUDE FILES
+// =============
+
+//
+// C++ STL
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+//
+// Linux
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//
+// zlib
+//
+
+#include <zlib.h>
+
+//
+// Antik Classes
+//
+
+#include "CZIP.hpp"
+#include "CZIPIO.hpp"
+#include "CSMTP.hpp"
+#include "CMIME.hpp"
+#include "CIMAPParse.hpp"
+#include "CIMAPBodyStruct.hpp"
+#include "Base64Codec.hpp"
+#include "ZIPArchiveReader.hpp"
+#include "ZIPArchiveWriter.hpp"
+
+using namespace Antik::ZIP;
+using namespace Antik::SMTP;
+using namespace Antik::IMAP;
+using namespace Antik::File;
+
+//
+// Boost program options library
+//
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+// ======================
+// LOCAL TYES/DEFINITIONS
+// ======================
+
+// Command line parameter data
+
+struct ParamArgData {
+    int iterations { 5 };        // Timed iterations of each benchmark
+    std::string filter;          // Benchmark name filter
+    std::string outputFileName;  // JSON results file
+    std::string workDirectory;   // Scratch directory for generated corpora
+    int scale { 1 };             // Corpus size multiplier
+    bool bList { false };        // == true list benchmarks
+};
+
+//
+// Work done by one run of a benchmark (items processed and bytes in).
+//
+
+struct BenchmarkWork {
+    std::uint64_t items { 0 };
+    std::uint64_t bytes { 0 };
+};
+
+typedef std::function<BenchmarkWork()> BenchmarkRunFn;
+
+//
+// Benchmark; setup generates its input (untimed) and returns the run to time.
+//
+
+struct Benchmark {
+    std::string name;                                                  // Benchmark name
+    std::function<BenchmarkRunFn(const ParamArgData &, std::mt19937 &)> setupFn; // Setup
+};
+
+//
+// Timings of a benchmark.
+//
+
+struct BenchmarkResult {
+    std::string name;             // Benchmark name
+    BenchmarkWork work;           // Work done per run
+    std::vector<double> seconds;  // Time of each run
+};
+
+//
+// Seed for generated corpora (never change it or results are not comparable)
+//
+
+constexpr std::uint32_t kCorpusSeed { 0x416e7469 };
+
+//
+// Corpus sizes (before scaling)
+//
+
+constexpr int kZIPTextFiles { 64 };                        // Compressible files in ZIP corpus
+constexpr int kZIPBinaryFiles { 16 };                      // Incompressible files in ZIP corpus
+constexpr std::size_t kZIPTextFileSize { 128 * 1024 };     // Size of text file
+constexpr std::size_t kZIPBinaryFileSize { 256 * 1024 };   // Size of binary file
+constexpr int kCentralDirectoryEntries { 20000 };          // Entries in large central directory
+constexpr std::size_t kBase64DataSize { 8 * 1024 * 1024 }; // Data encoded/decoded
+constexpr std::size_t kBase64BlockSize { 64 * 1024 };      // Streaming codec block size
+constexpr int kMIMESubjectRepeat { 20000 };                // Passes over MIME subjects
+constexpr int kFetchMessages { 500 };                      // Messages in FETCH response
+constexpr int kFetchBodyMessages { 50 };                   // Messages in FETCH BODY[] response
+constexpr std::size_t kFetchBodySize { 32 * 1024 };        // Size of each message body
+constexpr int kSearchResults { 20000 };                    // Indexes in SEARCH response
+constexpr int kListMailBoxes { 2000 };                     // Mailboxes in LIST response
+constexpr int kBodyStructRepeat { 2000 };                  // Passes over body structures
+
+//
+// Encoded subject lines (as found in mail headers)
+//
+
+static const std::vector<std::string> kMIMESubjects {
+    "=?UTF-8?B?UmU6IFF1YXJ0ZXJseSByZXBvcnQgZm9yIHJldmlldw==?=",
+    "=?ISO-8859-1?Q?Caf=E9_meeting_=E0_10h_-_ordre_du_jour?=",
+    "=?UTF-8?Q?Fwd:_Invoice_=E2=84=96_2018-0042_=E2=80=93_overdue?=",
+    "Plain subject with no encoded words at all in it",
+    "=?UTF-8?B?W0V4dGVybmFsXSBZb3VyIG9yZGVyIGhhcyBzaGlwcGVk?= =?UTF-8?B?IChvcmRlciAjNDQxMjMp?=",
+    "Re: =?windows-1252?Q?Team_off=ADsite_=96_venue_options?= for June"
+};
+
+//
+// Body structures (simple, multipart/alternative and mixed with attachments); hand
+// written in the form servers return them
+//
+
+static const std::string kTextBodyStructure {
+    R"(("TEXT" "PLAIN" ("CHARSET" "UTF-8") NIL NIL "7BIT" 1152 23 NIL NIL NIL NIL))"
+};
+
+static const std::string kAlternativeBodyStructure {
+    R"((("TEXT" "PLAIN" ("CHARSET" "UTF-8") NIL NIL "QUOTED-PRINTABLE" 2234 60 NIL NIL NIL NIL))"
+    R"(("TEXT" "HTML" ("CHARSET" "UTF-8") NIL NIL "QUOTED-PRINTABLE" 10234 210 NIL NIL NIL NIL))"
+    R"( "ALTERNATIVE" ("BOUNDARY" "000000000000a1b2c3d4e5") NIL NIL NIL))"
+};
+
+static const std::string kMixedBodyStructure {
+    "(" + kAlternativeBodyStructure +
+    R"(("APPLICATION" "PDF" ("NAME" "report.pdf") NIL NIL "BASE64" 482120 NIL ("ATTACHMENT" ("FILENAME" "report.pdf")) NIL NIL))"
+    R"(("IMAGE" "JPEG" ("NAME" "photo.jpg") "<img001@example.com>" NIL "BASE64" 1203340 NIL ("ATTACHMENT" ("FILENAME" "photo.jpg" "SIZE" "879400")) NIL NIL))"
+    R"(("APPLICATION" "VND.OPENXMLFORMATS-OFFICEDOCUMENT.SPREADSHEETML.SHEET" ("NAME" "figures.xlsx") NIL NIL "BASE64" 96212 NIL ("ATTACHMENT" ("FILENAME" "figures.xlsx")) NIL NIL))"
+    R"( "MIXED" ("BOUNDARY" "000000000000f6a7b8c9d0e1") NIL NIL NIL))"
+};
+
+static const std::vector<std::string> kBodyStructures {
+    kTextBodyStructure, kAlternativeBodyStructure, kMixedBodyStructure
+};
+
+// ===============
+// LOCAL FUNCTIONS
+// ===============
+
+//
+// Exit with error message/status
+//
+
+static void exitWithError(std::string errMsg) {
+
+    // Display error and exit.
+
+    std::cout.flush();
+    std::cerr << errMsg << std::endl;
+    exit(EXIT_FAILURE);
+
+}
+
+//
+// Read in and process command line arguments using boost.
+//
+
+static void procCmdLine(int argc, char** argv, ParamArgData &argData) {
+
+    // Define and parse the program options
+
+    po::options_description commandLine("Program Options");
+    commandLine.add_options()
+            ("help", "Print help messages")
+            ("iterations,i", po::value<int>(&argData.iterations)->default_value(5), "Timed iterations of each benchmark")
+            ("filter,f", po::value<std::string>(&argData.filter), "Only run benchmarks whose name contains this")
+            ("output,o", po::value<std::string>(&argData.outputFileName), "JSON results file (default stdout)")
+            ("work,w", po::value<std::string>(&argData.workDirectory), "Directory under which generated corpora are created")
+            ("scale,s", po::value<int>(&argData.scale)->default_value(1), "Corpus size multiplier")
+            ("list,l", "List benchmark names and exit");
+
+    po::variables_map vm;
+
+    try {
+
+        // Process arguments
+
+        po::store(po::parse_command_line(argc, argv, commandLine), vm);
+
+        // Display options and exit with success
+
+        if (vm.count("help")) {
+            std::cout << "AntikBenchmarks" << std::endl << commandLine << std::endl;
+            exit(EXIT_SUCCESS);
+        }
+
+        // List benchmarks
+
+        if (vm.count("list")) {
+            argData.bList = true;
+        }
+
+        po::notify(vm);
+
+        if (argData.iterations < 1) {
+            throw po::error("Iterations must be at least 1.");
+        }
+
+        if (argData.scale < 1) {
+            throw po::error("Scale must be at least 1.");
+        }
+
+        // Corpora go in their own sub-directory as it is removed afterwards
+
+        if (argData.workDirectory.empty()) {
+            argData.workDirectory = std::filesystem::temp_directory_path().string();
+        }
+        argData.workDirectory = (std::filesystem::path(argData.workDirectory) / "antik-benchmarks").string();
+
+    } catch (po::error& e) {
+        std::cerr << "AntikBenchmarks Error: " << e.what() << std::endl << std::endl;
+        std::cerr << commandLine << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+}
+
+//
+// Generate compressible text (words from a small vocabulary in lines).
+//
+
+static std::string generateText(std::mt19937 &generator, std::size_t length) {
+
+    static const std::vector<std::string> kWords {
+        "the", "archive", "of", "mail", "server", "backup", "file", "and", "restore", "folder",
+        "message", "attachment", "to", "from", "subject", "transfer", "directory", "data", "in", "report"
+    };
+
+    std::uniform_int_distribution<std::size_t> wordDistribution(0, kWords.size() - 1);
+    std::string text;
+    int wordsOnLine { 0 };
+
+    text.reserve(length + 16);
+    while (text.size() < length) {
+        text += kWords[wordDistribution(generator)];
+        text += (++wordsOnLine % 12) ? ' ' : '\n';
+    }
+    text.resize(length);
+
+    return (text);
+
+}
+
+//
+// Generate incompressible data.
+//
+
+static std::string generateBinary(std::mt19937 &generator, std::size_t length) {
+
+    std::uniform_int_distribution<int> byteDistribution(0, 255);
+    std::string data(length, '\0');
+
+    for (auto &byte : data) {
+        byte = static_cast<char> (byteDistribution(generator));
+    }
+
+    return (data);
+
+}
+
+//
+// Write a generated file.
+//
+
+static void writeFile(const std::string &fileName, const std::string &contents) {
+
+    std::ofstream fileStream(fileName, std::ios::binary | std::ios::trunc);
+    fileStream.write(contents.data(), contents.size());
+    if (!fileStream) {
+        throw std::runtime_error("Could not write [" + fileName + "]");
+    }
+
+}
+
+//
+// Generate ZIP corpus (text and binary files) returning the file names.
+//
+
+static std::vector<std::string> generateZIPCorpus(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::filesystem::path corpusDirectory { std::filesystem::path(argData.workDirectory) / "zip-corpus" };
+    std::vector<std::string> fileNames;
+
+    std::filesystem::remove_all(corpusDirectory);
+    std::filesystem::create_directories(corpusDirectory);
+
+    for (int fileNo = 0; fileNo < kZIPTextFiles * argData.scale; fileNo++) {
+        fileNames.push_back((corpusDirectory / ("text" + std::to_string(fileNo) + ".txt")).string());
+        writeFile(fileNames.back(), generateText(generator, kZIPTextFileSize));
+    }
+    for (int fileNo = 0; fileNo < kZIPBinaryFiles * argData.scale; fileNo++) {
+        fileNames.push_back((corpusDirectory / ("binary" + std::to_string(fileNo) + ".bin")).string());
+        writeFile(fileNames.back(), generateBinary(generator, kZIPBinaryFileSize));
+    }
+
+    return (fileNames);
+
+}
+
+//
+// Total size of files.
+//
+
+static std::uint64_t totalFileSize(const std::vector<std::string> &fileNames) {
+    std::uint64_t totalSize { 0 };
+    for (auto &fileName : fileNames) {
+        totalSize += std::filesystem::file_size(fileName);
+    }
+    return (totalSize);
+}
+
+//
+// Create a ZIP archive of files with CZIP (entries named after the files).
+//
+
+static void createZIPArchive(const std::string &zipFileName, const std::vector<std::string> &fileNames) {
+
+    std::filesystem::remove(zipFileName);
+
+    CZIP zipFile(zipFileName);
+    zipFile.create();
+    zipFile.open();
+    for (auto &fileName : fileNames) {
+        zipFile.add(fileName, std::filesystem::path(fileName).filename().string());
+    }
+    zipFile.close();
+
+}
+
+//
+// CZIP::add of the ZIP corpus to a new archive.
+//
+
+static BenchmarkRunFn setupZIPAdd(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::vector<std::string> fileNames { generateZIPCorpus(argData, generator) };
+    std::string zipFileName { (std::filesystem::path(argData.workDirectory) / "add.zip").string() };
+    BenchmarkWork work { fileNames.size(), totalFileSize(fileNames) };
+
+    return [fileNames, zipFileName, work]() {
+        createZIPArchive(zipFileName, fileNames);
+        return (work);
+    };
+
+}
+
+//
+// CZIP::extract of every entry of an archive of the ZIP corpus.
+//
+
+static BenchmarkRunFn setupZIPExtract(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::vector<std::string> fileNames { generateZIPCorpus(argData, generator) };
+    std::string zipFileName { (std::filesystem::path(argData.workDirectory) / "extract.zip").string() };
+    std::string destinationDirectory { (std::filesystem::path(argData.workDirectory) / "extracted").string() };
+    BenchmarkWork work { fileNames.size(), totalFileSize(fileNames) };
+
+    createZIPArchive(zipFileName, fileNames);
+    std::filesystem::create_directories(destinationDirectory);
+
+    return [zipFileName, destinationDirectory, work]() {
+        CZIP zipFile(zipFileName);
+        zipFile.open();
+        for (auto &file : zipFile.contents()) {
+            if (!zipFile.extract(file.fileName, (std::filesystem::path(destinationDirectory) / file.fileName).string())) {
+                throw std::runtime_error("Could not extract [" + file.fileName + "]");
+            }
+        }
+        zipFile.close();
+        return (work);
+    };
+
+}
+
+//
+// Generate an archive with a large central directory (small stored entries with
+// directory style names) returning the number of entries.
+//
+
+static std::uint64_t generateLargeCentralDirectory(const ParamArgData &argData, const std::string &zipFileName) {
+
+    int zipFileDescriptor = ::open(zipFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (zipFileDescriptor == -1) {
+        throw std::runtime_error("Could not create [" + zipFileName + "]");
+    }
+
+    try {
+        ZIPArchiveWriter zipWriter(ZIPArchiveWriter::fileDescriptorSink(zipFileDescriptor));
+        for (int entryNo = 0; entryNo < kCentralDirectoryEntries * argData.scale; entryNo++) {
+            ZIPCompressedEntry entry;
+            std::string contents { "entry " + std::to_string(entryNo) + "\n" };
+            entry.entryName = "project/module" + std::to_string(entryNo / 100) + "/source" + std::to_string(entryNo) + ".txt";
+            entry.compression = ZIPArchiveWriter::kStored;
+            entry.uncompressedSize = contents.size();
+            entry.crc32 = ::crc32(0, reinterpret_cast<const Bytef *> (contents.data()), contents.size());
+            entry.externalFileAttrib = 0100644 << 16;
+            entry.data.assign(contents.begin(), contents.end());
+            zipWriter.add(entry);
+        }
+        zipWriter.close();
+    } catch (...) {
+        ::close(zipFileDescriptor);
+        throw;
+    }
+    ::close(zipFileDescriptor);
+
+    return (static_cast<std::uint64_t> (kCentralDirectoryEntries) * argData.scale);
+
+}
+
+//
+// CZIPIO::getZIPRecord over every entry of a large central directory.
+//
+
+static BenchmarkRunFn setupZIPIOCentralDirectory(const ParamArgData &argData, std::mt19937 &) {
+
+    std::string zipFileName { (std::filesystem::path(argData.workDirectory) / "central-directory.zip").string() };
+    generateLargeCentralDirectory(argData, zipFileName);
+
+    std::uint64_t centralDirectoryOffset { 0 };
+    BenchmarkWork work;
+    {
+        ZIPArchiveReader zipReader(zipFileName);
+        centralDirectoryOffset = zipReader.endOfCentralDirectory().offsetCentralDirRecords;
+        work.items = zipReader.endOfCentralDirectory().totalCentralDirRecords;
+        work.bytes = zipReader.endOfCentralDirectory().sizeOfCentralDirRecords;
+    }
+
+    return [zipFileName, centralDirectoryOffset, work]() {
+        CZIPIO zipIO;
+        CZIPIO::CentralDirectoryFileHeader directoryFileHeader;
+        zipIO.openZIPFile(zipFileName, std::ios::binary | std::ios::in);
+        zipIO.positionInZIPFile(centralDirectoryOffset);
+        for (std::uint64_t entryNo = 0; entryNo < work.items; entryNo++) {
+            zipIO.getZIPRecord(directoryFileHeader);
+        }
+        zipIO.closeZIPFile();
+        return (work);
+    };
+
+}
+
+//
+// ZIPArchiveReader walk of the same central directory (for comparison).
+//
+
+static BenchmarkRunFn setupZIPReaderCentralDirectory(const ParamArgData &argData, std::mt19937 &) {
+
+    std::string zipFileName { (std::filesystem::path(argData.workDirectory) / "central-directory.zip").string() };
+    generateLargeCentralDirectory(argData, zipFileName);
+
+    return [zipFileName]() {
+        ZIPArchiveReader zipReader(zipFileName);
+        BenchmarkWork work { 0, zipReader.endOfCentralDirectory().sizeOfCentralDirRecords };
+        zipReader.forEachEntry([&work](const ZIPDirectoryEntryView &) {
+            work.items++;
+            return (true);
+        });
+        return (work);
+    };
+
+}
+
+//
+// Base64 encoded data in 76 character CRLF terminated lines.
+//
+
+static std::string encodeBase64Lines(const std::string &data) {
+    Base64Encoder encoder;
+    std::string encoded;
+    encoder.encode(data.data(), data.size(), encoded);
+    encoder.finish(encoded);
+    return (encoded);
+}
+
+//
+// CSMTP::encodeToBase64 of a block of data.
+//
+
+static BenchmarkRunFn setupSMTPEncode(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::string data { generateBinary(generator, kBase64DataSize * argData.scale) };
+
+    return [data]() {
+        std::string encoded;
+        CSMTP::encodeToBase64(data, encoded, data.size());
+        return (BenchmarkWork { 1, data.size() });
+    };
+
+}
+
+//
+// CSMTP::decodeFromBase64 a line at a time (as the mail examples used it).
+//
+
+static BenchmarkRunFn setupSMTPDecode(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::string encoded { encodeBase64Lines(generateBinary(generator, kBase64DataSize * argData.scale)) };
+    std::vector<std::string> encodedLines;
+    std::istringstream encodedStream(encoded);
+
+    for (std::string line; std::getline(encodedStream, line, '\n');) {
+        line.pop_back(); // Remove '\r'
+        encodedLines.push_back(line);
+    }
+
+    return [encodedLines, encodedSize = encoded.size()]() {
+        std::string decoded;
+        for (auto &line : encodedLines) {
+            CSMTP::decodeFromBase64(line, decoded, line.length());
+        }
+        return (BenchmarkWork { encodedLines.size(), encodedSize });
+    };
+
+}
+
+//
+// Base64Encoder of the same data in blocks (for comparison).
+//
+
+static BenchmarkRunFn setupCodecEncode(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::string data { generateBinary(generator, kBase64DataSize * argData.scale) };
+
+    return [data]() {
+        Base64Encoder encoder;
+        std::string encoded;
+        for (std::size_t offset = 0; offset < data.size(); offset += kBase64BlockSize) {
+            encoder.encode(data.data() + offset, std::min(kBase64BlockSize, data.size() - offset), encoded);
+        }
+        encoder.finish(encoded);
+        return (BenchmarkWork { 1, data.size() });
+    };
+
+}
+
+//
+// Base64Decoder of the same encoded lines in blocks (for comparison).
+//
+
+static BenchmarkRunFn setupCodecDecode(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::string encoded { encodeBase64Lines(generateBinary(generator, kBase64DataSize * argData.scale)) };
+
+    return [encoded]() {
+        Base64Decoder decoder;
+        std::string decoded;
+        for (std::size_t offset = 0; offset < encoded.size(); offset += kBase64BlockSize) {
+            decoder.decode(encoded.data() + offset, std::min(kBase64BlockSize, encoded.size() - offset), decoded);
+        }
+        decoder.finish(decoded);
+        return (BenchmarkWork { 1, encoded.size() });
+    };
+
+}
+
+//
+// CMIME::convertMIMEStringToASCII over encoded subject lines.
+//
+
+static BenchmarkRunFn setupMIMEConvert(const ParamArgData &argData, std::mt19937 &) {
+
+    int repeat { kMIMESubjectRepeat * argData.scale };
+
+    return [repeat]() {
+        BenchmarkWork work;
+        for (int pass = 0; pass < repeat; pass++) {
+            for (auto &subject : kMIMESubjects) {
+                work.bytes += subject.size();
+                work.items += !CMIME::convertMIMEStringToASCII(subject).empty();
+            }
+        }
+        return (work);
+    };
+
+}
+
+//
+// Generate a synthetic FETCH (UID FLAGS RFC822.SIZE BODYSTRUCTURE) response.
+//
+
+static std::string generateFetchResponse(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::uniform_int_distribution<int> sizeDistribution(1024, 4 * 1024 * 1024);
+    int messages { kFetchMessages * argData.scale };
+    std::string response { "A000001 FETCH 1:" + std::to_string(messages) + " (UID FLAGS RFC822.SIZE BODYSTRUCTURE)\r\n" };
+
+    for (int index = 1; index <= messages; index++) {
+        response += "* " + std::to_string(index) + " FETCH (UID " + std::to_string(index + 1000) +
+                " FLAGS (" + ((index % 3) ? "\\Seen" : "\\Seen \\Flagged") + ") RFC822.SIZE " +
+                std::to_string(sizeDistribution(generator)) + " BODYSTRUCTURE " +
+                kBodyStructures[index % kBodyStructures.size()] + ")\r\n";
+    }
+    response += "A000001 OK Success\r\n";
+
+    return (response);
+
+}
+
+//
+// Generate a synthetic FETCH BODY[] response (message bodies as literals).
+//
+
+static std::string generateFetchBodyResponse(const ParamArgData &argData, std::mt19937 &generator) {
+
+    int messages { kFetchBodyMessages * argData.scale };
+    std::string response { "A000002 FETCH 1:" + std::to_string(messages) + " BODY[]\r\n" };
+
+    for (int index = 1; index <= messages; index++) {
+        std::string body { "Subject: Message " + std::to_string(index) + "\r\n\r\n" };
+        std::istringstream textStream(generateText(generator, kFetchBodySize));
+        for (std::string line; std::getline(textStream, line, '\n');) {
+            body += line + "\r\n";
+        }
+        response += "* " + std::to_string(index) + " FETCH (BODY[] {" + std::to_string(body.size()) + "}\r\n" + body + ")\r\n";
+    }
+    response += "A000002 OK Success\r\n";
+
+    return (response);
+
+}
+
+//
+// Generate a SEARCH response.
+//
+
+static std::string generateSearchResponse(const ParamArgData &argData, std::mt19937 &generator) {
+
+    std::uniform_int_distribution<int> gapDistribution(1, 4);
+    std::string response { "A000003 SEARCH ALL\r\n* SEARCH" };
+    int index { 0 };
+
+    for (int result = 0; result < kSearchResults * argData.scale; result++) {
+        index += gapDistribution(generator);
+        response += " " + std::to_string(index);
+    }
+    response += "\r\nA000003 OK SEARCH completed\r\n";
+
+    return (response);
+
+}
+
+//
+// Generate a LIST response.
+//
+
+static std::string generateListResponse(const ParamArgData &argData, std::mt19937 &) {
+
+    std::string response { "A000004 LIST \"\" *\r\n" };
+
+    for (int mailBox = 0; mailBox < kListMailBoxes * argData.scale; mailBox++) {
+        response += std::string("* LIST (") + ((mailBox % 10) ? "\\HasNoChildren" : "\\HasChildren") +
+                ") \"/\" \"Archive/" + std::to_string(2000 + mailBox / 12) + "/Month " + std::to_string(mailBox % 12 + 1) + "\"\r\n";
+    }
+    response += "A000004 OK Success\r\n";
+
+    return (response);
+
+}
+
+//
+// CIMAPParse::parseResponse of a generated response.
+//
+
+static BenchmarkRunFn parseResponseRun(const std::string &response) {
+
+    return [response]() {
+        CIMAPParse::COMMANDRESPONSE parsedResponse { CIMAPParse::parseResponse(response) };
+        if (parsedResponse->status != CIMAPParse::RespCode::OK) {
+            throw std::runtime_error("Generated response did not parse OK: " + parsedResponse->errorMessage);
+        }
+        return (BenchmarkWork { parsedResponse->fetchList.size() + parsedResponse->indexes.size() +
+                                parsedResponse->mailBoxList.size(), response.size() });
+    };
+
+}
+
+//
+// CIMAPBodyStruct::consructBodyStructTree (and attachment walk) of body structures.
+//
+
+static BenchmarkRunFn setupBodyStructTree(const ParamArgData &argData, std::mt19937 &) {
+
+    int repeat { kBodyStructRepeat * argData.scale };
+
+    return [repeat]() {
+        BenchmarkWork work;
+        for (int pass = 0; pass < repeat; pass++) {
+            for (auto &bodyStructure : kBodyStructures) {
+                std::unique_ptr<CIMAPBodyStruct::BodyNode> treeBase { new CIMAPBodyStruct::BodyNode() };
+                std::shared_ptr<void> attachmentData { new CIMAPBodyStruct::AttachmentData() };
+                CIMAPBodyStruct::consructBodyStructTree(treeBase, bodyStructure);
+                CIMAPBodyStruct::walkBodyStructTree(treeBase, CIMAPBodyStruct::attachmentFn, attachmentData);
+                work.items++;
+                work.bytes += bodyStructure.size();
+            }
+        }
+        return (work);
+    };
+
+}
+
+//
+// All benchmarks in the order they are run.
+//
+
+static std::vector<Benchmark> benchmarkList() {
+
+    return {
+        { "zip_add", setupZIPAdd },
+        { "zip_extract", setupZIPExtract },
+        { "zipio_central_directory", setupZIPIOCentralDirectory },
+        { "zipreader_central_directory", setupZIPReaderCentralDirectory },
+        { "smtp_base64_encode", setupSMTPEncode },
+        { "smtp_base64_decode", setupSMTPDecode },
+        { "codec_base64_encode", setupCodecEncode },
+        { "codec_base64_decode", setupCodecDecode },
+        { "mime_convert_to_ascii", setupMIMEConvert },
+        { "imap_parse_fetch", [](const ParamArgData &argData, std::mt19937 & generator) {
+                return (parseResponseRun(generateFetchResponse(argData, generator)));
+            } },
+        { "imap_parse_fetch_body", [](const ParamArgData &argData, std::mt19937 & generator) {
+                return (parseResponseRun(generateFetchBodyResponse(argData, generator)));
+            } },
+        { "imap_parse_search", [](const ParamArgData &argData, std::mt19937 & generator) {
+                return (parseResponseRun(generateSearchResponse(argData, generator)));
+            } },
+        { "imap_parse_list", [](const ParamArgData &argData, std::mt19937 & generator) {
+                return (parseResponseRun(generateListResponse(argData, generator)));
+            } },
+        { "imap_bodystruct_tree", setupBodyStructTree }
+    };
+
+}
+
+//
+// Setup and time a benchmark. Each has its own generator so its input does not
+// depend on which other benchmarks were run.
+//
+
+static BenchmarkResult runBenchmark(const Benchmark &benchmark, const ParamArgData &argData) {
+
+    std::mt19937 generator { kCorpusSeed };
+    BenchmarkRunFn runFn { benchmark.setupFn(argData, generator) };
+    BenchmarkResult result { benchmark.name, runFn(), {} };
+
+    for (int iteration = 0; iteration < argData.iterations; iteration++) {
+        auto start = std::chrono::steady_clock::now();
+        result.work = runFn();
+        result.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return (result);
+
+}
+
+//
+// Write results as JSON. Rates are taken from the median time.
+//
+
+static void writeResults(std::ostream &resultsStream, const ParamArgData &argData, const std::vector<BenchmarkResult> &results) {
+
+    resultsStream << "{\n  \"suite\": \"AntikBenchmarks\",\n  \"seed\": " << kCorpusSeed <<
+            ",\n  \"iterations\": " << argData.iterations << ",\n  \"scale\": " << argData.scale <<
+            ",\n  \"benchmarks\": [";
+
+    for (std::size_t resultNo = 0; resultNo < results.size(); resultNo++) {
+
+        std::vector<double> seconds { results[resultNo].seconds };
+        std::sort(seconds.begin(), seconds.end());
+
+        double median { (seconds.size() % 2) ? seconds[seconds.size() / 2] :
+                        (seconds[seconds.size() / 2 - 1] + seconds[seconds.size() / 2]) / 2 };
+        double mean { std::accumulate(seconds.begin(), seconds.end(), 0.0) / seconds.size() };
+        double variance { 0.0 };
+        for (auto time : seconds) {
+            variance += (time - mean) * (time - mean);
+        }
+        double standardDeviation { std::sqrt(variance / seconds.size()) };
+
+        resultsStream << ((resultNo) ? ",\n" : "\n") <<
+                "    {\n      \"name\": \"" << results[resultNo].name << "\",\n" <<
+                "      \"items\": " << results[resultNo].work.items << ",\n" <<
+                "      \"bytes\": " << results[resultNo].work.bytes << ",\n" <<
+                "      \"minSeconds\": " << seconds.front() << ",\n" <<
+                "      \"medianSeconds\": " << median << ",\n" <<
+                "      \"meanSeconds\": " << mean << ",\n" <<
+                "      \"maxSeconds\": " << seconds.back() << ",\n" <<
+                "      \"stddevSeconds\": " << standardDeviation << ",\n" <<
+                "      \"itemsPerSecond\": " << ((median > 0) ? results[resultNo].work.items / median : 0) << ",\n" <<
+                "      \"bytesPerSecond\": " << ((median > 0) ? results[resultNo].work.bytes / median : 0) << "\n    }";
+
+    }
+
+    resultsStream << "\n  ]\n}" << std::endl;
+
+}
+
+// ============================
+// ===== MAIN ENTRY POINT =====
+// ============================
+
+int main(int argc, char** argv) {
+
+    try {
+
+        ParamArgData argData;
+        std::vector<BenchmarkResult> results;
+
+        // Read in command line parameters and process
+
+        procCmdLine(argc, argv, argData);
+
+        // List benchmarks
+
+        if (argData.bList) {
+            for (auto &benchmark : benchmarkList()) {
+                std::cout << benchmark.name << std::endl;
+            }
+            exit(EXIT_SUCCESS);
+        }
+
+        // Run benchmarks (generated corpora are removed afterwards)
+
+        std::filesystem::create_directories(argData.workDirectory);
+
+        for (auto &benchmark : benchmarkList()) {
+            if (benchmark.name.find(argData.filter) == std::string::npos) {
+                continue;
+            }
+            std::cerr << "Running [" << benchmark.name << "]" << std::flush;
+            results.push_back(runBenchmark(benchmark, argData));
+            std::cerr << " min " << *std::min_element(results.back().seconds.begin(),
+                                                      results.back().seconds.end()) << "s" << std::endl;
+        }
+
+        std::filesystem::remove_all(argData.workDirectory);
+
+        // Write results
+
+        if (!argData.outputFileName.empty()) {
+            std::ofstream resultsStream(argData.outputFileName, std::ios::trunc);
+            writeResults(resultsStream, argData, results);
+            if (!resultsStream) {
+                throw std::runtime_error("Could not write results to [" + argData.outputFileName + "]");
+            }
+        } else {
+            writeResults(std::cout, argData, results);
+        }
+
+    //
+    // Catch any errors
+    //
+
+    } catch (const std::exception &e) {
+        exitWithError(e.what());
+    }
+
+    exit(EXIT_SUCCESS);
+
+}